@@ -0,0 +1,461 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "checksum_cache.h"
+#include "error.h"
+
+#define ERR_DOMAIN                  CREATEREPO_C_ERROR
+#define CACHE_BUSY_TIMEOUT          60000       // ms to wait for other runs
+#define CACHE_FLUSH_THRESHOLD       1024        // pending entries per commit
+#define CACHE_TOUCH_INTERVAL        (24*60*60)  // min age of last_used
+                                                // which is worth an update
+
+typedef struct {
+    gint64 dev;
+    gint64 ino;
+    gint64 size;
+    gint64 mtime;
+    const char *checksum_type;
+    char *hdrid;
+    char *checksum;         // NULL - only refresh last_used of the entry
+} CacheEntry;
+
+struct _cr_ChecksumCache {
+    sqlite3 *db;            // Connection used by lookups
+    sqlite3 *wdb;           // Connection used by the batch writes, waiting
+                            // for other runs on it doesn't block lookups
+    sqlite3_stmt *lookup_handle;
+    sqlite3_stmt *insert_handle;
+    sqlite3_stmt *touch_handle;
+    GPtrArray *pending;     // CacheEntries waiting for the write
+    gint64 max_entries;     // Limit of entries (0 - unlimited)
+    gint64 now;             // Time of the cache opening
+    GMutex mutex;           // Guards the db and the pending
+    GMutex flush_mutex;     // Guards the wdb
+};
+
+static void
+cache_entry_free(CacheEntry *entry)
+{
+    if (!entry)
+        return;
+    g_free(entry->hdrid);
+    g_free(entry->checksum);
+    g_free(entry);
+}
+
+static CacheEntry *
+cache_entry_new(const struct stat *st, cr_ChecksumType type)
+{
+    CacheEntry *entry = g_new0(CacheEntry, 1);
+    entry->dev = (gint64) st->st_dev;
+    entry->ino = (gint64) st->st_ino;
+    entry->size = (gint64) st->st_size;
+    entry->mtime = (gint64) st->st_mtime;
+    entry->checksum_type = cr_checksum_name_str(type);
+    return entry;
+}
+
+static void
+bind_key(sqlite3_stmt *stmt, const CacheEntry *entry)
+{
+    sqlite3_bind_int64(stmt, 1, entry->dev);
+    sqlite3_bind_int64(stmt, 2, entry->ino);
+    sqlite3_bind_int64(stmt, 3, entry->size);
+    sqlite3_bind_int64(stmt, 4, entry->mtime);
+    sqlite3_bind_text(stmt, 5, entry->checksum_type, -1, SQLITE_STATIC);
+}
+
+static gboolean
+cache_exec(sqlite3 *db, const char *sql, GError **err)
+{
+    char *msg = NULL;
+
+    if (sqlite3_exec(db, sql, NULL, NULL, &msg) != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Checksum cache: %s: %s", sql, msg);
+        sqlite3_free(msg);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/** Write the batch of entries in a single transaction.
+ * Must be called with the cache->flush_mutex locked (and without
+ * the cache->mutex, the BEGIN may wait for other runs).
+ */
+static gboolean
+cache_flush(cr_ChecksumCache *cache, GPtrArray *batch, GError **err)
+{
+    if (batch->len == 0)
+        return TRUE;
+
+    // IMMEDIATE - wait (busy timeout) for other runs here, not in the middle
+    if (!cache_exec(cache->wdb, "BEGIN IMMEDIATE TRANSACTION", err))
+        goto exit;
+
+    for (guint x = 0; x < batch->len; x++) {
+        CacheEntry *entry = g_ptr_array_index(batch, x);
+        sqlite3_stmt *stmt;
+
+        if (entry->checksum) {
+            stmt = cache->insert_handle;
+            bind_key(stmt, entry);
+            sqlite3_bind_text(stmt, 6, entry->hdrid, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 7, entry->checksum, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 8, cache->now);
+        } else {
+            stmt = cache->touch_handle;
+            bind_key(stmt, entry);
+            sqlite3_bind_int64(stmt, 6, cache->now);
+        }
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            g_set_error(err, ERR_DOMAIN, CRE_DB,
+                        "Checksum cache: Cannot write an entry: %s",
+                        sqlite3_errmsg(cache->wdb));
+            sqlite3_exec(cache->wdb, "ROLLBACK", NULL, NULL, NULL);
+            goto exit;
+        }
+    }
+
+    if (!cache_exec(cache->wdb, "COMMIT", err)) {
+        sqlite3_exec(cache->wdb, "ROLLBACK", NULL, NULL, NULL);
+        goto exit;
+    }
+
+exit:
+    // The cache is only an optimization, entries which cannot be
+    // written are just dropped
+    g_ptr_array_set_size(batch, 0);
+    return !(err && *err);
+}
+
+/** Take the pending entries if there are enough of them for a batch.
+ * Must be called with the cache->mutex locked.
+ * @return          batch for the cache_flush() or NULL
+ */
+static GPtrArray *
+cache_take_batch(cr_ChecksumCache *cache)
+{
+    GPtrArray *batch;
+
+    if (cache->pending->len < CACHE_FLUSH_THRESHOLD)
+        return NULL;
+
+    batch = cache->pending;
+    cache->pending = g_ptr_array_new_with_free_func(
+                                    (GDestroyNotify) cache_entry_free);
+    return batch;
+}
+
+/** Write the batch taken by the cache_take_batch() (if any) and free it.
+ * Must be called without the cache->mutex locked.
+ */
+static void
+cache_write_batch(cr_ChecksumCache *cache, GPtrArray *batch)
+{
+    GError *tmp_err = NULL;
+
+    if (!batch)
+        return;
+
+    g_mutex_lock(&cache->flush_mutex);
+    if (!cache_flush(cache, batch, &tmp_err)) {
+        g_warning("%s", tmp_err->message);
+        g_error_free(tmp_err);
+    }
+    g_mutex_unlock(&cache->flush_mutex);
+
+    g_ptr_array_free(batch, TRUE);
+}
+
+/** Delete the least recently used entries over the limit
+ * and give the freed pages back to the filesystem.
+ */
+static gboolean
+cache_evict(cr_ChecksumCache *cache, GError **err)
+{
+    sqlite3_stmt *stmt = NULL;
+    gint64 count = 0;
+    int rc;
+
+    if (cache->max_entries <= 0)
+        return TRUE;
+
+    rc = sqlite3_prepare_v2(cache->wdb, "SELECT COUNT(*) FROM checksums",
+                            -1, &stmt, NULL);
+    if (rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+
+    if (count <= cache->max_entries)
+        return TRUE;
+
+    g_debug("Checksum cache: Evicting %"G_GINT64_FORMAT" entries",
+            count - cache->max_entries);
+
+    rc = sqlite3_prepare_v2(cache->wdb,
+            "DELETE FROM checksums WHERE (dev, ino, size, mtime, checksum_type) "
+            "IN (SELECT dev, ino, size, mtime, checksum_type FROM checksums "
+            "ORDER BY last_used LIMIT ?)", -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, count - cache->max_entries);
+        rc = sqlite3_step(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    if (rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Checksum cache: Cannot evict old entries: %s",
+                    sqlite3_errmsg(cache->wdb));
+        return FALSE;
+    }
+
+    // Compaction - the database is in the incremental auto_vacuum mode
+    return cache_exec(cache->wdb, "PRAGMA incremental_vacuum", err);
+}
+
+cr_ChecksumCache *
+cr_checksum_cache_open(const char *path, gint64 max_entries, GError **err)
+{
+    cr_ChecksumCache *cache;
+    int rc;
+
+    assert(path);
+    assert(!err || *err == NULL);
+
+    cache = g_new0(cr_ChecksumCache, 1);
+    cache->pending = g_ptr_array_new_with_free_func(
+                                    (GDestroyNotify) cache_entry_free);
+    cache->max_entries = max_entries;
+    cache->now = (gint64) time(NULL);
+    g_mutex_init(&cache->mutex);
+    g_mutex_init(&cache->flush_mutex);
+
+    rc = sqlite3_open_v2(path, &cache->wdb,
+                         SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot open checksum cache %s: %s",
+                    path, sqlite3_errmsg(cache->wdb));
+        goto error;
+    }
+
+    sqlite3_busy_timeout(cache->wdb, CACHE_BUSY_TIMEOUT);
+
+    // auto_vacuum has to be set before the table is created.
+    // WAL lets concurrent runs read while one of them writes, if it's not
+    // available (e.g. network filesystem) the default journal is used.
+    if (!cache_exec(cache->wdb, "PRAGMA auto_vacuum = INCREMENTAL", err))
+        goto error;
+    sqlite3_exec(cache->wdb, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
+    sqlite3_exec(cache->wdb, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+
+    if (!cache_exec(cache->wdb,
+            "CREATE TABLE IF NOT EXISTS checksums ("
+            "  dev INTEGER NOT NULL,"
+            "  ino INTEGER NOT NULL,"
+            "  size INTEGER NOT NULL,"
+            "  mtime INTEGER NOT NULL,"
+            "  checksum_type TEXT NOT NULL,"
+            "  hdrid TEXT,"
+            "  checksum TEXT NOT NULL,"
+            "  last_used INTEGER NOT NULL,"
+            "  PRIMARY KEY (dev, ino, size, mtime, checksum_type)"
+            ") WITHOUT ROWID", err))
+        goto error;
+
+    if (!cache_exec(cache->wdb,
+            "CREATE INDEX IF NOT EXISTS checksums_last_used "
+            "ON checksums (last_used)", err))
+        goto error;
+
+    // The read-only connection for lookups
+    rc = sqlite3_open_v2(path, &cache->db, SQLITE_OPEN_READONLY, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot open checksum cache %s: %s",
+                    path, sqlite3_errmsg(cache->db));
+        goto error;
+    }
+
+    sqlite3_busy_timeout(cache->db, CACHE_BUSY_TIMEOUT);
+
+    rc = sqlite3_prepare_v2(cache->db,
+            "SELECT checksum, hdrid, last_used FROM checksums WHERE "
+            "dev = ? AND ino = ? AND size = ? AND mtime = ? "
+            "AND checksum_type = ?", -1, &cache->lookup_handle, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(cache->wdb,
+            "INSERT OR REPLACE INTO checksums (dev, ino, size, mtime, "
+            "checksum_type, hdrid, checksum, last_used) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?)", -1, &cache->insert_handle, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(cache->wdb,
+            "UPDATE checksums SET last_used = ?6 WHERE "
+            "dev = ?1 AND ino = ?2 AND size = ?3 AND mtime = ?4 "
+            "AND checksum_type = ?5", -1, &cache->touch_handle, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Checksum cache: Cannot prepare statement: %s",
+                    sqlite3_errmsg(cache->lookup_handle ? cache->wdb
+                                                        : cache->db));
+        goto error;
+    }
+
+    return cache;
+
+error:
+    sqlite3_finalize(cache->lookup_handle);
+    sqlite3_finalize(cache->insert_handle);
+    sqlite3_finalize(cache->touch_handle);
+    sqlite3_close(cache->db);
+    sqlite3_close(cache->wdb);
+    g_ptr_array_free(cache->pending, TRUE);
+    g_mutex_clear(&cache->mutex);
+    g_mutex_clear(&cache->flush_mutex);
+    g_free(cache);
+    return NULL;
+}
+
+char *
+cr_checksum_cache_lookup(cr_ChecksumCache *cache,
+                         const struct stat *st,
+                         cr_ChecksumType type,
+                         const char *hdrid,
+                         GError **err)
+{
+    CacheEntry *key;
+    GPtrArray *batch;
+    char *checksum = NULL;
+    int rc;
+
+    assert(cache);
+    assert(st);
+    assert(!err || *err == NULL);
+
+    key = cache_entry_new(st, type);
+
+    g_mutex_lock(&cache->mutex);
+
+    bind_key(cache->lookup_handle, key);
+    rc = sqlite3_step(cache->lookup_handle);
+    if (rc == SQLITE_ROW) {
+        const char *db_checksum, *db_hdrid;
+        gint64 last_used;
+
+        db_checksum = (const char *) sqlite3_column_text(cache->lookup_handle, 0);
+        db_hdrid = (const char *) sqlite3_column_text(cache->lookup_handle, 1);
+        last_used = sqlite3_column_int64(cache->lookup_handle, 2);
+
+        if (hdrid && db_hdrid && strcmp(hdrid, db_hdrid)) {
+            // The same file metadata but a different package
+            g_debug("Checksum cache: hdrid mismatch (%s != %s)",
+                    hdrid, db_hdrid);
+        } else {
+            checksum = g_strdup(db_checksum);
+            if (cache->now - last_used >= CACHE_TOUCH_INTERVAL) {
+                // Refresh the entry for the LRU eviction
+                g_ptr_array_add(cache->pending, key);
+                key = NULL;
+            }
+        }
+    } else if (rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Checksum cache: Cannot look up an entry: %s",
+                    sqlite3_errmsg(cache->db));
+    }
+    sqlite3_reset(cache->lookup_handle);
+
+    batch = cache_take_batch(cache);
+
+    g_mutex_unlock(&cache->mutex);
+
+    cache_write_batch(cache, batch);
+    cache_entry_free(key);
+    return checksum;
+}
+
+void
+cr_checksum_cache_store(cr_ChecksumCache *cache,
+                        const struct stat *st,
+                        cr_ChecksumType type,
+                        const char *hdrid,
+                        const char *checksum)
+{
+    CacheEntry *entry;
+    GPtrArray *batch;
+
+    assert(cache);
+    assert(st);
+    assert(checksum);
+
+    entry = cache_entry_new(st, type);
+    entry->hdrid = g_strdup(hdrid);
+    entry->checksum = g_strdup(checksum);
+
+    g_mutex_lock(&cache->mutex);
+    g_ptr_array_add(cache->pending, entry);
+    batch = cache_take_batch(cache);
+    g_mutex_unlock(&cache->mutex);
+
+    cache_write_batch(cache, batch);
+}
+
+gboolean
+cr_checksum_cache_close(cr_ChecksumCache *cache, GError **err)
+{
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    if (!cache)
+        return TRUE;
+
+    // No other thread may use the cache now
+    if (cache_flush(cache, cache->pending, &tmp_err))
+        cache_evict(cache, &tmp_err);
+
+    sqlite3_finalize(cache->lookup_handle);
+    sqlite3_finalize(cache->insert_handle);
+    sqlite3_finalize(cache->touch_handle);
+    sqlite3_close(cache->db);
+    sqlite3_close(cache->wdb);
+    g_ptr_array_free(cache->pending, TRUE);
+    g_mutex_clear(&cache->mutex);
+    g_mutex_clear(&cache->flush_mutex);
+    g_free(cache);
+
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,113 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_CHECKSUM_CACHE_H__
+#define __C_CREATEREPOLIB_CHECKSUM_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include <sys/stat.h>
+#include "checksum.h"
+
+/** \defgroup   checksum_cache  Persistent cache of package checksums
+ *                              (used by the createrepo_c --cachedir)
+ *  \addtogroup checksum_cache
+ *  @{
+ */
+
+/** Name of the cache database file inside of the cache directory */
+#define CR_CHECKSUM_CACHE_FILENAME      "checksums.sqlite"
+
+/** Default max number of entries kept in the cache */
+#define CR_CHECKSUM_CACHE_MAX_ENTRIES   1000000
+
+/** Cache of package checksums stored in a single sqlite database.
+ *
+ * Entries are keyed by (device, inode, size, mtime, checksum type) of
+ * the package file, so a lookup needs only a fstat() result.
+ * The stored hdrid is compared with the hdrid of the package (if known)
+ * to catch reused inodes. Updates are batched in memory and written in
+ * a single transaction through a separate connection (lookups don't wait
+ * for the write), the database is in WAL mode and uses a busy timeout,
+ * so multiple createrepo_c runs can share one cache.
+ * All functions are thread-safe.
+ */
+typedef struct _cr_ChecksumCache cr_ChecksumCache;
+
+/** Open (create if needed) the cache database.
+ * @param path          Path to the database file
+ * @param max_entries   Max number of entries kept in the cache, the least
+ *                      recently used entries above this limit are evicted
+ *                      by cr_checksum_cache_close() (0 - no limit)
+ * @param err           GError **
+ * @return              cr_ChecksumCache or NULL on error
+ */
+cr_ChecksumCache *
+cr_checksum_cache_open(const char *path, gint64 max_entries, GError **err);
+
+/** Look up a cached checksum.
+ * @param cache         cr_ChecksumCache
+ * @param st            stat of the package file
+ * @param type          checksum type
+ * @param hdrid         hdrid of the package or NULL (not checked then)
+ * @param err           GError ** (set only if the database cannot be read)
+ * @return              Checksum (free it with g_free) or NULL if not cached
+ *                      or on error
+ */
+char *
+cr_checksum_cache_lookup(cr_ChecksumCache *cache,
+                         const struct stat *st,
+                         cr_ChecksumType type,
+                         const char *hdrid,
+                         GError **err);
+
+/** Store a checksum into the cache. The entry is written to the database
+ * later (in batch).
+ * @param cache         cr_ChecksumCache
+ * @param st            stat of the package file
+ * @param type          checksum type
+ * @param hdrid         hdrid of the package or NULL
+ * @param checksum      checksum of the package file
+ */
+void
+cr_checksum_cache_store(cr_ChecksumCache *cache,
+                        const struct stat *st,
+                        cr_ChecksumType type,
+                        const char *hdrid,
+                        const char *checksum);
+
+/** Write pending entries, evict the least recently used entries
+ * over the limit, compact the database and close it.
+ * @param cache         cr_ChecksumCache
+ * @param err           GError **
+ * @return              TRUE on success
+ */
+gboolean
+cr_checksum_cache_close(cr_ChecksumCache *cache, GError **err);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_CHECKSUM_CACHE_H__ */
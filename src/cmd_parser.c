@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <locale.h>
 #include "cmd_parser.h"
+#include "checksum_cache.h"
 #include "deltarpms.h"
 #include "error.h"
 #include "compression_wrapper.h"
@@ -34,6 +35,11 @@
 #define ERR_DOMAIN                      CREATEREPO_C_ERROR
 #define DEFAULT_CHECKSUM                "sha256"
 #define DEFAULT_WORKERS                 5
+#define DEFAULT_WRITE_BUFFER_DEPTH      128
+#define DEFAULT_IO_WORKERS              0
+#define DEFAULT_READAHEAD               64
+#define DEFAULT_COMPRESS_THREADS        0
+#define DEFAULT_DECOMPRESS_THREADS      0
 #define DEFAULT_UNIQUE_MD_FILENAMES     TRUE
 #define DEFAULT_IGNORE_LOCK             FALSE
 #define DEFAULT_LOCAL_SQLITE            FALSE
@@ -43,6 +49,11 @@ struct CmdOptions _cmd_options = {
         .changelog_limit            = DEFAULT_CHANGELOG_LIMIT,
         .checksum                   = NULL,
         .workers                    = DEFAULT_WORKERS,
+        .write_buffer_depth         = DEFAULT_WRITE_BUFFER_DEPTH,
+        .io_workers                 = DEFAULT_IO_WORKERS,
+        .readahead                  = DEFAULT_READAHEAD,
+        .compress_threads           = DEFAULT_COMPRESS_THREADS,
+        .decompress_threads         = DEFAULT_DECOMPRESS_THREADS,
         .unique_md_filenames        = DEFAULT_UNIQUE_MD_FILENAMES,
         .checksum_type              = CR_CHECKSUM_SHA256,
         .retain_old                 = 0,
@@ -51,6 +62,7 @@ struct CmdOptions _cmd_options = {
         .ignore_lock                = DEFAULT_IGNORE_LOCK,
         .md_max_age                 = G_GINT64_CONSTANT(0),
         .cachedir                   = NULL,
+        .cache_max_entries          = CR_CHECKSUM_CACHE_MAX_ENTRIES,
         .local_sqlite               = DEFAULT_LOCAL_SQLITE,
         .cut_dirs                   = 0,
         .location_prefix            = NULL,
@@ -136,6 +148,12 @@ static GOptionEntry cmd_entries[] =
     { "update-md-path", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &(_cmd_options.update_md_paths),
       "Existing metadata from this path are loaded and reused in addition to those "
       "present in the outputdir (works only with --update). Can be specified multiple times.", NULL },
+    { "update-stream", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.update_stream),
+      "Do not load the whole old metadata on a --update, stream them instead "
+      "and match them against the sorted list of packages. Saves memory and "
+      "the time before the processing starts. Old packages which are not in "
+      "the order createrepo_c writes them are regenerated. Implies --update.",
+      NULL },
     { "skip-stat", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.skip_stat),
       "Skip the stat() call on a --update, assumes if the filename is the same "
       "then the file is still the same (only use this if you're fairly "
@@ -183,6 +201,27 @@ static GOptionEntry cmd_entries[] =
       "READ_PKGS_LIST" },
     { "workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.workers),
       "Number of workers to spawn to read rpms.", NULL },
+    { "write-buffer-depth", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.write_buffer_depth),
+      "Max number of processed packages waiting to be written in order. "
+      "Workers which get this far ahead of the oldest unwritten package "
+      "wait for it (default: 128).", "NUM" },
+    { "io-workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.io_workers),
+      "Number of threads which read rpms and compute their checksums ahead "
+      "of the workers. Useful on storage with high latency, where more "
+      "outstanding reads than workers are needed (default: 0 - workers read "
+      "the rpms themselves).", "NUM" },
+    { "readahead", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.readahead),
+      "Max number of rpms read by --io-workers ahead of the workers "
+      "(default: 64).", "NUM" },
+    { "compress-threads", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.compress_threads),
+      "Number of threads used to compress each zstd, xz, gz or bz2 metadata file. "
+      "The result doesn't depend on the number of threads "
+      "(default: 0 - single-threaded compression).", "NUM" },
+    { "decompress-threads", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.decompress_threads),
+      "Number of threads used to decompress each zstd, xz, gz or bz2 metadata "
+      "file read by --update. The data are decompressed ahead of the XML "
+      "parser, xz files are also decoded by NUM threads if NUM > 1 "
+      "(default: 0 - decompressed by the parser thread).", "NUM" },
     { "xz", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.xz_compression),
       "Use xz for repodata compression.", NULL },
 #ifdef WITH_ZCHUNK
@@ -214,6 +253,9 @@ static GOptionEntry cmd_entries[] =
       "Available units (m - minutes, h - hours, d - days)", "AGE" },
     { "cachedir", 'c', 0, G_OPTION_ARG_FILENAME, &(_cmd_options.cachedir),
       "Set path to cache dir", "CACHEDIR." },
+    { "cache-max-entries", 0, 0, G_OPTION_ARG_INT64, &(_cmd_options.cache_max_entries),
+      "Max number of checksums kept in the --cachedir, the least recently "
+      "used are removed (default: 1000000, 0 - unlimited).", "NUM" },
 #ifdef CR_DELTA_RPM_SUPPORT
     { "deltas", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.deltas),
       "Tells createrepo to generate deltarpms and the delta metadata.", NULL },
@@ -413,6 +455,45 @@ check_arguments(struct CmdOptions *options,
         options->workers = DEFAULT_WORKERS;
     }
 
+    // Check write buffer depth
+    if (options->write_buffer_depth < 1) {
+        g_warning("Wrong write buffer depth - Using %d.",
+                  DEFAULT_WRITE_BUFFER_DEPTH);
+        options->write_buffer_depth = DEFAULT_WRITE_BUFFER_DEPTH;
+    }
+
+    // Check I/O stage
+    if ((options->io_workers < 0) || (options->io_workers > 1000)) {
+        g_warning("Wrong number of I/O workers - I/O stage disabled.");
+        options->io_workers = DEFAULT_IO_WORKERS;
+    }
+
+    if (options->readahead < 1) {
+        g_warning("Wrong read-ahead - Using %d.", DEFAULT_READAHEAD);
+        options->readahead = DEFAULT_READAHEAD;
+    }
+
+    // Check compression threads
+    if ((options->compress_threads < 0) || (options->compress_threads > 200)) {
+        g_warning("Wrong number of compression threads - "
+                  "Using single-threaded compression.");
+        options->compress_threads = DEFAULT_COMPRESS_THREADS;
+    }
+
+    // Check decompression threads
+    if ((options->decompress_threads < 0) || (options->decompress_threads > 200)) {
+        g_warning("Wrong number of decompression threads - "
+                  "Not decompressing ahead.");
+        options->decompress_threads = DEFAULT_DECOMPRESS_THREADS;
+    }
+
+    // Check checksum cache limit
+    if (options->cache_max_entries < 0) {
+        g_warning("Wrong max number of cache entries - Using %d.",
+                  CR_CHECKSUM_CACHE_MAX_ENTRIES);
+        options->cache_max_entries = CR_CHECKSUM_CACHE_MAX_ENTRIES;
+    }
+
     // Check changelog_limit
     if ((options->changelog_limit < -1)) {
         g_warning("Wrong changelog limit \"%d\" - Using 10", options->changelog_limit);
@@ -550,6 +631,16 @@ check_arguments(struct CmdOptions *options,
         }
     }
 
+    if (options->update_stream) {
+        options->update = TRUE;
+        if (options->update_md_paths || options->recycle_pkglist) {
+            g_warning("--update-stream cannot be used together with "
+                      "--update-md-path or --recycle-pkglist - "
+                      "old metadata will be loaded as a whole");
+            options->update_stream = FALSE;
+        }
+    }
+
     // Process update_md_paths
     if (options->update_md_paths && !options->update)
         g_warning("Usage of --update-md-path without --update has no effect!");
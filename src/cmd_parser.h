@@ -51,6 +51,7 @@ struct CmdOptions {
     gboolean pretty;            /*!< generate pretty xml (just for compatibility) */
     char **update_md_paths;     /*!< list of paths to repositories which should
                                      be used for update */
+    gboolean update_stream;     /*!< stream old metadata during --update */
     gboolean skip_stat;         /*!< skip stat() call during --update */
     gboolean split;             /*!< generate split media */
     gboolean version;           /*!< print program version */
@@ -77,6 +78,17 @@ struct CmdOptions {
                                              time for timestamps */
     char *read_pkgs_list;       /*!< output the paths to pkgs actually read */
     gint workers;               /*!< number of threads to spawn */
+    gint write_buffer_depth;    /*!< max number of processed packages
+                                     waiting to be written in order */
+    gint io_workers;            /*!< number of threads reading rpms ahead
+                                     of the workers (0 - disabled) */
+    gint readahead;             /*!< max number of rpms read ahead */
+    gint compress_threads;      /*!< number of threads compressing a single
+                                     zstd, xz, gz or bz2 file
+                                     (0 - single-threaded) */
+    gint decompress_threads;    /*!< number of threads decompressing a single
+                                     zstd, xz, gz or bz2 file
+                                     (0 - no read-ahead) */
     gboolean xz_compression;    /*!< use xz for repodata compression */
     gboolean zck_compression;   /*!< generate zchunk files */
     char *zck_dict_dir;         /*!< directory with zchunk dictionaries */
@@ -99,6 +111,8 @@ struct CmdOptions {
                                      Available units: (m - minutes, h - hours,
                                      d - days) */
     char *cachedir;             /*!< Cache dir for checksums */
+    gint64 cache_max_entries;   /*!< Max number of entries in the checksum
+                                     cache */
 
 #ifdef CR_DELTA_RPM_SUPPORT
     gboolean deltas;            /*!< Is delta generation enabled? */
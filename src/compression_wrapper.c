@@ -35,6 +35,7 @@
 #endif  // WITH_ZCHUNK
 #include "error.h"
 #include "compression_wrapper.h"
+#include "compression_wrapper_internal.h"
 #include <zstd.h>
 
 
@@ -87,6 +88,73 @@ LZMA_CHECK_SHA256
 #define XZ_DECODER_FLAGS        0
 #define XZ_BUFFER_SIZE          (1024*32)
 
+/* Threaded decoder is available since liblzma 5.4.0 */
+#if LZMA_VERSION >= 50040002
+#define XZ_HAVE_DECODER_MT
+#endif
+
+/* Size of a block compressed independently by the threaded xz encoder.
+ * It is fixed (instead of derived from the number of threads) to keep
+ * the output identical for any number of threads. Smaller blocks give
+ * more parallelism for the repodata sized files but worse compression. */
+#define XZ_MT_BLOCK_SIZE        (1024*1024*4)
+
+/* Number of encoder threads used by cr_sopen() in write mode */
+static gint compression_threads = 0;
+
+void
+cr_set_compression_threads(int threads)
+{
+    g_atomic_int_set(&compression_threads, (threads > 1) ? threads : 0);
+}
+
+int
+cr_get_compression_threads(void)
+{
+    return g_atomic_int_get(&compression_threads);
+}
+
+/* Number of decoder threads used by cr_sopen() in read mode */
+static gint decompression_threads = 0;
+
+void
+cr_set_decompression_threads(int threads)
+{
+    g_atomic_int_set(&decompression_threads, (threads > 0) ? threads : 0);
+}
+
+int
+cr_get_decompression_threads(void)
+{
+    return g_atomic_int_get(&decompression_threads);
+}
+
+/** Stats of the compressed file. They are kept out of cr_ContentStat,
+ * which callers may allocate by themselves, so only the objects created
+ * by cr_contentstat_new() have them (registered in compressed_stats).
+ */
+typedef struct {
+    gint64  size;       /*!< Size of the compressed file */
+    char    *checksum;  /*!< Checksum of the compressed file or NULL */
+} ContentStatCompressed;
+
+static GMutex compressed_stats_mutex;      // Guards compressed_stats
+static GHashTable *compressed_stats = NULL; // cr_ContentStat * ->
+                                            // ContentStatCompressed *
+
+static ContentStatCompressed *
+contentstat_compressed(cr_ContentStat *cstat)
+{
+    ContentStatCompressed *compressed = NULL;
+
+    g_mutex_lock(&compressed_stats_mutex);
+    if (compressed_stats)
+        compressed = g_hash_table_lookup(compressed_stats, cstat);
+    g_mutex_unlock(&compressed_stats_mutex);
+
+    return compressed;
+}
+
 cr_ContentStat *
 cr_contentstat_new(cr_ChecksumType type, GError **err)
 {
@@ -97,22 +165,66 @@ cr_contentstat_new(cr_ChecksumType type, GError **err)
     cstat = g_malloc0(sizeof(cr_ContentStat));
     cstat->checksum_type = type;
 
+    g_mutex_lock(&compressed_stats_mutex);
+    if (!compressed_stats)
+        compressed_stats = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_insert(compressed_stats, cstat,
+                        g_new0(ContentStatCompressed, 1));
+    g_mutex_unlock(&compressed_stats_mutex);
+
     return cstat;
 }
 
 void
 cr_contentstat_free(cr_ContentStat *cstat, GError **err)
 {
+    ContentStatCompressed *compressed = NULL;
+
     assert(!err || *err == NULL);
 
     if (!cstat)
         return;
 
+    g_mutex_lock(&compressed_stats_mutex);
+    if (compressed_stats
+        && g_hash_table_steal_extended(compressed_stats, cstat,
+                                       NULL, (gpointer *) &compressed))
+    {
+        g_free(compressed->checksum);
+        g_free(compressed);
+    }
+    g_mutex_unlock(&compressed_stats_mutex);
+
     g_free(cstat->hdr_checksum);
     g_free(cstat->checksum);
     g_free(cstat);
 }
 
+const char *
+cr_contentstat_get_compressed(cr_ContentStat *cstat, gint64 *size)
+{
+    ContentStatCompressed *compressed = contentstat_compressed(cstat);
+
+    if (size)
+        *size = compressed ? compressed->size : 0;
+    return compressed ? compressed->checksum : NULL;
+}
+
+void
+cr_contentstat_set_compressed(cr_ContentStat *cstat,
+                              gint64 size,
+                              const char *checksum)
+{
+    ContentStatCompressed *compressed = contentstat_compressed(cstat);
+
+    if (!compressed)
+        return;
+
+    g_free(compressed->checksum);
+    compressed->checksum = g_strdup(checksum);
+    compressed->size = size;
+}
+
 typedef struct {
     lzma_stream stream;
     FILE *file;
@@ -313,6 +425,700 @@ cr_cktype_from_zck(zckCtx *zck, GError **err)
 }
 #endif // WITH_ZCHUNK
 
+/** Checksums of the file as if its header member contained alternative
+ * data (see cr_write_header_member()).
+ */
+typedef struct {
+    cr_ContentStat  *stat;              /*!< Where to store the stats */
+    gint64          size_diff;          /*!< Alternative minus actual length */
+    cr_ChecksumCtx  *checksum_ctx;      /*!< Checksum of the content */
+    cr_ChecksumCtx  *out_checksum_ctx;  /*!< Checksum of the compressed file */
+} HeaderMemberAlt;
+
+/** Count data written after the header member into the alternative stats.
+ */
+static void
+header_alts_update(GSList *alts,
+                   gboolean compressed,
+                   const void *buffer,
+                   size_t len)
+{
+    for (GSList *elem = alts; elem; elem = g_slist_next(elem)) {
+        HeaderMemberAlt *alt = elem->data;
+        cr_checksum_update(compressed ? alt->out_checksum_ctx
+                                      : alt->checksum_ctx,
+                           buffer, len, NULL);
+    }
+}
+
+/** Fill the alternative stats from the final stats of the file (if ok)
+ * and free the checksum contexts.
+ */
+static void
+header_alts_finish(CR_FILE *cr_file, gboolean ok)
+{
+    GSList *alts = cr_file_priv(cr_file)->header_alts;
+    gint64 compressed_size;
+
+    if (ok)
+        cr_contentstat_get_compressed(cr_file->stat, &compressed_size);
+
+    for (GSList *elem = alts; elem; elem = g_slist_next(elem)) {
+        HeaderMemberAlt *alt = elem->data;
+        gchar *checksum = cr_checksum_final(alt->checksum_ctx, NULL);
+        gchar *out_checksum = cr_checksum_final(alt->out_checksum_ctx, NULL);
+
+        if (ok) {
+            g_free(alt->stat->checksum);
+            alt->stat->size = cr_file->stat->size + alt->size_diff;
+            alt->stat->checksum = checksum;
+            cr_contentstat_set_compressed(alt->stat, compressed_size,
+                                          out_checksum);
+        } else {
+            g_free(checksum);
+        }
+        g_free(out_checksum);
+        g_free(alt);
+    }
+
+    g_slist_free(alts);
+    cr_file_priv(cr_file)->header_alts = NULL;
+}
+
+/** Write compressed data to the output file and count them
+ * into the stats of the compressed file.
+ */
+static gboolean
+cw_fwrite(CR_FILE *cr_file, FILE *f, const void *buffer, size_t len)
+{
+    cr_FilePriv *priv = cr_file_priv(cr_file);
+
+    if (fwrite(buffer, 1, len, f) != len)
+        return FALSE;
+
+    priv->out_size += len;
+    if (priv->out_checksum_ctx)
+        cr_checksum_update(priv->out_checksum_ctx, buffer, len, NULL);
+    header_alts_update(priv->header_alts, TRUE, buffer, len);
+
+    return TRUE;
+}
+
+/*
+ * Block-parallel gzip/bzip2 writer
+ *
+ * Input is cut into blocks of a fixed size which are compressed
+ * independently by a thread pool. Every block becomes a complete gzip
+ * member or bzip2 stream, the blocks are written in the original order
+ * and their concatenation is a valid multi-member gzip file or
+ * a multi-stream bzip2 file (decompressed by zlib's gzread(), gzip, bzip2
+ * tools and by cr_read() as a single content). Block boundaries depend
+ * only on the input, therefore the output is the same for any number
+ * of threads.
+ */
+
+#define GZ_PARALLEL_BLOCK_SIZE  (1024*1024)
+#define BZ2_PARALLEL_BLOCK_SIZE (BZ2_BLOCKSIZE100K*100000)
+
+typedef struct {
+    unsigned char *in;          // Uncompressed data
+    size_t in_len;              // Length of the uncompressed data
+    unsigned char *out;         // Compressed data
+    size_t out_len;             // Length of the compressed data
+    gboolean done;              // Compression finished
+    GError *err;                // Error from the compressing thread
+    struct BlockWriter *bw;     // Owning writer
+} CwBlock;
+
+typedef struct BlockWriter {
+    cr_CompressionType type;    // CR_CW_GZ_COMPRESSION or CR_CW_BZ2_...
+    CR_FILE *cr_file;           // Owning file
+    FILE *file;                 // Output file
+    GThreadPool *pool;          // Compressing threads
+    size_t block_size;          // Size of uncompressed block
+    CwBlock *cur;               // Block being filled by cr_write()
+    gboolean empty;             // Nothing was submitted yet
+    GQueue *pending;            // Submitted blocks in the output order
+    guint max_pending;          // Max number of submitted unwritten blocks
+    GMutex mutex;               // Guards done flags of the blocks
+    GCond cond_done;            // Signaled when a block is compressed
+} BlockWriter;
+
+static CwBlock *
+cw_block_new(BlockWriter *bw)
+{
+    CwBlock *block = g_new0(CwBlock, 1);
+    block->in = g_malloc(bw->block_size);
+    block->bw = bw;
+    return block;
+}
+
+static void
+cw_block_free(CwBlock *block)
+{
+    if (!block)
+        return;
+    g_free(block->in);
+    g_free(block->out);
+    g_clear_error(&block->err);
+    g_free(block);
+}
+
+static void
+cw_block_compress_gz(CwBlock *block)
+{
+    z_stream zs;
+    int rc;
+
+    memset(&zs, 0, sizeof(zs));
+    // windowBits + 16 => gzip header and trailer (mtime 0, no name)
+    rc = deflateInit2(&zs, CR_CW_GZ_COMPRESSION_LEVEL, Z_DEFLATED,
+                      15 + 16, 8, GZ_STRATEGY);
+    if (rc != Z_OK) {
+        g_set_error(&block->err, ERR_DOMAIN, CRE_GZ,
+                    "deflateInit2() error (%d)", rc);
+        return;
+    }
+
+    block->out_len = deflateBound(&zs, block->in_len);
+    block->out = g_malloc(block->out_len);
+
+    zs.next_in = block->in;
+    zs.avail_in = block->in_len;
+    zs.next_out = block->out;
+    zs.avail_out = block->out_len;
+
+    rc = deflate(&zs, Z_FINISH);
+    if (rc != Z_STREAM_END)
+        g_set_error(&block->err, ERR_DOMAIN, CRE_GZ,
+                    "deflate() error (%d): %s", rc,
+                    zs.msg ? zs.msg : "unknown error");
+    else
+        block->out_len = zs.total_out;
+
+    deflateEnd(&zs);
+}
+
+static void
+cw_block_compress_bz2(CwBlock *block)
+{
+    // Worst case from the bzip2 documentation: 1% larger + 600 bytes
+    unsigned int out_len = block->in_len + block->in_len / 100 + 600;
+    int rc;
+
+    block->out = g_malloc(out_len);
+    rc = BZ2_bzBuffToBuffCompress((char *) block->out, &out_len,
+                                  (char *) block->in, block->in_len,
+                                  BZ2_BLOCKSIZE100K, BZ2_VERBOSITY,
+                                  BZ2_WORK_FACTOR);
+    if (rc != BZ_OK)
+        g_set_error(&block->err, ERR_DOMAIN, CRE_BZ2,
+                    "BZ2_bzBuffToBuffCompress() error (%d)", rc);
+    else
+        block->out_len = out_len;
+}
+
+static void
+cw_block_compressing_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    CwBlock *block = data;
+    BlockWriter *bw = block->bw;
+
+    if (bw->type == CR_CW_GZ_COMPRESSION)
+        cw_block_compress_gz(block);
+    else
+        cw_block_compress_bz2(block);
+
+    // The input is not needed anymore
+    g_free(block->in);
+    block->in = NULL;
+
+    g_mutex_lock(&bw->mutex);
+    block->done = TRUE;
+    g_cond_broadcast(&bw->cond_done);
+    g_mutex_unlock(&bw->mutex);
+}
+
+/** Wait for the oldest submitted block and write it out.
+ */
+static gboolean
+block_writer_flush_one(BlockWriter *bw, GError **err)
+{
+    CwBlock *block = g_queue_pop_head(bw->pending);
+    gboolean ret = TRUE;
+
+    if (!block)
+        return TRUE;
+
+    g_mutex_lock(&bw->mutex);
+    while (!block->done)
+        g_cond_wait(&bw->cond_done, &bw->mutex);
+    g_mutex_unlock(&bw->mutex);
+
+    if (block->err) {
+        g_propagate_error(err, block->err);
+        block->err = NULL;
+        ret = FALSE;
+    } else if (!cw_fwrite(bw->cr_file, bw->file, block->out, block->out_len)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fwrite(): %s", g_strerror(errno));
+        ret = FALSE;
+    }
+
+    cw_block_free(block);
+    return ret;
+}
+
+/** Hand over the block being filled to the compressing threads.
+ */
+static gboolean
+block_writer_submit(BlockWriter *bw, GError **err)
+{
+    CwBlock *block = bw->cur;
+
+    bw->cur = NULL;
+    bw->empty = FALSE;
+    g_queue_push_tail(bw->pending, block);
+    g_thread_pool_push(bw->pool, block, NULL);
+
+    // Keep memory bounded - write out everything what is ready
+    // and wait if too many blocks are in flight
+    while (!g_queue_is_empty(bw->pending)) {
+        CwBlock *head = g_queue_peek_head(bw->pending);
+        gboolean done;
+
+        g_mutex_lock(&bw->mutex);
+        done = head->done;
+        g_mutex_unlock(&bw->mutex);
+
+        if (!done && g_queue_get_length(bw->pending) <= bw->max_pending)
+            break;
+        if (!block_writer_flush_one(bw, err))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BlockWriter *
+block_writer_open(CR_FILE *cr_file,
+                  const char *filename,
+                  cr_CompressionType type,
+                  int threads,
+                  GError **err)
+{
+    BlockWriter *bw;
+    GError *tmp_err = NULL;
+    FILE *f = fopen(filename, "wb");
+
+    if (!f) {
+        // Open errors of gzip files are reported as CRE_GZ
+        g_set_error(err, ERR_DOMAIN,
+                    type == CR_CW_GZ_COMPRESSION ? CRE_GZ : CRE_IO,
+                    "fopen(): %s", g_strerror(errno));
+        return NULL;
+    }
+
+    bw = g_new0(BlockWriter, 1);
+    bw->type = type;
+    bw->cr_file = cr_file;
+    bw->file = f;
+    bw->block_size = (type == CR_CW_GZ_COMPRESSION) ? GZ_PARALLEL_BLOCK_SIZE
+                                                    : BZ2_PARALLEL_BLOCK_SIZE;
+    bw->empty = TRUE;
+    bw->pending = g_queue_new();
+    bw->max_pending = 2 * threads;
+    g_mutex_init(&bw->mutex);
+    g_cond_init(&bw->cond_done);
+
+    bw->pool = g_thread_pool_new(cw_block_compressing_thread, NULL,
+                                 threads, FALSE, &tmp_err);
+    if (!bw->pool) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Cannot create compression threads: ");
+        g_queue_free(bw->pending);
+        g_mutex_clear(&bw->mutex);
+        g_cond_clear(&bw->cond_done);
+        g_free(bw);
+        fclose(f);
+        return NULL;
+    }
+
+    return bw;
+}
+
+static int
+block_writer_write(BlockWriter *bw,
+                   const void *buffer,
+                   unsigned int len,
+                   GError **err)
+{
+    const unsigned char *data = buffer;
+    size_t remain = len;
+
+    while (remain > 0) {
+        if (!bw->cur)
+            bw->cur = cw_block_new(bw);
+
+        size_t n = MIN(remain, bw->block_size - bw->cur->in_len);
+        memcpy(bw->cur->in + bw->cur->in_len, data, n);
+        bw->cur->in_len += n;
+        data += n;
+        remain -= n;
+
+        if (bw->cur->in_len == bw->block_size
+            && !block_writer_submit(bw, err))
+            return CR_CW_ERR;
+    }
+
+    return len;
+}
+
+static int
+block_writer_close(BlockWriter *bw, GError **err)
+{
+    int ret = CRE_OK;
+    GError *tmp_err = NULL;
+
+    // The last partial block. A file with no content at all still
+    // gets one empty member/stream to stay a valid gz/bz2 file.
+    if (bw->cur || bw->empty) {
+        if (!bw->cur)
+            bw->cur = cw_block_new(bw);
+        if (!block_writer_submit(bw, &tmp_err))
+            ret = tmp_err->code;
+    }
+
+    while (!g_queue_is_empty(bw->pending)) {
+        if (!block_writer_flush_one(bw, tmp_err ? NULL : &tmp_err))
+            ret = tmp_err ? tmp_err->code : ret;
+    }
+
+    g_thread_pool_free(bw->pool, FALSE, TRUE);
+
+    if (fclose(bw->file) != 0 && !tmp_err) {
+        g_set_error(&tmp_err, ERR_DOMAIN, CRE_IO,
+                    "fclose(): %s", g_strerror(errno));
+        ret = CRE_IO;
+    }
+
+    if (tmp_err)
+        g_propagate_error(err, tmp_err);
+
+    cw_block_free(bw->cur);
+    g_queue_free(bw->pending);
+    g_mutex_clear(&bw->mutex);
+    g_cond_clear(&bw->cond_done);
+    g_free(bw);
+
+    return ret;
+}
+
+/*
+ * Single-threaded gzip/bzip2 writer
+ *
+ * Drives the zlib/bzlib stream directly (instead of gzFile/BZFILE) so all
+ * compressed data go through cw_fwrite() and the stats of the compressed
+ * file are computed without reading the file again. The output is
+ * the same as the one of gzwrite()/BZ2_bzWrite() with the same settings.
+ */
+
+typedef struct {
+    cr_CompressionType type;    // CR_CW_GZ_COMPRESSION or CR_CW_BZ2_...
+    z_stream gz;                // Gzip stream
+    bz_stream bz;               // Bzip2 stream
+    FILE *file;                 // Output file
+    unsigned char buffer[GZ_BUFFER_SIZE]; // Compressed data
+} StreamWriter;
+
+static StreamWriter *
+stream_writer_open(const char *filename,
+                   cr_CompressionType type,
+                   GError **err)
+{
+    StreamWriter *sw;
+    int rc;
+    FILE *f = fopen(filename, "wb");
+
+    if (!f) {
+        // Open errors of gzip files are reported as CRE_GZ
+        g_set_error(err, ERR_DOMAIN,
+                    type == CR_CW_GZ_COMPRESSION ? CRE_GZ : CRE_IO,
+                    "fopen(): %s", g_strerror(errno));
+        return NULL;
+    }
+
+    sw = g_new0(StreamWriter, 1);
+    sw->type = type;
+    sw->file = f;
+
+    if (type == CR_CW_GZ_COMPRESSION) {
+        // windowBits 15 + 16 == gzip header and trailer (like gzopen())
+        rc = deflateInit2(&sw->gz, CR_CW_GZ_COMPRESSION_LEVEL, Z_DEFLATED,
+                          15 + 16, 8, GZ_STRATEGY);
+        if (rc != Z_OK) {
+            g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                        "deflateInit2() error (%d)", rc);
+            goto error;
+        }
+    } else {
+        rc = BZ2_bzCompressInit(&sw->bz, BZ2_BLOCKSIZE100K,
+                                BZ2_VERBOSITY, BZ2_WORK_FACTOR);
+        if (rc != BZ_OK) {
+            g_set_error(err, ERR_DOMAIN, CRE_BZ2,
+                        "BZ2_bzCompressInit() error (%d)", rc);
+            goto error;
+        }
+    }
+
+    return sw;
+
+error:
+    fclose(f);
+    g_free(sw);
+    return NULL;
+}
+
+/** Compress len bytes of the buffer and write out the compressed data.
+ * If finish is TRUE, the stream is ended.
+ */
+static gboolean
+stream_writer_code(CR_FILE *cr_file,
+                   StreamWriter *sw,
+                   const void *buffer,
+                   unsigned int len,
+                   gboolean finish,
+                   GError **err)
+{
+    int rc;
+    size_t out_len;
+
+    if (sw->type == CR_CW_GZ_COMPRESSION) {
+        sw->gz.next_in = (Bytef *) buffer;
+        sw->gz.avail_in = len;
+        do {
+            sw->gz.next_out = sw->buffer;
+            sw->gz.avail_out = sizeof(sw->buffer);
+            rc = deflate(&sw->gz, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (rc == Z_STREAM_ERROR) {
+                g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                            "deflate() error (%d)", rc);
+                return FALSE;
+            }
+            out_len = sizeof(sw->buffer) - sw->gz.avail_out;
+            if (out_len && !cw_fwrite(cr_file, sw->file, sw->buffer, out_len)) {
+                g_set_error(err, ERR_DOMAIN, CRE_IO,
+                            "fwrite(): %s", g_strerror(errno));
+                return FALSE;
+            }
+        } while (sw->gz.avail_out == 0 || (finish && rc != Z_STREAM_END));
+        return TRUE;
+    }
+
+    // BZ_RUN with no input is a BZ_PARAM_ERROR
+    if (len == 0 && !finish)
+        return TRUE;
+
+    sw->bz.next_in = (char *) buffer;
+    sw->bz.avail_in = len;
+    do {
+        sw->bz.next_out = (char *) sw->buffer;
+        sw->bz.avail_out = sizeof(sw->buffer);
+        rc = BZ2_bzCompress(&sw->bz, finish ? BZ_FINISH : BZ_RUN);
+        if (rc != BZ_RUN_OK && rc != BZ_FINISH_OK && rc != BZ_STREAM_END) {
+            g_set_error(err, ERR_DOMAIN, CRE_BZ2,
+                        "BZ2_bzCompress() error (%d)", rc);
+            return FALSE;
+        }
+        out_len = sizeof(sw->buffer) - sw->bz.avail_out;
+        if (out_len && !cw_fwrite(cr_file, sw->file, sw->buffer, out_len)) {
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "fwrite(): %s", g_strerror(errno));
+            return FALSE;
+        }
+    } while (finish ? rc != BZ_STREAM_END : sw->bz.avail_in > 0);
+
+    return TRUE;
+}
+
+static int
+stream_writer_close(CR_FILE *cr_file, StreamWriter *sw, GError **err)
+{
+    int ret = CRE_OK;
+    GError *tmp_err = NULL;
+
+    if (!stream_writer_code(cr_file, sw, NULL, 0, TRUE, &tmp_err))
+        ret = tmp_err->code;
+
+    if (sw->type == CR_CW_GZ_COMPRESSION)
+        deflateEnd(&sw->gz);
+    else
+        BZ2_bzCompressEnd(&sw->bz);
+
+    if (fclose(sw->file) != 0 && !tmp_err) {
+        g_set_error(&tmp_err, ERR_DOMAIN, CRE_IO,
+                    "fclose(): %s", g_strerror(errno));
+        ret = CRE_IO;
+    }
+
+    if (tmp_err)
+        g_propagate_error(err, tmp_err);
+
+    g_free(sw);
+    return ret;
+}
+
+/*
+ * Read-ahead
+ *
+ * A background thread decompresses the file into a ring of large buffers
+ * while cr_read() just copies the already decompressed data, so the caller
+ * (typically an XML parser) doesn't wait for the decompression and vice
+ * versa. Content stats are still computed by cr_read() from the data
+ * returned to the caller.
+ */
+
+#define READ_AHEAD_BUFFER_SIZE  (1024*1024)
+#define READ_AHEAD_BUFFERS      4
+
+static int cw_read(CR_FILE *cr_file, void *buffer, unsigned int len,
+                   GError **err);
+
+typedef struct {
+    char *data;                 // Decompressed data
+    int len;                    // Length of the data
+    int pos;                    // Already consumed by cr_read()
+} ReadAheadBuffer;
+
+typedef struct {
+    CR_FILE *cr_file;           // Owning file
+    GThread *thread;            // Decompressing thread
+    ReadAheadBuffer buffers[READ_AHEAD_BUFFERS];
+    guint head;                 // Number of filled buffers
+    guint tail;                 // Number of consumed buffers
+    gboolean done;              // Decompression hit EOF or an error
+    gboolean stop;              // File is being closed
+    GError *err;                // Error from the decompressing thread
+    GMutex mutex;               // Guards everything above but the data
+    GCond cond;                 // Signaled when head, tail or flags change
+} ReadAhead;
+
+static gpointer
+read_ahead_thread(gpointer data)
+{
+    ReadAhead *ra = data;
+
+    while (1) {
+        ReadAheadBuffer *buf;
+        GError *tmp_err = NULL;
+
+        g_mutex_lock(&ra->mutex);
+        while (ra->head - ra->tail == READ_AHEAD_BUFFERS && !ra->stop)
+            g_cond_wait(&ra->cond, &ra->mutex);
+        if (ra->stop) {
+            g_mutex_unlock(&ra->mutex);
+            break;
+        }
+        buf = &ra->buffers[ra->head % READ_AHEAD_BUFFERS];
+        g_mutex_unlock(&ra->mutex);
+
+        // The buffer isn't visible to cr_read() until the head moves
+        int ret = cw_read(ra->cr_file, buf->data, READ_AHEAD_BUFFER_SIZE,
+                          &tmp_err);
+
+        g_mutex_lock(&ra->mutex);
+        if (ret == CR_CW_ERR || ret == 0) {
+            ra->err = tmp_err;
+            ra->done = TRUE;
+        } else {
+            buf->len = ret;
+            buf->pos = 0;
+            ra->head++;
+        }
+        g_cond_broadcast(&ra->cond);
+        g_mutex_unlock(&ra->mutex);
+
+        if (ra->done)
+            break;
+    }
+
+    return NULL;
+}
+
+static ReadAhead *
+read_ahead_start(CR_FILE *cr_file)
+{
+    ReadAhead *ra = g_new0(ReadAhead, 1);
+
+    ra->cr_file = cr_file;
+    for (int x = 0; x < READ_AHEAD_BUFFERS; x++)
+        ra->buffers[x].data = g_malloc(READ_AHEAD_BUFFER_SIZE);
+    g_mutex_init(&ra->mutex);
+    g_cond_init(&ra->cond);
+    ra->thread = g_thread_new("read-ahead", read_ahead_thread, ra);
+
+    return ra;
+}
+
+static int
+read_ahead_read(ReadAhead *ra, void *buffer, unsigned int len, GError **err)
+{
+    unsigned int copied = 0;
+
+    while (copied < len) {
+        ReadAheadBuffer *buf;
+
+        g_mutex_lock(&ra->mutex);
+        while (ra->head == ra->tail && !ra->done)
+            g_cond_wait(&ra->cond, &ra->mutex);
+        if (ra->head == ra->tail) {
+            // Everything was consumed - EOF or error
+            gboolean failed = (ra->err && copied == 0);
+            if (failed)
+                g_propagate_error(err, g_error_copy(ra->err));
+            g_mutex_unlock(&ra->mutex);
+            if (failed)
+                return CR_CW_ERR;
+            break;
+        }
+        buf = &ra->buffers[ra->tail % READ_AHEAD_BUFFERS];
+        g_mutex_unlock(&ra->mutex);
+
+        unsigned int n = MIN(len - copied, (unsigned int) (buf->len - buf->pos));
+        memcpy((char *) buffer + copied, buf->data + buf->pos, n);
+        buf->pos += n;
+        copied += n;
+
+        if (buf->pos == buf->len) {
+            g_mutex_lock(&ra->mutex);
+            ra->tail++;
+            g_cond_broadcast(&ra->cond);
+            g_mutex_unlock(&ra->mutex);
+        }
+    }
+
+    return (int) copied;
+}
+
+static void
+read_ahead_stop(ReadAhead *ra)
+{
+    g_mutex_lock(&ra->mutex);
+    ra->stop = TRUE;
+    g_cond_broadcast(&ra->cond);
+    g_mutex_unlock(&ra->mutex);
+
+    g_thread_join(ra->thread);
+
+    for (int x = 0; x < READ_AHEAD_BUFFERS; x++)
+        g_free(ra->buffers[x].data);
+    if (ra->err)
+        g_error_free(ra->err);
+    g_mutex_clear(&ra->mutex);
+    g_cond_clear(&ra->cond);
+    g_free(ra);
+}
+
 CR_FILE *
 cr_sopen(const char *filename,
          cr_OpenMode mode,
@@ -322,6 +1128,8 @@ cr_sopen(const char *filename,
 {
     CR_FILE *file = NULL;
     cr_CompressionType type = comtype;
+    int threads = cr_get_compression_threads();
+    int dthreads = cr_get_decompression_threads();
     GError *tmp_err = NULL;
 
     assert(filename);
@@ -376,7 +1184,7 @@ cr_sopen(const char *filename,
 
     const char *mode_str = (mode == CR_CW_MODE_WRITE) ? "wb" : "rb";
 
-    file = g_malloc0(sizeof(CR_FILE));
+    file = (CR_FILE *) g_new0(cr_FilePriv, 1);
     file->mode = mode;
     file->type = type;
     file->INNERFILE = NULL;
@@ -392,6 +1200,18 @@ cr_sopen(const char *filename,
             break;
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+            if (mode == CR_CW_MODE_WRITE && threads > 1) {
+                file->FILE = (void *) block_writer_open(file, filename, type,
+                                                        threads, err);
+                cr_file_priv(file)->parallel = TRUE;
+                break;
+            }
+
+            if (mode == CR_CW_MODE_WRITE) {
+                file->FILE = (void *) stream_writer_open(filename, type, err);
+                break;
+            }
+
             file->FILE = (void *) gzopen(filename, mode_str);
             if (!file->FILE) {
                 g_set_error(err, ERR_DOMAIN, CRE_GZ,
@@ -399,11 +1219,6 @@ cr_sopen(const char *filename,
                 break;
             }
 
-            if (mode == CR_CW_MODE_WRITE)
-                gzsetparams((gzFile) file->FILE,
-                            CR_CW_GZ_COMPRESSION_LEVEL,
-                            GZ_STRATEGY);
-
             if (gzbuffer((gzFile) file->FILE, GZ_BUFFER_SIZE) == -1) {
                 g_debug("%s: gzbuffer() call failed", __func__);
                 g_set_error(err, ERR_DOMAIN, CRE_GZ,
@@ -439,6 +1254,20 @@ cr_sopen(const char *filename,
                     fclose(f);
                     break;
                 }
+                if (threads > 1) {
+                    // Fails if the libzstd was built without
+                    // the multithreading support
+                    ret = ZSTD_CCtx_setParameter(zstd_file->context, ZSTD_c_nbWorkers, threads);
+                    if (ZSTD_isError(ret)) {
+                        g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                "Cannot use %d compression threads: %s",
+                                threads, ZSTD_getErrorName(ret));
+                        ZSTD_freeCCtx(zstd_file->context);
+                        g_free(zstd_file);
+                        fclose(f);
+                        break;
+                    }
+                }
                 zstd_file->buffer_size = ZSTD_CStreamOutSize();
             } else {
                 if ((zstd_file->context = (void *) ZSTD_createDCtx()) == NULL) {
@@ -457,6 +1286,18 @@ cr_sopen(const char *filename,
         }
 
         case (CR_CW_BZ2_COMPRESSION): { // ------------------------------------
+            if (mode == CR_CW_MODE_WRITE && threads > 1) {
+                file->FILE = (void *) block_writer_open(file, filename, type,
+                                                        threads, err);
+                cr_file_priv(file)->parallel = TRUE;
+                break;
+            }
+
+            if (mode == CR_CW_MODE_WRITE) {
+                file->FILE = (void *) stream_writer_open(filename, type, err);
+                break;
+            }
+
             FILE *f = fopen(filename, mode_str);
             file->INNERFILE = f;
             int bzerror;
@@ -467,19 +1308,11 @@ cr_sopen(const char *filename,
                 break;
             }
 
-            if (mode == CR_CW_MODE_WRITE) {
-                file->FILE = (void *) BZ2_bzWriteOpen(&bzerror,
-                                                      f,
-                                                      BZ2_BLOCKSIZE100K,
-                                                      BZ2_VERBOSITY,
-                                                      BZ2_WORK_FACTOR);
-            } else {
-                file->FILE = (void *) BZ2_bzReadOpen(&bzerror,
-                                                     f,
-                                                     BZ2_VERBOSITY,
-                                                     BZ2_USE_LESS_MEMORY,
-                                                     NULL, 0);
-            }
+            file->FILE = (void *) BZ2_bzReadOpen(&bzerror,
+                                                 f,
+                                                 BZ2_VERBOSITY,
+                                                 BZ2_USE_LESS_MEMORY,
+                                                 NULL, 0);
 
             if (bzerror != BZ_OK) {
                 const char *err_msg;
@@ -524,7 +1357,21 @@ cr_sopen(const char *filename,
 
             // Prepare coder/decoder
 
-            if (mode == CR_CW_MODE_WRITE) {
+            if (mode == CR_CW_MODE_WRITE && threads > 1) {
+                // Number of threads explicitly requested
+                lzma_mt mt = {
+                    .flags = 0,
+                    .threads = threads,
+                    .block_size = XZ_MT_BLOCK_SIZE,
+                    .timeout = 0,
+                    .preset = CR_CW_XZ_COMPRESSION_LEVEL,
+                    .filters = NULL,
+                    .check = XZ_CHECK,
+                };
+
+                ret = lzma_stream_encoder_mt(stream, &mt);
+
+            } else if (mode == CR_CW_MODE_WRITE) {
 
 #ifdef ENABLE_THREADED_XZ_ENCODER
                 // The threaded encoder takes the options as pointer to
@@ -578,6 +1425,20 @@ cr_sopen(const char *filename,
                                             CR_CW_XZ_COMPRESSION_LEVEL,
                                             XZ_CHECK);
 
+#ifdef XZ_HAVE_DECODER_MT
+            } else if (dthreads > 1) {
+                // Blocks of multi-block files (e.g. written by the threaded
+                // encoder) are decoded in parallel, others in single thread
+                lzma_mt mt = {
+                    .flags = XZ_DECODER_FLAGS,
+                    .threads = dthreads,
+                    .timeout = 0,
+                    .memlimit_threading = XZ_MEMORY_USAGE_LIMIT,
+                    .memlimit_stop = XZ_MEMORY_USAGE_LIMIT,
+                };
+
+                ret = lzma_stream_decoder_mt(stream, &mt);
+#endif
             } else {
                 ret = lzma_auto_decoder(stream,
                                         XZ_MEMORY_USAGE_LIMIT,
@@ -695,6 +1556,23 @@ cr_sopen(const char *filename,
             }
         }
 
+        // Checksum of the compressed output (zchunk library writes
+        // the file by itself, for uncompressed files it's the same
+        // as the checksum of the content)
+        if (mode == CR_CW_MODE_WRITE
+            && stat->checksum_type != CR_CHECKSUM_UNKNOWN
+            && type != CR_CW_NO_COMPRESSION
+            && type != CR_CW_ZCK_COMPRESSION)
+        {
+            cr_file_priv(file)->out_checksum_ctx =
+                    cr_checksum_new(stat->checksum_type, &tmp_err);
+            if (tmp_err) {
+                g_propagate_error(err, tmp_err);
+                cr_close(file, NULL);
+                return NULL;
+            }
+        }
+
 #ifdef WITH_ZCHUNK
         /* Fill zchunk header_stat with header information */
         if (mode == CR_CW_MODE_READ && type == CR_CW_ZCK_COMPRESSION) {
@@ -717,6 +1595,12 @@ cr_sopen(const char *filename,
 #endif // WITH_ZCHUNK
     }
 
+    // Decompress in background (zchunk files are left out as they are
+    // also accessed by chunks)
+    if (mode == CR_CW_MODE_READ && dthreads > 0
+        && type != CR_CW_NO_COMPRESSION && type != CR_CW_ZCK_COMPRESSION)
+        cr_file_priv(file)->read_ahead = read_ahead_start(file);
+
     assert(!err || (!file && *err != NULL) || (file && *err == NULL));
 
     return file;
@@ -767,12 +1651,18 @@ cr_close(CR_FILE *cr_file, GError **err)
 {
     int ret = CRE_ERROR;
     int rc;
+    cr_FilePriv *priv = cr_file_priv(cr_file);
 
     assert(!err || *err == NULL);
 
     if (!cr_file)
         return CRE_OK;
 
+    if (priv->read_ahead) {
+        read_ahead_stop((ReadAhead *) priv->read_ahead);
+        priv->read_ahead = NULL;
+    }
+
     switch (cr_file->type) {
 
         case (CR_CW_NO_COMPRESSION): // ---------------------------------------
@@ -786,6 +1676,17 @@ cr_close(CR_FILE *cr_file, GError **err)
             break;
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+            if (priv->parallel) {
+                ret = block_writer_close((BlockWriter *) cr_file->FILE, err);
+                break;
+            }
+
+            if (cr_file->mode == CR_CW_MODE_WRITE) {
+                ret = stream_writer_close(cr_file,
+                                          (StreamWriter *) cr_file->FILE, err);
+                break;
+            }
+
             rc = gzclose((gzFile) cr_file->FILE);
             if (rc == Z_OK)
                 ret = CRE_OK;
@@ -831,7 +1732,7 @@ cr_close(CR_FILE *cr_file, GError **err)
                     if (ZSTD_isError(remaining)) {
                         g_set_error(err, ERR_DOMAIN, CRE_ZSTD, "%s", ZSTD_getErrorName(remaining));
                         break;
-                    } else if (zstd->zob.pos != fwrite(zstd->buffer, 1, zstd->zob.pos, cr_file->INNERFILE)) {
+                    } else if (!cw_fwrite(cr_file, cr_file->INNERFILE, zstd->buffer, zstd->zob.pos)) {
                         g_set_error(err, ERR_DOMAIN, CRE_IO, "cr_close ZSTD fwrite failed");
                         break;
                     }
@@ -847,11 +1748,18 @@ cr_close(CR_FILE *cr_file, GError **err)
             break;
         }
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
-            if (cr_file->mode == CR_CW_MODE_READ)
-                BZ2_bzReadClose(&rc, (BZFILE *) cr_file->FILE);
-            else
-                BZ2_bzWriteClose(&rc, (BZFILE *) cr_file->FILE,
-                                 BZ2_SKIP_FFLUSH, NULL, NULL);
+            if (priv->parallel) {
+                ret = block_writer_close((BlockWriter *) cr_file->FILE, err);
+                break;
+            }
+
+            if (cr_file->mode == CR_CW_MODE_WRITE) {
+                ret = stream_writer_close(cr_file,
+                                          (StreamWriter *) cr_file->FILE, err);
+                break;
+            }
+
+            BZ2_bzReadClose(&rc, (BZFILE *) cr_file->FILE);
 
             fclose(cr_file->INNERFILE);
 
@@ -927,7 +1835,7 @@ cr_close(CR_FILE *cr_file, GError **err)
                     }
 
                     size_t olen = XZ_BUFFER_SIZE - stream->avail_out;
-                    if (fwrite(xz_file->buffer, 1, olen, xz_file->file) != olen) {
+                    if (!cw_fwrite(cr_file, xz_file->file, xz_file->buffer, olen)) {
                         // Error while writing
                         ret = CRE_XZ;
                         g_set_error(err, ERR_DOMAIN, CRE_XZ,
@@ -1009,8 +1917,31 @@ cr_close(CR_FILE *cr_file, GError **err)
                                                         NULL);
         else
             cr_file->stat->checksum = NULL;
+
+        // Stats of the compressed file
+        cr_contentstat_set_compressed(cr_file->stat, 0, NULL);
+        if (ret == CRE_OK && cr_file->mode == CR_CW_MODE_WRITE) {
+            if (cr_file->type == CR_CW_NO_COMPRESSION) {
+                cr_contentstat_set_compressed(cr_file->stat,
+                                              cr_file->stat->size,
+                                              cr_file->stat->checksum);
+            } else if (priv->out_checksum_ctx) {
+                gchar *checksum = cr_checksum_final(priv->out_checksum_ctx,
+                                                    NULL);
+                priv->out_checksum_ctx = NULL;
+                cr_contentstat_set_compressed(cr_file->stat, priv->out_size,
+                                              checksum);
+                g_free(checksum);
+            }
+        }
     }
 
+    if (priv->out_checksum_ctx)  // Not used - just free the context
+        g_free(cr_checksum_final(priv->out_checksum_ctx, NULL));
+
+    header_alts_finish(cr_file, cr_file->stat
+                       && cr_contentstat_get_compressed(cr_file->stat, NULL));
+
     g_free(cr_file);
 
     assert(!err || (ret != CRE_OK && *err != NULL)
@@ -1021,22 +1952,15 @@ cr_close(CR_FILE *cr_file, GError **err)
 
 
 
-int
-cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
+/** Read and decompress up to len bytes from the file.
+ * This is the synchronous part of cr_read() without content stats.
+ */
+static int
+cw_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
 {
     int bzerror;
     int ret = CR_CW_ERR;
 
-    assert(cr_file);
-    assert(buffer);
-    assert(!err || *err == NULL);
-
-    if (cr_file->mode != CR_CW_MODE_READ) {
-        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
-                    "File is not opened in read mode");
-        return CR_CW_ERR;
-    }
-
     switch (cr_file->type) {
 
         case (CR_CW_NO_COMPRESSION): // ---------------------------------------
@@ -1095,6 +2019,45 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
                 // Next read after BZ_STREAM_END (EOF)
                 return 0;
 
+            while (bzerror == BZ_STREAM_END) {
+                // Multi-stream file (e.g. from the block-parallel writer)
+                // - continue with the next stream if there is one
+                char unused[BZ_MAX_UNUSED];
+                void *unused_ptr;
+                int nunused, c;
+
+                BZ2_bzReadGetUnused(&bzerror, (BZFILE *) cr_file->FILE,
+                                    &unused_ptr, &nunused);
+                if (bzerror != BZ_OK)
+                    break;
+                if (nunused == 0) {
+                    c = getc((FILE *) cr_file->INNERFILE);
+                    if (c == EOF) {
+                        bzerror = BZ_STREAM_END;
+                        break;
+                    }
+                    ungetc(c, (FILE *) cr_file->INNERFILE);
+                }
+                memcpy(unused, unused_ptr, nunused);
+
+                BZ2_bzReadClose(&bzerror, (BZFILE *) cr_file->FILE);
+                cr_file->FILE = (void *) BZ2_bzReadOpen(&bzerror,
+                                                  cr_file->INNERFILE,
+                                                  BZ2_VERBOSITY,
+                                                  BZ2_USE_LESS_MEMORY,
+                                                  unused, nunused);
+                if (bzerror != BZ_OK)
+                    break;
+                if (ret > 0) {
+                    // Return what we have, the next stream is read by
+                    // the next call
+                    bzerror = BZ_OK;
+                    break;
+                }
+                ret = BZ2_bzRead(&bzerror, (BZFILE *) cr_file->FILE,
+                                 buffer, len);
+            }
+
             if (bzerror != BZ_OK && bzerror != BZ_STREAM_END) {
                 const char *err_msg;
                 ret = CR_CW_ERR;
@@ -1252,6 +2215,30 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
             break;
     }
 
+    return ret;
+}
+
+int
+cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
+{
+    int ret;
+
+    assert(cr_file);
+    assert(buffer);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_READ) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in read mode");
+        return CR_CW_ERR;
+    }
+
+    if (cr_file_priv(cr_file)->read_ahead)
+        ret = read_ahead_read((ReadAhead *) cr_file_priv(cr_file)->read_ahead,
+                              buffer, len, err);
+    else
+        ret = cw_read(cr_file, buffer, len, err);
+
     assert(!err || (ret == CR_CW_ERR && *err != NULL)
            || (ret != CR_CW_ERR && *err == NULL));
 
@@ -1275,7 +2262,6 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
 int
 cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
 {
-    int bzerror;
     int ret = CR_CW_ERR;
 
     assert(cr_file);
@@ -1299,6 +2285,7 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
             }
         }
     }
+    header_alts_update(cr_file_priv(cr_file)->header_alts, FALSE, buffer, len);
 
     switch (cr_file->type) {
 
@@ -1316,11 +2303,15 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
                 break;
             }
 
-            if ((ret = gzwrite((gzFile) cr_file->FILE, buffer, len)) == 0) {
-                ret = CR_CW_ERR;
-                g_set_error(err, ERR_DOMAIN, CRE_GZ,
-                    "gzwrite(): %s", cr_gz_strerror((gzFile) cr_file->FILE));
+            if (cr_file_priv(cr_file)->parallel) {
+                ret = block_writer_write((BlockWriter *) cr_file->FILE,
+                                         buffer, len, err);
+                break;
             }
+
+            if (stream_writer_code(cr_file, (StreamWriter *) cr_file->FILE,
+                                   buffer, len, FALSE, err))
+                ret = len;
             break;
 
         case (CR_CW_ZSTD_COMPRESSION): { // ---------------------------------------
@@ -1341,8 +2332,7 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
 
                 // Write compressed buffer
                 if (zstd->zob.pos > 0) {
-                    size_t nw = fwrite(zstd->buffer, 1, zstd->zob.pos, cr_file->INNERFILE);
-                    if (nw != zstd->zob.pos) {
+                    if (!cw_fwrite(cr_file, cr_file->INNERFILE, zstd->buffer, zstd->zob.pos)) {
                         g_set_error(err, ERR_DOMAIN, CRE_IO, "cr_write zstd write failed");
                         break;
                     }
@@ -1358,32 +2348,15 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
         }
 
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
-            BZ2_bzWrite(&bzerror, (BZFILE *) cr_file->FILE, (void *) buffer, len);
-            if (bzerror == BZ_OK) {
-                ret = len;
-            } else {
-                const char *err_msg;
-                ret = CR_CW_ERR;
-
-                switch (bzerror) {
-                    case BZ_PARAM_ERROR:
-                        // This should not happend
-                        err_msg = "bad function params!";
-                        break;
-                    case BZ_SEQUENCE_ERROR:
-                        // This should not happend
-                        err_msg = "file was opened with BZ2_bzReadOpen";
-                        break;
-                    case BZ_IO_ERROR:
-                        err_msg = "error while reading from the compressed file";
-                        break;
-                    default:
-                        err_msg = "other error";
-                }
-
-                g_set_error(err, ERR_DOMAIN, CRE_BZ2,
-                            "Bz2 error: %s", err_msg);
+            if (cr_file_priv(cr_file)->parallel) {
+                ret = block_writer_write((BlockWriter *) cr_file->FILE,
+                                         buffer, len, err);
+                break;
             }
+
+            if (stream_writer_code(cr_file, (StreamWriter *) cr_file->FILE,
+                                   buffer, len, FALSE, err))
+                ret = len;
             break;
 
         case (CR_CW_XZ_COMPRESSION): { // -------------------------------------
@@ -1435,7 +2408,7 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
                 }
 
                 size_t out_len = XZ_BUFFER_SIZE - stream->avail_out;
-                if ((fwrite(xz_file->buffer, 1, out_len, xz_file->file)) != out_len) {
+                if (!cw_fwrite(cr_file, xz_file->file, xz_file->buffer, out_len)) {
                     ret = CR_CW_ERR;
                     g_set_error(err, ERR_DOMAIN, CRE_XZ,
                                 "XZ: fwrite(): %s", g_strerror(errno));
@@ -1627,6 +2600,272 @@ cr_set_autochunk(CR_FILE *cr_file, gboolean auto_chunk, GError **err)
     return ret;
 }
 
+/*
+ * Header members
+ *
+ * A header member is a standalone gzip member (a single stored deflate
+ * block) or zstd frame (a single raw block) at the very beginning of
+ * the file. It is padded up to a given capacity in the container (an extra
+ * field of the gzip header, a skippable frame after the zstd frame), so its
+ * size depends only on the capacity and it can be replaced by different
+ * data of up to the same length in an already closed file without touching
+ * the rest of it. The padding is not a part of the decompressed content.
+ */
+
+#define HEADER_MEMBER_GZ_OVERHEAD       (10 + 2 + 4 + 5 + 8)
+#define HEADER_MEMBER_ZSTD_OVERHEAD     (4 + 1 + 4 + 3 + 8)
+
+static inline void
+put_le16(unsigned char *p, guint32 val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+}
+
+static inline void
+put_le32(unsigned char *p, guint32 val)
+{
+    put_le16(p, val);
+    put_le16(p + 2, val >> 16);
+}
+
+static unsigned char *
+header_member_encode(cr_CompressionType type,
+                     const void *buffer,
+                     unsigned int len,
+                     unsigned int capacity,
+                     size_t *member_len)
+{
+    unsigned char *out, *p;
+    unsigned int pad = capacity - len;
+
+    assert(len <= capacity);
+
+    switch (type) {
+        case (CR_CW_GZ_COMPRESSION): { // -------------------------------------
+            static const unsigned char gz_header[10] = {
+                0x1f, 0x8b,             // Magic
+                0x08,                   // Deflate
+                0x04,                   // FEXTRA
+                0x00, 0x00, 0x00, 0x00, // No mtime
+                0x04,                   // Fastest algorithm
+                0x03 };                 // Unix
+            *member_len = capacity + HEADER_MEMBER_GZ_OVERHEAD;
+            p = out = g_malloc0(*member_len);
+            memcpy(p, gz_header, sizeof(gz_header));
+            p += sizeof(gz_header);
+            // Extra field with a single zero-filled subfield as the padding
+            put_le16(p, 4 + pad);
+            p[2] = 'C';
+            p[3] = 'R';
+            put_le16(p + 4, pad);
+            p += 6 + pad;
+            *p++ = 0x01;                // Final stored block
+            put_le16(p, len);
+            put_le16(p + 2, ~len);
+            p += 4;
+            memcpy(p, buffer, len);
+            p += len;
+            put_le32(p, crc32(crc32(0L, Z_NULL, 0), buffer, len));
+            put_le32(p + 4, len);
+            return out;
+        }
+
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            *member_len = capacity + HEADER_MEMBER_ZSTD_OVERHEAD;
+            p = out = g_malloc0(*member_len);
+            put_le32(p, ZSTD_MAGICNUMBER);
+            p += 4;
+            // Single segment frame with 4 bytes of content size
+            *p++ = 0xa0;
+            put_le32(p, len);
+            p += 4;
+            // The last block, raw
+            guint32 block_header = 1 | (len << 3);
+            *p++ = block_header & 0xff;
+            *p++ = (block_header >> 8) & 0xff;
+            *p++ = (block_header >> 16) & 0xff;
+            memcpy(p, buffer, len);
+            p += len;
+            // Zero-filled skippable frame as the padding
+            put_le32(p, ZSTD_MAGIC_SKIPPABLE_START);
+            put_le32(p + 4, pad);
+            return out;
+        }
+
+        default:
+            return NULL;
+    }
+}
+
+gboolean
+cr_header_member_supported(cr_CompressionType type)
+{
+    switch (type) {
+        case (CR_CW_GZ_COMPRESSION):
+        case (CR_CW_ZSTD_COMPRESSION):
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+int
+cr_write_header_member(CR_FILE *cr_file,
+                       const void *buffer,
+                       unsigned int len,
+                       const cr_HeaderMemberAlt *alts,
+                       unsigned int n_alts,
+                       GError **err)
+{
+    FILE *f;
+    unsigned char *member;
+    size_t member_len;
+    unsigned int capacity = len;
+
+    assert(cr_file);
+    assert(buffer || len == 0);
+    assert(alts || n_alts == 0);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_WRITE) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in write mode");
+        return CR_CW_ERR;
+    }
+
+    if (!cr_header_member_supported(cr_file->type)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Header member is not supported by the compression type");
+        return CR_CW_ERR;
+    }
+
+    for (unsigned int x = 0; x < n_alts; x++)
+        capacity = MAX(capacity, alts[x].len);
+
+    if (capacity > CR_CW_HEADER_MEMBER_MAX_SIZE) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Header member is too big (%u bytes)", capacity);
+        return CR_CW_ERR;
+    }
+
+    if (cr_file_priv(cr_file)->parallel)
+        f = ((BlockWriter *) cr_file->FILE)->file;
+    else if (cr_file->type == CR_CW_GZ_COMPRESSION)
+        f = ((StreamWriter *) cr_file->FILE)->file;
+    else
+        f = (FILE *) cr_file->INNERFILE;
+
+    member = header_member_encode(cr_file->type, buffer, len, capacity,
+                                  &member_len);
+
+    if (!cw_fwrite(cr_file, f, member, member_len)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot write header member: %s", g_strerror(errno));
+        g_free(member);
+        return CR_CW_ERR;
+    }
+
+    g_free(member);
+
+    if (cr_file_priv(cr_file)->parallel)
+        // The header member alone makes a valid gzip file
+        ((BlockWriter *) cr_file->FILE)->empty = FALSE;
+
+    if (cr_file->stat) {
+        cr_file->stat->size += len;
+        if (cr_file->checksum_ctx) {
+            GError *tmp_err = NULL;
+            cr_checksum_update(cr_file->checksum_ctx, buffer, len, &tmp_err);
+            if (tmp_err) {
+                g_propagate_prefixed_error(err, tmp_err,
+                        "Error while checksum calculation: ");
+                return CR_CW_ERR;
+            }
+        }
+    }
+
+    // Start the stats of the alternatives from their own header members.
+    // The rest of the file is counted by cr_write() and cw_fwrite().
+    if (!cr_file->checksum_ctx || !cr_file_priv(cr_file)->out_checksum_ctx)
+        return len;
+
+    for (unsigned int x = 0; x < n_alts; x++) {
+        HeaderMemberAlt *alt = g_new0(HeaderMemberAlt, 1);
+        alt->stat = alts[x].stat;
+        alt->size_diff = (gint64) alts[x].len - len;
+        alt->checksum_ctx = cr_checksum_new(cr_file->stat->checksum_type, NULL);
+        alt->out_checksum_ctx = cr_checksum_new(cr_file->stat->checksum_type,
+                                                NULL);
+        member = header_member_encode(cr_file->type, alts[x].buffer,
+                                      alts[x].len, capacity, &member_len);
+        cr_checksum_update(alt->checksum_ctx, alts[x].buffer, alts[x].len,
+                           NULL);
+        cr_checksum_update(alt->out_checksum_ctx, member, member_len, NULL);
+        g_free(member);
+        cr_file_priv(cr_file)->header_alts =
+                g_slist_prepend(cr_file_priv(cr_file)->header_alts, alt);
+    }
+
+    return len;
+}
+
+int
+cr_rewrite_header_member(const char *filename,
+                         cr_CompressionType type,
+                         const void *buffer,
+                         unsigned int len,
+                         unsigned int capacity,
+                         GError **err)
+{
+    FILE *f;
+    unsigned char *member;
+    size_t member_len;
+    int ret = CRE_OK;
+
+    assert(filename);
+    assert(buffer || len == 0);
+    assert(!err || *err == NULL);
+
+    if (!cr_header_member_supported(type)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Header member is not supported by the compression type");
+        return CRE_BADARG;
+    }
+
+    if (len > capacity) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Header member data (%u bytes) don't fit into "
+                    "the header member (%u bytes)", len, capacity);
+        return CRE_BADARG;
+    }
+
+    f = fopen(filename, "r+b");
+    if (!f) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", filename, g_strerror(errno));
+        return CRE_IO;
+    }
+
+    member = header_member_encode(type, buffer, len, capacity, &member_len);
+
+    if (fwrite(member, 1, member_len, f) != member_len) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot rewrite header of %s: %s",
+                    filename, g_strerror(errno));
+        ret = CRE_IO;
+    }
+
+    if (fclose(f) != 0 && ret == CRE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fclose(): %s", g_strerror(errno));
+        ret = CRE_IO;
+    }
+
+    g_free(member);
+    return ret;
+}
+
 int
 cr_printf(GError **err, CR_FILE *cr_file, const char *format, ...)
 {
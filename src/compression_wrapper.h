@@ -84,6 +84,28 @@ cr_ContentStat *cr_contentstat_new(cr_ChecksumType type, GError **err);
  */
 void cr_contentstat_free(cr_ContentStat *cstat, GError **err);
 
+/** Get the stats of the compressed file computed by cr_close() for a file
+ * written with the cr_ContentStat (see cr_sopen()). Only objects created
+ * by cr_contentstat_new() carry them.
+ * @param cstat     cr_ContentStat object
+ * @param size      size of the compressed file (output) or NULL
+ * @return          checksum (checksum_type) of the compressed file
+ *                  or NULL if it wasn't computed. Owned by the cstat.
+ */
+const char *cr_contentstat_get_compressed(cr_ContentStat *cstat,
+                                          gint64 *size);
+
+/** Set the stats of the compressed file. Ignored for cr_ContentStat objects
+ * which weren't created by cr_contentstat_new().
+ * @param cstat     cr_ContentStat object
+ * @param size      size of the compressed file
+ * @param checksum  checksum (checksum_type) of the compressed file
+ *                  or NULL (copied)
+ */
+void cr_contentstat_set_compressed(cr_ContentStat *cstat,
+                                   gint64 size,
+                                   const char *checksum);
+
 /** Structure represents a compressed file.
  */
 typedef struct {
@@ -116,6 +138,45 @@ cr_CompressionType cr_detect_compression(const char* filename, GError **err);
  */
 cr_CompressionType cr_compression_type(const char *name);
 
+/** Set number of encoder threads used by every subsequent cr_sopen()
+ * in CR_CW_MODE_WRITE. Zstd files are then compressed by
+ * the ZSTD_c_nbWorkers workers and xz files by the lzma_stream_encoder_mt().
+ * Gzip and bzip2 files are cut into blocks compressed in parallel
+ * and written as multi-member gzip and multi-stream bzip2 files.
+ * Other compression types ignore this value.
+ * The compressed output for a given compression type doesn't depend on
+ * the exact number of threads (as long as it is > 1), so repeated runs
+ * with different settings produce identical files. Stats of the open
+ * content (cr_ContentStat) are always computed by the writing thread
+ * from uncompressed data and are not affected by this setting.
+ * @param threads       Number of threads. 0 or 1 means single-threaded
+ *                      (default) compression.
+ */
+void cr_set_compression_threads(int threads);
+
+/** Get number of encoder threads set by cr_set_compression_threads().
+ * @return              Number of threads (0 = single-threaded)
+ */
+int cr_get_compression_threads(void);
+
+/** Set number of decoder threads used by every subsequent cr_sopen()
+ * in CR_CW_MODE_READ. Gzip, bzip2, xz and zstd files are then
+ * decompressed ahead by a background thread into a ring of large buffers
+ * and cr_read() only copies the already decompressed data. Xz files are
+ * decoded by the lzma_stream_decoder_mt() if liblzma supports it and
+ * more than one thread is set (only multi-block files are decoded in
+ * parallel).
+ * @param threads       Number of threads. 1 means the read-ahead thread
+ *                      only, 0 means the data are decompressed by
+ *                      cr_read() itself (default).
+ */
+void cr_set_decompression_threads(int threads);
+
+/** Get number of decoder threads set by cr_set_decompression_threads().
+ * @return              Number of threads (0 = no read-ahead)
+ */
+int cr_get_decompression_threads(void);
+
 /** Open/Create the specified file.
  * @param FILENAME      filename
  * @param MODE          open mode
@@ -128,7 +189,12 @@ cr_CompressionType cr_compression_type(const char *name);
 
 /** Open/Create the specified file. If opened for writting, you can pass
  * a cr_ContentStat object and after cr_close() get stats of
- * an open content (stats of uncompressed content).
+ * an open content (stats of uncompressed content) and also the size and
+ * checksum of the compressed file itself (see
+ * cr_contentstat_get_compressed(), not available for zchunk files), so
+ * the file doesn't have to be read again to fill a repomd record.
+ * Files opened for writing use the number of encoder threads set by
+ * cr_set_compression_threads().
  * @param filename      filename
  * @param mode          open mode
  * @param comtype       type of compression
@@ -196,6 +262,71 @@ int cr_end_chunk(CR_FILE *cr_file, GError **err);
  */
 int cr_set_autochunk(CR_FILE *cr_file, gboolean auto_chunk, GError **err);
 
+/** Max length of data in a header member */
+#define CR_CW_HEADER_MEMBER_MAX_SIZE    65535
+
+/** Check if the compression type supports header members.
+ * Header member is a standalone gzip member or zstd frame at the beginning
+ * of the file, padded in the container (not in the content) up to a given
+ * capacity, so its size depends only on the capacity.
+ * @param type          Compression type
+ * @return              TRUE if supported
+ */
+gboolean cr_header_member_supported(cr_CompressionType type);
+
+/** Alternative data of a header member.
+ */
+typedef struct {
+    const void      *buffer;    /*!< Alternative data */
+    unsigned int    len;        /*!< Number of bytes */
+    cr_ContentStat  *stat;      /*!< Stats of the file as if its header
+                                     member contained the alternative data.
+                                     Filled by cr_close() when the stats
+                                     of the file are checksummed. */
+} cr_HeaderMemberAlt;
+
+/** Write data as a header member. Must be called before anything else
+ * is written to the file. The data are counted into the content stat.
+ * The capacity of the member is the largest of the lengths of the data
+ * and of the alternatives. For every alternative, the stats of the file
+ * with the alternative data in the header member are computed along
+ * with the real stats, so the header member can be replaced by
+ * cr_rewrite_header_member() without reading the file again.
+ * @param cr_file       CR_FILE pointer
+ * @param buffer        source buffer
+ * @param len           number of bytes
+ * @param alts          alternative data or NULL
+ * @param n_alts        number of alternatives
+ * @param err           GError **
+ * @return              number of uncompressed bytes written or CR_CW_ERR
+ */
+int cr_write_header_member(CR_FILE *cr_file,
+                           const void *buffer,
+                           unsigned int len,
+                           const cr_HeaderMemberAlt *alts,
+                           unsigned int n_alts,
+                           GError **err);
+
+/** Replace the header member of an already closed file written
+ * by cr_write_header_member() with new data that fit into it.
+ * The rest of the file is not touched. Note: The content stat of the file
+ * is not updated (see cr_HeaderMemberAlt).
+ * @param filename      Filename
+ * @param type          Compression type of the file
+ * @param buffer        New data of the header member
+ * @param len           number of bytes
+ * @param capacity      capacity of the header member (the length of
+ *                      the longest data passed to cr_write_header_member())
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_rewrite_header_member(const char *filename,
+                             cr_CompressionType type,
+                             const void *buffer,
+                             unsigned int len,
+                             unsigned int capacity,
+                             GError **err);
+
 /** Get specific zchunks data indentified by index
  * @param cr_file       CR_FILE pointer
  * @param zchunk_index  Index of wanted zchunk
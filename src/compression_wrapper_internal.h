@@ -0,0 +1,61 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_COMPRESSION_WRAPPER_INTERNAL_H__
+#define __C_CREATEREPOLIB_COMPRESSION_WRAPPER_INTERNAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "checksum.h"
+#include "compression_wrapper.h"
+
+/** State of a CR_FILE private to the library. Every CR_FILE is allocated
+ * by cr_sopen() as the first member of this structure, so the public
+ * CR_FILE keeps its size.
+ */
+typedef struct {
+    CR_FILE             file;           /*!< Public part */
+    gboolean            parallel;       /*!< FILE is a block-parallel
+                                             gz/bz2 writer */
+    cr_ChecksumCtx      *out_checksum_ctx; /*!< Checksum context of
+                                             the compressed output */
+    gint64              out_size;       /*!< Size of the compressed output */
+    void                *read_ahead;    /*!< Background decompression
+                                             or NULL */
+    GSList              *header_alts;   /*!< Stats being computed for
+                                             alternative header members */
+} cr_FilePriv;
+
+/** Get the private state of a CR_FILE.
+ * @param cr_file       CR_FILE opened by cr_sopen()
+ * @return              private state
+ */
+static inline cr_FilePriv *
+cr_file_priv(CR_FILE *cr_file)
+{
+    return (cr_FilePriv *) cr_file;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_COMPRESSION_WRAPPER_INTERNAL_H__ */
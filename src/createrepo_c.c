@@ -36,6 +36,7 @@
 #include "deltarpms.h"
 #include "dumper_thread.h"
 #include "checksum.h"
+#include "checksum_cache.h"
 #include "cleanup.h"
 #include "error.h"
 #include "helpers.h"
@@ -52,6 +53,7 @@
 #include "version.h"
 #include "xml_dump.h"
 #include "xml_file.h"
+#include "xml_parser_internal.h"
 
 #ifdef WITH_LIBMODULEMD
 #include <modulemd.h>
@@ -130,6 +132,170 @@ task_cmp(gconstpointer a_p, gconstpointer b_p)
 }
 
 
+/** Shared state of the parallel directory walk.
+ */
+struct DirWalk {
+    size_t in_dir_len;              // Length of the input dir path
+    struct CmdOptions *cmd_options; // Options (excludes, skip_symlinks, ...)
+    GMutex mutex;                   // Guards everything below
+    GCond cond;                     // New directory queued or walk finished
+    GQueue *dirs;                   // Directories waiting for a scan
+    int busy;                       // Number of directories being scanned
+    GArray *tasks;                  // Found packages (struct PoolTask *)
+    GSList *modulemd;               // Found module metadata files
+};
+
+/** Scan a single directory. Packages are added into the tasks array,
+ * found subdirectories into the subdirs queue.
+ */
+static void
+dir_walk_scan(struct DirWalk *walk,
+              const char *dirname,
+              GPtrArray *tasks,
+              GQueue *subdirs,
+              GSList **modulemd)
+{
+    struct CmdOptions *cmd_options = walk->cmd_options;
+    struct dirent *entry;
+    DIR *dirp;
+
+    dirp = opendir(dirname);
+    if (!dirp) {
+        g_warning("Cannot open directory: %s", dirname);
+        return;
+    }
+
+    while ((entry = readdir(dirp))) {
+        const gchar *filename = entry->d_name;
+
+        if (!strcmp(filename, ".") || !strcmp(filename, ".."))
+            continue;
+
+        if (!allowed_file(filename, cmd_options->exclude_masks)) {
+            continue;
+        }
+
+        gchar *full_path = g_strconcat(dirname, "/", filename, NULL);
+
+        // d_type saves a stat() per entry (expensive on network filesystems),
+        // symlinks and filesystems without d_type fall back to the stat()
+        gboolean is_regular = entry->d_type == DT_REG;
+        gboolean is_dir = entry->d_type == DT_DIR;
+        gboolean is_symlink = FALSE;
+        if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+            is_regular = g_file_test(full_path, G_FILE_TEST_IS_REGULAR);
+            is_dir = !is_regular && g_file_test(full_path, G_FILE_TEST_IS_DIR);
+            is_symlink = entry->d_type == DT_LNK
+                         || g_file_test(full_path, G_FILE_TEST_IS_SYMLINK);
+        }
+
+        if (!is_regular) {
+            if (is_dir) {
+                // Directory
+                g_queue_push_tail(subdirs, full_path);
+                g_debug("Dir to scan: %s", full_path);
+                continue;
+            }
+            g_free(full_path);
+            continue;
+        }
+
+        // Skip symbolic links if --skip-symlinks arg is used
+        if (cmd_options->skip_symlinks && is_symlink) {
+            g_debug("Skipped symlink: %s", full_path);
+            g_free(full_path);
+            continue;
+        }
+
+        if (allowed_modulemd_module_metadata_file(full_path)) {
+#ifdef WITH_LIBMODULEMD
+            *modulemd = g_slist_prepend(*modulemd, (gpointer) full_path);
+#else
+            g_warning("createrepo_c not compiled with libmodulemd support, "
+                      "ignoring found module metadata: %s", full_path);
+            g_free(full_path);
+#endif /* WITH_LIBMODULEMD */
+            continue;
+        }
+
+        // Non .rpm files are ignored
+        if (!g_str_has_suffix (filename, ".rpm")) {
+            g_free(full_path);
+            continue;
+        }
+
+        // Check filename against exclude glob masks
+        const gchar *repo_relative_path = filename;
+        if (walk->in_dir_len < strlen(full_path))
+            // This probably should be always true
+            repo_relative_path = full_path + walk->in_dir_len;
+
+        if (allowed_file(repo_relative_path, cmd_options->exclude_masks)) {
+            // FINALLY! Add file into pool
+            g_debug("Adding pkg: %s", full_path);
+            struct PoolTask *task = g_malloc(sizeof(struct PoolTask));
+            task->full_path = full_path;
+            task->filename = g_strdup(filename);
+            task->path = g_strdup(dirname);
+            // TODO: One common path for all tasks with the same path?
+            g_ptr_array_add(tasks, task);
+        } else {
+            g_free(full_path);
+        }
+    }
+
+    closedir(dirp);
+}
+
+/** Thread of the parallel directory walk.
+ * Takes directories from the shared queue until all of them are scanned
+ * and no other thread can add a new one.
+ */
+static gpointer
+dir_walk_thread(gpointer data)
+{
+    struct DirWalk *walk = data;
+    GPtrArray *tasks = g_ptr_array_new();
+    GQueue subdirs = G_QUEUE_INIT;
+    GSList *modulemd = NULL;
+
+    g_mutex_lock(&walk->mutex);
+    while (TRUE) {
+        gchar *dirname = g_queue_pop_head(walk->dirs);
+        if (!dirname) {
+            if (walk->busy == 0)
+                break;  // Nothing to scan and nobody can add more
+            g_cond_wait(&walk->cond, &walk->mutex);
+            continue;
+        }
+
+        walk->busy++;
+        g_mutex_unlock(&walk->mutex);
+
+        dir_walk_scan(walk, dirname, tasks, &subdirs, &modulemd);
+        g_free(dirname);
+
+        g_mutex_lock(&walk->mutex);
+        walk->busy--;
+        // Depth-first like the serial walk, keeps the queue short
+        gchar *subdir;
+        while ((subdir = g_queue_pop_tail(&subdirs)))
+            g_queue_push_head(walk->dirs, subdir);
+        if (!g_queue_is_empty(walk->dirs) || walk->busy == 0)
+            g_cond_broadcast(&walk->cond);
+    }
+
+    // Merge the results, their order is fixed later by sorting
+    for (guint i = 0; i < tasks->len; i++)
+        g_array_append_val(walk->tasks, g_ptr_array_index(tasks, i));
+    walk->modulemd = g_slist_concat(modulemd, walk->modulemd);
+    g_mutex_unlock(&walk->mutex);
+
+    g_ptr_array_free(tasks, TRUE);
+    return NULL;
+}
+
+
 /** Recursively walkt throught the input directory and add push the found
  * rpms to the thread pool (create a PoolTask and push it to the pool).
  * If the filelists is supplied then no recursive walk is done and only
@@ -139,6 +305,8 @@ task_cmp(gconstpointer a_p, gconstpointer b_p)
  * the exclude masks, etc.).
  *
  * @param pool              GThreadPool pool
+ * @param io_pool           GThreadPool of the I/O stage (NULL if not used),
+ *                          it gets the very same tasks as the pool
  * @param in_dir            Directory to scan
  * @param cmd_options       Options specified on command line
  * @param current_pkglist   Pointer to a list where basenames of files that
@@ -147,6 +315,7 @@ task_cmp(gconstpointer a_p, gconstpointer b_p)
  */
 static long
 fill_pool(GThreadPool *pool,
+          GThreadPool *io_pool,
           gchar *in_dir,
           struct CmdOptions *cmd_options,
           GSList **current_pkglist,
@@ -155,6 +324,7 @@ fill_pool(GThreadPool *pool,
 {
     GArray *package_tasks = g_array_new(FALSE, FALSE, sizeof(struct PoolTask *));
     struct PoolTask *task;
+    gboolean walked = FALSE;
 
     if ( ! cmd_options->split ) {
         media_id = 0;
@@ -168,103 +338,39 @@ fill_pool(GThreadPool *pool,
         //  --> do dir walk
 
         g_message("Directory walk started");
-
-        size_t in_dir_len = strlen(in_dir);
-        GStringChunk *sub_dirs_chunk = g_string_chunk_new(1024);
-        GQueue *sub_dirs = g_queue_new();
-        gchar *input_dir_stripped;
-
-        input_dir_stripped = g_string_chunk_insert_len(sub_dirs_chunk,
-                                                       in_dir,
-                                                       in_dir_len-1);
-        g_queue_push_head(sub_dirs, input_dir_stripped);
-
-        char *dirname;
-        while ((dirname = g_queue_pop_head(sub_dirs))) {
-            // Open dir
-            GDir *dirp;
-            dirp = g_dir_open (dirname, 0, NULL);
-            if (!dirp) {
-                g_warning("Cannot open directory: %s", dirname);
-                continue;
-            }
-
-            const gchar *filename;
-            while ((filename = g_dir_read_name(dirp))) {
-                if (!allowed_file(filename, cmd_options->exclude_masks)) {
-                    continue;
-                }
-
-                gchar *full_path = g_strconcat(dirname, "/", filename, NULL);
-
-                if (!g_file_test(full_path, G_FILE_TEST_IS_REGULAR)) {
-                    if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
-                        // Directory
-                        gchar *sub_dir_in_chunk;
-                        sub_dir_in_chunk = g_string_chunk_insert(sub_dirs_chunk,
-                                                                 full_path);
-                        g_queue_push_head(sub_dirs, sub_dir_in_chunk);
-                        g_debug("Dir to scan: %s", sub_dir_in_chunk);
-                    }
-                    g_free(full_path);
-                    continue;
-                }
-
-                // Skip symbolic links if --skip-symlinks arg is used
-                if (cmd_options->skip_symlinks
-                    && g_file_test(full_path, G_FILE_TEST_IS_SYMLINK))
-                {
-                    g_debug("Skipped symlink: %s", full_path);
-                    g_free(full_path);
-                    continue;
-                }
-
-                if (allowed_modulemd_module_metadata_file(full_path)) {
-#ifdef WITH_LIBMODULEMD
-                    cmd_options->modulemd_metadata = g_slist_prepend(
-                        cmd_options->modulemd_metadata,
-                        (gpointer) full_path);
-#else
-                    g_warning("createrepo_c not compiled with libmodulemd support, "
-                              "ignoring found module metadata: %s", full_path);
-                    g_free(full_path);
-#endif /* WITH_LIBMODULEMD */
-                    continue;
-                }
-
-                // Non .rpm files are ignored
-                if (!g_str_has_suffix (filename, ".rpm")) {
-                    g_free(full_path);
-                    continue;
-                }
-
-                // Check filename against exclude glob masks
-                const gchar *repo_relative_path = filename;
-                if (in_dir_len < strlen(full_path))
-                    // This probably should be always true
-                    repo_relative_path = full_path + in_dir_len;
-
-                if (allowed_file(repo_relative_path, cmd_options->exclude_masks)) {
-                    // FINALLY! Add file into pool
-                    g_debug("Adding pkg: %s", full_path);
-                    task = g_malloc(sizeof(struct PoolTask));
-                    task->full_path = full_path;
-                    task->filename = g_strdup(filename);
-                    task->path = g_strdup(dirname);
-                    *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
-                    // TODO: One common path for all tasks with the same path?
-                    g_array_append_val(package_tasks, task);
-                } else {
-                    g_free(full_path);
-                }
-            }
-
-            // Cleanup
-            g_dir_close (dirp);
-        }
-
-        g_string_chunk_free (sub_dirs_chunk);
-        g_queue_free(sub_dirs);
+        walked = TRUE;
+
+        struct DirWalk walk = {0};
+        walk.in_dir_len = strlen(in_dir);
+        walk.cmd_options = cmd_options;
+        walk.dirs = g_queue_new();
+        walk.tasks = package_tasks;
+        g_mutex_init(&walk.mutex);
+        g_cond_init(&walk.cond);
+
+        // Input dir without the trailing '/'
+        g_queue_push_head(walk.dirs, g_strndup(in_dir, walk.in_dir_len-1));
+
+        // Every scanner takes directories from the shared queue and puts
+        // the found subdirectories back, so idle scanners pick up the work
+        // of the busy ones
+        int n_scanners = MAX(1, cmd_options->workers);
+        GThread **scanners = g_new0(GThread *, n_scanners);
+        for (int i = 0; i < n_scanners; i++)
+            scanners[i] = g_thread_new(NULL, dir_walk_thread, &walk);
+        for (int i = 0; i < n_scanners; i++)
+            g_thread_join(scanners[i]);
+        g_free(scanners);
+
+        // The scanners finish in random order, make the found module
+        // metadata list deterministic
+        walk.modulemd = g_slist_sort(walk.modulemd, (GCompareFunc) g_strcmp0);
+        cmd_options->modulemd_metadata = g_slist_concat(walk.modulemd,
+                                            cmd_options->modulemd_metadata);
+
+        g_queue_free(walk.dirs);
+        g_mutex_clear(&walk.mutex);
+        g_cond_clear(&walk.cond);
     } else {
         // pkglist is supplied - use only files in pkglist
 
@@ -314,13 +420,24 @@ fill_pool(GThreadPool *pool,
         }
     }
 
+    // The tasks are sorted by filename, so the position (and the ID) of
+    // a task is known only once the whole tree is scanned
     g_array_sort(package_tasks, task_cmp);
 
     // Push sorted tasks into the thread pool
     for (int i=0; i<package_tasks->len; i++) {
         task = g_array_index(package_tasks, struct PoolTask *, i);
+        if (walked)
+            *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
         task->id = *task_count;
         task->media_id = media_id;
+        task->fd = -1;
+        task->checksum = NULL;
+        task->read_done = FALSE;
+        task->old_pkg = NULL;
+        task->old_matched = FALSE;
+        if (io_pool)
+            g_thread_pool_push(io_pool, task, NULL);
         g_thread_pool_push(pool, task, NULL);
         ++*task_count;
     }
@@ -449,6 +566,7 @@ load_old_metadata(cr_Metadata **md,
                   GSList *current_pkglist,
                   struct CmdOptions *cmd_options,
                   gchar *dir,
+                  gboolean raw_only,
                   GThreadPool *pool,
                   GError *tmp_err)
 {
@@ -467,6 +585,8 @@ load_old_metadata(cr_Metadata **md,
 
     *md = cr_metadata_new(CR_HT_KEY_HREF, 1, current_pkglist);
     cr_metadata_set_dupaction(*md, CR_HT_DUPACT_REMOVEALL);
+    // Keep the original XML to reuse it for the unchanged packages
+    cr_metadata_set_raw_xml(*md, TRUE, raw_only);
 
     int ret;
 
@@ -506,6 +626,106 @@ load_old_metadata(cr_Metadata **md,
               g_hash_table_size(cr_metadata_hashtable(*md)));
 }
 
+/** Open the old metadata for streaming (--update-stream).
+ * Unlike the load_old_metadata() no package is loaded here, the packages
+ * are parsed by the pool while they are matched against the tasks.
+ */
+static cr_PkgIterator *
+open_old_metadata_stream(struct cr_MetadataLocation **md_location,
+                         gchar *dir,
+                         gboolean raw_only,
+                         GThreadPool *pool,
+                         GError *tmp_err)
+{
+    cr_PkgIterator *stream = NULL;
+
+    *md_location = cr_locate_metadata(dir, TRUE, &tmp_err);
+    if (tmp_err) {
+        if (tmp_err->domain == CRE_MODULEMD) {
+            g_thread_pool_free(pool, FALSE, FALSE);
+            g_clear_pointer(md_location, cr_metadatalocation_free);
+            g_critical("%s\n",tmp_err->message);
+            exit(tmp_err->code);
+        } else {
+            g_debug("Old metadata from default outputdir not found: %s",tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+
+    if (!*md_location || !(*md_location)->pri_xml_href)
+        return NULL;
+
+    stream = cr_PkgIterator_new((*md_location)->pri_xml_href,
+                                (*md_location)->fex_xml_href
+                                    ? (*md_location)->fex_xml_href
+                                    : (*md_location)->fil_xml_href,
+                                (*md_location)->oth_xml_href,
+                                NULL,
+                                NULL,
+                                cr_warning_cb,
+                                "Old metadata parser",
+                                &tmp_err);
+    if (!stream) {
+        g_debug("Old metadata from %s - opening failed: %s",
+                (*md_location)->original_url, tmp_err->message);
+        g_clear_error(&tmp_err);
+        return NULL;
+    }
+
+    // Keep the original XML to reuse it for the unchanged packages
+    cr_PkgIterator_keep_raw_xml(stream, raw_only);
+
+    g_message("Old metadata from %s are going to be streamed",
+              (*md_location)->original_url);
+    return stream;
+}
+
+/** Decompress the old sqlite database (--update) and attach it to the new
+ * one. The db writers then copy the rows of the unchanged packages from
+ * it instead of inserting them row by row.
+ * @param db            new database
+ * @param old_db_href   path to the old (compressed) database or NULL
+ * @param dir           directory for the decompressed database
+ * @return              path to the decompressed database (has to be removed
+ *                      once the new db is closed) or NULL if not attached
+ */
+static gchar *
+attach_old_db(cr_SqliteDb *db, const char *old_db_href, const char *dir)
+{
+    GError *tmp_err = NULL;
+    gchar *path;
+    int fd;
+
+    if (!db || !old_db_href)
+        return NULL;
+
+    path = g_build_filename(dir, "old.XXXXXX.sqlite", NULL);
+    fd = g_mkstemp(path);
+    if (fd == -1) {
+        g_warning("Cannot create %s: %s", path, g_strerror(errno));
+        g_free(path);
+        return NULL;
+    }
+    close(fd);
+
+    cr_decompress_file_with_stat(old_db_href, path,
+                                 CR_CW_AUTO_DETECT_COMPRESSION, NULL,
+                                 &tmp_err);
+    if (!tmp_err)
+        cr_db_attach_old(db, path, &tmp_err);
+    if (tmp_err) {
+        g_warning("Cannot use old sqlite db %s: %s",
+                  old_db_href, tmp_err->message);
+        g_clear_error(&tmp_err);
+        g_remove(path);
+        g_free(path);
+        return NULL;
+    }
+
+    g_debug("Old sqlite db %s attached", old_db_href);
+    return path;
+}
+
 // Sorting function for location_href strings, by length.
 // Compatible with g_array_sort()
 static int strlensort(gconstpointer a, gconstpointer b)
@@ -738,6 +958,8 @@ main(int argc, char **argv)
     cr_package_parser_init();
     cr_xml_dump_init();
     cr_xml_dump_set_parameter(CR_XML_DUMP_DO_PRETTY_PRINT, cmd_options->pretty);
+    cr_set_compression_threads(cmd_options->compress_threads);
+    cr_set_decompression_threads(cmd_options->decompress_threads);
 
     // Thread pool - Creation
     struct UserData user_data = {0};
@@ -748,6 +970,19 @@ main(int argc, char **argv)
                                           NULL);
     g_debug("Thread pool ready");
 
+    // I/O stage - Creation (started together with the pool)
+    GThreadPool *io_pool = NULL;
+    if (cmd_options->io_workers > 0)
+        io_pool = g_thread_pool_new(cr_reader_thread,
+                                    &user_data,
+                                    0,
+                                    TRUE,
+                                    NULL);
+
+    // Without the sqlite databases the files and changelogs of the reused
+    // old packages are needed only in their raw XML
+    gboolean should_create_databases = cmd_options->database || (cmd_options->compatibility && !cmd_options->no_database);
+
     long task_count = 0;
     long package_count_in_headers = 0;
     GSList *current_pkglist = NULL;
@@ -756,6 +991,10 @@ main(int argc, char **argv)
     // Load old metadata if --update
     struct cr_MetadataLocation *old_metadata_location = NULL;
     cr_Metadata *old_metadata = NULL;
+    cr_PkgIterator *old_metadata_stream = NULL;
+#ifdef WITH_LIBMODULEMD
+    ModulemdModuleIndex *old_moduleindex = NULL;
+#endif /* WITH_LIBMODULEMD */
 
     gchar *old_metadata_dir = cmd_options->outputdir ? out_dir : in_dir;
 
@@ -766,6 +1005,7 @@ main(int argc, char **argv)
                           NULL /* no filter wanted in this case */,
                           cmd_options,
                           old_metadata_dir,
+                          !should_create_databases,
                           pool,
                           tmp_err);
 
@@ -784,6 +1024,7 @@ main(int argc, char **argv)
         gchar *tmp_in_dir = cr_normalize_dir_path(argv[media_id]);
         // Thread pool - Fill with tasks
         fill_pool(pool,
+                  io_pool,
                   tmp_in_dir,
                   cmd_options,
                   &current_pkglist,
@@ -810,16 +1051,44 @@ main(int argc, char **argv)
             g_debug("Old metadata already loaded.");
         else if (!task_count)
             g_debug("No packages found - skipping metadata loading");
+        else if (cmd_options->update_stream)
+            old_metadata_stream = open_old_metadata_stream(
+                                            &old_metadata_location,
+                                            old_metadata_dir,
+                                            !should_create_databases,
+                                            pool,
+                                            tmp_err);
         else
             load_old_metadata(&old_metadata,
                               &old_metadata_location,
                               current_pkglist,
                               cmd_options,
                               old_metadata_dir,
+                              !should_create_databases,
                               pool,
                               tmp_err);
     }
 
+#ifdef WITH_LIBMODULEMD
+    // Streamed old metadata don't carry the module index, load it apart
+    if (old_metadata_stream) {
+        GSList *modules = g_slist_find_custom(
+                                old_metadata_location->additional_metadata,
+                                "modules",
+                                cr_cmp_metadatum_type);
+        if (modules) {
+            cr_Metadatum *modules_metadatum = modules->data;
+            if (cr_metadata_load_modulemd(&old_moduleindex,
+                                          modules_metadatum->name,
+                                          &tmp_err) != CRE_OK)
+            {
+                g_critical("%s\n", tmp_err->message);
+                exit(tmp_err->code);
+            }
+        }
+    }
+#endif /* WITH_LIBMODULEMD */
+
     g_slist_free(current_pkglist);
     current_pkglist = NULL;
     GSList *additional_metadata = NULL;
@@ -893,8 +1162,11 @@ main(int argc, char **argv)
 
         if (cmd_options->update && old_metadata_location && old_metadata_location->additional_metadata){
             //associate old metadata into the merger if we want to keep them (--keep-all-metadata)
-            if (cr_metadata_modulemd(old_metadata) && cmd_options->keep_all_metadata){
-                modulemd_module_index_merger_associate_index(merger, cr_metadata_modulemd(old_metadata), 0);
+            ModulemdModuleIndex *old_index = old_metadata
+                                    ? cr_metadata_modulemd(old_metadata)
+                                    : old_moduleindex;
+            if (old_index && cmd_options->keep_all_metadata){
+                modulemd_module_index_merger_associate_index(merger, old_index, 0);
                 merger_is_empty = FALSE;
                 if (tmp_err) {
                     g_critical("%s: Cannot merge old module index with new: %s", __func__, tmp_err->message);
@@ -1148,8 +1420,7 @@ main(int argc, char **argv)
     cr_SqliteDb *fil_db = NULL;
     cr_SqliteDb *fex_db = NULL;
     cr_SqliteDb *oth_db = NULL;
-
-    gboolean should_create_databases = cmd_options->database || (cmd_options->compatibility && !cmd_options->no_database);
+    gchar *old_db_paths[4] = { NULL, NULL, NULL, NULL };
 
     if (should_create_databases) {
         _cleanup_file_close_ int pri_db_fd = -1;
@@ -1242,6 +1513,31 @@ main(int argc, char **argv)
             g_clear_error(&tmp_err);
             exit(EXIT_FAILURE);
         }
+
+        // Copy the unchanged packages from the old databases
+        if (cmd_options->update && old_metadata_location) {
+            struct cr_MetadataLocation *old_db_location;
+            const gchar *old_db_dir = cmd_options->local_sqlite
+                                        ? g_get_tmp_dir() : tmp_out_repo;
+
+            old_db_location = cr_locate_metadata(old_metadata_dir, FALSE, &tmp_err);
+            g_clear_error(&tmp_err);
+            if (old_db_location) {
+                old_db_paths[0] = attach_old_db(pri_db,
+                                        old_db_location->pri_sqlite_href,
+                                        old_db_dir);
+                old_db_paths[1] = attach_old_db(fil_db,
+                                        old_db_location->fil_sqlite_href,
+                                        old_db_dir);
+                old_db_paths[2] = attach_old_db(fex_db,
+                                        old_db_location->fex_sqlite_href,
+                                        old_db_dir);
+                old_db_paths[3] = attach_old_db(oth_db,
+                                        old_db_location->oth_sqlite_href,
+                                        old_db_dir);
+                cr_metadatalocation_free(old_db_location);
+            }
+        }
     }
 
     gchar *pri_zck_filename = NULL;
@@ -1462,7 +1758,7 @@ main(int argc, char **argv)
     user_data.location_base     = cmd_options->location_base;
     user_data.checksum_type_str = cr_checksum_name_str(cmd_options->checksum_type);
     user_data.checksum_type     = cmd_options->checksum_type;
-    user_data.checksum_cachedir = cmd_options->checksum_cachedir;
+    user_data.checksum_cache    = NULL;
     user_data.skip_symlinks     = cmd_options->skip_symlinks;
     user_data.filelists_ext     = cmd_options->filelists_ext;
     user_data.repodir_name_len  = strlen(in_dir);
@@ -1470,11 +1766,29 @@ main(int argc, char **argv)
     user_data.nevra_table       = g_hash_table_new(g_str_hash, g_str_equal);
     user_data.skip_stat         = cmd_options->skip_stat;
     user_data.old_metadata      = old_metadata;
-    user_data.id_pri            = 0;
-    user_data.id_fil            = 0;
-    user_data.id_fex            = 0;
-    user_data.id_oth            = 0;
-    user_data.buffer            = g_queue_new();
+    user_data.old_md_stream     = old_metadata_stream;
+    user_data.old_md_next       = NULL;
+    user_data.old_md_href       = NULL;
+    user_data.old_md_eof        = FALSE;
+    user_data.old_md_matched    = 0;
+    user_data.write_buffer_depth = cmd_options->write_buffer_depth;
+    user_data.io_stage          = io_pool != NULL;
+    user_data.readahead         = cmd_options->readahead;
+    user_data.dump_started      = 0;
+
+    // Checksum cache (--cachedir)
+    if (cmd_options->checksum_cachedir) {
+        _cleanup_free_ gchar *cache_path = NULL;
+        cache_path = g_build_filename(cmd_options->checksum_cachedir,
+                                      CR_CHECKSUM_CACHE_FILENAME, NULL);
+        user_data.checksum_cache = cr_checksum_cache_open(cache_path,
+                                        cmd_options->cache_max_entries,
+                                        &tmp_err);
+        if (!user_data.checksum_cache) {
+            g_warning("Checksum cache cannot be used: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
 
 #ifdef CR_DELTA_RPM_SUPPORT
     user_data.deltas            = cmd_options->deltas;
@@ -1489,27 +1803,36 @@ main(int argc, char **argv)
 
     g_mutex_init(&(user_data.mutex_nevra_table));
     g_mutex_init(&(user_data.mutex_output_pkg_list));
-    g_mutex_init(&(user_data.mutex_pri));
-    g_mutex_init(&(user_data.mutex_fil));
-    g_mutex_init(&(user_data.mutex_fex));
-    g_mutex_init(&(user_data.mutex_oth));
-    g_cond_init(&(user_data.cond_pri));
-    g_cond_init(&(user_data.cond_fil));
-    g_cond_init(&(user_data.cond_fex));
-    g_cond_init(&(user_data.cond_oth));
-    g_mutex_init(&(user_data.mutex_buffer));
     g_mutex_init(&(user_data.mutex_old_md));
+    g_cond_init(&(user_data.cond_old_md_matched));
     g_mutex_init(&(user_data.mutex_deltatargetpackages));
+    g_mutex_init(&(user_data.mutex_io));
+    g_cond_init(&(user_data.cond_io_done));
+    g_cond_init(&(user_data.cond_io_window));
 
     g_debug("Thread pool user data ready");
 
+    // Start writers which write the finished packages in order
+    cr_dumper_writers_start(&user_data);
+
     // Start pool
+    if (io_pool) {
+        g_thread_pool_set_max_threads(io_pool, cmd_options->io_workers, NULL);
+        g_message("I/O stage started (with %d workers, read-ahead %d packages)",
+                  cmd_options->io_workers, cmd_options->readahead);
+    }
     g_thread_pool_set_max_threads(pool, cmd_options->workers, NULL);
     g_message("Pool started (with %d workers)", cmd_options->workers);
 
     // Wait until pool is finished
+    if (io_pool)
+        g_thread_pool_free(io_pool, FALSE, TRUE);
     g_thread_pool_free(pool, FALSE, TRUE);
 
+    // Wait until everything is written
+    if (!cmd_options->delayed_dump)
+        cr_dumper_writers_finish(&user_data);
+
     GHashTableIter iter;
     gpointer key, value;
 
@@ -1546,6 +1869,7 @@ main(int argc, char **argv)
             cr_xmlfile_set_num_of_pkgs(oth_cr_zck, package_count_in_headers, NULL);
         }
         cr_delayed_dump_run(&user_data);
+        cr_dumper_writers_finish(&user_data);
     }
 
     // Clean up nevra_table and everything it contains
@@ -1570,11 +1894,50 @@ main(int argc, char **argv)
 
     g_message("Pool finished%s", (user_data.had_errors ? " with errors" : ""));
 
+    if (old_metadata_stream) {
+        // Old packages which are not in the repo anymore are left
+        cr_package_free(user_data.old_md_next);
+        g_free(user_data.old_md_href);
+        cr_PkgIterator_free(old_metadata_stream, NULL);
+        old_metadata_stream = NULL;
+    }
+
+    if (!cr_checksum_cache_close(user_data.checksum_cache, &tmp_err)) {
+        g_warning("Cannot close checksum cache: %s", tmp_err->message);
+        g_clear_error(&tmp_err);
+    }
+    if (user_data.io_stage)
+        g_message("Max queue depths: I/O stage %ld of %ld (dumpers waited "
+                  "for %ld packages), write buffer %ld of %ld",
+                  user_data.io_queue_max, user_data.readahead,
+                  user_data.io_waits, user_data.write_buffer_max,
+                  user_data.write_buffer_depth);
+    else
+        g_message("Max queue depths: write buffer %ld of %ld",
+                  user_data.write_buffer_max, user_data.write_buffer_depth);
+
     cr_xml_dump_cleanup();
 
     if (output_pkg_list)
         fclose(output_pkg_list);
 
+    /* At the time of writing xml metadata headers we haven't yet parsed all
+     * the packages and we don't know whether there were some invalid ones,
+     * therefore we write the task count into the headers instead of the actual package count.
+     * Headers written as standalone gzip members/zstd frames are corrected
+     * in place when the files are closed.
+     */
+    gboolean xml_pkg_count_fixed = FALSE;
+    if (package_count_in_headers != user_data.package_count) {
+        long count = user_data.package_count;
+        xml_pkg_count_fixed =
+            cr_xmlfile_set_num_of_pkgs(pri_cr_file, count, NULL) == CRE_OK
+            && cr_xmlfile_set_num_of_pkgs(fil_cr_file, count, NULL) == CRE_OK
+            && (!cmd_options->filelists_ext
+                || cr_xmlfile_set_num_of_pkgs(fex_cr_file, count, NULL) == CRE_OK)
+            && cr_xmlfile_set_num_of_pkgs(oth_cr_file, count, NULL) == CRE_OK;
+    }
+
     cr_xmlfile_close(pri_cr_file, &tmp_err);
     if (!tmp_err)
         cr_xmlfile_close(fil_cr_file, &tmp_err);
@@ -1617,14 +1980,13 @@ main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    /* At the time of writing xml metadata headers we haven't yet parsed all
-     * the packages and we don't know whether there were some invalid ones,
-     * therefore we write the task count into the headers instead of the actual package count.
-     * If there actually were some invalid packages we have to correct this value
-     * that unfortunately means we have to decompress metadata files change package
-     * count value and compress them again.
+    /* Other headers (bz2, xz and zck compressed files) with the package
+     * count can't be changed in place, that unfortunately means we have to
+     * decompress metadata files change package count value and compress them again.
      */
-    if (package_count_in_headers != user_data.package_count) {
+    if (package_count_in_headers != user_data.package_count
+        && (!xml_pkg_count_fixed || cmd_options->zck_compression))
+    {
         g_message("Warning: There were some invalid packages: we have to recompress other, filelists and primary xml metadata files in order to have correct package counts");
 
         GThreadPool *rewrite_pkg_count_pool = g_thread_pool_new(cr_rewrite_pkg_count_thread,
@@ -1639,39 +2001,41 @@ main(int argc, char **argv)
         cr_CompressionTask *fex_zck_rewrite_pkg_count_task = NULL;
         cr_CompressionTask *oth_zck_rewrite_pkg_count_task = NULL;
 
-        pri_rewrite_pkg_count_task = cr_compressiontask_new(pri_xml_filename,
-                                                            NULL,
-                                                            xml_compression,
-                                                            cmd_options->repomd_checksum_type,
-                                                            NULL, FALSE, 1,
-                                                            &tmp_err);
-        g_thread_pool_push(rewrite_pkg_count_pool, pri_rewrite_pkg_count_task, NULL);
-
-        fil_rewrite_pkg_count_task = cr_compressiontask_new(fil_xml_filename,
-                                                            NULL,
-                                                            xml_compression,
-                                                            cmd_options->repomd_checksum_type,
-                                                            NULL, FALSE, 1,
-                                                            &tmp_err);
-        g_thread_pool_push(rewrite_pkg_count_pool, fil_rewrite_pkg_count_task, NULL);
+        if (!xml_pkg_count_fixed) {
+            pri_rewrite_pkg_count_task = cr_compressiontask_new(pri_xml_filename,
+                                                                NULL,
+                                                                xml_compression,
+                                                                cmd_options->repomd_checksum_type,
+                                                                NULL, FALSE, 1,
+                                                                &tmp_err);
+            g_thread_pool_push(rewrite_pkg_count_pool, pri_rewrite_pkg_count_task, NULL);
 
-        if (cmd_options->filelists_ext) {
-            fex_rewrite_pkg_count_task = cr_compressiontask_new(fex_xml_filename,
+            fil_rewrite_pkg_count_task = cr_compressiontask_new(fil_xml_filename,
                                                                 NULL,
                                                                 xml_compression,
                                                                 cmd_options->repomd_checksum_type,
                                                                 NULL, FALSE, 1,
                                                                 &tmp_err);
-            g_thread_pool_push(rewrite_pkg_count_pool, fex_rewrite_pkg_count_task, NULL);
-        }
+            g_thread_pool_push(rewrite_pkg_count_pool, fil_rewrite_pkg_count_task, NULL);
 
-        oth_rewrite_pkg_count_task = cr_compressiontask_new(oth_xml_filename,
-                                                            NULL,
-                                                            xml_compression,
-                                                            cmd_options->repomd_checksum_type,
-                                                            NULL, FALSE, 1,
-                                                            &tmp_err);
-        g_thread_pool_push(rewrite_pkg_count_pool, oth_rewrite_pkg_count_task, NULL);
+            if (cmd_options->filelists_ext) {
+                fex_rewrite_pkg_count_task = cr_compressiontask_new(fex_xml_filename,
+                                                                    NULL,
+                                                                    xml_compression,
+                                                                    cmd_options->repomd_checksum_type,
+                                                                    NULL, FALSE, 1,
+                                                                    &tmp_err);
+                g_thread_pool_push(rewrite_pkg_count_pool, fex_rewrite_pkg_count_task, NULL);
+            }
+
+            oth_rewrite_pkg_count_task = cr_compressiontask_new(oth_xml_filename,
+                                                                NULL,
+                                                                xml_compression,
+                                                                cmd_options->repomd_checksum_type,
+                                                                NULL, FALSE, 1,
+                                                                &tmp_err);
+            g_thread_pool_push(rewrite_pkg_count_pool, oth_rewrite_pkg_count_task, NULL);
+        }
 
         if (cmd_options->zck_compression) {
             pri_zck_rewrite_pkg_count_task = cr_compressiontask_new(pri_zck_filename,
@@ -1711,11 +2075,13 @@ main(int argc, char **argv)
 
         g_thread_pool_free(rewrite_pkg_count_pool, FALSE, TRUE);
 
-        error_check_and_set_content_stat(pri_rewrite_pkg_count_task, pri_xml_filename, &exit_val, &pri_stat);
-        error_check_and_set_content_stat(fil_rewrite_pkg_count_task, fil_xml_filename, &exit_val, &fil_stat);
-        if (cmd_options->filelists_ext)
-            error_check_and_set_content_stat(fex_rewrite_pkg_count_task, fex_xml_filename, &exit_val, &fex_stat);
-        error_check_and_set_content_stat(oth_rewrite_pkg_count_task, oth_xml_filename, &exit_val, &oth_stat);
+        if (!xml_pkg_count_fixed) {
+            error_check_and_set_content_stat(pri_rewrite_pkg_count_task, pri_xml_filename, &exit_val, &pri_stat);
+            error_check_and_set_content_stat(fil_rewrite_pkg_count_task, fil_xml_filename, &exit_val, &fil_stat);
+            if (cmd_options->filelists_ext)
+                error_check_and_set_content_stat(fex_rewrite_pkg_count_task, fex_xml_filename, &exit_val, &fex_stat);
+            error_check_and_set_content_stat(oth_rewrite_pkg_count_task, oth_xml_filename, &exit_val, &oth_stat);
+        }
 
         cr_compressiontask_free(pri_rewrite_pkg_count_task, NULL);
         cr_compressiontask_free(fil_rewrite_pkg_count_task, NULL);
@@ -1743,20 +2109,14 @@ main(int argc, char **argv)
         g_free(oth_dict_file);
     }
 
-    g_queue_free(user_data.buffer);
     g_mutex_clear(&(user_data.mutex_nevra_table));
     g_mutex_clear(&(user_data.mutex_output_pkg_list));
-    g_mutex_clear(&(user_data.mutex_pri));
-    g_mutex_clear(&(user_data.mutex_fil));
-    g_mutex_clear(&(user_data.mutex_fex));
-    g_mutex_clear(&(user_data.mutex_oth));
-    g_cond_clear(&(user_data.cond_pri));
-    g_cond_clear(&(user_data.cond_fil));
-    g_cond_clear(&(user_data.cond_fex));
-    g_cond_clear(&(user_data.cond_oth));
-    g_mutex_clear(&(user_data.mutex_buffer));
     g_mutex_clear(&(user_data.mutex_old_md));
+    g_cond_clear(&(user_data.cond_old_md_matched));
     g_mutex_clear(&(user_data.mutex_deltatargetpackages));
+    g_mutex_clear(&(user_data.mutex_io));
+    g_cond_clear(&(user_data.cond_io_done));
+    g_cond_clear(&(user_data.cond_io_window));
 
     // Create repomd records for each file
     g_debug("Generating repomd.xml");
@@ -1876,6 +2236,13 @@ main(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
 
+        // Remove the decompressed old dbs (--update)
+        for (int x = 0; x < 4; x++) {
+            if (old_db_paths[x])
+                g_remove(old_db_paths[x]);
+            g_free(old_db_paths[x]);
+        }
+
 
         // Compress dbs
         GThreadPool *compress_pool =  g_thread_pool_new(cr_compressing_thread,
@@ -2476,9 +2843,10 @@ cleanup:
 
     if (old_metadata)
         cr_metadata_free(old_metadata);
+#ifdef WITH_LIBMODULEMD
+    g_clear_pointer(&old_moduleindex, g_object_unref);
+#endif /* WITH_LIBMODULEMD */
 
-    g_free(user_data.prev_srpm);
-    g_free(user_data.cur_srpm);
     g_free(in_repo);
     g_free(out_repo);
     g_free(tmp_out_repo);
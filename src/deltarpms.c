@@ -256,14 +256,31 @@ typedef struct {
 } cr_DeltaThreadUserData;
 
 
+/** Old package usable for a delta, with its evr pre-tokenized
+ * (the evr is compared repeatedly while the candidates are sorted)
+ */
+typedef struct {
+    cr_DeltaTargetPackage *tpkg;
+    cr_EvrKey *evr_key;
+} cr_DeltaCandidate;
+
+
+static void
+cr_deltacandidate_free(cr_DeltaCandidate *candidate)
+{
+    cr_deltatargetpackage_free(candidate->tpkg);
+    cr_evr_key_free(candidate->evr_key);
+    g_free(candidate);
+}
+
+
 static gint
-cmp_deltatargetpackage_evr(gconstpointer aa, gconstpointer bb)
+cmp_deltacandidate_evr(gconstpointer aa, gconstpointer bb)
 {
-    const cr_DeltaTargetPackage *a = aa;
-    const cr_DeltaTargetPackage *b = bb;
+    const cr_DeltaCandidate *a = aa;
+    const cr_DeltaCandidate *b = bb;
 
-    return cr_cmp_evr(a->epoch, a->version, a->release,
-                      b->epoch, b->version, b->release);
+    return cr_evr_key_cmp(a->evr_key, b->evr_key);
 }
 
 
@@ -273,6 +290,9 @@ cr_delta_thread(gpointer data, gpointer udata)
     cr_DeltaTask *task = data;
     cr_DeltaThreadUserData *user_data = udata;
     cr_DeltaTargetPackage *tpkg = task->tpkg;  // Shortcut
+    cr_EvrKey *tpkg_evr_key = cr_evr_key_new(tpkg->epoch,
+                                             tpkg->version,
+                                             tpkg->release);
 
     GHashTableIter iter;
     gpointer key, value;
@@ -306,28 +326,33 @@ cr_delta_thread(gpointer data, gpointer udata)
                     continue;
                 }
 
-                if (cr_cmp_evr(tpkg->epoch, tpkg->version, tpkg->release,
-                        l_tpkg->epoch, l_tpkg->version, l_tpkg->release) <= 0)
-                {
+                cr_EvrKey *l_evr_key = cr_evr_key_new(l_tpkg->epoch,
+                                                      l_tpkg->version,
+                                                      l_tpkg->release);
+                if (cr_evr_key_cmp(tpkg_evr_key, l_evr_key) <= 0) {
+                    cr_evr_key_free(l_evr_key);
                     cr_deltatargetpackage_free(l_tpkg);
                     continue;
                 }
 
                 // This candidate looks good
-                local_candidates = g_slist_prepend(local_candidates, l_tpkg);
+                cr_DeltaCandidate *candidate = g_new(cr_DeltaCandidate, 1);
+                candidate->tpkg = l_tpkg;
+                candidate->evr_key = l_evr_key;
+                local_candidates = g_slist_prepend(local_candidates, candidate);
             }
         }
 
         // Sort the candidates
         local_candidates = g_slist_sort(local_candidates,
-                                        cmp_deltatargetpackage_evr);
+                                        cmp_deltacandidate_evr);
         local_candidates = g_slist_reverse(local_candidates);
 
         // Generate deltas
         int x = 0;
         for (GSList *lelem = local_candidates; lelem; lelem = g_slist_next(lelem)){
             GError *tmp_err = NULL;
-            cr_DeltaTargetPackage *old = lelem->data;
+            cr_DeltaTargetPackage *old = ((cr_DeltaCandidate *) lelem->data)->tpkg;
 
             g_debug("Generating delta %s -> %s", old->path, tpkg->path);
             char * drpm_path = cr_drpm_create(old, tpkg, user_data->outdeltadir, &tmp_err);
@@ -342,9 +367,11 @@ cr_delta_thread(gpointer data, gpointer udata)
                 break;
         }
 
-        g_slist_free_full(local_candidates, (GDestroyNotify) cr_deltatargetpackage_free);
+        g_slist_free_full(local_candidates, (GDestroyNotify) cr_deltacandidate_free);
     }
 
+    cr_evr_key_free(tpkg_evr_key);
+
     g_debug("Deltas for \"%s\" (%"G_GINT64_FORMAT") generated",
             tpkg->name, tpkg->size_installed);
 
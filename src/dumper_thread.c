@@ -26,6 +26,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include "checksum.h"
 #include "cleanup.h"
 #include "deltarpms.h"
@@ -35,253 +36,312 @@
 #include "parsepkg.h"
 #include "package_internal.h"
 #include "xml_dump.h"
+#include "xml_dump_internal.h"
 #include <fcntl.h>
 
-#define MAX_TASK_BUFFER_LEN         20
-#define CACHEDCHKSUM_BUFFER_LEN     2048
 
 struct BufferedTask {
     long id;                        // ID of the task
     struct cr_XmlStruct res;        // XML for primary, filelists and other
-    cr_Package *pkg;                // Package structure
+    cr_Package *pkg;                // Package structure (NULL - nothing
+                                    // to write, e.g. invalid package)
+    int pending;                    // Number of outputs which haven't
+                                    // written the task yet
 };
 
 
-static gint
-buf_task_sort_func(gconstpointer a, gconstpointer b, G_GNUC_UNUSED gpointer data)
+static void
+buf_task_free(struct BufferedTask *buf_task)
 {
-    const struct BufferedTask *task_a = a;
-    const struct BufferedTask *task_b = b;
-    if (task_a->id < task_b->id)  return -1;
-    if (task_a->id == task_b->id) return 0;
-    return 1;
+    g_free(buf_task->res.primary);
+    g_free(buf_task->res.filelists);
+    g_free(buf_task->res.filelists_ext);
+    g_free(buf_task->res.other);
+    g_free(buf_task);
 }
 
 
+/** Put a finished task into the reorder buffer.
+ * Blocks only if the task is too far ahead of the oldest task which
+ * is still being written (the buffer is full).
+ * The pkg may be NULL, the ID is then just marked as done.
+ */
 static void
-wait_for_incremented_ids(long id, struct UserData *udata)
+deposit_task(long id,
+             struct cr_XmlStruct res,
+             cr_Package *pkg,
+             struct UserData *udata)
 {
-    g_mutex_lock(&(udata->mutex_pri));
-    while (udata->id_pri != id)
-        g_cond_wait (&(udata->cond_pri), &(udata->mutex_pri));
-    ++udata->id_pri;
-    g_cond_broadcast(&(udata->cond_pri));
-    g_mutex_unlock(&(udata->mutex_pri));
-
-    g_mutex_lock(&(udata->mutex_fil));
-    while (udata->id_fil != id)
-        g_cond_wait (&(udata->cond_fil), &(udata->mutex_fil));
-    ++udata->id_fil;
-    g_cond_broadcast(&(udata->cond_fil));
-    g_mutex_unlock(&(udata->mutex_fil));
-
-    if (udata->filelists_ext) {
-        g_mutex_lock(&(udata->mutex_fex));
-        while (udata->id_fex != id)
-            g_cond_wait (&(udata->cond_fex), &(udata->mutex_fex));
-        ++udata->id_fex;
-        g_cond_broadcast(&(udata->cond_fex));
-        g_mutex_unlock(&(udata->mutex_fex));
-    }
-
-    g_mutex_lock(&(udata->mutex_oth));
-    while (udata->id_oth != id)
-        g_cond_wait (&(udata->cond_oth), &(udata->mutex_oth));
-    ++udata->id_oth;
-    g_cond_broadcast(&(udata->cond_oth));
-    g_mutex_unlock(&(udata->mutex_oth));
+    struct BufferedTask *buf_task = g_malloc0(sizeof(struct BufferedTask));
+    buf_task->id  = id;
+    buf_task->res = res;
+    buf_task->pkg = pkg;
+
+    for (int x = 0; x < CR_DUMPER_OUTPUT_SENTINEL; x++)
+        if (udata->writers[x].thread)
+            buf_task->pending++;
+
+    g_mutex_lock(&(udata->mutex_write_buffer));
+    while (id >= udata->write_buffer_released + udata->write_buffer_depth)
+        g_cond_wait(&(udata->cond_released), &(udata->mutex_write_buffer));
+    assert(!udata->write_buffer[id % udata->write_buffer_depth]);
+    udata->write_buffer[id % udata->write_buffer_depth] = buf_task;
+    if (id + 1 - udata->write_buffer_released > udata->write_buffer_max)
+        udata->write_buffer_max = id + 1 - udata->write_buffer_released;
+    g_cond_broadcast(&(udata->cond_deposited));
+    g_mutex_unlock(&(udata->mutex_write_buffer));
 }
 
 
 static void
-write_pkg(long id,
-          struct cr_XmlStruct res,
-          cr_Package *pkg,
-          struct UserData *udata)
+deposit_empty_task(long id, struct UserData *udata)
 {
-    GError *tmp_err = NULL;
+    struct cr_XmlStruct res = { NULL, NULL, NULL, NULL };
+    deposit_task(id, res, NULL, udata);
+}
 
-    // Write primary data
-    g_mutex_lock(&(udata->mutex_pri));
-    while (udata->id_pri != id)
-        g_cond_wait (&(udata->cond_pri), &(udata->mutex_pri));
 
-    udata->package_count++;
-    g_free(udata->prev_srpm);
-    udata->prev_srpm = udata->cur_srpm;
-    udata->cur_srpm = g_strdup(pkg->rpm_sourcerpm);
-    gboolean new_pkg = FALSE;
-    if (g_strcmp0(udata->prev_srpm, udata->cur_srpm) != 0)
-        new_pkg = TRUE;
+/** Sqlite database of the output or NULL if it is not generated.
+ */
+static cr_SqliteDb *
+output_db(struct UserData *udata, cr_DumperOutput type)
+{
+    switch (type) {
+        case CR_DUMPER_OUTPUT_PRI_DB:   return udata->pri_db;
+        case CR_DUMPER_OUTPUT_FIL_DB:   return udata->fil_db;
+        case CR_DUMPER_OUTPUT_FEX_DB:   return udata->fex_db;
+        case CR_DUMPER_OUTPUT_OTH_DB:   return udata->oth_db;
+        default:                        return NULL;
+    }
+}
 
-    ++udata->id_pri;
-    cr_xmlfile_add_chunk(udata->pri_f, (const char *) res.primary, &tmp_err);
+
+/** Insert the package into the sqlite database. Every database has its
+ * own writer, so the inserts run aside the XML outputs. All of them are
+ * done in a single transaction (started by the cr_db_open()) by
+ * the prepared statements of the database.
+ */
+static void
+write_db(struct OutputWriter *writer, struct BufferedTask *buf_task)
+{
+    GError *tmp_err = NULL;
+    struct UserData *udata = writer->udata;
+    cr_Package *pkg = buf_task->pkg;
+
+    if (pkg->loadingflags & CR_PACKAGE_FROM_XML)
+        // Unchanged package from the old metadata (--update), its rows
+        // are copied from the old db if it is attached
+        cr_db_add_pkg_from_old(output_db(udata, writer->type), pkg, &tmp_err);
+    else
+        cr_db_add_pkg(output_db(udata, writer->type), pkg, &tmp_err);
     if (tmp_err) {
-        g_critical("Cannot add primary chunk:\n%s\nError: %s",
-                   res.primary, tmp_err->message);
+        g_critical("Cannot add record of %s (%s) to %s: %s",
+                   pkg->name, pkg->pkgId, writer->name, tmp_err->message);
         udata->had_errors = TRUE;
         g_clear_error(&tmp_err);
     }
+}
 
-    if (udata->pri_db) {
-        cr_db_add_pkg(udata->pri_db, pkg, &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot add record of %s (%s) to primary db: %s",
-                       pkg->name, pkg->pkgId, tmp_err->message);
-            udata->had_errors = TRUE;
-            g_clear_error(&tmp_err);
-        }
-    }
-    if (udata->pri_zck) {
-        if (new_pkg) {
-            cr_end_chunk(udata->pri_zck->f, &tmp_err);
-            if (tmp_err) {
-                g_critical("Unable to end primary zchunk: %s", tmp_err->message);
-                udata->had_errors = TRUE;
-                g_clear_error(&tmp_err);
-            }
-        }
-        cr_xmlfile_add_chunk(udata->pri_zck, (const char *) res.primary, &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot add primary zchunk:\n%s\nError: %s",
-                       res.primary, tmp_err->message);
-            udata->had_errors = TRUE;
-            g_clear_error(&tmp_err);
-        }
+
+static void
+write_output(struct OutputWriter *writer, struct BufferedTask *buf_task)
+{
+    GError *tmp_err = NULL;
+    struct UserData *udata = writer->udata;
+    cr_Package *pkg = buf_task->pkg;
+    const char *chunk = NULL;
+    cr_XmlFile *xml_f = NULL;
+    cr_XmlFile *zck_f = NULL;
+
+    switch (writer->type) {
+        case CR_DUMPER_OUTPUT_PRI:
+            chunk = buf_task->res.primary;
+            xml_f = udata->pri_f;
+            zck_f = udata->pri_zck;
+            // Only the primary writer touches the counter
+            udata->package_count++;
+            break;
+        case CR_DUMPER_OUTPUT_FIL:
+            chunk = buf_task->res.filelists;
+            xml_f = udata->fil_f;
+            zck_f = udata->fil_zck;
+            break;
+        case CR_DUMPER_OUTPUT_FEX:
+            chunk = buf_task->res.filelists_ext;
+            xml_f = udata->fex_f;
+            zck_f = udata->fex_zck;
+            break;
+        case CR_DUMPER_OUTPUT_OTH:
+            chunk = buf_task->res.other;
+            xml_f = udata->oth_f;
+            zck_f = udata->oth_zck;
+            break;
+        case CR_DUMPER_OUTPUT_PRI_DB:
+        case CR_DUMPER_OUTPUT_FIL_DB:
+        case CR_DUMPER_OUTPUT_FEX_DB:
+        case CR_DUMPER_OUTPUT_OTH_DB:
+            write_db(writer, buf_task);
+            return;
+        default:
+            assert(0);
+            return;
     }
 
-    g_cond_broadcast(&(udata->cond_pri));
-    g_mutex_unlock(&(udata->mutex_pri));
+    // All writers see the same sequence of packages, so every one of
+    // them can track the srpm changes on its own
+    gboolean new_pkg = FALSE;
+    if (g_strcmp0(writer->prev_srpm, pkg->rpm_sourcerpm) != 0)
+        new_pkg = TRUE;
+    g_free(writer->prev_srpm);
+    writer->prev_srpm = g_strdup(pkg->rpm_sourcerpm);
 
-    // Write fielists data
-    g_mutex_lock(&(udata->mutex_fil));
-    while (udata->id_fil != id)
-        g_cond_wait (&(udata->cond_fil), &(udata->mutex_fil));
-    ++udata->id_fil;
-    cr_xmlfile_add_chunk(udata->fil_f, (const char *) res.filelists, &tmp_err);
+    cr_xmlfile_add_chunk(xml_f, chunk, &tmp_err);
     if (tmp_err) {
-        g_critical("Cannot add filelists chunk:\n%s\nError: %s",
-                   res.filelists, tmp_err->message);
+        g_critical("Cannot add %s chunk:\n%s\nError: %s",
+                   writer->name, chunk, tmp_err->message);
         udata->had_errors = TRUE;
         g_clear_error(&tmp_err);
     }
 
-    if (udata->fil_db) {
-        cr_db_add_pkg(udata->fil_db, pkg, &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot add record of %s (%s) to filelists db: %s",
-                       pkg->name, pkg->pkgId, tmp_err->message);
-            udata->had_errors = TRUE;
-            g_clear_error(&tmp_err);
-        }
-    }
-    if (udata->fil_zck) {
+    if (zck_f) {
         if (new_pkg) {
-            cr_end_chunk(udata->fil_zck->f, &tmp_err);
+            cr_end_chunk(zck_f->f, &tmp_err);
             if (tmp_err) {
-                g_critical("Unable to end filelists zchunk: %s", tmp_err->message);
+                g_critical("Unable to end %s zchunk: %s",
+                           writer->name, tmp_err->message);
                 udata->had_errors = TRUE;
                 g_clear_error(&tmp_err);
             }
         }
-        cr_xmlfile_add_chunk(udata->fil_zck, (const char *) res.filelists, &tmp_err);
+        cr_xmlfile_add_chunk(zck_f, chunk, &tmp_err);
         if (tmp_err) {
-            g_critical("Cannot add filelists zchunk:\n%s\nError: %s",
-                       res.filelists, tmp_err->message);
+            g_critical("Cannot add %s zchunk:\n%s\nError: %s",
+                       writer->name, chunk, tmp_err->message);
             udata->had_errors = TRUE;
             g_clear_error(&tmp_err);
         }
     }
+}
 
-    g_cond_broadcast(&(udata->cond_fil));
-    g_mutex_unlock(&(udata->mutex_fil));
 
-    // Write filelists-ext data
-    if (udata->filelists_ext) {
-        g_mutex_lock(&(udata->mutex_fex));
-        while (udata->id_fex != id)
-            g_cond_wait (&(udata->cond_fex), &(udata->mutex_fex));
-        ++udata->id_fex;
-        cr_xmlfile_add_chunk(udata->fex_f, (const char *) res.filelists_ext, &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot add filelists-ext chunk:\n%s\nError: %s",
-                       res.filelists_ext, tmp_err->message);
-            udata->had_errors = TRUE;
-            g_clear_error(&tmp_err);
-        }
+static gpointer
+output_writer_thread(gpointer data)
+{
+    struct OutputWriter *writer = data;
+    struct UserData *udata = writer->udata;
+    long depth = udata->write_buffer_depth;
+
+    for (long id = 0; ; id++) {
+        struct BufferedTask *buf_task = NULL;
+
+        // Wait for our turn (the task_count may be lowered meanwhile,
+        // see cr_dumper_writers_set_task_count())
+        g_mutex_lock(&(udata->mutex_write_buffer));
+        while (id < udata->task_count
+               && !(buf_task = udata->write_buffer[id % depth]))
+            g_cond_wait(&(udata->cond_deposited), &(udata->mutex_write_buffer));
+        g_mutex_unlock(&(udata->mutex_write_buffer));
+
+        if (!buf_task)
+            break;
 
-        if (udata->fex_db) {
-            cr_db_add_pkg(udata->fex_db, pkg, &tmp_err);
-            if (tmp_err) {
-                g_critical("Cannot add record of %s (%s) to filelists-ext db: %s",
-                           pkg->name, pkg->pkgId, tmp_err->message);
-                udata->had_errors = TRUE;
-                g_clear_error(&tmp_err);
-            }
-        }
-        if (udata->fex_zck) {
-            if (new_pkg) {
-                cr_end_chunk(udata->fex_zck->f, &tmp_err);
-                if (tmp_err) {
-                    g_critical("Unable to end filelists-ext zchunk: %s", tmp_err->message);
-                    udata->had_errors = TRUE;
-                    g_clear_error(&tmp_err);
-                }
-            }
-            cr_xmlfile_add_chunk(udata->fex_zck, (const char *) res.filelists_ext, &tmp_err);
-            if (tmp_err) {
-                g_critical("Cannot add filelists-ext zchunk:\n%s\nError: %s",
-                           res.filelists_ext, tmp_err->message);
-                udata->had_errors = TRUE;
-                g_clear_error(&tmp_err);
-            }
+        assert(buf_task->id == id);
+
+        if (buf_task->pkg)
+            write_output(writer, buf_task);
+
+        // The last writer releases the slot
+        gboolean release = FALSE;
+        g_mutex_lock(&(udata->mutex_write_buffer));
+        if (--buf_task->pending == 0) {
+            udata->write_buffer[id % depth] = NULL;
+            udata->write_buffer_released = id + 1;
+            g_cond_broadcast(&(udata->cond_released));
+            release = TRUE;
         }
+        g_mutex_unlock(&(udata->mutex_write_buffer));
 
-        g_cond_broadcast(&(udata->cond_fex));
-        g_mutex_unlock(&(udata->mutex_fex));
+        if (release) {
+            if (udata->free_written_pkgs)
+                cr_package_free(buf_task->pkg);
+            buf_task_free(buf_task);
+        }
     }
 
-    // Write other data
-    g_mutex_lock(&(udata->mutex_oth));
-    while (udata->id_oth != id)
-        g_cond_wait (&(udata->cond_oth), &(udata->mutex_oth));
-    ++udata->id_oth;
-    cr_xmlfile_add_chunk(udata->oth_f, (const char *) res.other, &tmp_err);
-    if (tmp_err) {
-        g_critical("Cannot add other chunk:\n%s\nError: %s",
-                   res.other, tmp_err->message);
-        udata->had_errors = TRUE;
-        g_clear_error(&tmp_err);
+    return NULL;
+}
+
+
+void
+cr_dumper_writers_start(struct UserData *udata)
+{
+    static const char *names[CR_DUMPER_OUTPUT_SENTINEL] = {
+        "primary", "filelists", "filelists-ext", "other",
+        "primary db", "filelists db", "filelists-ext db", "other db"
+    };
+
+    assert(udata->write_buffer_depth > 0);
+
+    udata->write_buffer = g_new0(struct BufferedTask *,
+                                 udata->write_buffer_depth);
+    udata->write_buffer_released = 0;
+    g_mutex_init(&(udata->mutex_write_buffer));
+    g_cond_init(&(udata->cond_deposited));
+    g_cond_init(&(udata->cond_released));
+
+    for (int x = 0; x < CR_DUMPER_OUTPUT_SENTINEL; x++) {
+        struct OutputWriter *writer = &(udata->writers[x]);
+        writer->type = x;
+        writer->name = names[x];
+        writer->udata = udata;
+        writer->prev_srpm = NULL;
+        writer->thread = NULL;
     }
 
-    if (udata->oth_db) {
-        cr_db_add_pkg(udata->oth_db, pkg, NULL);
-        if (tmp_err) {
-            g_critical("Cannot add record of %s (%s) to other db: %s",
-                       pkg->name, pkg->pkgId, tmp_err->message);
-            udata->had_errors = TRUE;
-            g_clear_error(&tmp_err);
-        }
+    for (int x = 0; x < CR_DUMPER_OUTPUT_SENTINEL; x++) {
+        struct OutputWriter *writer = &(udata->writers[x]);
+        if (x == CR_DUMPER_OUTPUT_FEX && !udata->filelists_ext)
+            continue;
+        if (x >= CR_DUMPER_OUTPUT_PRI_DB && !output_db(udata, x))
+            continue;
+        if (x > CR_DUMPER_OUTPUT_PRI_DB)
+            // The pkgKey of the packages belongs to the primary db,
+            // filled concurrently
+            cr_db_set_store_pkgkey(output_db(udata, x), FALSE);
+        writer->thread = g_thread_new(writer->name,
+                                      output_writer_thread,
+                                      writer);
     }
-    if (udata->oth_zck) {
-        if (new_pkg) {
-            cr_end_chunk(udata->oth_zck->f, &tmp_err);
-            if (tmp_err) {
-                g_critical("Unable to end other zchunk: %s", tmp_err->message);
-                udata->had_errors = TRUE;
-                g_clear_error(&tmp_err);
-            }
-        }
-        cr_xmlfile_add_chunk(udata->oth_zck, (const char *) res.other, &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot add other zchunk:\n%s\nError: %s",
-                       res.other, tmp_err->message);
-            udata->had_errors = TRUE;
-            g_clear_error(&tmp_err);
-        }
+}
+
+
+void
+cr_dumper_writers_set_task_count(struct UserData *udata, long task_count)
+{
+    g_mutex_lock(&(udata->mutex_write_buffer));
+    udata->task_count = task_count;
+    g_cond_broadcast(&(udata->cond_deposited));
+    g_mutex_unlock(&(udata->mutex_write_buffer));
+}
+
+
+void
+cr_dumper_writers_finish(struct UserData *udata)
+{
+    for (int x = 0; x < CR_DUMPER_OUTPUT_SENTINEL; x++) {
+        struct OutputWriter *writer = &(udata->writers[x]);
+        if (writer->thread)
+            g_thread_join(writer->thread);
+        writer->thread = NULL;
+        g_free(writer->prev_srpm);
+        writer->prev_srpm = NULL;
     }
-    g_cond_broadcast(&(udata->cond_oth));
-    g_mutex_unlock(&(udata->mutex_oth));
+
+    g_free(udata->write_buffer);
+    udata->write_buffer = NULL;
+    g_mutex_clear(&(udata->mutex_write_buffer));
+    g_cond_clear(&(udata->cond_deposited));
+    g_cond_clear(&(udata->cond_released));
 }
 
 
@@ -300,131 +360,139 @@ cr_delayed_dump_set(gpointer user_data)
 }
 
 
+/** Free the raw XML of a package from the old metadata.
+ */
+static void
+free_raw_xml(cr_Package *pkg)
+{
+    g_clear_pointer(&pkg->raw_primary, g_free);
+    g_clear_pointer(&pkg->raw_filelists, g_free);
+    g_clear_pointer(&pkg->raw_filelists_ext, g_free);
+    g_clear_pointer(&pkg->raw_other, g_free);
+}
+
+/** Get XML chunks of the package, packages from the old metadata reuse
+ * their raw XML (which is not needed afterwards anymore).
+ */
+static struct cr_XmlStruct
+dump_package(cr_Package *pkg, gboolean filelists_ext, GError **err)
+{
+    struct cr_XmlStruct res;
+
+    if (pkg->raw_primary || pkg->raw_filelists
+        || pkg->raw_filelists_ext || pkg->raw_other)
+    {
+        res = cr_xml_dump_raw(pkg, filelists_ext, err);
+        free_raw_xml(pkg);
+    } else if (filelists_ext) {
+        res = cr_xml_dump_ext(pkg, err);
+    } else {
+        res = cr_xml_dump(pkg, err);
+    }
+
+    return res;
+}
+
 void
-cr_delayed_dump_run(gpointer user_data)
+cr_dumper_dump_package(long id, cr_Package *pkg, struct UserData *udata)
 {
     GError *tmp_err = NULL;
+
+    if (!pkg || pkg->skip_dump) {
+        // invalid || explicitly skipped task
+        if (udata->free_written_pkgs)
+            cr_package_free(pkg);
+        deposit_empty_task(id, udata);
+        return;
+    }
+
+    struct cr_XmlStruct res;
+    res = dump_package(pkg, udata->filelists_ext, &tmp_err);
+    if (tmp_err) {
+        g_critical("Cannot dump XML for %s (%s): %s",
+                   pkg->name, pkg->pkgId, tmp_err->message);
+        udata->had_errors = TRUE;
+        g_clear_error(&tmp_err);
+        if (udata->free_written_pkgs)
+            cr_package_free(pkg);
+        deposit_empty_task(id, udata);
+    }
+    else {
+        // The writer threads take ownership of the XML strings
+        deposit_task(id, res, pkg, udata);
+    }
+}
+
+void
+cr_delayed_dump_run(gpointer user_data)
+{
     struct UserData *udata = (struct UserData *) user_data;
     long int stop = udata->task_count;
     g_debug("Performing the delayed metadata dump");
     for (int id = 0; id < stop; id++) {
         struct DelayedTask dtask = g_array_index(udata->delayed_write,
                                                  struct DelayedTask, id);
-        if (!dtask.pkg || dtask.pkg->skip_dump) {
-            // invalid || explicitly skipped task
-            wait_for_incremented_ids(id, udata);
-            continue;
-        }
-
-        struct cr_XmlStruct res;
-        if (udata->filelists_ext) {
-            res = cr_xml_dump_ext(dtask.pkg,  &tmp_err);
-        } else {
-            res = cr_xml_dump(dtask.pkg, &tmp_err);
-        }
-        if (tmp_err) {
-            g_critical("Cannot dump XML for %s (%s): %s",
-                       dtask.pkg->name, dtask.pkg->pkgId, tmp_err->message);
-            udata->had_errors = TRUE;
-            g_clear_error(&tmp_err);
-        }
-        else {
-            write_pkg(id, res, dtask.pkg, udata);
-        }
-
-        g_free(res.primary);
-        g_free(res.filelists);
-        g_free(res.filelists_ext);
-        g_free(res.other);
+        cr_dumper_dump_package(id, dtask.pkg, udata);
     }
 }
 
 
 static char *
-get_checksum(const char *filename,
+get_checksum(int fd,
+             const char *filename,
              cr_ChecksumType type,
              cr_Package *pkg,
-             const char *cachedir,
+             cr_ChecksumCache *cache,
+             const struct stat *stat_buf,
+             struct cr_HeaderRangeStruct *hdr_r,
              GError **err)
 {
     GError *tmp_err = NULL;
     char *checksum = NULL;
-    char *cachefn = NULL;
-
-    if (cachedir) {
-        // Prepare cache fn
-        cr_ChecksumCtx *ctx = cr_checksum_new(type, err);
-        if (!ctx) return NULL;
-
-        if (pkg->siggpg)
-            cr_checksum_update(ctx, pkg->siggpg->data, pkg->siggpg->size, NULL);
-        if (pkg->sigpgp)
-            cr_checksum_update(ctx, pkg->sigpgp->data, pkg->sigpgp->size, NULL);
-
-        for (GSList *elem = pkg->signatures; elem; elem = g_slist_next(elem)) {
-            const char *sig = (const char *)elem->data;
-            if (sig)
-                cr_checksum_update(ctx, sig, strlen(sig), NULL);
-        }
 
-        if (pkg->hdrid)
-            cr_checksum_update(ctx, pkg->hdrid, strlen(pkg->hdrid), NULL);
-
-        gchar *key = cr_checksum_final(ctx, err);
-        if (!key) return NULL;
-
-        cachefn = g_strdup_printf("%s%s-%s-%"G_GINT64_FORMAT"-%"G_GINT64_FORMAT,
-                                  cachedir,
-                                  cr_get_filename(pkg->location_href),
-                                  key, pkg->size_installed, pkg->time_file);
-        g_free(key);
-
-        // Try to load checksum
-        FILE *f = fopen(cachefn, "r");
-        if (f) {
-            char buf[CACHEDCHKSUM_BUFFER_LEN];
-            size_t readed = fread(buf, 1, CACHEDCHKSUM_BUFFER_LEN, f);
-            if (!ferror(f) && readed > 0) {
-                checksum = g_strndup(buf, readed);
-            }
-            fclose(f);
+    if (cache) {
+        // Cheap lookup - keyed by the file stat, hdrid is just verified
+        checksum = cr_checksum_cache_lookup(cache, stat_buf, type,
+                                            pkg->hdrid, &tmp_err);
+        if (tmp_err) {
+            // The cache is only an optimization
+            g_warning("%s", tmp_err->message);
+            g_clear_error(&tmp_err);
         }
-
         if (checksum) {
-            g_debug("Cached checksum used: %s: \"%s\"", cachefn, checksum);
-            goto exit;
-        }
-    }
+            g_debug("Cached checksum used: %s: \"%s\"", filename, checksum);
 
-    // Calculate checksum
-    checksum = cr_checksum_file(filename, type, &tmp_err);
-    if (!checksum) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while checksum calculation: ");
-        goto exit;
+            // Only the leading part of the package is needed now
+            *hdr_r = cr_get_header_byte_range_fd(fd, filename, NULL, &tmp_err);
+            if (tmp_err) {
+                g_propagate_prefixed_error(err, tmp_err,
+                                    "Error while determining header range: ");
+                g_free(checksum);
+                checksum = NULL;
+            }
+            return checksum;
+        }
     }
 
-    // Cache the checksum value
-    if (cachefn && !g_file_test(cachefn, G_FILE_TEST_EXISTS)) {
-        gchar *template = g_strconcat(cachefn, "-XXXXXX", NULL);
-        // Files should not be executable so use only 0666
-        gint fd = g_mkstemp_full(template, O_RDWR, 0666);
-        if (fd < 0) {
-            g_free(template);
-            goto exit;
-        }
+    // Calculate checksum and header range in a single pass over the file
+    cr_ChecksumCtx *ctx = cr_checksum_new(type, err);
+    if (!ctx)
+        return NULL;
 
-        write(fd, checksum, strlen(checksum));
-        close(fd);
-        if (!cr_move_recursive(template, cachefn, &tmp_err)) {
-            g_propagate_prefixed_error(err, tmp_err, "Error while renaming: ");
-            g_remove(template);
-        }
-        g_free(template);
+    *hdr_r = cr_get_header_byte_range_fd(fd, filename, ctx, &tmp_err);
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        g_free(cr_checksum_final(ctx, NULL));
+        return NULL;
     }
 
-exit:
-    g_free(cachefn);
+    checksum = cr_checksum_final(ctx, err);
+    if (!checksum)
+        return NULL;
+
+    // Cache the checksum value
+    if (cache)
+        cr_checksum_cache_store(cache, stat_buf, type, pkg->hdrid, checksum);
 
     return checksum;
 }
@@ -448,9 +516,12 @@ prepare_split_media_baseurl(int media_id, const char *location_base)
 }
 
 static cr_Package *
-load_rpm(const char *fullpath,
+load_rpm(int fd,
+         const char *fullpath,
          cr_ChecksumType checksum_type,
-         const char *checksum_cachedir,
+         cr_ChecksumCache *checksum_cache,
+         const char *read_checksum,
+         const struct cr_HeaderRangeStruct *read_hdr_r,
          const char *location_href,
          const char *location_base,
          int changelog_limit,
@@ -464,8 +535,33 @@ load_rpm(const char *fullpath,
     assert(fullpath);
     assert(!err || *err == NULL);
 
+    // The package is opened only once (or not at all if the I/O stage
+    // already did it). The header is read by rpm through a duplicate of
+    // this fd and the checksum together with the header range are computed
+    // from a single sequential read of the same fd (unless the I/O stage
+    // already computed them as read_checksum and read_hdr_r).
+    // The fd is always closed.
+    if (fd < 0) {
+        fd = open(fullpath, O_RDONLY);
+        if (fd < 0) {
+            const gchar * open_error = g_strerror(errno);
+            g_warning("%s: open(%s) error (%s)", __func__, fullpath, open_error);
+            g_set_error(err, CREATEREPO_C_ERROR, CRE_IO, "Cannot open %s: %s",
+                        fullpath, open_error);
+            return NULL;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    } else if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO, "Cannot seek over %s: %s",
+                    fullpath, g_strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
     // Get a package object
-    pkg = cr_package_from_rpm_base(fullpath, changelog_limit, hdrrflags, err);
+    pkg = cr_package_from_rpm_fd(fd, fullpath, changelog_limit, hdrrflags, err);
     if (!pkg)
         goto errexit;
 
@@ -478,26 +574,40 @@ load_rpm(const char *fullpath,
                                         cr_checksum_name_str(checksum_type));
 
     // Get file stat
+    struct stat stat_buf_own;
     if (!stat_buf) {
-        struct stat stat_buf_own;
-        if (stat(fullpath, &stat_buf_own) == -1) {
+        if (fstat(fd, &stat_buf_own) == -1) {
             const gchar * stat_error = g_strerror(errno);
-            g_warning("%s: stat(%s) error (%s)", __func__,
+            g_warning("%s: fstat(%s) error (%s)", __func__,
                       fullpath, stat_error);
-            g_set_error(err,  CREATEREPO_C_ERROR, CRE_IO, "stat(%s) failed: %s",
+            g_set_error(err,  CREATEREPO_C_ERROR, CRE_IO, "fstat(%s) failed: %s",
                         fullpath, stat_error);
             goto errexit;
         }
-        pkg->time_file    = stat_buf_own.st_mtime;
-        pkg->size_package = stat_buf_own.st_size;
-    } else {
-        pkg->time_file    = stat_buf->st_mtime;
-        pkg->size_package = stat_buf->st_size;
+        stat_buf = &stat_buf_own;
+    }
+    pkg->time_file    = stat_buf->st_mtime;
+    pkg->size_package = stat_buf->st_size;
+
+    if (read_checksum) {
+        pkg->pkgId = cr_safe_string_chunk_insert(pkg->chunk, read_checksum);
+        pkg->rpm_header_start = read_hdr_r->start;
+        pkg->rpm_header_end = read_hdr_r->end;
+        close(fd);
+        return pkg;
     }
 
-    // Compute checksum
-    char *checksum = get_checksum(fullpath, checksum_type, pkg,
-                                  checksum_cachedir, &tmp_err);
+    // Rewind, rpm left the offset somewhere behind the header
+    if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO, "Cannot seek over %s: %s",
+                    fullpath, g_strerror(errno));
+        goto errexit;
+    }
+
+    // Compute checksum and get header range
+    struct cr_HeaderRangeStruct hdr_r = { 0, 0 };
+    char *checksum = get_checksum(fd, fullpath, checksum_type, pkg,
+                                  checksum_cache, stat_buf, &hdr_r, &tmp_err);
     if (!checksum) {
         g_propagate_error(err, tmp_err);
         goto errexit;
@@ -505,25 +615,268 @@ load_rpm(const char *fullpath,
     pkg->pkgId = cr_safe_string_chunk_insert(pkg->chunk, checksum);
     g_free(checksum);
 
-    // Get header range
-    struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range(fullpath,
-                                                                 &tmp_err);
-    if (tmp_err) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while determining header range: ");
-        goto errexit;
-    }
-
     pkg->rpm_header_start = hdr_r.start;
     pkg->rpm_header_end = hdr_r.end;
 
+    close(fd);
     return pkg;
 
 errexit:
+    close(fd);
     cr_package_free(pkg);
     return NULL;
 }
 
+/** Get location_href of the task's package (with the user requested
+ * modifications applied).
+ */
+static gchar *
+task_location_href(struct PoolTask *task, struct UserData *udata)
+{
+    // get location_href without leading part of path (path to repo)
+    // including '/' char
+    gchar *location_href = g_strdup(task->full_path + udata->repodir_name_len);
+
+    // User requested modification of the location href
+    if (udata->cut_dirs) {
+        gchar *tmp = location_href;
+        location_href = g_strdup(cr_cut_dirs(location_href, udata->cut_dirs));
+        g_free(tmp);
+    }
+
+    if (udata->location_prefix) {
+        gchar *tmp = location_href;
+        location_href = g_build_filename(udata->location_prefix, tmp, NULL);
+        g_free(tmp);
+    }
+
+    return location_href;
+}
+
+/** Move to the next package of the streamed old metadata.
+ * The current udata->old_md_next is dropped.
+ * Must be called with udata->mutex_old_md locked.
+ */
+static void
+old_md_stream_next(struct UserData *udata)
+{
+    GError *tmp_err = NULL;
+
+    cr_package_free(udata->old_md_next);
+    udata->old_md_next = NULL;
+
+    if (udata->old_md_eof)
+        return;
+
+    udata->old_md_next = cr_PkgIterator_parse_next(udata->old_md_stream,
+                                                   &tmp_err);
+    if (tmp_err) {
+        g_warning("Cannot read old metadata, the rest of packages "
+                  "will be regenerated: %s", tmp_err->message);
+        g_clear_error(&tmp_err);
+        cr_package_free(udata->old_md_next);
+        udata->old_md_next = NULL;
+    }
+
+    if (!udata->old_md_next) {
+        udata->old_md_eof = TRUE;
+        return;
+    }
+
+    const char *href = cr_get_cleaned_href(udata->old_md_next->location_href);
+    if (!href) {
+        g_debug("Old package without location_href ignored");
+        old_md_stream_next(udata);
+        return;
+    }
+
+    if (udata->old_md_href
+        && cr_location_href_cmp(udata->old_md_href, href) > 0)
+        g_debug("Old metadata are not sorted (%s after %s), some packages "
+                "will be regenerated", href, udata->old_md_href);
+    g_free(udata->old_md_href);
+    udata->old_md_href = g_strdup(href);
+}
+
+/** Find a package with the href in the streamed old metadata.
+ * The old packages are expected in the same order as the tasks, so all
+ * the old packages before the href are dropped (they are not in the repo
+ * anymore). Packages present multiple times are not used at all.
+ * Must be called with udata->mutex_old_md locked.
+ */
+static cr_Package *
+old_md_stream_match(struct UserData *udata, const char *href)
+{
+    cr_Package *match = NULL;
+    gboolean duplicate = FALSE;
+
+    if (!udata->old_md_next)
+        old_md_stream_next(udata);
+
+    while (udata->old_md_next
+           && cr_location_href_cmp(udata->old_md_href, href) < 0)
+        old_md_stream_next(udata);
+
+    if (!udata->old_md_next || cr_location_href_cmp(udata->old_md_href, href))
+        return NULL;
+
+    match = udata->old_md_next;
+    udata->old_md_next = NULL;
+    old_md_stream_next(udata);
+
+    while (udata->old_md_next
+           && !cr_location_href_cmp(udata->old_md_href, href)) {
+        duplicate = TRUE;
+        old_md_stream_next(udata);
+    }
+
+    if (duplicate) {
+        g_debug("%s is present multiple times in the old metadata - "
+                "ignoring all occurrences", href);
+        cr_package_free(match);
+        return NULL;
+    }
+
+    return match;
+}
+
+/** Match the task against the streamed old metadata (--update-stream).
+ * Tasks are matched strictly in the order of their IDs, by the I/O stage
+ * or by the dumper, whatever comes first. The found package is stored
+ * in the task->old_pkg.
+ */
+static void
+old_md_stream_match_task(struct PoolTask *task, struct UserData *udata)
+{
+    g_mutex_lock(&(udata->mutex_old_md));
+    while (!task->old_matched && udata->old_md_matched != task->id)
+        g_cond_wait(&(udata->cond_old_md_matched), &(udata->mutex_old_md));
+
+    if (!task->old_matched) {
+        _cleanup_free_ gchar *location_href = task_location_href(task, udata);
+        task->old_pkg = old_md_stream_match(udata,
+                                        cr_get_cleaned_href(location_href));
+        task->old_matched = TRUE;
+        udata->old_md_matched++;
+        g_cond_broadcast(&(udata->cond_old_md_matched));
+    }
+    g_mutex_unlock(&(udata->mutex_old_md));
+}
+
+/** Check (without taking it) if usable old metadata exist for the task.
+ */
+static gboolean
+old_metadata_usable(struct PoolTask *task, struct UserData *udata)
+{
+    struct stat stat_buf;
+    cr_Package *md;
+    gboolean usable = FALSE;
+
+    if (!udata->old_metadata && !udata->old_md_stream)
+        return FALSE;
+
+    if (udata->old_md_stream)
+        // The dumper doesn't touch the task->old_pkg before the I/O stage
+        // is done with the task, no lock is needed
+        old_md_stream_match_task(task, udata);
+
+    if (!udata->skip_stat && stat(task->full_path, &stat_buf) == -1)
+        return FALSE;
+
+    if (udata->old_md_stream) {
+        md = task->old_pkg;
+        return md && (udata->skip_stat
+                      || (stat_buf.st_mtime == md->time_file
+                          && stat_buf.st_size == md->size_package
+                          && !strcmp(udata->checksum_type_str,
+                                     md->checksum_type)));
+    }
+
+    _cleanup_free_ gchar *location_href = task_location_href(task, udata);
+
+    g_mutex_lock(&(udata->mutex_old_md));
+    md = (cr_Package *) g_hash_table_lookup(
+                            cr_metadata_hashtable(udata->old_metadata),
+                            cr_get_cleaned_href(location_href));
+    if (md) {
+        usable = udata->skip_stat
+                 || (stat_buf.st_mtime == md->time_file
+                     && stat_buf.st_size == md->size_package
+                     && !strcmp(udata->checksum_type_str, md->checksum_type));
+    }
+    g_mutex_unlock(&(udata->mutex_old_md));
+
+    return usable;
+}
+
+/** Compute the checksum and the header range of a package by the I/O
+ * stage, so the dumper doesn't have to read the package again.
+ * @return checksum or NULL on error (the dumper computes it again then)
+ */
+static char *
+read_checksum(int fd,
+              const char *filename,
+              cr_ChecksumType type,
+              struct cr_HeaderRangeStruct *hdr_r)
+{
+    GError *tmp_err = NULL;
+    cr_ChecksumCtx *ctx = cr_checksum_new(type, NULL);
+
+    if (!ctx)
+        return NULL;
+
+    *hdr_r = cr_get_header_byte_range_fd(fd, filename, ctx, &tmp_err);
+    if (tmp_err) {
+        g_clear_error(&tmp_err);
+        g_free(cr_checksum_final(ctx, NULL));
+        return NULL;
+    }
+
+    return cr_checksum_final(ctx, NULL);
+}
+
+void
+cr_reader_thread(gpointer data, gpointer user_data)
+{
+    struct UserData *udata = (struct UserData *) user_data;
+    struct PoolTask *task  = (struct PoolTask *) data;
+    int fd = -1;
+    char *checksum = NULL;
+    struct cr_HeaderRangeStruct hdr_r = { 0, 0 };
+
+    // Do not get too far ahead of the dumpers
+    g_mutex_lock(&(udata->mutex_io));
+    while (task->id >= udata->dump_started + udata->readahead)
+        g_cond_wait(&(udata->cond_io_window), &(udata->mutex_io));
+    if (task->id - udata->dump_started + 1 > udata->io_queue_max)
+        udata->io_queue_max = task->id - udata->dump_started + 1;
+    g_mutex_unlock(&(udata->mutex_io));
+
+    if (!old_metadata_usable(task, udata)) {
+        fd = open(task->full_path, O_RDONLY);
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (fd >= 0)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        if (fd >= 0 && fstat(fd, &(task->stat_buf)) == -1) {
+            close(fd);
+            fd = -1;
+        }
+        // Errors are reported by the dumper which reads the package again
+        if (fd >= 0 && !udata->checksum_cache)
+            checksum = read_checksum(fd, task->full_path,
+                                     udata->checksum_type, &hdr_r);
+    }
+
+    g_mutex_lock(&(udata->mutex_io));
+    task->fd = fd;
+    task->checksum = checksum;
+    task->hdr_r = hdr_r;
+    task->read_done = TRUE;
+    g_cond_broadcast(&(udata->cond_io_done));
+    g_mutex_unlock(&(udata->mutex_io));
+}
+
 void
 cr_dumper_thread(gpointer data, gpointer user_data)
 {
@@ -534,10 +887,23 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     struct stat stat_buf;       // Struct with info from stat() on file
     struct cr_XmlStruct res;    // Structure for generated XML
     cr_HeaderReadingFlags hdrrflags = CR_HDRR_NONE;
+    gboolean task_done = FALSE; // Was the result deposited for writing?
 
     struct UserData *udata = (struct UserData *) user_data;
     struct PoolTask *task  = (struct PoolTask *) data;
 
+    if (udata->io_stage) {
+        // Let the I/O stage read further and wait until it's done with us
+        g_mutex_lock(&(udata->mutex_io));
+        udata->dump_started++;
+        g_cond_broadcast(&(udata->cond_io_window));
+        if (!task->read_done)
+            udata->io_waits++;
+        while (!task->read_done)
+            g_cond_wait(&(udata->cond_io_done), &(udata->mutex_io));
+        g_mutex_unlock(&(udata->mutex_io));
+    }
+
     struct DelayedTask *dtask = NULL;
     if (udata->delayed_write) {
         // even if we might found out that this is an invalid package,
@@ -550,27 +916,12 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         dtask->pkg = NULL;
     }
 
-    // get location_href without leading part of path (path to repo)
-    // including '/' char
     _cleanup_free_ gchar *location_href = NULL;
-    location_href = g_strdup(task->full_path + udata->repodir_name_len);
+    location_href = task_location_href(task, udata);
 
     _cleanup_free_ gchar *location_base = NULL;
     location_base = g_strdup(udata->location_base);
 
-    // User requested modification of the location href
-    if (udata->cut_dirs) {
-        gchar *tmp = location_href;
-        location_href = g_strdup(cr_cut_dirs(location_href, udata->cut_dirs));
-        g_free(tmp);
-    }
-
-    if (udata->location_prefix) {
-        gchar *tmp = location_href;
-        location_href = g_build_filename(udata->location_prefix, tmp, NULL);
-        g_free(tmp);
-    }
-
     // Prepare location base (if split option is used)
     if (task->media_id) {
         gchar *new_location_base = prepare_split_media_baseurl(task->media_id,
@@ -579,12 +930,19 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         location_base = new_location_base;
     }
 
-    // If --cachedir is used, load signatures and hdrid from packages too
-    if (udata->checksum_cachedir)
-        hdrrflags = CR_HDRR_LOADHDRID | CR_HDRR_LOADSIGNATURES;
+    // If --cachedir is used, load hdrid to verify the cached checksums
+    if (udata->checksum_cache)
+        hdrrflags = CR_HDRR_LOADHDRID;
+
+    // Match the task against the streamed old metadata
+    if (udata->old_md_stream) {
+        old_md_stream_match_task(task, udata);
+        md = task->old_pkg;
+        task->old_pkg = NULL;
+    }
 
     // Get stat info about file
-    if (udata->old_metadata && !(udata->skip_stat)) {
+    if ((udata->old_metadata || udata->old_md_stream) && !(udata->skip_stat)) {
         if (stat(task->full_path, &stat_buf) == -1) {
             g_critical("Stat() on %s: %s", task->full_path, g_strerror(errno));
             goto task_cleanup;
@@ -605,7 +963,9 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         g_hash_table_steal(cr_metadata_hashtable(udata->old_metadata),
                                                  cache_key);
         g_mutex_unlock(&(udata->mutex_old_md));
+    }
 
+    if (udata->old_metadata || udata->old_md_stream) {
         if (md) {
             g_debug("CACHE HIT %s", task->filename);
 
@@ -619,15 +979,25 @@ cr_dumper_thread(gpointer data, gpointer user_data)
             } else {
                 g_debug("%s metadata are obsolete -> generating new",
                         task->filename);
+                if (udata->old_md_stream) {
+                    // Streamed packages are standalone objects
+                    cr_package_free(md);
+                    md = NULL;
+                } else {
+                    // Its raw XML won't be used
+                    free_raw_xml(md);
+                }
             }
 
-            if (old_used) {
+            if (old_used && !md->chunk) {
                 // CR_PACKAGE_SINGLE_CHUNK used with the preloaded (old)
                 // metadata.  Create a new per-package chunk.
-                assert (!md->chunk);
+                // (Packages from the streamed metadata have their own.)
                 md->chunk = g_string_chunk_new(1024);
                 md->loadingflags &= ~CR_PACKAGE_SINGLE_CHUNK;
+            }
 
+            if (old_used) {
                 // We have usable old data, but we have to set proper locations
                 // WARNING! location_href is overidden
                 // location_base is kept by default, unless specified differently
@@ -645,10 +1015,12 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     // Load package and gen XML metadata
     if (!old_used) {
         // Load package from file
-        pkg = load_rpm(task->full_path, udata->checksum_type,
-                       udata->checksum_cachedir, location_href,
-                       location_base, udata->changelog_limit,
-                       NULL, hdrrflags, &tmp_err);
+        pkg = load_rpm(task->fd, task->full_path, udata->checksum_type,
+                       udata->checksum_cache, task->checksum, &(task->hdr_r),
+                       location_href, location_base, udata->changelog_limit,
+                       task->fd >= 0 ? &(task->stat_buf) : NULL,
+                       hdrrflags, &tmp_err);
+        task->fd = -1;  // Closed by the load_rpm()
         assert(pkg || tmp_err);
 
         if (!pkg) {
@@ -716,6 +1088,9 @@ cr_dumper_thread(gpointer data, gpointer user_data)
 
     if (dtask) {
         dtask->pkg = pkg;
+        if (task->fd >= 0)
+            close(task->fd);
+        g_free(task->checksum);
         g_free(task->full_path);
         g_free(task->filename);
         g_free(task->path);
@@ -723,14 +1098,9 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         return;
     }
 
-    // Pre-calculate the XML data aside any critical section, and early enough
-    // so we can put it into the buffer (so buffered single-threaded write later
-    // is faster).
-    if (udata->filelists_ext) {
-        res = cr_xml_dump_ext(pkg,  &tmp_err);
-    } else {
-        res = cr_xml_dump(pkg, &tmp_err);
-    }
+    // Generate the XML data aside any critical section, the writer
+    // threads then only append the chunks to the outputs
+    res = dump_package(pkg, udata->filelists_ext, &tmp_err);
     if (tmp_err) {
         g_critical("Cannot dump XML for %s (%s): %s",
                    pkg->name, pkg->pkgId, tmp_err->message);
@@ -739,78 +1109,28 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         goto task_cleanup;
     }
 
-    // Buffering stuff
-    g_mutex_lock(&(udata->mutex_buffer));
-
-    if (g_queue_get_length(udata->buffer) < MAX_TASK_BUFFER_LEN
-        && udata->id_pri != task->id
-        && udata->task_count > (task->id + 1))
-    {
-        // If:
-        //  * this isn't our turn
-        //  * the buffer isn't full
-        //  * this isn't the last task
-        // Then: save the task to the buffer
-
-        struct BufferedTask *buf_task = g_malloc0(sizeof(struct BufferedTask));
-        buf_task->id  = task->id;
-        buf_task->res = res;
-        buf_task->pkg = pkg;
-
-        g_queue_insert_sorted(udata->buffer, buf_task, buf_task_sort_func, NULL);
-        g_mutex_unlock(&(udata->mutex_buffer));
-
-        g_free(task->full_path);
-        g_free(task->filename);
-        g_free(task->path);
-        g_free(task);
-
-        return;
-    }
-
-    g_mutex_unlock(&(udata->mutex_buffer));
-
-    // Dump XML and SQLite
-    write_pkg(task->id, res, pkg, udata);
-
-    g_free(res.primary);
-    g_free(res.filelists);
-    g_free(res.filelists_ext);
-    g_free(res.other);
+    // Hand the result over to the writers, they take care of the order
+    deposit_task(task->id, res, pkg, udata);
+    task_done = TRUE;
 
 task_cleanup:
     // Clean up
-    if (!dtask && udata->id_pri <= task->id) {
-        // An error was encountered and we have to wait to increment counters
-        wait_for_incremented_ids(task->id, udata);
+    if (!dtask && !task_done) {
+        // An error was encountered, the writers still have to skip this ID
+        deposit_empty_task(task->id, udata);
     }
 
+    if (udata->old_md_stream && !old_used)
+        // Unused package from the streamed old metadata
+        cr_package_free(md);
+
+    if (task->fd >= 0)
+        close(task->fd);
+    g_free(task->checksum);
     g_free(task->full_path);
     g_free(task->filename);
     g_free(task->path);
     g_free(task);
 
-    // Try to write all results from buffer which was waiting for us
-    while (1) {
-        struct BufferedTask *buf_task;
-        g_mutex_lock(&(udata->mutex_buffer));
-        buf_task = g_queue_peek_head(udata->buffer);
-        if (buf_task && buf_task->id == udata->id_pri) {
-            buf_task = g_queue_pop_head (udata->buffer);
-            g_mutex_unlock(&(udata->mutex_buffer));
-            // Dump XML and SQLite
-            write_pkg(buf_task->id, buf_task->res, buf_task->pkg, udata);
-            // Clean up
-            g_free(buf_task->res.primary);
-            g_free(buf_task->res.filelists);
-            g_free(buf_task->res.filelists_ext);
-            g_free(buf_task->res.other);
-            g_free(buf_task);
-        } else {
-            g_mutex_unlock(&(udata->mutex_buffer));
-            break;
-        }
-    }
-
     return;
 }
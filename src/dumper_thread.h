@@ -25,12 +25,14 @@ extern "C" {
 #endif
 
 #include <glib.h>
+#include "checksum_cache.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
 #include "misc.h"
 #include "package.h"
 #include "sqlite.h"
 #include "xml_file.h"
+#include "xml_parser.h"
 
 /** \defgroup   dumperthread    Implementation of concurent dumping used in createrepo_c
  *  \addtogroup dumperthread
@@ -43,6 +45,18 @@ struct PoolTask {
     char* full_path;                // Complete path - /foo/bar/packages/foo.rpm
     char* filename;                 // Just filename - foo.rpm
     char* path;                     // Just path     - /foo/bar/packages
+    int   fd;                       // Package opened and read by the I/O
+                                    // stage, -1 if not available
+    struct stat stat_buf;           // Stat of the fd (if fd >= 0)
+    char *checksum;                 // Checksum of the package computed
+                                    // by the I/O stage or NULL
+    struct cr_HeaderRangeStruct hdr_r; // Header range found together
+                                    // with the checksum
+    gboolean read_done;             // The I/O stage is done with the task
+    cr_Package *old_pkg;            // Matching package from the streamed
+                                    // old metadata (--update-stream)
+    gboolean old_matched;           // Was the task matched against
+                                    // the streamed old metadata?
 };
 
 struct DuplicateLocation {
@@ -50,6 +64,31 @@ struct DuplicateLocation {
     cr_Package *pkg;
 };
 
+struct UserData;
+struct BufferedTask;
+
+/** Output streams, every one of them has its own writer thread
+ */
+typedef enum {
+    CR_DUMPER_OUTPUT_PRI,           // primary.xml (+ zck)
+    CR_DUMPER_OUTPUT_FIL,           // filelists.xml (+ zck)
+    CR_DUMPER_OUTPUT_FEX,           // filelists-ext.xml (+ zck)
+    CR_DUMPER_OUTPUT_OTH,           // other.xml (+ zck)
+    CR_DUMPER_OUTPUT_PRI_DB,        // primary.sqlite
+    CR_DUMPER_OUTPUT_FIL_DB,        // filelists.sqlite
+    CR_DUMPER_OUTPUT_FEX_DB,        // filelists-ext.sqlite
+    CR_DUMPER_OUTPUT_OTH_DB,        // other.sqlite
+    CR_DUMPER_OUTPUT_SENTINEL,
+} cr_DumperOutput;
+
+struct OutputWriter {
+    cr_DumperOutput type;           // Which output the writer serves
+    const char *name;               // Name used in messages
+    struct UserData *udata;         // Shared user data
+    GThread *thread;                // Writer thread (NULL if not used)
+    char *prev_srpm;                // Srpm of the previously written package
+};
+
 struct UserData {
     cr_XmlFile *pri_f;              // Opened compressed primary.xml.*
     cr_XmlFile *fil_f;              // Opened compressed filelists.xml.*
@@ -63,15 +102,13 @@ struct UserData {
     cr_XmlFile *fil_zck;            // Opened compressed filelists.xml.zck
     cr_XmlFile *fex_zck;            // Opened compressed filelists-ext.xml.zck
     cr_XmlFile *oth_zck;            // Opened compressed other.xml.zck
-    char *prev_srpm;                // Previous srpm
-    char *cur_srpm;                 // Current srpm
     int changelog_limit;            // Max number of changelogs for a package
     const char *location_base;      // Base location url
     int repodir_name_len;           // Len of path to repo /foo/bar/repodata
                                     //       This part     |<----->|
     const char *checksum_type_str;  // Name of selected checksum
     cr_ChecksumType checksum_type;  // Constant representing selected checksum
-    const char *checksum_cachedir;  // Dir with cached checksums
+    cr_ChecksumCache *checksum_cache; // Cache of checksums (--cachedir)
     gboolean skip_symlinks;         // Skip symlinks
     gboolean filelists_ext;         // Include hashes (and create filelists-ext.*)
     long task_count;                // Total number of tasks to process
@@ -86,24 +123,41 @@ struct UserData {
     gboolean skip_stat;             // Skip stat() while updating
     cr_Metadata *old_metadata;      // Loaded metadata
     GMutex mutex_old_md;            // Mutex for accessing old metadata
+    cr_PkgIterator *old_md_stream;  // Old metadata streamed in the order
+                                    // of the tasks (--update-stream)
+    cr_Package *old_md_next;        // The first not yet matched package
+                                    // from the old_md_stream
+    gchar *old_md_href;             // Href of the last streamed package
+    gboolean old_md_eof;            // No more packages in the old_md_stream
+    long old_md_matched;            // Tasks with a lower ID were matched
+    GCond cond_old_md_matched;      // The old_md_matched was increased
+
+    // Ordered output (reorder buffer)
+    long write_buffer_depth;        // Number of slots in the reorder buffer
+    struct BufferedTask **write_buffer; // Finished tasks, slot = ID % depth
+    long write_buffer_released;     // Tasks with a lower ID were already
+                                    // written to all outputs
+    GMutex mutex_write_buffer;      // Mutex for the reorder buffer
+    GCond cond_deposited;           // A finished task was deposited
+    GCond cond_released;            // A slot of the buffer was released
+    struct OutputWriter writers[CR_DUMPER_OUTPUT_SENTINEL]; // One per output
+    gboolean free_written_pkgs;     // Packages are owned by the writers
+                                    // (freed once written to all outputs)
 
-    // Thread serialization
-    GMutex mutex_pri;               // Mutex for primary metadata
-    GMutex mutex_fil;               // Mutex for filelists metadata
-    GMutex mutex_fex;               // Mutex for filelists-ext metadata
-    GMutex mutex_oth;               // Mutex for other metadata
-    GCond cond_pri;                 // Condition for primary metadata
-    GCond cond_fil;                 // Condition for filelists metadata
-    GCond cond_fex;                 // Condition for filelists-ext metadata
-    GCond cond_oth;                 // Condition for other metadata
-    volatile long id_pri;           // ID of task on turn (write primary metadata)
-    volatile long id_fil;           // ID of task on turn (write filelists metadata)
-    volatile long id_fex;           // ID of task on turn (write filelists-ext metadata)
-    volatile long id_oth;           // ID of task on turn (write other metadata)
-
-    // Buffering
-    GQueue *buffer;                 // Buffer for done tasks
-    GMutex mutex_buffer;            // Mutex for accessing the buffer
+    // I/O stage (read-ahead)
+    gboolean io_stage;              // Are packages read by the I/O stage?
+    long readahead;                 // How many tasks may the I/O stage read
+                                    // ahead of the dumpers
+    long dump_started;              // Number of tasks taken by the dumpers
+    GMutex mutex_io;                // Mutex for the I/O stage
+    GCond cond_io_done;             // A task was read by the I/O stage
+    GCond cond_io_window;           // The read-ahead window moved
+
+    // Queue depths (high-water marks)
+    long io_queue_max;              // Max number of tasks read ahead
+    long io_waits;                  // Number of tasks a dumper had to wait
+                                    // for the I/O stage for
+    long write_buffer_max;          // Max number of tasks in the reorder buffer
 
     // Delta generation
     gboolean deltas;                // Are deltas enabled?
@@ -128,6 +182,64 @@ struct UserData {
 void
 cr_dumper_thread(gpointer data, gpointer user_data);
 
+/** I/O stage of the pipeline.
+ * Opens the package and reads it through before a dumper gets to it,
+ * computing its checksum and header range on the way. The opened fd,
+ * its stat and the checksum are handed over to the dumper, which then
+ * only reads the header again. With a checksum cache, the checksum is
+ * looked up (or computed) by the dumper as it needs the hdrid, so only
+ * the fd is handed over.
+ * The stage never reads more than udata->readahead tasks ahead of
+ * the dumpers. Packages which are going to be reused from the old
+ * metadata (--update) are not read.
+ * Must be fed by the same tasks in the same order as the dumper pool.
+ */
+void
+cr_reader_thread(gpointer data, gpointer user_data);
+
+/** Start one writer thread per output. The writers drain the reorder
+ * buffer in the order of task IDs, so the workers never wait for their
+ * turn, they only deposit the finished task into the buffer.
+ * Every opened sqlite database gets a writer of its own, so the inserts
+ * overlap with the XML dumping instead of being serialized with it.
+ * Must be called once the UserData (including the task_count and the
+ * write_buffer_depth) are filled and before any task is processed.
+ * @param udata         user data shared with the dumper threads
+ */
+void
+cr_dumper_writers_start(struct UserData *udata);
+
+/** Set the final number of tasks. Useful when the tasks are produced
+ * on the fly (the writers were started with an upper bound of the
+ * task_count), the writers stop once they write the last task.
+ * Every ID lower than task_count still has to be deposited.
+ * @param udata         user data shared with the dumper threads
+ * @param task_count    total number of tasks
+ */
+void
+cr_dumper_writers_set_task_count(struct UserData *udata, long task_count);
+
+/** Wait until all the tasks are written and join the writer threads.
+ * Every task ID lower than task_count has to be deposited (by the
+ * cr_dumper_thread() or the cr_delayed_dump_run()) before this returns.
+ * @param udata         user data shared with the dumper threads
+ */
+void
+cr_dumper_writers_finish(struct UserData *udata);
+
+/** Dump XML of an already loaded package and hand it over to the writers
+ * as the task with the given ID. Callable from any number of threads,
+ * the writers restore the order of the IDs. The pkg may be NULL (or
+ * marked by skip_dump), the ID is then just marked as done.
+ * The package must not be freed before cr_dumper_writers_finish(),
+ * unless udata->free_written_pkgs is set - the writers free it then.
+ * @param id            ID of the task (0 .. task_count-1)
+ * @param pkg           package to dump or NULL
+ * @param udata         user data with started writers
+ */
+void
+cr_dumper_dump_package(long id, cr_Package *pkg, struct UserData *udata);
+
 
 void
 cr_delayed_dump_set(gpointer user_data);
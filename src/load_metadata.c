@@ -34,6 +34,8 @@
 #include "load_metadata.h"
 #include "locate_metadata.h"
 #include "xml_parser.h"
+#include "xml_parser_internal.h"
+#include "metadata_internal.h"
 
 #define ERR_DOMAIN              CREATEREPO_C_ERROR
 #define STRINGCHUNK_SIZE        16384
@@ -44,9 +46,14 @@ struct _cr_Metadata {
     cr_HashTableKey key;    /*!< key used in hashtable */
     GHashTable *ht;         /*!< hashtable with packages */
     GStringChunk *chunk;    /*!< NULL or string chunk with strings from htn */
+    GSList *secondary_chunks; /*!< Chunks with strings of files and
+        changelogs kept from the filelists and other parsers in
+        the single chunk mode */
     GHashTable *pkglist_ht; /*!< list of allowed package basenames to load */
     cr_HashTableKeyDupAction dupaction; /*!<
         How to behave in case of duplicated items */
+    gboolean raw_xml;       /*!< Keep raw <package> elements in packages */
+    gboolean raw_only;      /*!< Don't parse files and changelogs */
 
 #ifdef WITH_LIBMODULEMD
     ModulemdModuleIndex *moduleindex; /*!< Module metadata */
@@ -146,11 +153,21 @@ cr_metadata_free(cr_Metadata *md)
     cr_destroy_metadata_hashtable(md->ht);
     if (md->chunk)
         g_string_chunk_free(md->chunk);
+    g_slist_free_full(md->secondary_chunks,
+                      (GDestroyNotify) g_string_chunk_free);
     if (md->pkglist_ht)
         g_hash_table_destroy(md->pkglist_ht);
     g_free(md);
 }
 
+void
+cr_metadata_set_raw_xml(cr_Metadata *md, gboolean raw_xml, gboolean only)
+{
+    assert(md);
+    md->raw_xml = raw_xml;
+    md->raw_only = raw_xml && only;
+}
+
 gboolean
 cr_metadata_set_dupaction(cr_Metadata *md, cr_HashTableKeyDupAction dupaction)
 {
@@ -180,7 +197,6 @@ typedef struct {
         primary.xml with metadata from filelists[_ext].xml and other.xml and
         we want the pkgId to be unique.
         Key is pkgId and value is NULL. */
-    cr_ParsingState state;
     gint64          pkgKey; /*!< basically order of the package */
 } cr_CbData;
 
@@ -289,84 +305,255 @@ primary_pkgcb(cr_Package *pkg, void *cbdata, G_GNUC_UNUSED GError **err)
     return CR_CB_RET_OK;
 }
 
+/** Filelists or other xml parsed in a separate thread.
+ * The packages are stored into a private hashtable (key is pkgId) and
+ * their strings into a private chunk (single chunk mode) or chunks of
+ * the packages, so the thread doesn't touch anything shared with
+ * the primary.xml parser.
+ */
+typedef struct {
+    cr_ParsingState state;
+    const char      *path;
+    cr_XmlParserFunc parser_func;
+    GHashTable      *ht;
+    GStringChunk    *chunk; /*!< Chunk for all strings or NULL */
+    gint            *stop;  /*!< Set if primary.xml parsing failed */
+    GError          *err;
+} cr_SecondaryXml;
+
 static int
-newpkgcb(cr_Package **pkg,
-         const char *pkgId,
-         G_GNUC_UNUSED const char *name,
-         G_GNUC_UNUSED const char *arch,
-         void *cbdata,
-         G_GNUC_UNUSED GError **err)
+secondary_newpkgcb(cr_Package **pkg,
+                   const char *pkgId,
+                   G_GNUC_UNUSED const char *name,
+                   G_GNUC_UNUSED const char *arch,
+                   void *cbdata,
+                   G_GNUC_UNUSED GError **err)
 {
-    cr_CbData *cb_data = cbdata;
+    cr_SecondaryXml *sec = cbdata;
 
     assert(*pkg == NULL);
     assert(pkgId);
 
-    *pkg = g_hash_table_lookup(cb_data->ht, pkgId);
+    if (g_atomic_int_get(sec->stop))
+        // The result would be thrown away anyway
+        return CR_CB_RET_ERR;
 
-    if (*pkg) {
-        // If package with the pkgId was parsed from primary.xml, then...
-
-        if (cb_data->state == PARSING_FIL) {
-            if ((*pkg)->loadingflags & CR_PACKAGE_LOADED_FIL) {
-                // For package with this checksum, the filelist was
-                // already loaded.
-                *pkg = NULL;
-            } else {
-                // Make a note that filelist is parsed
-                (*pkg)->loadingflags |= CR_PACKAGE_LOADED_FIL;
-            }
-        }
-
-        if (cb_data->state == PARSING_OTH) {
-            if ((*pkg)->loadingflags & CR_PACKAGE_LOADED_OTH) {
-                // For package with this checksum, the other (changelogs) were
-                // already loaded.
-                *pkg = NULL;
-            } else {
-                // Make a note that other is parsed
-                (*pkg)->loadingflags |= CR_PACKAGE_LOADED_OTH;
-            }
-        }
+    if (g_hash_table_contains(sec->ht, pkgId))
+        // Metadata for this checksum were already loaded
+        return CR_CB_RET_OK;
 
-        if (*pkg && cb_data->chunk) {
-            assert(!(*pkg)->chunk);
-            (*pkg)->chunk = cb_data->chunk;
-        }
+    if (sec->chunk) {
+        *pkg = cr_package_new_without_chunk();
+        (*pkg)->chunk = sec->chunk;
+        (*pkg)->loadingflags |= CR_PACKAGE_SINGLE_CHUNK;
+    } else {
+        *pkg = cr_package_new();
     }
 
     return CR_CB_RET_OK;
 }
 
 static int
-pkgcb(cr_Package *pkg, void *cbdata, G_GNUC_UNUSED GError **err)
+secondary_pkgcb(cr_Package *pkg, void *cbdata, G_GNUC_UNUSED GError **err)
 {
-    cr_CbData *cb_data = cbdata;
+    cr_SecondaryXml *sec = cbdata;
 
-    if (cb_data->chunk) {
-        assert(pkg->chunk == cb_data->chunk);
+    if (sec->chunk) {
+        assert(pkg->chunk == sec->chunk);
         pkg->chunk = NULL;
     }
+    g_hash_table_replace(sec->ht, pkg->pkgId, pkg);
 
     return CR_CB_RET_OK;
 }
 
+static gpointer
+secondary_xml_thread(gpointer data)
+{
+    cr_SecondaryXml *sec = data;
+
+    if (sec->state == PARSING_FIL)
+        cr_xml_parse_filelists_internal(sec->path,
+                                        secondary_newpkgcb,
+                                        sec,
+                                        secondary_pkgcb,
+                                        sec,
+                                        cr_warning_cb,
+                                        "Filelists XML parser",
+                                        sec->parser_func,
+                                        &sec->err);
+    else
+        cr_xml_parse_other_internal(sec->path,
+                                    secondary_newpkgcb,
+                                    sec,
+                                    secondary_pkgcb,
+                                    sec,
+                                    cr_warning_cb,
+                                    "Other XML parser",
+                                    sec->parser_func,
+                                    &sec->err);
+
+    return NULL;
+}
+
+/** Check whether most of the packages parsed by a secondary thread
+ * are also in primary.xml (and were not filtered out).
+ */
+static gboolean
+secondary_xml_mostly_used(GHashTable *hashtable, cr_SecondaryXml *sec)
+{
+    GHashTableIter iter;
+    gpointer key;
+    guint used = 0;
+
+    g_hash_table_iter_init(&iter, sec->ht);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        if (g_hash_table_contains(hashtable, key))
+            used++;
+
+    return used > 0 && used >= g_hash_table_size(sec->ht) / 2;
+}
+
+/** Move files or changelogs parsed by a secondary thread into the packages
+ * from primary.xml. Every parsed package is freed right after it is
+ * joined (or dropped), so its strings are not held twice.
+ * @param hashtable     packages from primary.xml
+ * @param sec           finished secondary parser
+ * @param chunk         shared chunk in the single chunk mode or NULL
+ * @param copy_strings  copy strings into the chunk or into the chunk
+ *                      of the package, always TRUE if chunk is NULL;
+ *                      FALSE if the private chunk is kept alive
+ */
+static void
+secondary_xml_join(GHashTable *hashtable,
+                   cr_SecondaryXml *sec,
+                   GStringChunk *chunk,
+                   gboolean copy_strings)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    assert(chunk || copy_strings);
+
+    // Without the files and changelogs the content isn't loaded
+    gboolean loaded = sec->parser_func != cr_xml_parser_generic_raw_only;
+
+    g_hash_table_iter_init(&iter, sec->ht);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        cr_Package *spkg = value;
+        cr_Package *pkg = g_hash_table_lookup(hashtable, key);
+        GStringChunk *dst = pkg ? (chunk ? chunk : pkg->chunk) : NULL;
+
+        if (!pkg) {
+            // Not in primary.xml or filtered out
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+
+        if (sec->state == PARSING_FIL) {
+            if (loaded)
+                pkg->loadingflags |= CR_PACKAGE_LOADED_FIL;
+            for (GSList *elem = spkg->files;
+                 copy_strings && elem;
+                 elem = g_slist_next(elem))
+            {
+                cr_PackageFile *file = elem->data;
+                // file->type points to a static string
+                file->path = cr_safe_string_chunk_insert_const(dst, file->path);
+                file->name = cr_safe_string_chunk_insert(dst, file->name);
+                file->digest = cr_safe_string_chunk_insert(dst, file->digest);
+            }
+            pkg->files = g_slist_concat(pkg->files, spkg->files);
+            spkg->files = NULL;
+            if (!pkg->files_checksum_type)
+                pkg->files_checksum_type = copy_strings
+                    ? cr_safe_string_chunk_insert(dst,
+                                                  spkg->files_checksum_type)
+                    : spkg->files_checksum_type;
+            if (spkg->raw_filelists) {
+                g_free(pkg->raw_filelists);
+                pkg->raw_filelists = g_steal_pointer(&spkg->raw_filelists);
+            }
+            if (spkg->raw_filelists_ext) {
+                g_free(pkg->raw_filelists_ext);
+                pkg->raw_filelists_ext = g_steal_pointer(&spkg->raw_filelists_ext);
+            }
+        } else {
+            if (loaded)
+                pkg->loadingflags |= CR_PACKAGE_LOADED_OTH;
+            for (GSList *elem = spkg->changelogs;
+                 copy_strings && elem;
+                 elem = g_slist_next(elem))
+            {
+                cr_ChangelogEntry *changelog = elem->data;
+                changelog->author = cr_safe_string_chunk_insert(dst,
+                                                        changelog->author);
+                changelog->changelog = cr_safe_string_chunk_insert(dst,
+                                                        changelog->changelog);
+            }
+            pkg->changelogs = g_slist_concat(pkg->changelogs,
+                                             spkg->changelogs);
+            spkg->changelogs = NULL;
+            if (spkg->raw_other) {
+                g_free(pkg->raw_other);
+                pkg->raw_other = g_steal_pointer(&spkg->raw_other);
+            }
+        }
+
+        // Frees the chunk of the spkg as well (if it has its own)
+        g_hash_table_iter_remove(&iter);
+    }
+}
+
 static int
 cr_load_xml_files(GHashTable *hashtable,
                   const char *primary_xml_path,
                   const char *filelists_xml_path,
                   const char *other_xml_path,
                   GStringChunk *chunk,
+                  GSList **secondary_chunks,
                   GHashTable *pkglist_ht,
+                  gboolean raw_xml,
+                  gboolean raw_only,
                   GError **err)
 {
     cr_CbData cb_data;
     GError *tmp_err = NULL;
+    int code = CRE_OK;
+    gint stop = 0;
+    cr_XmlParserFunc parser_func = raw_xml ? cr_xml_parser_generic_raw
+                                           : cr_xml_parser_generic;
+    // Files and changelogs are kept in the raw elements only
+    cr_XmlParserFunc sec_parser_func = raw_only ? cr_xml_parser_generic_raw_only
+                                                : parser_func;
+    cr_SecondaryXml secondary[] = {
+        { PARSING_FIL, filelists_xml_path, sec_parser_func, NULL, NULL, &stop, NULL },
+        { PARSING_OTH, other_xml_path, sec_parser_func, NULL, NULL, &stop, NULL },
+    };
+    GThread *threads[G_N_ELEMENTS(secondary)] = { NULL };
 
     assert(hashtable);
 
+    // Filelists and other are parsed in their own threads while
+    // primary.xml is parsed here, the results are joined by pkgId
+    // afterwards. Packages from filelists and other which are not
+    // in primary (or not in pkglist) are dropped by the join.
+    for (gsize x = 0; x < G_N_ELEMENTS(secondary); x++) {
+        cr_SecondaryXml *sec = &secondary[x];
+
+        if (!sec->path)
+            continue;
+
+        sec->ht = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        NULL, cr_free_values);
+        if (chunk)
+            sec->chunk = g_string_chunk_new(STRINGCHUNK_SIZE);
+        threads[x] = g_thread_new(sec->state == PARSING_FIL
+                                    ? "filelists parser" : "other parser",
+                                  secondary_xml_thread, sec);
+    }
+
     // Prepare cb data
-    cb_data.state           = PARSING_PRI;
     cb_data.ht              = hashtable;
     cb_data.chunk           = chunk;
     cb_data.pkglist_ht      = pkglist_ht;
@@ -374,65 +561,66 @@ cr_load_xml_files(GHashTable *hashtable,
                                                     g_free, NULL);
     cb_data.pkgKey          = G_GINT64_CONSTANT(0);
 
-    cr_xml_parse_primary(primary_xml_path,
-                         primary_newpkgcb,
-                         &cb_data,
-                         primary_pkgcb,
-                         &cb_data,
-                         cr_warning_cb,
-                         "Primary XML parser",
-                         (filelists_xml_path) ? 0 : 1,
-                         &tmp_err);
+    cr_xml_parse_primary_internal(primary_xml_path,
+                                  primary_newpkgcb,
+                                  &cb_data,
+                                  primary_pkgcb,
+                                  &cb_data,
+                                  cr_warning_cb,
+                                  "Primary XML parser",
+                                  (filelists_xml_path) ? 0 : 1,
+                                  parser_func,
+                                  &tmp_err);
 
     g_hash_table_destroy(cb_data.ignored_pkgIds);
     cb_data.ignored_pkgIds = NULL;
 
+    // Don't wait for the whole filelists and other to be parsed in vain
+    if (tmp_err)
+        g_atomic_int_set(&stop, 1);
+
+    for (gsize x = 0; x < G_N_ELEMENTS(secondary); x++)
+        if (threads[x])
+            g_thread_join(threads[x]);
+
     if (tmp_err) {
-        int code = tmp_err->code;
+        code = tmp_err->code;
         g_debug("primary.xml parsing error: %s", tmp_err->message);
         g_propagate_prefixed_error(err, tmp_err, "primary.xml parsing: ");
-        return code;
     }
 
-    cb_data.state = PARSING_FIL;
-
-    if (filelists_xml_path) {
-        cr_xml_parse_filelists(filelists_xml_path,
-                               newpkgcb,
-                               &cb_data,
-                               pkgcb,
-                               &cb_data,
-                               cr_warning_cb,
-                               "Filelists XML parser",
-                               &tmp_err);
-        if (tmp_err) {
-            int code = tmp_err->code;
-            g_debug("filelists.xml parsing error: %s", tmp_err->message);
-            g_propagate_prefixed_error(err, tmp_err, "filelists.xml parsing: ");
-            return code;
+    for (gsize x = 0; x < G_N_ELEMENTS(secondary); x++) {
+        cr_SecondaryXml *sec = &secondary[x];
+        const char *name = (sec->state == PARSING_FIL) ? "filelists.xml"
+                                                       : "other.xml";
+
+        if (!sec->path)
+            continue;
+
+        if (sec->err && code == CRE_OK) {
+            code = sec->err->code;
+            g_debug("%s parsing error: %s", name, sec->err->message);
+            g_propagate_prefixed_error(err, sec->err, "%s parsing: ", name);
+            sec->err = NULL;
+        } else if (code == CRE_OK) {
+            // In the single chunk mode, the strings stay in the private
+            // chunk instead of being copied, unless most of them belong
+            // to packages which are not loaded
+            gboolean keep_chunk = sec->chunk
+                                  && secondary_xml_mostly_used(hashtable, sec);
+            secondary_xml_join(hashtable, sec, chunk, !keep_chunk);
+            if (keep_chunk)
+                *secondary_chunks = g_slist_prepend(*secondary_chunks,
+                                                    g_steal_pointer(&sec->chunk));
         }
-    }
 
-    cb_data.state = PARSING_OTH;
-
-    if (other_xml_path) {
-        cr_xml_parse_other(other_xml_path,
-                           newpkgcb,
-                           &cb_data,
-                           pkgcb,
-                           &cb_data,
-                           cr_warning_cb,
-                           "Other XML parser",
-                           &tmp_err);
-        if (tmp_err) {
-            int code = tmp_err->code;
-            g_debug("other.xml parsing error: %s", tmp_err->message);
-            g_propagate_prefixed_error(err, tmp_err, "other.xml parsing: ");
-            return code;
-        }
+        g_clear_error(&sec->err);
+        g_hash_table_destroy(sec->ht);
+        if (sec->chunk)
+            g_string_chunk_free(sec->chunk);
     }
 
-    return CRE_OK;
+    return code;
 }
 
 static gint
@@ -556,7 +744,10 @@ cr_metadata_load_xml(cr_Metadata *md,
                                ml->fex_xml_href ? ml->fex_xml_href : ml->fil_xml_href,
                                ml->oth_xml_href,
                                md->chunk,
+                               &md->secondary_chunks,
                                md->pkglist_ht,
+                               md->raw_xml,
+                               md->raw_only,
                                &tmp_err);
 
     if (result != CRE_OK) {
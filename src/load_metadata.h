@@ -104,7 +104,8 @@ GHashTable *cr_metadata_hashtable(cr_Metadata *md);
  * @param key               key specifies which value will be (is) used as key
  *                          in hash table
  * @param use_single_chunk  use only one string chunk (all loaded packages
- *                          share one string chunk in the cr_Metadata object)
+ *                          share string chunks owned by the cr_Metadata
+ *                          object)
  *                          Packages will not be standalone objects.
  *                          This option leads to less memory consumption.
  * @param pkglist           load only packages which base filename is in this
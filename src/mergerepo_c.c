@@ -30,6 +30,7 @@
 #endif /* WITH_LIBMODULEMD */
 #include "error.h"
 #include "createrepo_shared.h"
+#include "dumper_thread.h"
 #include "version.h"
 #include "helpers.h"
 #include "metadata_internal.h"
@@ -46,6 +47,8 @@
 #include "koji.h"
 
 #define DEFAULT_OUTPUTDIR               "merged_repo/"
+#define DUMP_WRITE_BUFFER_DEPTH         128
+#define STREAM_HEADER_PKGS              G_MAXINT
 
 #include "mergerepo_c.h"
 
@@ -91,6 +94,17 @@ static GOptionEntry cmd_entries[] =
       "Do not merge updateinfo metadata", NULL },
     { "compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.compress_type),
       "Which compression type to use", "COMPRESS_TYPE" },
+    { "compress-threads", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.compress_threads),
+      "Number of threads used to compress each zstd, xz, gz or bz2 metadata file "
+      "(default: 0 - single-threaded compression)", "NUM" },
+    { "decompress-threads", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.decompress_threads),
+      "Number of threads used to decompress each zstd, xz, gz or bz2 metadata "
+      "file of the input repositories ahead of the XML parser, xz files "
+      "are also decoded by NUM threads if NUM > 1 "
+      "(default: 0 - decompressed by the parser thread)", "NUM" },
+    { "workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.workers),
+      "Number of threads used to load the repositories and to dump "
+      "the merged metadata (default: 0 - number of CPUs)", "NUM" },
 #ifdef WITH_ZCHUNK
     { "zck", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.zck_compression),
       "Generate zchunk files as well as the standard repodata.", NULL },
@@ -113,6 +127,12 @@ static GOptionEntry cmd_entries[] =
       "Do not include the file's checksum in the metadata filename.", NULL },
     { "omit-baseurl", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.omit_baseurl),
       "Don't add a baseurl to packages that don't have one before." , NULL},
+    { "stream", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.stream),
+      "Merge the repositories in a single pass over their metadata, only "
+      "packages with the same name are kept in memory at a time. Packages "
+      "in the primary.xml of every repository must be sorted by name "
+      "(as in the output of mergerepo_c). Cannot be used with --noarch-repo, "
+      "--koji or --pkgorigins.", NULL },
 
     // -- Options related to Koji-mergerepos behaviour
     { "koji", 'k', 0, G_OPTION_ARG_NONE, &(_cmd_options.koji),
@@ -289,6 +309,28 @@ check_arguments(struct CmdOptions *options)
         }
     }
 
+    // Compression threads
+    if ((options->compress_threads < 0) || (options->compress_threads > 200)) {
+        g_critical("Wrong number of compression threads: %d",
+                   options->compress_threads);
+        ret = FALSE;
+    }
+
+    // Decompression threads
+    if ((options->decompress_threads < 0) || (options->decompress_threads > 200)) {
+        g_critical("Wrong number of decompression threads: %d",
+                   options->decompress_threads);
+        ret = FALSE;
+    }
+
+    // Workers
+    if (options->workers < 0) {
+        g_critical("Wrong number of workers: %d", options->workers);
+        ret = FALSE;
+    } else if (options->workers == 0) {
+        options->workers = g_get_num_processors();
+    }
+
     // Merge method
     if (options->merge_method_str) {
         if (options->koji) {
@@ -349,6 +391,18 @@ check_arguments(struct CmdOptions *options)
         }
     }
 
+    // Stream merge
+    if (options->stream) {
+        if (options->noarch_repo_url) {
+            g_critical("--stream cannot be used with --noarch-repo");
+            ret = FALSE;
+        }
+        if (options->koji || options->pkgorigins) {
+            g_critical("--stream cannot be used with -k/--koji or --pkgorigins");
+            ret = FALSE;
+        }
+    }
+
     // Zchunk options
     if (options->zck_dict_dir && !options->zck_compression) {
         g_critical("Cannot use --zck-dict-dir without setting --zck");
@@ -561,19 +615,9 @@ add_package(cr_Package *pkg,
 
                 // NVR merge method
                 case MM_WITH_HIGHEST_NEVRA: {
-                    gboolean pkg_is_newer = FALSE;
-
-                    int epoch_cmp   = cr_cmp_version_str(pkg->epoch, c_pkg->epoch);
-                    int version_cmp = cr_cmp_version_str(pkg->version, c_pkg->version);
-                    int release_cmp = cr_cmp_version_str(pkg->release, c_pkg->release);
-
-
-                    if (epoch_cmp == 1)
-                        pkg_is_newer = TRUE;
-                    else if (epoch_cmp == 0 && version_cmp == 1)
-                        pkg_is_newer = TRUE;
-                    else if (epoch_cmp == 0 && version_cmp == 0 && release_cmp == 1)
-                        pkg_is_newer = TRUE;
+                    gboolean pkg_is_newer = cr_evr_key_cmp(
+                                                cr_package_evr_key(pkg),
+                                                cr_package_evr_key(c_pkg)) > 0;
 
                     if (pkg_is_newer) {
                         // Remove older package
@@ -600,9 +644,8 @@ add_package(cr_Package *pkg,
                     // We want to check if two packages are the same.
                     // We already know that name and arch matches.
                     // We need to check version and release and epoch
-                    if ((cr_cmp_version_str(pkg->epoch, c_pkg->epoch) == 0)
-                        && (cr_cmp_version_str(pkg->version, c_pkg->version) == 0)
-                        && (cr_cmp_version_str(pkg->release, c_pkg->release) == 0))
+                    if (cr_evr_key_cmp(cr_package_evr_key(pkg),
+                                       cr_package_evr_key(c_pkg)) == 0)
                     {
                         // Both packages are the same (at least by NEVRA values)
                         g_debug("Same version of package %s.%s "
@@ -616,9 +659,8 @@ add_package(cr_Package *pkg,
                     break;
                 case MM_ALL_WITH_IDENTICAL_NEVRA:
                     // We want even duplicates with exact NEVRAs
-                    if ((cr_cmp_version_str(pkg->epoch, c_pkg->epoch) == 0)
-                        && (cr_cmp_version_str(pkg->version, c_pkg->version) == 0)
-                        && (cr_cmp_version_str(pkg->release, c_pkg->release) == 0))
+                    if (cr_evr_key_cmp(cr_package_evr_key(pkg),
+                                       cr_package_evr_key(c_pkg)) == 0)
                     {
                         // Both packages are the same (at least by NEVRA values)
                         // We warn, but do not omit it
@@ -653,7 +695,79 @@ add_package:
 }
 
 
+/** Base url of the packages of the repo (used as their location_base)
+ */
+static gchar *
+repo_location_base(struct cr_MetadataLocation *ml,
+                   gchar *repo_prefix_search,
+                   gchar *repo_prefix_replace)
+{
+    gchar *repopath = cr_normalize_dir_path(ml->original_url);
+
+    // Base paths in output of original createrepo doesn't have trailing '/'
+    if (repopath && strlen(repopath) > 1)
+        repopath[strlen(repopath)-1] = '\0';
+
+    // If repo_prefix_search and repo_prefix_replace is set, replace
+    // repo_prefix_search in the repopath by repo_prefix_replace.
+    if (repo_prefix_search && *repo_prefix_search &&
+            repo_prefix_replace &&
+            g_str_has_prefix(repopath, repo_prefix_search)) {
+        gchar *repo_suffix = repopath + strlen(repo_prefix_search);
+        gchar *new_repopath = g_strconcat(repo_prefix_replace, repo_suffix, NULL);
+        g_free(repopath);
+        repopath = new_repopath;
+    }
+
+    return repopath;
+}
+
+
+/** Repository loaded by a thread of the pool (see merge_repos)
+ */
+struct RepoLoadTask {
+    struct cr_MetadataLocation *ml; // Location of the repodata
+    cr_Metadata *metadata;          // Loaded repodata or NULL
+    GError *err;                    // Error encountered during loading
+    gboolean done;                  // Loading finished (even unsuccessfully)
+};
+
+/** Data shared by the repo loading threads and the merging (main) thread
+ */
+struct RepoLoader {
+    GMutex mutex;                   // Mutex for the done flags of tasks
+    GCond cond_done;                // A task was done
+};
+
+
+static void
+load_repo_thread(gpointer data, gpointer user_data)
+{
+    struct RepoLoadTask *task = data;
+    struct RepoLoader *loader = user_data;
+    cr_Metadata *metadata = NULL;
+    GError *tmp_err = NULL;
+
+    if (task->ml) {
+        metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+        if (cr_metadata_load_xml(metadata, task->ml, &tmp_err) != CRE_OK)
+            g_clear_pointer(&metadata, cr_metadata_free);
+    }
+
+    g_mutex_lock(&(loader->mutex));
+    task->metadata = metadata;
+    task->err = tmp_err;
+    task->done = TRUE;
+    g_cond_broadcast(&(loader->cond_done));
+    g_mutex_unlock(&(loader->mutex));
+}
+
+
 /**
+ * The repos are loaded in parallel by a pool of workers, at most workers
+ * repos are loaded ahead of the one being merged. The merging itself
+ * is done in order of the repo_list, so the result doesn't depend
+ * on the number of workers.
  * @return Number of loaded packages or -1 on error
  */
 long
@@ -668,7 +782,8 @@ merge_repos(GHashTable *merged,
             struct KojiMergedReposStuff *koji_stuff,
             gboolean omit_baseurl,
             gchar *repo_prefix_search,
-            gchar *repo_prefix_replace)
+            gchar *repo_prefix_replace,
+            int workers)
 {
     long loaded_packages = 0;
     GSList *used_noarch_keys = NULL;
@@ -680,10 +795,31 @@ merge_repos(GHashTable *merged,
     merger = modulemd_module_index_merger_new();
 #endif /* WITH_LIBMODULEMD */
 
-    // Load all repos
+    // Start loading of the repos
 
-    int repoid = 0;
+    int repo_count = g_slist_length(repo_list);
+    struct RepoLoadTask *tasks = g_new0(struct RepoLoadTask, repo_count);
+    struct RepoLoader loader;
+    GThreadPool *load_pool;
+    int pushed = 0;
+
+    g_mutex_init(&(loader.mutex));
+    g_cond_init(&(loader.cond_done));
+    load_pool = g_thread_pool_new(load_repo_thread, &loader,
+                                  workers, FALSE, NULL);
+
+    int x = 0;
     GSList *element = NULL;
+    for (element = repo_list; element; element = g_slist_next(element), x++)
+        tasks[x].ml = (struct cr_MetadataLocation *) element->data;
+
+    for (; pushed < repo_count && pushed < workers; pushed++)
+        g_thread_pool_push(load_pool, &tasks[pushed], NULL);
+
+    // Merge all repos (in order)
+
+    long ret_packages = -1;
+    int repoid = 0;
     for (element = repo_list; element; element = g_slist_next(element), repoid++) {
         gchar *repopath;                    // base url of current repodata
         cr_Metadata *metadata;              // current repodata
@@ -692,35 +828,32 @@ merge_repos(GHashTable *merged,
         ml = (struct cr_MetadataLocation *) element->data;
         if (!ml) {
             g_critical("Bad location!");
-            break;
+            ret_packages = loaded_packages;
+            goto cleanup;
         }
 
-        metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
-        repopath = cr_normalize_dir_path(ml->original_url);
+        // Wait till the repo is loaded and let the pool load the next one
+        g_mutex_lock(&(loader.mutex));
+        while (!tasks[repoid].done)
+            g_cond_wait(&(loader.cond_done), &(loader.mutex));
+        g_mutex_unlock(&(loader.mutex));
 
-        // Base paths in output of original createrepo doesn't have trailing '/'
-        if (repopath && strlen(repopath) > 1)
-            repopath[strlen(repopath)-1] = '\0';
-
-        // If repo_prefix_search and repo_prefix_replace is set, replace
-        // repo_prefix_search in the repopath by repo_prefix_replace.
-        if (repo_prefix_search && *repo_prefix_search &&
-                repo_prefix_replace &&
-                g_str_has_prefix(repopath, repo_prefix_search)) {
-            gchar *repo_suffix = repopath + strlen(repo_prefix_search);
-            gchar *new_repopath = g_strconcat(repo_prefix_replace, repo_suffix, NULL);
-            g_free(repopath);
-            repopath = new_repopath;
-        }
+        metadata = g_steal_pointer(&tasks[repoid].metadata);
+        err = g_steal_pointer(&tasks[repoid].err);
+
+        if (pushed < repo_count)
+            g_thread_pool_push(load_pool, &tasks[pushed++], NULL);
+
+        repopath = repo_location_base(ml, repo_prefix_search,
+                                      repo_prefix_replace);
 
         g_debug("Processing: %s", repopath);
 
-        if (cr_metadata_load_xml(metadata, ml, &err) != CRE_OK) {
-            cr_metadata_free(metadata);
+        if (!metadata) {
             g_critical("Cannot load repo: \"%s\" : %s", ml->original_url, err->message);
             g_error_free(err);
             g_free(repopath);
-            return -1;
+            goto cleanup;
         }
 
 #ifdef WITH_LIBMODULEMD
@@ -804,6 +937,24 @@ merge_repos(GHashTable *merged,
         g_free(repopath);
     }
 
+    ret_packages = loaded_packages;
+
+cleanup:
+    // Drop the not yet started loads and wait for the running ones
+    g_thread_pool_free(load_pool, TRUE, TRUE);
+    for (x = 0; x < repo_count; x++) {
+        if (tasks[x].metadata)
+            cr_metadata_free(tasks[x].metadata);
+        if (tasks[x].err)
+            g_error_free(tasks[x].err);
+    }
+    g_free(tasks);
+    g_mutex_clear(&(loader.mutex));
+    g_cond_clear(&(loader.cond_done));
+
+    if (ret_packages < 0)
+        return -1;
+
 #ifdef WITH_LIBMODULEMD
     g_autoptr(ModulemdModuleIndex) moduleindex =
         modulemd_module_index_merger_resolve (merger, &err);
@@ -844,6 +995,242 @@ package_cmp(gconstpointer a_p, gconstpointer b_p)
 }
 
 
+/** Repository merged by stream_merge_repos()
+ */
+struct RepoStream {
+    struct cr_MetadataLocation *ml; // Location of the repodata
+    gchar *repopath;                // Base url of the packages
+    cr_PkgIterator *iter;           // Packages of the repo (sorted by name)
+    cr_Package *next;               // The first not yet merged package
+};
+
+
+/** Move to the next package of the repo.
+ * @param stream        the repo
+ * @param prev_name     name of the previous package (for the sort check)
+ * @return              FALSE on error (already reported)
+ */
+static gboolean
+repo_stream_next(struct RepoStream *stream, const char *prev_name)
+{
+    GError *tmp_err = NULL;
+
+    stream->next = NULL;
+    if (cr_PkgIterator_is_finished(stream->iter))
+        return TRUE;
+
+    stream->next = cr_PkgIterator_parse_next(stream->iter, &tmp_err);
+    if (tmp_err) {
+        g_critical("Cannot load repo: \"%s\" : %s",
+                   stream->ml->original_url, tmp_err->message);
+        g_error_free(tmp_err);
+        g_clear_pointer(&stream->next, cr_package_free);
+        return FALSE;
+    }
+
+    if (stream->next && prev_name
+        && g_strcmp0(stream->next->name, prev_name) < 0)
+    {
+        g_critical("Packages of repo \"%s\" are not sorted by name "
+                   "(%s after %s), it cannot be merged with --stream",
+                   stream->ml->original_url, stream->next->name, prev_name);
+        g_clear_pointer(&stream->next, cr_package_free);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/** Merge the repos by a single pass over their metadata (k-way merge)
+ * and hand the merged packages over to the writers in the order
+ * of the output (by name).
+ * Packages of every repo have to be sorted by name. All packages with
+ * the same name (a name group) are taken from the repos in the order of
+ * the repo_list and merged by add_package(), so the merge methods work
+ * the same way as with merge_repos(). Only one name group is kept
+ * in memory at a time.
+ * @return Number of merged packages or -1 on error
+ */
+static long
+stream_merge_repos(struct UserData *udata,
+                   GSList *repo_list,
+                   struct CmdOptions *cmd_options)
+{
+    long id = 0;
+    gboolean ret = TRUE;
+    int repo_count = g_slist_length(repo_list);
+    struct RepoStream *streams = g_new0(struct RepoStream, repo_count);
+    GHashTable *group = new_merged_metadata_hashtable();
+
+    // Open the repos
+
+    int x = 0;
+    for (GSList *elem = repo_list; elem; elem = g_slist_next(elem), x++) {
+        struct cr_MetadataLocation *ml = elem->data;
+        GError *tmp_err = NULL;
+
+        streams[x].ml = ml;
+        streams[x].repopath = repo_location_base(ml,
+                                        cmd_options->repo_prefix_search,
+                                        cmd_options->repo_prefix_replace);
+        streams[x].iter = cr_PkgIterator_new(ml->pri_xml_href,
+                                             ml->fex_xml_href && cmd_options->filelists_ext
+                                                ? ml->fex_xml_href
+                                                : ml->fil_xml_href,
+                                             ml->oth_xml_href,
+                                             NULL,
+                                             NULL,
+                                             cr_warning_cb,
+                                             "Stream merge parser",
+                                             &tmp_err);
+        if (!streams[x].iter) {
+            g_critical("Cannot load repo: \"%s\" : %s",
+                       ml->original_url, tmp_err->message);
+            g_error_free(tmp_err);
+            ret = FALSE;
+            break;
+        }
+
+        g_debug("Processing: %s", streams[x].repopath);
+
+        if (!repo_stream_next(&streams[x], NULL)) {
+            ret = FALSE;
+            break;
+        }
+    }
+
+    // Merge the name groups
+
+    while (ret) {
+        gchar *name = NULL;
+
+        // The lowest name of the not yet merged packages
+        for (x = 0; x < repo_count; x++)
+            if (streams[x].next
+                && (!name || g_strcmp0(streams[x].next->name, name) < 0))
+                name = streams[x].next->name;
+
+        if (!name)
+            break;  // All repos are merged
+
+        name = g_strdup(name);
+
+        // Packages from the repos listed first take precedence
+        for (x = 0; ret && x < repo_count; x++) {
+            while (streams[x].next
+                   && !g_strcmp0(streams[x].next->name, name))
+            {
+                cr_Package *pkg = streams[x].next;
+
+                g_debug("Reading metadata for %s (%s-%s.%s)",
+                        pkg->name, pkg->version, pkg->release, pkg->arch);
+
+                if (add_package(pkg,
+                                streams[x].repopath,
+                                group,
+                                cmd_options->arch_list,
+                                cmd_options->merge_method,
+                                NULL,
+                                cmd_options->omit_baseurl,
+                                x) == 0)
+                    cr_package_free(pkg);
+
+                if (!repo_stream_next(&streams[x], name)) {
+                    ret = FALSE;
+                    break;
+                }
+            }
+        }
+
+        // Hand over the merged packages of the group to the writers
+        // (they free the packages once written)
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, group);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            GSList *list = g_slist_sort((GSList *) value, package_cmp);
+            g_hash_table_iter_steal(&iter);
+            g_free(key);
+            for (GSList *elem = list; elem; elem = g_slist_next(elem)) {
+                cr_Package *pkg = elem->data;
+                g_debug("Writing metadata for %s (%s-%s.%s)",
+                        pkg->name, pkg->version, pkg->release, pkg->arch);
+                cr_dumper_dump_package(id++, pkg, udata);
+            }
+            g_slist_free(list);
+        }
+
+        g_free(name);
+    }
+
+    // Cleanup
+
+    for (x = 0; x < repo_count; x++) {
+        cr_package_free(streams[x].next);
+        if (streams[x].iter)
+            cr_PkgIterator_free(streams[x].iter, NULL);
+        g_free(streams[x].repopath);
+    }
+    g_free(streams);
+    destroy_merged_metadata_hashtable(group);
+
+    // No more tasks will come
+    cr_dumper_writers_set_task_count(udata, id);
+
+    return ret ? id : -1;
+}
+
+
+#ifdef WITH_LIBMODULEMD
+/** Merge module metadata of the repos (--stream mode, where
+ * merge_repos() which does this otherwise is not used).
+ * @return FALSE on error
+ */
+static gboolean
+stream_merge_modules(ModulemdModuleIndex **module_index, GSList *repo_list)
+{
+    GError *err = NULL;
+    g_autoptr(ModulemdModuleIndexMerger) merger = NULL;
+
+    merger = modulemd_module_index_merger_new();
+
+    for (GSList *elem = repo_list; elem; elem = g_slist_next(elem)) {
+        struct cr_MetadataLocation *ml = elem->data;
+        GSList *md = g_slist_find_custom(ml->additional_metadata, "modules",
+                                         cr_cmp_metadatum_type);
+        if (!md)
+            continue;
+
+        g_autoptr(ModulemdModuleIndex) index = NULL;
+        cr_Metadatum *modules = md->data;
+        if (cr_metadata_load_modulemd(&index, modules->name, &err) != CRE_OK) {
+            g_critical("Cannot load modules of repo: \"%s\" : %s",
+                       ml->original_url, err->message);
+            g_error_free(err);
+            return FALSE;
+        }
+        modulemd_module_index_merger_associate_index(merger, index, 0);
+    }
+
+    g_autoptr(ModulemdModuleIndex) moduleindex =
+        modulemd_module_index_merger_resolve (merger, &err);
+    g_auto (GStrv) module_names =
+        modulemd_module_index_get_module_names_as_strv (moduleindex);
+
+    if (moduleindex && g_strv_length(module_names) == 0) {
+        /* If the final module index is empty, free it so it won't get
+         * output in dump_merged_metadata()
+         */
+        g_clear_pointer (&moduleindex, g_object_unref);
+    }
+
+    *module_index = g_steal_pointer(&moduleindex);
+    return TRUE;
+}
+#endif /* WITH_LIBMODULEMD */
+
+
 #ifdef WITH_LIBMODULEMD
 static gint
 modulemd_write_handler (void          *data,
@@ -864,8 +1251,74 @@ modulemd_write_handler (void          *data,
 }
 #endif /* WITH_LIBMODULEMD */
 
+/** Set the real package count of a file whose header was written with
+ * the STREAM_HEADER_PKGS placeholder (--stream).
+ * @return TRUE if the header cannot be fixed in place and the file
+ *         has to be rewritten by stream_rewrite_num_of_pkgs()
+ */
+static gboolean
+stream_set_num_of_pkgs(cr_XmlFile *f, long count)
+{
+    if (!f)
+        return FALSE;
+    return cr_xmlfile_set_num_of_pkgs(f, count, NULL) != CRE_OK;
+}
+
+
+/** Replace the STREAM_HEADER_PKGS placeholder in the header of a closed
+ * file by the real package count (the file is recompressed).
+ */
+static void
+stream_rewrite_num_of_pkgs(gboolean rewrite,
+                           gchar *filename,
+                           cr_CompressionType type,
+                           long count,
+                           cr_ContentStat *stat,
+                           gchar *dict_file)
+{
+    GError *tmp_err = NULL;
+
+    if (!rewrite)
+        return;
+
+    g_debug("Rewriting package count in %s", filename);
+    cr_rewrite_header_package_count(filename, type, count,
+                                    STREAM_HEADER_PKGS, stat,
+                                    dict_file, &tmp_err);
+    if (tmp_err) {
+        g_critical("Cannot fix package count in %s: %s",
+                   filename, tmp_err->message);
+        g_error_free(tmp_err);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/** Task of the pool dumping the merged packages
+ */
+struct DumpTask {
+    long id;                        // Position of the package in the output
+    cr_Package *pkg;                // Package to dump
+};
+
+
+static void
+dump_package_thread(gpointer data, gpointer user_data)
+{
+    struct DumpTask *task = data;
+    struct UserData *udata = user_data;
+    cr_Package *pkg = task->pkg;
+
+    g_debug("Writing metadata for %s (%s-%s.%s)",
+            pkg->name, pkg->version, pkg->release, pkg->arch);
+
+    cr_dumper_dump_package(task->id, pkg, udata);
+}
+
+
 int
 dump_merged_metadata(GHashTable *merged_hashtable,
+                     GSList *repo_list,
                      long packages,
                      gchar *groupfile,
 #ifdef WITH_LIBMODULEMD
@@ -875,6 +1328,11 @@ dump_merged_metadata(GHashTable *merged_hashtable,
 {
     GError *tmp_err = NULL;
 
+    // Without the merged_hashtable the repos are merged while dumping
+    // (--stream) and the headers get a placeholder instead of the count
+    if (!merged_hashtable)
+        packages = STREAM_HEADER_PKGS;
+
     // Set up XML dump parameters
 
     cr_xml_dump_init();
@@ -1283,76 +1741,103 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     }
 
 
-    // Dump hashtable
+    // Dump packages by the pool of workers (or by the stream merge),
+    // one writer thread per output restores their order
+
+    struct UserData udata;
+    memset(&udata, 0, sizeof(udata));
+    udata.pri_f                 = pri_f;
+    udata.fil_f                 = fil_f;
+    udata.fex_f                 = fex_f;
+    udata.oth_f                 = oth_f;
+    udata.pri_db                = pri_db;
+    udata.fil_db                = fil_db;
+    udata.fex_db                = fex_db;
+    udata.oth_db                = oth_db;
+    udata.pri_zck               = pri_cr_zck;
+    udata.fil_zck               = fil_cr_zck;
+    udata.fex_zck               = fex_cr_zck;
+    udata.oth_zck               = oth_cr_zck;
+    udata.filelists_ext         = cmd_options->filelists_ext;
+    udata.write_buffer_depth    = DUMP_WRITE_BUFFER_DEPTH;
+    udata.had_errors            = FALSE;
+
+    if (merged_hashtable) {
+        GList *keys, *key;
+        keys = g_hash_table_get_keys(merged_hashtable);
+        keys = g_list_sort(keys, (GCompareFunc) g_strcmp0);
+
+        // Packages in the order of output
+        GPtrArray *pkgs = g_ptr_array_sized_new(packages);
+        for (key = keys; key; key = g_list_next(key)) {
+            gpointer value = g_hash_table_lookup(merged_hashtable, key->data);
+            GSList *element = (GSList *) value;
+            element = g_slist_sort(element, package_cmp);
+            for (; element; element=g_slist_next(element))
+                g_ptr_array_add(pkgs, element->data);
+        }
+        g_list_free(keys);
 
-    GList *keys, *key;
-    keys = g_hash_table_get_keys(merged_hashtable);
-    keys = g_list_sort(keys, (GCompareFunc) g_strcmp0);
+        udata.task_count = pkgs->len;
 
-    char *prev_srpm = NULL;
+        struct DumpTask *tasks = g_new0(struct DumpTask, pkgs->len);
+        GThreadPool *dump_pool = g_thread_pool_new(dump_package_thread,
+                                                   &udata,
+                                                   cmd_options->workers,
+                                                   FALSE,
+                                                   NULL);
 
-    for (key = keys; key; key = g_list_next(key)) {
-        gpointer value = g_hash_table_lookup(merged_hashtable, key->data);
-        GSList *element = (GSList *) value;
-        element = g_slist_sort(element, package_cmp);
-        for (; element; element=g_slist_next(element)) {
-            struct cr_XmlStruct res;
-            cr_Package *pkg;
+        cr_dumper_writers_start(&udata);
 
-            pkg = (cr_Package *) element->data;
-            if (cmd_options->filelists_ext) {
-                res = cr_xml_dump_ext(pkg, NULL);
-            } else {
-                res = cr_xml_dump(pkg, NULL);
-            }
+        for (guint x = 0; x < pkgs->len; x++) {
+            tasks[x].id  = x;
+            tasks[x].pkg = g_ptr_array_index(pkgs, x);
+            g_thread_pool_push(dump_pool, &tasks[x], NULL);
+        }
 
-            g_debug("Writing metadata for %s (%s-%s.%s)",
-                    pkg->name, pkg->version, pkg->release, pkg->arch);
+        g_thread_pool_free(dump_pool, FALSE, TRUE);
+        cr_dumper_writers_finish(&udata);
 
-            if (cmd_options->zck_compression &&
-               (!prev_srpm || !pkg->rpm_sourcerpm ||
-                strlen(prev_srpm) != strlen(pkg->rpm_sourcerpm) ||
-                strncmp(pkg->rpm_sourcerpm, prev_srpm, strlen(prev_srpm)) != 0)) {
-                cr_end_chunk(pri_cr_zck->f, NULL);
-                cr_end_chunk(fil_cr_zck->f, NULL);
-                if (cmd_options->filelists_ext)
-                    cr_end_chunk(fex_cr_zck->f, NULL);
-                cr_end_chunk(oth_cr_zck->f, NULL);
-                g_free(prev_srpm);
-                if (pkg->rpm_sourcerpm)
-                    prev_srpm = g_strdup(pkg->rpm_sourcerpm);
-                else
-                    prev_srpm = NULL;
-            }
-            cr_xmlfile_add_chunk(pri_f, (const char *) res.primary, NULL);
-            cr_xmlfile_add_chunk(fil_f, (const char *) res.filelists, NULL);
-            if (cmd_options->filelists_ext)
-                cr_xmlfile_add_chunk(fex_f, (const char *) res.filelists_ext, NULL);
-            cr_xmlfile_add_chunk(oth_f, (const char *) res.other, NULL);
-            if (cmd_options->zck_compression) {
-                cr_xmlfile_add_chunk(pri_cr_zck, (const char *) res.primary, NULL);
-                cr_xmlfile_add_chunk(fil_cr_zck, (const char *) res.filelists, NULL);
-                if (cmd_options->filelists_ext)
-                    cr_xmlfile_add_chunk(fex_cr_zck, (const char *) res.filelists_ext, NULL);
-                cr_xmlfile_add_chunk(oth_cr_zck, (const char *) res.other, NULL);
-            }
+        g_free(tasks);
+        g_ptr_array_free(pkgs, TRUE);
+    } else {
+        // Packages are merged on the fly (--stream), their number
+        // is known once all of them are written
+        udata.task_count        = G_MAXLONG;
+        udata.free_written_pkgs = TRUE;
 
-            if (cmd_options->database) {
-                cr_db_add_pkg(pri_db, pkg, NULL);
-                cr_db_add_pkg(fil_db, pkg, NULL);
-                if (cmd_options->filelists_ext)
-                    cr_db_add_pkg(fex_db, pkg, NULL);
-                cr_db_add_pkg(oth_db, pkg, NULL);
-            }
+        cr_dumper_writers_start(&udata);
+        long merged = stream_merge_repos(&udata, repo_list, cmd_options);
+        cr_dumper_writers_finish(&udata);
 
-            free(res.primary);
-            free(res.filelists);
-            free(res.filelists_ext);
-            free(res.other);
-        }
+        if (merged < 0)
+            exit(EXIT_FAILURE);
+
+        g_message("Merged packages: %ld", udata.package_count);
+    }
+
+    if (udata.had_errors)
+        g_warning("Errors were encountered while dumping the metadata");
+
+    // The headers of the streamed files contain a placeholder instead
+    // of the package count. Headers written as standalone members are
+    // fixed in place when the files are closed, the others have to be
+    // rewritten afterwards.
+    gboolean pri_rewrite = FALSE, fil_rewrite = FALSE;
+    gboolean fex_rewrite = FALSE, oth_rewrite = FALSE;
+    gboolean pri_zck_rewrite = FALSE, fil_zck_rewrite = FALSE;
+    gboolean fex_zck_rewrite = FALSE, oth_zck_rewrite = FALSE;
+    if (!merged_hashtable) {
+        long count = udata.package_count;
+        pri_rewrite     = stream_set_num_of_pkgs(pri_f, count);
+        fil_rewrite     = stream_set_num_of_pkgs(fil_f, count);
+        fex_rewrite     = stream_set_num_of_pkgs(fex_f, count);
+        oth_rewrite     = stream_set_num_of_pkgs(oth_f, count);
+        pri_zck_rewrite = stream_set_num_of_pkgs(pri_cr_zck, count);
+        fil_zck_rewrite = stream_set_num_of_pkgs(fil_cr_zck, count);
+        fex_zck_rewrite = stream_set_num_of_pkgs(fex_cr_zck, count);
+        oth_zck_rewrite = stream_set_num_of_pkgs(oth_cr_zck, count);
     }
-    g_free(prev_srpm);
-    g_list_free(keys);
 
 
     // Close files
@@ -1368,6 +1853,29 @@ dump_merged_metadata(GHashTable *merged_hashtable,
         cr_xmlfile_close(oth_cr_zck, NULL);
     }
 
+    long count = udata.package_count;
+    cr_CompressionType xml_type = cmd_options->compression_type;
+    stream_rewrite_num_of_pkgs(pri_rewrite, pri_xml_filename, xml_type,
+                               count, pri_stat, NULL);
+    stream_rewrite_num_of_pkgs(fil_rewrite, fil_xml_filename, xml_type,
+                               count, fil_stat, NULL);
+    stream_rewrite_num_of_pkgs(fex_rewrite, fex_xml_filename, xml_type,
+                               count, fex_stat, NULL);
+    stream_rewrite_num_of_pkgs(oth_rewrite, oth_xml_filename, xml_type,
+                               count, oth_stat, NULL);
+    stream_rewrite_num_of_pkgs(pri_zck_rewrite, pri_zck_filename,
+                               CR_CW_ZCK_COMPRESSION, count,
+                               pri_zck_stat, pri_dict_file);
+    stream_rewrite_num_of_pkgs(fil_zck_rewrite, fil_zck_filename,
+                               CR_CW_ZCK_COMPRESSION, count,
+                               fil_zck_stat, fil_dict_file);
+    stream_rewrite_num_of_pkgs(fex_zck_rewrite, fex_zck_filename,
+                               CR_CW_ZCK_COMPRESSION, count,
+                               fex_zck_stat, fex_dict_file);
+    stream_rewrite_num_of_pkgs(oth_zck_rewrite, oth_zck_filename,
+                               CR_CW_ZCK_COMPRESSION, count,
+                               oth_zck_stat, oth_dict_file);
+
 
     // Write updateinfo.xml
     // TODO
@@ -1996,6 +2504,9 @@ main(int argc, char **argv)
 
     g_debug("Version: %s", cr_version_string_with_features());
 
+    cr_set_compression_threads(cmd_options->compress_threads);
+    cr_set_decompression_threads(cmd_options->decompress_threads);
+
     // Prepare out_repo
 
     if (g_file_test(cmd_options->tmp_out_repo, G_FILE_TEST_EXISTS)) {
@@ -2127,8 +2638,8 @@ main(int argc, char **argv)
 
     // Load metadata
 
-    long loaded_packages;
-    GHashTable *merged_hashtable = new_merged_metadata_hashtable();
+    long loaded_packages = 0;
+    GHashTable *merged_hashtable = NULL;
     // merged_hashtable:
     //   Key: pkg->name
     //   Value: GSList with packages with the same name
@@ -2136,7 +2647,15 @@ main(int argc, char **argv)
     g_autoptr(ModulemdModuleIndex) merged_index = NULL;
 #endif
 
-    loaded_packages = merge_repos(merged_hashtable,
+    if (cmd_options->stream) {
+        // Packages are merged while dumping, just modules are merged here
+#ifdef WITH_LIBMODULEMD
+        if (!stream_merge_modules(&merged_index, local_repos))
+            loaded_packages = -1;
+#endif /* WITH_LIBMODULEMD */
+    } else {
+        merged_hashtable = new_merged_metadata_hashtable();
+        loaded_packages = merge_repos(merged_hashtable,
 #ifdef WITH_LIBMODULEMD
                                   &merged_index,
 #endif /* WITH_LIBMODULEMD */
@@ -2149,8 +2668,10 @@ main(int argc, char **argv)
                                   koji_stuff,
                                   cmd_options->omit_baseurl,
                                   cmd_options->repo_prefix_search,
-                                  cmd_options->repo_prefix_replace
+                                  cmd_options->repo_prefix_replace,
+                                  cmd_options->workers
                                  );
+    }
 
 
     // Destroy koji stuff - we have to close pkgorigins file before dump
@@ -2162,6 +2683,7 @@ main(int argc, char **argv)
     if(loaded_packages >= 0) {
         // Dump metadata
         dump_merged_metadata(merged_hashtable,
+                local_repos,
                 loaded_packages,
                 groupfile,
 #ifdef WITH_LIBMODULEMD
@@ -58,6 +58,9 @@ struct CmdOptions {
     gboolean nogroups;
     gboolean noupdateinfo;
     char *compress_type;
+    gint compress_threads;
+    gint decompress_threads;
+    gint workers;
     gboolean zck_compression;
     char *zck_dict_dir;
     char *merge_method_str;
@@ -66,6 +69,7 @@ struct CmdOptions {
     gboolean unique_md_filenames;
     gboolean simple_md_filenames;
     gboolean omit_baseurl;
+    gboolean stream;
 
     // Koji mergerepos specific options
     gboolean koji;
@@ -55,6 +55,18 @@ cr_metadata_load_modulemd(ModulemdModuleIndex **moduleindex,
 
 #endif /* WITH_LIBMODULEMD */
 
+#include "load_metadata.h"
+
+/** Keep the raw <package> elements of the loaded packages (cr_Package
+ * raw_* members), so they can be written out again without dumping.
+ * Must be set before the metadata are loaded.
+ * @param md        cr_Metadata object.
+ * @param raw_xml   Keep the raw elements?
+ * @param only      Keep the files and changelogs only in the raw elements
+ *                  (see cr_xml_parse_raw_content())?
+ */
+void cr_metadata_set_raw_xml(cr_Metadata *md, gboolean raw_xml, gboolean only);
+
 gchar *
 cr_compress_groupfile(const char *groupfile,
                       const char *dest_dir,
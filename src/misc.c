@@ -41,6 +41,7 @@
 #include "cleanup.h"
 #include "error.h"
 #include "misc.h"
+#include "package_internal.h"
 #include "version.h"
 
 #define ERR_DOMAIN      CREATEREPO_C_ERROR
@@ -244,6 +245,14 @@ cr_is_primary(const char *filename)
 
 #define VAL_LEN         4       // Len of numeric values in rpm (bytes)
 
+// Limits of a header index and data sizes (same as hdrchkTags() and
+// hdrchkData() of rpm) and the longest possible prefix of a package
+// which has to be read to locate the header:
+// lead + signature intro + signature + padding + header intro
+#define HDR_MAX_TAGS        0xffff
+#define HDR_MAX_DATA        0xffffff
+#define HDR_MAX_PREFIX_LEN  (112 + HDR_MAX_TAGS * 16 + HDR_MAX_DATA + 8 + 16)
+
 struct cr_HeaderRangeStruct
 cr_get_header_byte_range(const char *filename, GError **err)
 {
@@ -366,6 +375,158 @@ cr_get_header_byte_range(const char *filename, GError **err)
     return results;
 }
 
+#define HDR_RANGE_FOUND     1   // Range is stored in the results
+#define HDR_RANGE_AGAIN     0   // More leading bytes are needed
+#define HDR_RANGE_BOGUS    -1   // Not a valid signature header
+
+/** Compute the header byte range from the leading bytes of a package.
+ * The layout is the same as described in cr_get_header_byte_range().
+ * @param buf           leading bytes of the package
+ * @param len           number of bytes in the buf
+ * @param results       header range is stored here
+ * @return              HDR_RANGE_FOUND, HDR_RANGE_AGAIN if the buf is
+ *                      too short to contain the whole signature header
+ *                      and the header intro or HDR_RANGE_BOGUS if the
+ *                      signature header sizes are out of limits
+ */
+static int
+header_byte_range_from_buffer(const unsigned char *buf,
+                              size_t len,
+                              struct cr_HeaderRangeStruct *results)
+{
+    guint32 sigindex, sigdata, hdrindex, hdrdata;
+
+    // Lead (96) + 8 bytes of the signature header intro + il + dl
+    if (len < 104 + 2 * VAL_LEN)
+        return HDR_RANGE_AGAIN;
+
+    memcpy(&sigindex, buf + 104, VAL_LEN);
+    memcpy(&sigdata, buf + 104 + VAL_LEN, VAL_LEN);
+    sigindex = ntohl(sigindex);
+    sigdata  = ntohl(sigdata);
+
+    if (sigindex > HDR_MAX_TAGS || sigdata > HDR_MAX_DATA)
+        return HDR_RANGE_BOGUS;
+
+    unsigned int sigsize = sigdata + sigindex * 16;
+    unsigned int disttoboundary = sigsize % 8;
+    if (disttoboundary)
+        disttoboundary = 8 - disttoboundary;
+    unsigned int hdrstart = 112 + sigsize + disttoboundary;
+
+    if (len < (size_t) hdrstart + 8 + 2 * VAL_LEN)
+        return HDR_RANGE_AGAIN;
+
+    memcpy(&hdrindex, buf + hdrstart + 8, VAL_LEN);
+    memcpy(&hdrdata, buf + hdrstart + 8 + VAL_LEN, VAL_LEN);
+    hdrindex = ntohl(hdrindex);
+    hdrdata  = ntohl(hdrdata);
+
+    results->start = hdrstart;
+    results->end   = hdrstart + hdrdata + hdrindex * 16 + 16;
+    return HDR_RANGE_FOUND;
+}
+
+struct cr_HeaderRangeStruct
+cr_get_header_byte_range_fd(int fd,
+                            const char *filename,
+                            cr_ChecksumCtx *ctx,
+                            GError **err)
+{
+    struct cr_HeaderRangeStruct results = { 0, 0 };
+    struct cr_HeaderRangeStruct range = { 0, 0 };
+    int have_range = HDR_RANGE_AGAIN;
+    _cleanup_free_ unsigned char *buf = NULL;
+    GByteArray *prefix = NULL;
+    GError *tmp_err = NULL;
+
+    assert(fd >= 0);
+    assert(!err || *err == NULL);
+
+    buf = g_malloc(CR_RPM_INGEST_BUFFER_SIZE);
+
+    while (1) {
+        ssize_t readed = read(fd, buf, CR_RPM_INGEST_BUFFER_SIZE);
+        if (readed < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "read() error on %s: %s", filename, g_strerror(errno));
+            goto exit;
+        }
+
+        if (readed == 0)
+            break;  // EOF
+
+        if (ctx && cr_checksum_update(ctx, buf, readed, &tmp_err) != CRE_OK) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                       "Error while checksum calculation: ");
+            goto exit;
+        }
+
+        if (have_range == HDR_RANGE_AGAIN) {
+            // The signature header usually fits into the first buffer,
+            // otherwise accumulate the leading bytes until it does
+            if (!prefix)
+                have_range = header_byte_range_from_buffer(buf, readed, &range);
+
+            if (have_range == HDR_RANGE_AGAIN) {
+                if (!prefix)
+                    prefix = g_byte_array_new();
+                g_byte_array_append(prefix, buf, readed);
+                have_range = header_byte_range_from_buffer(prefix->data,
+                                                           prefix->len,
+                                                           &range);
+                if (have_range == HDR_RANGE_AGAIN
+                    && prefix->len >= HDR_MAX_PREFIX_LEN)
+                    have_range = HDR_RANGE_BOGUS;
+            }
+
+            if (have_range == HDR_RANGE_BOGUS) {
+                g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                            "Cannot determine header range of %s: "
+                            "bad signature header", filename);
+                goto exit;
+            }
+
+            // The leading bytes are not needed anymore
+            if (have_range == HDR_RANGE_FOUND && prefix) {
+                g_byte_array_free(prefix, TRUE);
+                prefix = NULL;
+            }
+
+            // Without a checksum context there is nothing more to read
+            if (have_range == HDR_RANGE_FOUND && !ctx)
+                break;
+        }
+    }
+
+    if (have_range != HDR_RANGE_FOUND) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot determine header range of %s: file is truncated",
+                    filename);
+        goto exit;
+    }
+
+    // Check sanity
+    if (range.end < range.start) {
+        g_debug("%s: sanity check fail on %s (%d > %d))", __func__,
+                filename, range.start, range.end);
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "sanity check error on %s (hdrstart: %d > hdrend: %d)",
+                    filename, range.start, range.end);
+        goto exit;
+    }
+
+    results = range;
+
+exit:
+    if (prefix)
+        g_byte_array_free(prefix, TRUE);
+
+    return results;
+}
+
 char *
 cr_get_filename(const char *filepath)
 {
@@ -387,6 +548,30 @@ cr_get_filename(const char *filepath)
     return filename;
 }
 
+int
+cr_location_href_cmp(const char *a, const char *b)
+{
+    const char *a_filename = cr_get_filename(a);
+    const char *b_filename = cr_get_filename(b);
+
+    int ret = strcmp(a_filename, b_filename);
+    if (ret)
+        return ret;
+
+    // Directories are compared without the trailing '/', the same way
+    // as the paths of the tasks
+    size_t a_len = a_filename - a;
+    size_t b_len = b_filename - b;
+    if (a_len)
+        a_len--;
+    if (b_len)
+        b_len--;
+    ret = strncmp(a, b, MIN(a_len, b_len));
+    if (ret || a_len == b_len)
+        return ret;
+    return a_len < b_len ? -1 : 1;
+}
+
 char *
 cr_get_cleaned_href(const char *filepath)
 {
@@ -1329,6 +1514,120 @@ cr_cmp_evr(const char *e1, const char *v1, const char *r1,
     return rc;
 }
 
+// Tokens of the evr keys, their values define the order of the tokens
+// (the same as the order used by rpmvercmp())
+#define EVR_KEY_NULL        0x00    // Missing (NULL) string
+#define EVR_KEY_TILDE       0x01    // '~' - sorts before everything
+#define EVR_KEY_END         0x02    // End of the string
+#define EVR_KEY_CARET       0x03    // '^' - sorts after the end of the string
+#define EVR_KEY_ALPHA       0x04    // Alphabetic segment (zero terminated)
+#define EVR_KEY_NUM         0x05    // Numeric segment (length + digits)
+#define EVR_KEY_LONG_NUM    0xff    // Length of a numeric segment is stored
+                                    // in next 4 bytes (big endian)
+
+struct _cr_EvrKey {
+    gsize len;                      // Length of the data
+    guchar data[];                  // Tokens of epoch, version and release
+};
+
+/** Append tokens of the string to the key. Separators (non alphanumeric
+ * characters) are dropped, leading zeros of numeric segments too and
+ * the length of the numeric segment precedes its digits, so the keys
+ * can be compared by memcmp().
+ */
+static void
+evr_key_append(GByteArray *key, const char *str)
+{
+    guint8 token;
+
+    if (!str) {
+        token = EVR_KEY_NULL;
+        g_byte_array_append(key, &token, 1);
+        return;
+    }
+
+    while (*str) {
+        const char *start;
+
+        if (*str == '~' || *str == '^') {
+            token = (*str == '~') ? EVR_KEY_TILDE : EVR_KEY_CARET;
+            g_byte_array_append(key, &token, 1);
+            str++;
+        } else if (g_ascii_isdigit(*str)) {
+            while (*str == '0')
+                str++;
+            start = str;
+            while (g_ascii_isdigit(*str))
+                str++;
+
+            guint32 len = str - start;
+            token = EVR_KEY_NUM;
+            g_byte_array_append(key, &token, 1);
+            if (len < EVR_KEY_LONG_NUM) {
+                guint8 len8 = len;
+                g_byte_array_append(key, &len8, 1);
+            } else {
+                guint32 len_be = GUINT32_TO_BE(len);
+                token = EVR_KEY_LONG_NUM;
+                g_byte_array_append(key, &token, 1);
+                g_byte_array_append(key, (guint8 *) &len_be, 4);
+            }
+            g_byte_array_append(key, (const guint8 *) start, len);
+        } else if (g_ascii_isalpha(*str)) {
+            start = str;
+            while (g_ascii_isalpha(*str))
+                str++;
+
+            token = EVR_KEY_ALPHA;
+            g_byte_array_append(key, &token, 1);
+            g_byte_array_append(key, (const guint8 *) start, str - start);
+            token = 0;
+            g_byte_array_append(key, &token, 1);
+        } else {
+            // Separator
+            str++;
+        }
+    }
+
+    token = EVR_KEY_END;
+    g_byte_array_append(key, &token, 1);
+}
+
+cr_EvrKey *
+cr_evr_key_new(const char *epoch, const char *version, const char *release)
+{
+    cr_EvrKey *key;
+    GByteArray *data = g_byte_array_sized_new(32);
+
+    evr_key_append(data, epoch ? epoch : "0");
+    evr_key_append(data, version);
+    evr_key_append(data, release);
+
+    key = g_malloc(sizeof(cr_EvrKey) + data->len);
+    key->len = data->len;
+    memcpy(key->data, data->data, data->len);
+    g_byte_array_free(data, TRUE);
+
+    return key;
+}
+
+void
+cr_evr_key_free(cr_EvrKey *key)
+{
+    g_free(key);
+}
+
+int
+cr_evr_key_cmp(const cr_EvrKey *key1, const cr_EvrKey *key2)
+{
+    int rc = memcmp(key1->data, key2->data, MIN(key1->len, key2->len));
+    if (rc)
+        return rc < 0 ? -1 : 1;
+    if (key1->len == key2->len)
+        return 0;
+    return key1->len < key2->len ? -1 : 1;
+}
+
 int
 cr_warning_cb(G_GNUC_UNUSED cr_XmlParserWarningType type,
               char *msg,
@@ -28,6 +28,7 @@ extern "C" {
 #include <string.h>
 #include <gio/gio.h>
 #include <curl/curl.h>
+#include "checksum.h"
 #include "compression_wrapper.h"
 #include "xml_parser.h"
 
@@ -133,6 +134,28 @@ struct cr_HeaderRangeStruct {
 struct cr_HeaderRangeStruct cr_get_header_byte_range(const char *filename,
                                                      GError **err);
 
+/** Size of the read buffer used by cr_get_header_byte_range_fd().
+ */
+#define CR_RPM_INGEST_BUFFER_SIZE   (256*1024)
+
+/** Read a package from a file descriptor in a single pass.
+ * Everything from the current offset of the fd to the end of the file
+ * is fed into the checksum context and the header byte range is computed
+ * from the very same buffer, so the package doesn't have to be opened
+ * and read again by cr_checksum_file() and cr_get_header_byte_range().
+ * If ctx is NULL, the reading stops as soon as the header range is known.
+ * The fd should be positioned at the beginning of the package.
+ * @param fd            file descriptor of the opened package
+ * @param filename      filename (used in error messages only)
+ * @param ctx           checksum context or NULL
+ * @param err           GError **
+ * @return              header range (start = end = 0 on error)
+ */
+struct cr_HeaderRangeStruct cr_get_header_byte_range_fd(int fd,
+                                                        const char *filename,
+                                                        cr_ChecksumCtx *ctx,
+                                                        GError **err);
+
 /** Return pointer to the rest of string after last '/'.
  * (e.g. for "/foo/bar" returns "bar")
  * @param filepath      path
@@ -147,6 +170,16 @@ char *cr_get_filename(const char *filepath);
  */
 char *cr_get_cleaned_href(const char *filepath);
 
+/** Compare two location hrefs in the order in which createrepo_c
+ * processes the packages: by filename first, then by the directory
+ * (without the trailing '/', so "a/x.rpm" < "a-b/x.rpm").
+ * @param a             location href
+ * @param b             location href
+ * @return              an integer less than, equal to, or greater than
+ *                      zero, like strcmp()
+ */
+int cr_location_href_cmp(const char *a, const char *b);
+
 /** Download a file from the URL into the in_dst via curl handle.
  * @param handle        CURL handle
  * @param url           source url
@@ -56,6 +56,7 @@ typedef struct {
     gchar *new_name;
     gboolean zck;
     gchar *zck_dict_dir;
+    gboolean merge;
 
 } RawCmdOptions;
 
@@ -94,6 +95,10 @@ parse_arguments(int *argc, char ***argv, RawCmdOptions *options, GError **err)
           "Batch file.", "BATCHFILE" },
         { "new-name", 0, 0, G_OPTION_ARG_STRING, &(options->new_name),
           "New filename for the file", "NEWFILENAME"},
+        { "merge", 0, 0, G_OPTION_ARG_NONE, &(options->merge),
+          "Merge the input updateinfo into the one already present in the "
+          "repodata. Advisories with the same id are replaced, new ones are "
+          "appended and the rest is copied as is.", NULL },
 #ifdef WITH_ZCHUNK
         { "zck", 0, 0, G_OPTION_ARG_NONE, &(options->zck),
           "Generate zchunk files as well as the standard repodata.", NULL },
@@ -119,6 +124,7 @@ parse_arguments(int *argc, char ***argv, RawCmdOptions *options, GError **err)
     options->new_name = NULL;
     options->zck = FALSE;
     options->zck_dict_dir = NULL;
+    options->merge = FALSE;
 
     GOptionContext *context;
     context = g_option_context_new("<input metadata> <output repodata>\n"
@@ -175,6 +181,13 @@ check_arguments(RawCmdOptions *options, GError **err)
         return FALSE;
     }
 
+    // --merge
+    if (options->merge && options->remove) {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "Cannot use --merge together with --remove");
+        return FALSE;
+    }
+
     // Zchunk options
     if (options->zck_dict_dir && !options->zck) {
         g_set_error(err, ERR_DOMAIN, CRE_ERROR,
@@ -238,6 +251,7 @@ cmd_options_to_task(GSList **modifyrepotasks,
                                                       options->new_name);
     task->zck = options->zck;
     task->zck_dict_dir = options->zck_dict_dir;
+    task->merge = options->merge;
 
     *modifyrepotasks = g_slist_append(*modifyrepotasks, task);
 
@@ -27,7 +27,6 @@
 #include "checksum.h"
 #include "modifyrepo_shared.h"
 #include "compression_wrapper.h"
-#include "threads.h"
 #include "xml_dump.h"
 
 #define ERR_DOMAIN              CREATEREPO_C_ERROR
@@ -67,9 +66,14 @@ cr_remove_compression_suffix_if_present(gchar* name, GError **err)
     return g_strdup(name);
 }
 
-gchar *
-cr_write_file(gchar *repopath, cr_ModifyRepoTask *task,
-           cr_CompressionType compress_type, GError **err)
+/** Copy (and compress) the file of the task into the repodata/ directory.
+ * If stat is not NULL and the file is really written, the stats of its
+ * content and of the written file are collected on the fly.
+ */
+static gchar *
+write_file_with_stat(gchar *repopath, cr_ModifyRepoTask *task,
+                     cr_CompressionType compress_type, cr_ContentStat *stat,
+                     GError **err)
 {
     const gchar *suffix = NULL;
 
@@ -120,8 +124,9 @@ cr_write_file(gchar *repopath, cr_ModifyRepoTask *task,
         g_debug("%s: Copy & compress operation %s -> %s",
                  __func__, src_fn, dst_fn);
 
-        if (cr_compress_file(src_fn, dst_fn, compress_type,
-                             task->zck_dict_dir, TRUE, err) != CRE_OK) {
+        if (cr_compress_file_with_stat(src_fn, dst_fn, compress_type, stat,
+                                       task->zck_dict_dir, TRUE,
+                                       err) != CRE_OK) {
             g_debug("%s: Copy & compress operation failed", __func__);
             return NULL;
         }
@@ -129,6 +134,725 @@ cr_write_file(gchar *repopath, cr_ModifyRepoTask *task,
     return dst_fn;
 }
 
+gchar *
+cr_write_file(gchar *repopath, cr_ModifyRepoTask *task,
+           cr_CompressionType compress_type, GError **err)
+{
+    return write_file_with_stat(repopath, task, compress_type, NULL, err);
+}
+
+/** Work item of the pool used by cr_modifyrepo() to write the files
+ * of the tasks and to fill their repomd records.
+ */
+struct WriteTask {
+    cr_ModifyRepoTask *task;
+    cr_RepomdRecord *rec;       // Record of the written file
+    cr_RepomdRecord *zck_rec;   // Record of the zchunk file (if task->zck)
+    GError *err;
+};
+
+/** Write a file of the task and prepare a filled repomd record for it.
+ * Checksums computed during the compression are loaded into the record,
+ * so cr_repomd_record_fill() doesn't have to read the file again.
+ */
+static cr_RepomdRecord *
+write_and_fill_record(gchar *repopath,
+                      cr_ModifyRepoTask *task,
+                      const gchar *type,
+                      cr_CompressionType compress_type,
+                      gchar **repofile,
+                      GError **err)
+{
+    _cleanup_free_ gchar *dst_fn = NULL;
+    cr_ContentStat *stat = cr_contentstat_new(task->checksum_type, err);
+    if (!stat)
+        return NULL;
+
+    dst_fn = write_file_with_stat(repopath, task, compress_type, stat, err);
+    if (!dst_fn) {
+        cr_contentstat_free(stat, NULL);
+        return NULL;
+    }
+
+    *repofile = cr_safe_string_chunk_insert_null(task->chunk, dst_fn);
+
+    cr_RepomdRecord *rec = cr_repomd_record_new(type, dst_fn);
+
+    // Stats are available only if the file was really written (it is
+    // not the already existing file). Uncompressed files have no open
+    // checksum in repomd.xml, so leave those to cr_repomd_record_fill().
+    if (stat->checksum) {
+        if (compress_type == CR_CW_ZCK_COMPRESSION)
+            cr_repomd_record_load_zck_contentstat(rec, stat);
+        else if (compress_type != CR_CW_NO_COMPRESSION)
+            cr_repomd_record_load_contentstat(rec, stat);
+    }
+    cr_contentstat_free(stat, NULL);
+
+    if (cr_repomd_record_fill(rec, task->checksum_type, err) != CRE_OK) {
+        cr_repomd_record_free(rec);
+        return NULL;
+    }
+
+    return rec;
+}
+
+/** Merge the file of the task into the existing updateinfo and point
+ * task->path to the result. The merged file gets the same basename as
+ * the original one, so the destination filename stays the same.
+ * @return      Temporary directory with the merged file or NULL on error
+ */
+static gchar *
+merge_task_file(gchar *repopath, cr_ModifyRepoTask *task, GError **err)
+{
+    gchar *tmp_dir = g_build_filename(repopath, ".modifyrepo-XXXXXX", NULL);
+    if (!g_mkdtemp(tmp_dir)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot create a temporary directory %s: %s",
+                    tmp_dir, g_strerror(errno));
+        g_free(tmp_dir);
+        return NULL;
+    }
+
+    _cleanup_free_ gchar *sufixless_fn = cr_remove_compression_suffix_if_present(
+                                                        task->path, NULL);
+    _cleanup_free_ gchar *basename = g_path_get_basename(sufixless_fn);
+    _cleanup_free_ gchar *merged_fn = g_build_filename(tmp_dir, basename, NULL);
+
+    g_debug("%s: Merging %s into %s -> %s",
+            __func__, task->path, task->merge_path, merged_fn);
+
+    if (!cr_modifyrepo_merge_updateinfo(task->merge_path, task->path,
+                                        merged_fn, err)) {
+        cr_remove_dir(tmp_dir, NULL);
+        g_free(tmp_dir);
+        return NULL;
+    }
+
+    task->path = cr_safe_string_chunk_insert(task->chunk, merged_fn);
+    return tmp_dir;
+}
+
+static void
+write_and_fill_thread(gpointer data, gpointer user_data)
+{
+    struct WriteTask *wtask = data;
+    cr_ModifyRepoTask *task = wtask->task;
+    gchar *repopath = user_data;
+    gchar *orig_path = task->path;
+    _cleanup_free_ gchar *merge_dir = NULL;
+    cr_CompressionType compress_type = CR_CW_NO_COMPRESSION;
+
+    if (task->compress)
+        compress_type = task->compress_type;
+
+    if (task->merge_path) {
+        merge_dir = merge_task_file(repopath, task, &wtask->err);
+        if (!merge_dir)
+            return;
+    }
+
+    wtask->rec = write_and_fill_record(repopath, task, task->type,
+                                       compress_type, &task->repopath,
+                                       &wtask->err);
+    if (!wtask->rec)
+        goto cleanup;
+
+#ifdef WITH_ZCHUNK
+    if (task->zck) {
+        _cleanup_free_ gchar *type = g_strconcat(task->type, "_zck", NULL);
+        wtask->zck_rec = write_and_fill_record(repopath, task, type,
+                                               CR_CW_ZCK_COMPRESSION,
+                                               &task->zck_repopath,
+                                               &wtask->err);
+    }
+#endif
+
+cleanup:
+    task->path = orig_path;
+    if (merge_dir)
+        cr_remove_dir(merge_dir, NULL);
+}
+
+//
+// Streaming merge of updateinfo
+//
+
+#define MERGE_BUFFER_SIZE       (128*1024)
+#define MERGE_NAME_MAX          32
+
+typedef enum {
+    XML_TOKEN_EOF,
+    XML_TOKEN_TEXT,     // Character data
+    XML_TOKEN_START,    // <name ...>
+    XML_TOKEN_EMPTY,    // <name ... />
+    XML_TOKEN_END,      // </name>
+    XML_TOKEN_OTHER,    // Comment, CDATA, PI, DOCTYPE
+} XmlTokenType;
+
+/** Minimal pull tokenizer over a (possibly compressed) XML file.
+ * It doesn't build any tree, every token is appended in its raw form
+ * to the output GString, so elements can be copied verbatim.
+ */
+typedef struct {
+    CR_FILE *file;
+    const gchar *path;
+    gchar *buf;
+    int len;
+    int pos;
+    gboolean eof;
+    int peeked;                     // Character read by the text tokenizer
+    gchar name[MERGE_NAME_MAX];     // Name of the last tag
+} XmlTokenizer;
+
+static int
+xml_tokenizer_getc(XmlTokenizer *tok, GError **err)
+{
+    if (tok->peeked != -1) {
+        int c = tok->peeked;
+        tok->peeked = -1;
+        return c;
+    }
+
+    if (tok->pos >= tok->len) {
+        if (tok->eof)
+            return -1;
+        tok->len = cr_read(tok->file, tok->buf, MERGE_BUFFER_SIZE, err);
+        tok->pos = 0;
+        if (tok->len == CR_CW_ERR) {
+            tok->len = 0;
+            tok->eof = TRUE;
+            return -2;
+        }
+        if (tok->len == 0) {
+            tok->eof = TRUE;
+            return -1;
+        }
+    }
+
+    return (guchar) tok->buf[tok->pos++];
+}
+
+/** Read until the out ends with the terminator */
+static gboolean
+xml_tokenizer_read_until(XmlTokenizer *tok,
+                         GString *out,
+                         const gchar *terminator,
+                         GError **err)
+{
+    gsize term_len = strlen(terminator);
+
+    while (out->len < term_len
+           || strcmp(out->str + out->len - term_len, terminator))
+    {
+        int c = xml_tokenizer_getc(tok, err);
+        if (c == -2)
+            return FALSE;
+        if (c == -1) {
+            g_set_error(err, ERR_DOMAIN, CRE_XMLPARSER,
+                        "Unexpected end of file %s", tok->path);
+            return FALSE;
+        }
+        g_string_append_c(out, c);
+    }
+
+    return TRUE;
+}
+
+/** Append next token to the out and return its type.
+ * Returns XML_TOKEN_EOF with err set on error.
+ */
+static XmlTokenType
+xml_tokenizer_next(XmlTokenizer *tok, GString *out, GError **err)
+{
+    gsize start = out->len;
+    int c = xml_tokenizer_getc(tok, err);
+
+    if (c < 0)
+        return XML_TOKEN_EOF;
+
+    if (c != '<') {
+        // Character data up to the next markup
+        do {
+            g_string_append_c(out, c);
+            c = xml_tokenizer_getc(tok, err);
+        } while (c >= 0 && c != '<');
+        if (c == -2)
+            return XML_TOKEN_EOF;
+        tok->peeked = c;
+        return XML_TOKEN_TEXT;
+    }
+
+    g_string_append_c(out, c);
+    c = xml_tokenizer_getc(tok, err);
+    if (c < 0)
+        goto unexpected_eof;
+    g_string_append_c(out, c);
+
+    if (c == '?') {
+        if (!xml_tokenizer_read_until(tok, out, "?>", err))
+            return XML_TOKEN_EOF;
+        return XML_TOKEN_OTHER;
+    }
+
+    if (c == '!') {
+        // Comment, CDATA section or DOCTYPE
+        while (out->len - start < 3) {
+            if ((c = xml_tokenizer_getc(tok, err)) < 0)
+                goto unexpected_eof;
+            g_string_append_c(out, c);
+        }
+        const gchar *terminator = ">";
+        if (out->str[start+2] == '-')
+            terminator = "-->";
+        else if (out->str[start+2] == '[')
+            terminator = "]]>";
+        if (!xml_tokenizer_read_until(tok, out, terminator, err))
+            return XML_TOKEN_EOF;
+        return XML_TOKEN_OTHER;
+    }
+
+    // Tag
+    gboolean end_tag = (c == '/');
+    gboolean in_name = TRUE;
+    gsize name_len = 0;
+    int quote = 0;
+
+    if (!end_tag) {
+        tok->name[name_len++] = c;
+    }
+
+    while (1) {
+        c = xml_tokenizer_getc(tok, err);
+        if (c < 0)
+            goto unexpected_eof;
+        g_string_append_c(out, c);
+
+        if (quote) {
+            if (c == quote)
+                quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            break;
+        }
+
+        if (in_name) {
+            if (g_ascii_isspace(c) || c == '>' || c == '/')
+                in_name = FALSE;
+            else if (name_len < MERGE_NAME_MAX - 1)
+                tok->name[name_len++] = c;
+        }
+    }
+    tok->name[name_len] = '\0';
+
+    if (end_tag)
+        return XML_TOKEN_END;
+    if (out->str[out->len-2] == '/')
+        return XML_TOKEN_EMPTY;
+    return XML_TOKEN_START;
+
+unexpected_eof:
+    if (c == -1)
+        g_set_error(err, ERR_DOMAIN, CRE_XMLPARSER,
+                    "Unexpected end of file %s", tok->path);
+    return XML_TOKEN_EOF;
+}
+
+/** Append the character data to the out with the entity and character
+ * references replaced. Unknown references are kept as they are.
+ */
+static void
+xml_append_decoded(GString *out, const gchar *text, gsize len)
+{
+    static const struct { const gchar *name; gchar c; } entities[] = {
+        { "amp", '&' }, { "lt", '<' }, { "gt", '>' },
+        { "quot", '"' }, { "apos", '\'' },
+    };
+    const gchar *end = text + len;
+
+    while (text < end) {
+        const gchar *amp = memchr(text, '&', end - text);
+        if (!amp) {
+            g_string_append_len(out, text, end - text);
+            break;
+        }
+        g_string_append_len(out, text, amp - text);
+        text = amp + 1;
+
+        const gchar *semicolon = memchr(text, ';', end - text);
+        gboolean decoded = FALSE;
+        if (semicolon && semicolon > text) {
+            gsize ref_len = semicolon - text;
+            if (*text == '#') {
+                gboolean hex = (ref_len > 1 && text[1] == 'x');
+                const gchar *digit = text + 1 + hex;
+                gunichar c = 0;
+                for (; digit < semicolon && c <= 0x10FFFF; digit++) {
+                    int value = hex ? g_ascii_xdigit_value(*digit)
+                                    : g_ascii_digit_value(*digit);
+                    if (value < 0)
+                        break;
+                    c = c * (hex ? 16 : 10) + value;
+                }
+                if (digit == semicolon && digit > text + 1 + hex
+                    && c > 0 && g_unichar_validate(c))
+                {
+                    g_string_append_unichar(out, c);
+                    decoded = TRUE;
+                }
+            } else {
+                for (gsize x = 0; x < G_N_ELEMENTS(entities); x++) {
+                    if (strlen(entities[x].name) == ref_len
+                        && !strncmp(text, entities[x].name, ref_len))
+                    {
+                        g_string_append_c(out, entities[x].c);
+                        decoded = TRUE;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (decoded) {
+            text = semicolon + 1;
+        } else {
+            g_string_append_c(out, '&');
+        }
+    }
+}
+
+/** Read the next top level <update> element of an updateinfo.
+ * Everything before it is appended to the prefix, the element itself
+ * to the element and its <id> is returned (or "" if it has none).
+ * Returns NULL if the root element was closed (the closing tag is left
+ * in the prefix) or on error.
+ */
+static gchar *
+xml_tokenizer_next_update(XmlTokenizer *tok,
+                          GString *prefix,
+                          GString *element,
+                          gboolean *root_closed,
+                          GError **err)
+{
+    XmlTokenType type;
+    GError *tmp_err = NULL;
+
+    *root_closed = FALSE;
+
+    // Find start of the next <update> inside of <updates>
+    while (1) {
+        gsize start = prefix->len;
+        type = xml_tokenizer_next(tok, prefix, &tmp_err);
+        if (tmp_err) {
+            g_propagate_error(err, tmp_err);
+            return NULL;
+        }
+        if (type == XML_TOKEN_EOF) {
+            g_set_error(err, ERR_DOMAIN, CRE_XMLPARSER,
+                        "Missing </updates> in %s", tok->path);
+            return NULL;
+        }
+        if (type == XML_TOKEN_END && !strcmp(tok->name, "updates")) {
+            *root_closed = TRUE;
+            return NULL;
+        }
+        if ((type == XML_TOKEN_START || type == XML_TOKEN_EMPTY)
+            && !strcmp(tok->name, "update"))
+        {
+            g_string_append_len(element, prefix->str + start,
+                                prefix->len - start);
+            g_string_truncate(prefix, start);
+            if (type == XML_TOKEN_EMPTY)
+                return g_strdup("");
+            break;
+        }
+    }
+
+    // Read the rest of the element and pick its id
+    GString *id = NULL;
+    gboolean in_id = FALSE;
+    int depth = 1;
+
+    while (depth) {
+        gsize start = element->len;
+        type = xml_tokenizer_next(tok, element, &tmp_err);
+        if (tmp_err || type == XML_TOKEN_EOF) {
+            if (tmp_err)
+                g_propagate_error(err, tmp_err);
+            else
+                g_set_error(err, ERR_DOMAIN, CRE_XMLPARSER,
+                            "Unterminated <update> in %s", tok->path);
+            if (id)
+                g_string_free(id, TRUE);
+            return NULL;
+        }
+
+        if (type == XML_TOKEN_START) {
+            if (depth == 1 && !id && !strcmp(tok->name, "id")) {
+                id = g_string_new(NULL);
+                in_id = TRUE;
+            }
+            depth++;
+        } else if (type == XML_TOKEN_END) {
+            in_id = FALSE;
+            depth--;
+        } else if (type == XML_TOKEN_TEXT && in_id) {
+            xml_append_decoded(id, element->str + start,
+                               element->len - start);
+        } else if (type == XML_TOKEN_OTHER && in_id
+                   && g_str_has_prefix(element->str + start, "<![CDATA[")) {
+            // CDATA content is taken literally, without the "]]>"
+            gsize cdata_start = start + strlen("<![CDATA[");
+            g_string_append_len(id, element->str + cdata_start,
+                                element->len - cdata_start - 3);
+        }
+    }
+
+    if (!id)
+        return g_strdup("");
+    return g_strstrip(g_string_free(id, FALSE));
+}
+
+static XmlTokenizer *
+xml_tokenizer_new(const gchar *path, GError **err)
+{
+    CR_FILE *file = cr_open(path, CR_CW_MODE_READ,
+                            CR_CW_AUTO_DETECT_COMPRESSION, err);
+    if (!file)
+        return NULL;
+
+    XmlTokenizer *tok = g_new0(XmlTokenizer, 1);
+    tok->file = file;
+    tok->path = path;
+    tok->buf = g_malloc(MERGE_BUFFER_SIZE);
+    tok->peeked = -1;
+    return tok;
+}
+
+static void
+xml_tokenizer_free(XmlTokenizer *tok)
+{
+    if (!tok)
+        return;
+    cr_close(tok->file, NULL);
+    g_free(tok->buf);
+    g_free(tok);
+}
+
+/** Copy everything up to (and including) the <updates> start tag.
+ * Returns FALSE on error, sets *empty_root if the root is <updates/>.
+ */
+static gboolean
+xml_tokenizer_skip_to_root(XmlTokenizer *tok,
+                           GString *out,
+                           gboolean *empty_root,
+                           GError **err)
+{
+    GError *tmp_err = NULL;
+
+    while (1) {
+        XmlTokenType type = xml_tokenizer_next(tok, out, &tmp_err);
+        if (tmp_err) {
+            g_propagate_error(err, tmp_err);
+            return FALSE;
+        }
+        if (type == XML_TOKEN_EOF)
+            break;
+        if ((type == XML_TOKEN_START || type == XML_TOKEN_EMPTY)
+            && !strcmp(tok->name, "updates"))
+        {
+            *empty_root = (type == XML_TOKEN_EMPTY);
+            return TRUE;
+        }
+        if (type == XML_TOKEN_START || type == XML_TOKEN_EMPTY)
+            break;
+    }
+
+    g_set_error(err, ERR_DOMAIN, CRE_XMLPARSER,
+                "%s is not an updateinfo (missing <updates>)", tok->path);
+    return FALSE;
+}
+
+static gboolean
+merge_write(CR_FILE *out, GString *str, GError **err)
+{
+    if (str->len && cr_write(out, str->str, str->len, err) == CR_CW_ERR)
+        return FALSE;
+    g_string_truncate(str, 0);
+    return TRUE;
+}
+
+gboolean
+cr_modifyrepo_merge_updateinfo(const gchar *old_path,
+                               const gchar *new_path,
+                               const gchar *out_path,
+                               GError **err)
+{
+    gboolean ret = FALSE;
+    gboolean empty_root = FALSE;
+    gboolean root_closed = FALSE;
+    XmlTokenizer *tok = NULL;
+    CR_FILE *out = NULL;
+    GString *prefix = g_string_new(NULL);
+    GString *element = g_string_new(NULL);
+    GHashTable *new_updates = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                    g_free, NULL);
+    GPtrArray *new_elements = g_ptr_array_new_with_free_func(g_free);
+    long kept = 0, replaced = 0, dropped = 0;
+
+    assert(!err || *err == NULL);
+
+    // Load advisories from the new file, it is expected to be small
+    tok = xml_tokenizer_new(new_path, err);
+    if (!tok || !xml_tokenizer_skip_to_root(tok, prefix, &empty_root, err))
+        goto cleanup;
+
+    while (!empty_root) {
+        gchar *id = xml_tokenizer_next_update(tok, prefix, element,
+                                              &root_closed, err);
+        if (!id) {
+            if (!root_closed)
+                goto cleanup;
+            break;
+        }
+
+        gpointer idx;
+        if (*id == '\0') {
+            g_warning("Skipping advisory without <id> in %s", new_path);
+            g_string_free(element, TRUE);
+            g_free(id);
+        } else if (g_hash_table_lookup_extended(new_updates, id, NULL, &idx)) {
+            g_warning("Advisory \"%s\" is present in %s more than once, "
+                      "using the last one", id, new_path);
+            g_free(g_ptr_array_index(new_elements, GPOINTER_TO_UINT(idx)));
+            g_ptr_array_index(new_elements, GPOINTER_TO_UINT(idx)) =
+                    g_string_free(element, FALSE);
+            g_free(id);
+        } else {
+            g_hash_table_insert(new_updates, id,
+                                GUINT_TO_POINTER(new_elements->len));
+            g_ptr_array_add(new_elements, g_string_free(element, FALSE));
+        }
+        element = g_string_new(NULL);
+        g_string_truncate(prefix, 0);
+    }
+
+    xml_tokenizer_free(tok);
+    tok = NULL;
+    g_string_truncate(prefix, 0);
+    root_closed = FALSE;
+
+    // Stream the old file into the output
+    tok = xml_tokenizer_new(old_path, err);
+    if (!tok)
+        goto cleanup;
+
+    out = cr_open(out_path, CR_CW_MODE_WRITE, CR_CW_NO_COMPRESSION, err);
+    if (!out)
+        goto cleanup;
+
+    if (!xml_tokenizer_skip_to_root(tok, prefix, &empty_root, err))
+        goto cleanup;
+
+    if (empty_root) {
+        // <updates/> - Open the root element to be able to append updates
+        gchar *tag = strrchr(prefix->str, '<');
+        g_string_truncate(prefix, tag - prefix->str);
+        g_string_append(prefix, "<updates>\n");
+    }
+
+    while (!empty_root) {
+        gchar *id = xml_tokenizer_next_update(tok, prefix, element,
+                                              &root_closed, err);
+        if (!id) {
+            if (!root_closed)
+                goto cleanup;
+            break;
+        }
+
+        gpointer idx;
+        if (g_hash_table_lookup_extended(new_updates, id, NULL, &idx)) {
+            // Replace the advisory in place
+            gchar **new_element = (gchar **) &g_ptr_array_index(new_elements,
+                                                    GPOINTER_TO_UINT(idx));
+            if (*new_element) {
+                g_string_assign(element, *new_element);
+                g_clear_pointer(new_element, g_free);
+                replaced++;
+            } else {
+                g_warning("Advisory \"%s\" is present in %s more than once, "
+                          "dropping the duplicate replaced by %s",
+                          id, old_path, new_path);
+                g_string_truncate(element, 0);
+                dropped++;
+            }
+        } else {
+            kept++;
+        }
+        g_free(id);
+
+        if (!merge_write(out, prefix, err) || !merge_write(out, element, err))
+            goto cleanup;
+    }
+
+    // Keep the closing tag of the root and write it after the new ones
+    GString *root_end = g_string_new(NULL);
+    if (root_closed) {
+        gchar *tag = strrchr(prefix->str, '<');
+        g_string_assign(root_end, tag);
+        g_string_truncate(prefix, tag - prefix->str);
+    } else {
+        g_string_assign(root_end, "</updates>");
+    }
+
+    gboolean write_ok = merge_write(out, prefix, err);
+    for (guint x = 0; write_ok && x < new_elements->len; x++) {
+        gchar *new_element = g_ptr_array_index(new_elements, x);
+        if (!new_element)
+            continue;
+        g_string_append_printf(prefix, "%s\n", new_element);
+        write_ok = merge_write(out, prefix, err);
+    }
+    if (write_ok)
+        write_ok = merge_write(out, root_end, err);
+    g_string_free(root_end, TRUE);
+    if (!write_ok)
+        goto cleanup;
+
+    // Copy the rest of the file
+    if (root_closed) {
+        GError *tmp_err = NULL;
+        while (xml_tokenizer_next(tok, prefix, &tmp_err) != XML_TOKEN_EOF)
+            if (prefix->len >= MERGE_BUFFER_SIZE && !merge_write(out, prefix, err))
+                goto cleanup;
+        if (tmp_err) {
+            g_propagate_error(err, tmp_err);
+            goto cleanup;
+        }
+    } else {
+        g_string_append_c(prefix, '\n');
+    }
+    if (!merge_write(out, prefix, err))
+        goto cleanup;
+
+    g_debug("%s: Updateinfo merged: %ld kept, %ld replaced, %ld added, "
+            "%ld duplicates dropped", __func__, kept, replaced,
+            (long) g_hash_table_size(new_updates) - replaced, dropped);
+
+    ret = TRUE;
+
+cleanup:
+    if (out && cr_close(out, ret ? err : NULL) != CRE_OK)
+        ret = FALSE;
+    xml_tokenizer_free(tok);
+    g_string_free(prefix, TRUE);
+    g_string_free(element, TRUE);
+    g_hash_table_destroy(new_updates);
+    g_ptr_array_free(new_elements, TRUE);
+    return ret;
+}
+
 gboolean
 cr_modifyrepo(GSList *modifyrepotasks, gchar *repopath, GError **err)
 {
@@ -247,10 +971,36 @@ cr_modifyrepo(GSList *modifyrepotasks, gchar *repopath, GError **err)
                 }
             }
 
-            // Check if record with this name doesn't exist yet
-            if (cr_repomd_get_record(repomd, task->type))
+            cr_RepomdRecord *rec = cr_repomd_get_record(repomd, task->type);
+
+            if (task->merge) {
+                // Only updateinfo could be merged
+                if (g_strcmp0(task->type, "updateinfo")) {
+                    g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                                "Merge is supported only for updateinfo, "
+                                "not for \"%s\"", task->type);
+                    cr_repomd_free(repomd);
+                    g_free(repomd_path);
+                    return FALSE;
+                }
+
+                if (rec && !rec->location_base) {
+                    task->merge_path = cr_safe_string_chunk_insert_and_free(
+                                task->chunk,
+                                g_build_filename(repopath, "../",
+                                                 rec->location_href, NULL));
+                    g_debug("%s: \"%s\" will be merged into \"%s\"",
+                            __func__, task->path, task->merge_path);
+                } else {
+                    g_debug("%s: No local record of type \"%s\" to merge "
+                            "with, adding \"%s\" as is",
+                            __func__, task->type, task->path);
+                }
+            } else if (rec) {
+                // Check if record with this name doesn't exist yet
                 g_warning("Record with type \"%s\" already exists "
                           "in repomd.xml", task->type);
+            }
 
         }
     }
@@ -259,91 +1009,66 @@ cr_modifyrepo(GSList *modifyrepotasks, gchar *repopath, GError **err)
     // Modifications of the target repository starts here
     //
 
-    // Add (copy) new metadata to repodata/ directory
+    // Add (copy) new metadata to repodata/ directory and prepare
+    // new repomd records. Every task is compressed and its record filled
+    // in a separate thread, repomd.xml is written only once at the end.
+    GSList *repomdrecords = NULL;
+    GSList *repomdrecords_uniquefn = NULL;
+    GSList *writetasks = NULL;
+
+    GThreadPool *write_pool = g_thread_pool_new(write_and_fill_thread,
+                                                repopath,
+                                                g_get_num_processors(),
+                                                FALSE, NULL);
+
     for (GSList *elem = modifyrepotasks; elem; elem = g_slist_next(elem)) {
         cr_ModifyRepoTask *task = elem->data;
-        _cleanup_free_ gchar *dst_fn = NULL;
 
         if (task->remove)
             // Skip removing task
             continue;
 
-        cr_CompressionType compress_type = CR_CW_NO_COMPRESSION;
-
-        if (task->compress)
-            compress_type = task->compress_type;
-
-        dst_fn = cr_write_file(repopath, task, compress_type, err);
-        if (dst_fn == NULL) {
-            cr_repomd_free(repomd);
-            g_free(repomd_path);
-            return FALSE;
-        }
-        
-        task->repopath = cr_safe_string_chunk_insert_null(task->chunk, dst_fn);
-#ifdef WITH_ZCHUNK
-        if (task->zck) {
-            free(dst_fn);
-            dst_fn = cr_write_file(repopath, task, CR_CW_ZCK_COMPRESSION, err);
-            if (dst_fn == NULL) {
-                cr_repomd_free(repomd);
-                g_free(repomd_path);
-                return FALSE;
-            }
-            task->zck_repopath = cr_safe_string_chunk_insert_null(task->chunk, dst_fn);
-        }
-#endif
+        struct WriteTask *wtask = g_new0(struct WriteTask, 1);
+        wtask->task = task;
+        writetasks = g_slist_prepend(writetasks, wtask);
+        g_thread_pool_push(write_pool, wtask, NULL);
     }
 
-    // Prepare new repomd records
-    GSList *repomdrecords = NULL;
-    GSList *repomdrecords_uniquefn = NULL;
-    GSList *repomdrecordfilltasks = NULL;
+    g_thread_pool_free(write_pool, FALSE, TRUE); // Wait
+    writetasks = g_slist_reverse(writetasks);
 
-    GThreadPool *fill_pool = g_thread_pool_new(cr_repomd_record_fill_thread,
-                                               NULL, 5, FALSE, NULL);
+    // Collect records in the order of the tasks, report the first error
+    gboolean write_ok = TRUE;
+    for (GSList *elem = writetasks; elem; elem = g_slist_next(elem)) {
+        struct WriteTask *wtask = elem->data;
 
-    for (GSList *elem = modifyrepotasks; elem; elem = g_slist_next(elem)) {
-        cr_ModifyRepoTask *task = elem->data;
-
-        if (task->remove)
-            continue;
+        if (wtask->err) {
+            if (write_ok)
+                g_propagate_error(err, wtask->err);
+            else
+                g_error_free(wtask->err);
+            write_ok = FALSE;
+        }
 
-        cr_RepomdRecord *rec = cr_repomd_record_new(task->type,
-                                                    task->repopath);
-        cr_RepomdRecordFillTask *filltask = cr_repomdrecordfilltask_new(rec,
-                                            task->checksum_type, NULL);
-        g_thread_pool_push(fill_pool, filltask, NULL);
-
-        repomdrecords = g_slist_append(repomdrecords, rec); 
-
-        if (task->unique_md_filenames)
-            repomdrecords_uniquefn = g_slist_prepend(repomdrecords_uniquefn, rec);
-        repomdrecordfilltasks = g_slist_prepend(repomdrecordfilltasks,
-                                                filltask);
-        if (task->zck) {
-            _cleanup_free_ gchar *type = g_strconcat(task->type, "_zck", NULL);
-            rec = cr_repomd_record_new(type, task->zck_repopath);
-            filltask = cr_repomdrecordfilltask_new(rec, task->checksum_type, NULL);
-            g_thread_pool_push(fill_pool, filltask, NULL);
-
-            repomdrecords = g_slist_append(repomdrecords, rec);
-
-            if (task->unique_md_filenames)
-                repomdrecords_uniquefn = g_slist_prepend(repomdrecords_uniquefn, rec);
-            repomdrecordfilltasks = g_slist_prepend(repomdrecordfilltasks,
-                                                    filltask);
+        cr_RepomdRecord *recs[] = { wtask->rec, wtask->zck_rec };
+        for (size_t x = 0; x < G_N_ELEMENTS(recs); x++) {
+            if (!recs[x])
+                continue;
+            repomdrecords = g_slist_append(repomdrecords, recs[x]);
+            if (wtask->task->unique_md_filenames)
+                repomdrecords_uniquefn = g_slist_prepend(repomdrecords_uniquefn,
+                                                         recs[x]);
         }
     }
+    cr_slist_free_full(writetasks, g_free);
 
-    g_thread_pool_free(fill_pool, FALSE, TRUE); // Wait
-
-    for (GSList *elem = repomdrecordfilltasks; elem; elem = g_slist_next(elem)) {
-        // Clean up tasks
-        cr_RepomdRecordFillTask *filltask = elem->data;
-        cr_repomdrecordfilltask_free(filltask, NULL);
+    if (!write_ok) {
+        g_slist_free(repomdrecords_uniquefn);
+        cr_slist_free_full(repomdrecords, (GDestroyNotify)cr_repomd_record_free);
+        cr_repomd_free(repomd);
+        g_free(repomd_path);
+        return FALSE;
     }
-    g_slist_free(repomdrecordfilltasks);
 
     // Detach records from repomd
     GSList *recordstoremove = NULL;
@@ -523,6 +1248,8 @@ cr_modifyrepo_parse_batchfile(const gchar *path,
         g_free(tmp_str);
         task->new_name = cr_safe_string_chunk_insert_and_free(task->chunk,
                     g_key_file_get_string(keyfile, group, "new-name", NULL));
+        task->merge = cr_key_file_get_boolean_default(keyfile, group,
+                   "merge", FALSE, NULL);
 
         g_debug("Task: [path: %s, type: %s, remove: %d, compress: %d, "
                 "compress_type: %d (%s), unique_md_filenames: %d, "
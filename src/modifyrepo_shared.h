@@ -49,8 +49,10 @@ typedef struct {
     gchar *new_name;
     gboolean zck;
     gchar *zck_dict_dir;
+    gboolean merge;
 
     // Internal use
+    gchar *merge_path;
     gchar *repopath;
     gchar *zck_repopath;
     gchar *dst_fn;
@@ -78,6 +80,25 @@ cr_modifyrepo_parse_batchfile(const gchar *path,
 
 gchar *
 cr_remove_compression_suffix_if_present(gchar* name, GError **err);
+
+/** Merge advisories from new_path into the updateinfo old_path and write
+ * the result (uncompressed) to out_path. The old file is streamed, its
+ * <update> elements are copied verbatim unless an advisory with the same
+ * id is present in the new file, in which case it is replaced in place.
+ * Remaining new advisories are appended at the end. Ids are compared
+ * after entity and CDATA decoding. Further copies of a replaced advisory
+ * in the old file are dropped with a warning.
+ * @param old_path      Path to the existing (possibly compressed) updateinfo
+ * @param new_path      Path to the updateinfo with new advisories
+ * @param out_path      Path to the output file
+ * @param err           GError **
+ * @return              TRUE on success
+ */
+gboolean
+cr_modifyrepo_merge_updateinfo(const gchar *old_path,
+                               const gchar *new_path,
+                               const gchar *out_path,
+                               GError **err);
 /** @} */
 
 #ifdef __cplusplus
@@ -134,9 +134,25 @@ cr_package_free(cr_Package *package)
     g_free(package->siggpg);
     g_free(package->sigpgp);
 
+    g_free(package->raw_primary);
+    g_free(package->raw_filelists);
+    g_free(package->raw_filelists_ext);
+    g_free(package->raw_other);
+    cr_evr_key_free(package->evr_key);
+
     g_free (package);
 }
 
+const cr_EvrKey *
+cr_package_evr_key(cr_Package *package)
+{
+    if (!package->evr_key)
+        package->evr_key = cr_evr_key_new(package->epoch,
+                                          package->version,
+                                          package->release);
+    return package->evr_key;
+}
+
 gchar *
 cr_package_nvra(cr_Package *package)
 {
@@ -195,6 +211,7 @@ cr_package_copy_into(cr_Package *orig, cr_Package *pkg)
     pkg->version          = cr_safe_string_chunk_insert(pkg->chunk, orig->version);
     pkg->epoch            = cr_safe_string_chunk_insert(pkg->chunk, orig->epoch);
     pkg->release          = cr_safe_string_chunk_insert(pkg->chunk, orig->release);
+    g_clear_pointer(&pkg->evr_key, cr_evr_key_free);
     pkg->summary          = cr_safe_string_chunk_insert(pkg->chunk, orig->summary);
     pkg->description      = cr_safe_string_chunk_insert(pkg->chunk, orig->description);
     pkg->url              = cr_safe_string_chunk_insert(pkg->chunk, orig->url);
@@ -313,6 +330,7 @@ void
 cr_package_set_version(cr_Package *pkg, const char *value)
 {
     cr_package_assign_string(pkg, &pkg->version, value);
+    g_clear_pointer(&pkg->evr_key, cr_evr_key_free);
 }
 
 const char *
@@ -325,6 +343,7 @@ void
 cr_package_set_epoch(cr_Package *pkg, const char *value)
 {
     cr_package_assign_string(pkg, &pkg->epoch, value);
+    g_clear_pointer(&pkg->evr_key, cr_evr_key_free);
 }
 
 const char *
@@ -337,6 +356,7 @@ void
 cr_package_set_release(cr_Package *pkg, const char *value)
 {
     cr_package_assign_string(pkg, &pkg->release, value);
+    g_clear_pointer(&pkg->evr_key, cr_evr_key_free);
 }
 
 const char *
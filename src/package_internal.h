@@ -27,6 +27,36 @@ extern "C" {
 
 #include "package.h"
 
+/** Pre-tokenized epoch, version and release.
+ * Comparison of two keys is much cheaper than cr_cmp_evr() (the strings
+ * are not parsed again), so keys are worth it when the same evr is
+ * compared repeatedly (e.g. while sorting).
+ */
+typedef struct _cr_EvrKey cr_EvrKey;
+
+/** Build a key of the evr. The key compares the same way as cr_cmp_evr()
+ * (rpmvercmp() semantics, including '~' and '^', NULL epoch is "0").
+ * @param epoch     epoch or NULL
+ * @param version   version
+ * @param release   release
+ * @return          new key (free it with cr_evr_key_free())
+ */
+cr_EvrKey *cr_evr_key_new(const char *epoch,
+                          const char *version,
+                          const char *release);
+
+/** Free the evr key.
+ * @param key       key or NULL
+ */
+void cr_evr_key_free(cr_EvrKey *key);
+
+/** Compare two evr keys.
+ * @param key1      first key
+ * @param key2      second key
+ * @return          0 = same, 1 = first is newer, -1 = second is newer
+ */
+int cr_evr_key_cmp(const cr_EvrKey *key1, const cr_EvrKey *key2);
+
 /** Package
  */
 struct _cr_Package {
@@ -89,6 +119,19 @@ struct _cr_Package {
     cr_PackageLoadingFlags loadingflags; /*!<
         Bitfield flags with information about package loading  */
     gboolean skip_dump;         /*!<  Don't dump this package to metadata. */
+
+    char *raw_primary;          /*!< Raw <package> element from primary.xml
+                                     the package was loaded from (not stored
+                                     in the chunk) or NULL */
+    char *raw_filelists;        /*!< Raw <package> element from
+                                     filelists.xml or NULL */
+    char *raw_filelists_ext;    /*!< Raw <package> element from
+                                     filelists-ext.xml or NULL */
+    char *raw_other;            /*!< Raw <package> element from other.xml
+                                     or NULL */
+    cr_EvrKey *evr_key;         /*!< Cached key of epoch, version and
+                                     release (see cr_package_evr_key())
+                                     or NULL */
 };
 
 /** Copy package data into specified package (overriding its data)
@@ -97,6 +140,16 @@ struct _cr_Package {
  */
 void cr_package_copy_into(cr_Package *source, cr_Package *target);
 
+/** Get pre-tokenized epoch, version and release of the package.
+ * The key is built by the first call and cached in the package
+ * (not thread safe). The setters of epoch, version and release
+ * drop the cached key, direct changes of the fields don't.
+ * Ownership: not transferred.
+ * @param package       cr_Package
+ * @return              evr key
+ */
+const cr_EvrKey *cr_package_evr_key(cr_Package *package);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,12 +20,14 @@
 #include <glib.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <rpm/rpmts.h>
 #include <rpm/rpmfi.h>
+#include <rpm/rpmio.h>
 #include <rpm/rpmlib.h>
 #include <rpm/rpmmacro.h>
 #include <rpm/rpmkeyring.h>
@@ -86,21 +88,8 @@ cr_package_parser_cleanup()
 }
 
 static gboolean
-read_header(const char *filename, Header *hdr, GError **err)
+read_header_fd(FD_t fd, const char *filename, Header *hdr, GError **err)
 {
-    assert(filename);
-    assert(!err || *err == NULL);
-
-    FD_t fd = Fopen(filename, "r.ufdio");
-    if (!fd) {
-        int fopen_error = errno;
-        g_warning("%s: Fopen of %s failed %s",
-                  __func__, filename, g_strerror(fopen_error));
-        g_set_error(err, ERR_DOMAIN, CRE_IO,
-                    "Fopen failed: %s", g_strerror(fopen_error));
-        return FALSE;
-    }
-
     int rc = rpmReadPackageFile(cr_ts, fd, NULL, hdr);
     if (rc != RPMRC_OK) {
         switch (rc) {
@@ -117,15 +106,34 @@ read_header(const char *filename, Header *hdr, GError **err)
                           __func__);
                 g_set_error(err, ERR_DOMAIN, CRE_IO,
                             "rpmReadPackageFile() error");
-                Fclose(fd);
                 return FALSE;
         }
     }
 
-    Fclose(fd);
     return TRUE;
 }
 
+static gboolean
+read_header(const char *filename, Header *hdr, GError **err)
+{
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    FD_t fd = Fopen(filename, "r.ufdio");
+    if (!fd) {
+        int fopen_error = errno;
+        g_warning("%s: Fopen of %s failed %s",
+                  __func__, filename, g_strerror(fopen_error));
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Fopen failed: %s", g_strerror(fopen_error));
+        return FALSE;
+    }
+
+    gboolean ret = read_header_fd(fd, filename, hdr, err);
+    Fclose(fd);
+    return ret;
+}
+
 cr_Package *
 cr_package_from_rpm_base(const char *filename,
                          int changelog_limit,
@@ -146,6 +154,40 @@ cr_package_from_rpm_base(const char *filename,
     return pkg;
 }
 
+cr_Package *
+cr_package_from_rpm_fd(int fd,
+                       const char *filename,
+                       int changelog_limit,
+                       cr_HeaderReadingFlags flags,
+                       GError **err)
+{
+    Header hdr;
+    cr_Package *pkg;
+
+    assert(fd >= 0);
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    // The duplicate shares the file offset with the fd, so the header
+    // is read through the same open file description
+    FD_t rpmfd = fdDup(fd);
+    if (!rpmfd) {
+        int dup_error = errno;
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fdDup of %s failed: %s", filename, g_strerror(dup_error));
+        return NULL;
+    }
+
+    gboolean ret = read_header_fd(rpmfd, filename, &hdr, err);
+    Fclose(rpmfd);
+    if (!ret)
+        return NULL;
+
+    pkg = cr_package_from_header(hdr, changelog_limit, flags, err);
+    headerFree(hdr);
+    return pkg;
+}
+
 cr_Package *
 cr_package_from_rpm(const char *filename,
                     cr_ChecksumType checksum_type,
@@ -162,8 +204,24 @@ cr_package_from_rpm(const char *filename,
     assert(filename);
     assert(!err || *err == NULL);
 
+    // Open the package just once, the header, the checksum and the header
+    // range are all read through this fd
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        int open_error = errno;
+        g_warning("%s: open of %s failed %s",
+                  __func__, filename, g_strerror(open_error));
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", filename, g_strerror(open_error));
+        return NULL;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
     // Get a package object
-    pkg = cr_package_from_rpm_base(filename, changelog_limit, flags, err);
+    pkg = cr_package_from_rpm_fd(fd, filename, changelog_limit, flags, err);
     if (!pkg)
         goto errexit;
 
@@ -177,11 +235,11 @@ cr_package_from_rpm(const char *filename,
     // Get file stat
     if (!stat_buf) {
         struct stat stat_buf_own;
-        if (stat(filename, &stat_buf_own) == -1) {
+        if (fstat(fd, &stat_buf_own) == -1) {
             int stat_error = errno;
-            g_warning("%s: stat(%s) error (%s)", __func__,
+            g_warning("%s: fstat(%s) error (%s)", __func__,
                       filename, g_strerror(stat_error));
-            g_set_error(err,  ERR_DOMAIN, CRE_IO, "stat(%s) failed: %s",
+            g_set_error(err,  ERR_DOMAIN, CRE_IO, "fstat(%s) failed: %s",
                         filename, g_strerror(stat_error));
             goto errexit;
         }
@@ -192,31 +250,42 @@ cr_package_from_rpm(const char *filename,
         pkg->size_package = stat_buf->st_size;
     }
 
-    // Compute checksum
-    gchar *checksum = cr_checksum_file(filename, checksum_type, &tmp_err);
-    if (!checksum) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while checksum calculation: ");
+    // Compute checksum and header range in a single pass
+    if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO, "Cannot seek over %s: %s",
+                    filename, g_strerror(errno));
         goto errexit;
     }
-    pkg->pkgId = cr_safe_string_chunk_insert(pkg->chunk, checksum);
-    g_free(checksum);
 
-    // Get header range
-    struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range(filename,
-                                                                 &tmp_err);
+    cr_ChecksumCtx *ctx = cr_checksum_new(checksum_type, err);
+    if (!ctx)
+        goto errexit;
+
+    struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range_fd(fd,
+                                                                    filename,
+                                                                    ctx,
+                                                                    &tmp_err);
     if (tmp_err) {
         g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while determining header range: ");
+                                   "Error while reading package: ");
+        g_free(cr_checksum_final(ctx, NULL));
         goto errexit;
     }
 
+    gchar *checksum = cr_checksum_final(ctx, err);
+    if (!checksum)
+        goto errexit;
+    pkg->pkgId = cr_safe_string_chunk_insert(pkg->chunk, checksum);
+    g_free(checksum);
+
     pkg->rpm_header_start = hdr_r.start;
     pkg->rpm_header_end = hdr_r.end;
 
+    close(fd);
     return pkg;
 
 errexit:
+    close(fd);
     cr_package_free(pkg);
     return NULL;
 }
@@ -61,6 +61,25 @@ cr_package_from_rpm_base(const char *filename,
                          cr_HeaderReadingFlags flags,
                          GError **err);
 
+/** Generate a package object from an already opened package file.
+ * The header is read from the current offset of the fd (which is
+ * advanced), so the caller can reuse the same fd for the checksum
+ * calculation instead of opening the package again.
+ * The same attributes as in cr_package_from_rpm_base() are not filled.
+ * @param fd                    file descriptor of the opened package
+ * @param filename              filename (used in error messages only)
+ * @param changelog_limit       number of changelogs that will be loaded
+ * @param flags                 Flags for header reading
+ * @param err                   GError **
+ * @return                      cr_Package or NULL on error
+ */
+cr_Package *
+cr_package_from_rpm_fd(int fd,
+                       const char *filename,
+                       int changelog_limit,
+                       cr_HeaderReadingFlags flags,
+                       GError **err);
+
 /** Generate a package object from a package file.
  * @param filename              filename
  * @param checksum_type         type of checksum to be used
@@ -206,6 +206,27 @@ set_str(_ContentStatObject *self, PyObject *value, void *member_offset)
     return 0;
 }
 
+static PyObject *
+get_compressed_size(_ContentStatObject *self, G_GNUC_UNUSED void *nothing)
+{
+    gint64 size;
+    if (check_ContentStatStatus(self))
+        return NULL;
+    cr_contentstat_get_compressed(self->stat, &size);
+    return PyLong_FromLongLong((long long) size);
+}
+
+static PyObject *
+get_compressed_checksum(_ContentStatObject *self, G_GNUC_UNUSED void *nothing)
+{
+    if (check_ContentStatStatus(self))
+        return NULL;
+    const char *str = cr_contentstat_get_compressed(self->stat, NULL);
+    if (str == NULL)
+        Py_RETURN_NONE;
+    return PyUnicode_FromString(str);
+}
+
 static PyGetSetDef contentstat_getsetters[] = {
     {"size",            (getter)get_num, (setter)set_num,
         "Number of uncompressed bytes written", OFFSET(size)},
@@ -213,6 +234,10 @@ static PyGetSetDef contentstat_getsetters[] = {
         "Type of used checksum", OFFSET(checksum_type)},
     {"checksum",        (getter)get_str, (setter)set_str,
         "Calculated checksum", OFFSET(checksum)},
+    {"compressed_size", (getter)get_compressed_size, NULL,
+        "Size of the compressed file", NULL},
+    {"compressed_checksum", (getter)get_compressed_checksum, NULL,
+        "Checksum of the compressed file", NULL},
     {NULL, NULL, NULL, NULL, NULL} /* sentinel */
 };
 
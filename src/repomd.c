@@ -432,11 +432,14 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
                                              &dict_size, &tmp_err)) {
             ret = tmp_err->code;
             g_propagate_prefixed_error(err, tmp_err, "Error reading zchunk dict %s:", dict_file);
+            cr_close(cw_plain, NULL);
             return ret;
         }
     }
 
-    _cleanup_free_ cr_ContentStat *out_stat = g_malloc0(sizeof(cr_ContentStat));
+    // Checksums of the written content and of the compressed file
+    // are computed during the compression
+    cr_ContentStat *out_stat = cr_contentstat_new(checksum_type, NULL);
     cw_compressed = cr_sopen(cpath,
                              CR_CW_MODE_WRITE,
                              record_compression,
@@ -445,19 +448,24 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
     if (!cw_compressed) {
         ret = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", cpath);
-        return ret;
+        cr_close(cw_plain, NULL);
+        goto end;
     }
 
     if (record_compression == CR_CW_ZCK_COMPRESSION) {
         if (dict && cr_set_dict(cw_compressed, dict, dict_size, &tmp_err) != CRE_OK) {
             ret = tmp_err->code;
             g_propagate_prefixed_error(err, tmp_err, "Unable to set zdict for %s: ", cpath);
-            return ret;
+            cr_close(cw_plain, NULL);
+            cr_close(cw_compressed, NULL);
+            goto end;
         }
         if (cr_set_autochunk(cw_compressed, TRUE, &tmp_err) != CRE_OK) {
             ret = tmp_err->code;
             g_propagate_prefixed_error(err, tmp_err, "Unable to set auto-chunking for %s: ", cpath);
-            return ret;
+            cr_close(cw_plain, NULL);
+            cr_close(cw_compressed, NULL);
+            goto end;
         }
     }
 
@@ -476,7 +484,7 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
                 tmp_err->message);
         g_propagate_prefixed_error(err, tmp_err,
                 "Error while compression %s -> %s:", path, cpath);
-        return ret;
+        goto end;
     }
 
     cr_close(cw_compressed, &tmp_err);
@@ -484,12 +492,18 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
         ret = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err,
                 "Error while closing %s: ", path);
-        return ret;
+        goto end;
     }
 
-    // Compute checksums
+    // Compute checksums (if they weren't computed during the compression)
 
-    checksum  = cr_checksum_file(path, checksum_type, &tmp_err);
+    if (mode == CR_CW_NO_COMPRESSION) {
+        // The plain file was copied as is
+        checksum = out_stat->checksum;
+        out_stat->checksum = NULL;
+    }
+    if (!checksum)
+        checksum = cr_checksum_file(path, checksum_type, &tmp_err);
     if (!checksum) {
         ret = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err,
@@ -497,7 +511,9 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
         goto end;
     }
 
-    cchecksum = cr_checksum_file(cpath, checksum_type, &tmp_err);
+    cchecksum = g_strdup(cr_contentstat_get_compressed(out_stat, NULL));
+    if (!cchecksum)
+        cchecksum = cr_checksum_file(cpath, checksum_type, &tmp_err);
     if (!cchecksum) {
         ret = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err,
@@ -533,6 +549,7 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
         cgf_hdrsize = out_stat->hdr_size;
         hdr_checksum_str = cr_checksum_name_str(out_stat->hdr_checksum_type);
         hdrchecksum = out_stat->hdr_checksum;
+        out_stat->hdr_checksum = NULL;
     }
 
     // Results
@@ -568,6 +585,7 @@ end:
     g_free(checksum);
     g_free(cchecksum);
     g_free(hdrchecksum);
+    cr_contentstat_free(out_stat, NULL);
 
     return ret;
 }
@@ -728,6 +746,18 @@ cr_repomd_record_load_contentstat(cr_RepomdRecord *record,
     record->checksum_open_type = cr_safe_string_chunk_insert(record->chunk,
                                 cr_checksum_name_str(stats->checksum_type));
     record->size_open = stats->size;
+
+    // Stats of the compressed file computed by the writer
+    gint64 compressed_size;
+    const char *compressed_checksum =
+                cr_contentstat_get_compressed(stats, &compressed_size);
+    if (compressed_checksum) {
+        record->checksum = cr_safe_string_chunk_insert(record->chunk,
+                                                compressed_checksum);
+        record->checksum_type = cr_safe_string_chunk_insert(record->chunk,
+                                cr_checksum_name_str(stats->checksum_type));
+        record->size = compressed_size;
+    }
 }
 
 void
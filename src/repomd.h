@@ -184,7 +184,10 @@ int cr_repomd_record_rename_file(cr_RepomdRecord *record, GError **err);
 void cr_repomd_record_set_timestamp(cr_RepomdRecord *record, gint64 timestamp);
 
 /** Load the open stats (checksum_open, checksum_open_type and size_open)
- * from the cr_ContentStat object.
+ * from the cr_ContentStat object. If the stats contain also the checksum
+ * of the compressed file (filled by cr_close() of a file opened for
+ * writing), the checksum, checksum_type and size are loaded too and
+ * cr_repomd_record_fill() doesn't have to read the file again.
  * @param record                cr_RepomdRecord
  * @param stats                 cr_ContentStat
  */
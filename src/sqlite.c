@@ -58,12 +58,22 @@ struct _DbFilelistsStatements {
     sqlite3 *db;
     sqlite3_stmt *package_id_handle;
     sqlite3_stmt *filelists_handle;
+    gboolean store_pkgkey;  // Store the pkgKey into the added packages
 };
 
 struct _DbOtherStatements {
     sqlite3 *db;
     sqlite3_stmt *package_id_handle;
     sqlite3_stmt *changelog_handle;
+    gboolean store_pkgkey;  // Store the pkgKey into the added packages
+};
+
+#define OLD_COPY_HANDLES    9   // Files + 8 dependency tables of primary
+
+struct _DbOldStatements {
+    sqlite3_stmt *pkgkey_handle;    // pkgKey of a pkgId in the old db
+    sqlite3_stmt *copy_handles[OLD_COPY_HANDLES]; // Copy rows of a pkgKey
+                                                  // (NULL terminated)
 };
 
 static inline int cr_sqlite3_bind_text(sqlite3_stmt *stmt, int i,
@@ -135,7 +145,7 @@ db_create_dbinfo_table(sqlite3 *db, GError **err)
 
     assert(!err || *err == NULL);
 
-    sql = "CREATE TABLE db_info (dbversion INTEGER, checksum TEXT)";
+    sql = "CREATE TABLE IF NOT EXISTS db_info (dbversion INTEGER, checksum TEXT)";
     rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
     if (rc != SQLITE_OK) {
         g_set_error(err, ERR_DOMAIN, CRE_DB,
@@ -644,7 +654,7 @@ force_null(const char *str)
         return str;
 }
 
-static void
+static gint64
 db_package_write (sqlite3 *db,
                   sqlite3_stmt *handle,
                   cr_Package *p,
@@ -685,13 +695,15 @@ db_package_write (sqlite3 *db,
 
     if (rc == SQLITE_DONE) {
         p->pkgKey = sqlite3_last_insert_rowid (db);
-    } else {
-        g_critical ("Error adding package to db: %s",
-                    sqlite3_errmsg(db));
-        g_set_error(err, ERR_DOMAIN, CRE_DB,
-                    "Error adding package to db: %s",
-                    sqlite3_errmsg(db));
+        return p->pkgKey;
     }
+
+    g_critical ("Error adding package to db: %s",
+                sqlite3_errmsg(db));
+    g_set_error(err, ERR_DOMAIN, CRE_DB,
+                "Error adding package to db: %s",
+                sqlite3_errmsg(db));
+    return 0;
 }
 
 
@@ -1047,10 +1059,15 @@ db_package_ids_prepare(sqlite3 *db, GError **err)
 }
 
 
-static void
+/** Insert the package into the packages table of filelists or other db.
+ * The key is returned and stored into the package only if store_pkgkey
+ * is set (see cr_db_set_store_pkgkey()).
+ */
+static gint64
 db_package_ids_write(sqlite3 *db,
                      sqlite3_stmt *handle,
                      cr_Package *pkg,
+                     gboolean store_pkgkey,
                      GError **err)
 {
     int rc;
@@ -1062,14 +1079,18 @@ db_package_ids_write(sqlite3 *db,
     sqlite3_reset (handle);
 
     if (rc == SQLITE_DONE) {
-        pkg->pkgKey = sqlite3_last_insert_rowid (db);
-    } else {
-        g_critical("Error adding package to db: %s",
-                   sqlite3_errmsg(db));
-        g_set_error(err, ERR_DOMAIN, CRE_DB,
-                    "Error adding package to db: %s",
-                    sqlite3_errmsg(db));
-    }
+        gint64 pkgKey = sqlite3_last_insert_rowid (db);
+        if (store_pkgkey)
+            pkg->pkgKey = pkgKey;
+        return pkgKey;
+    }
+
+    g_critical("Error adding package to db: %s",
+               sqlite3_errmsg(db));
+    g_set_error(err, ERR_DOMAIN, CRE_DB,
+                "Error adding package to db: %s",
+                sqlite3_errmsg(db));
+    return 0;
 }
 
 /*
@@ -1204,10 +1225,11 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
 {
     GError *tmp_err = NULL;
     GSList *iter;
+    gint64 pkgKey;
 
     assert(!err || *err == NULL);
 
-    db_package_write(stmts->db, stmts->pkg_handle, pkg, &tmp_err);
+    pkgKey = db_package_write(stmts->db, stmts->pkg_handle, pkg, &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1216,7 +1238,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->provides; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->provides_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             FALSE,
                             &tmp_err);
@@ -1229,7 +1251,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->conflicts; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->conflicts_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             FALSE,
                             &tmp_err);
@@ -1242,7 +1264,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->obsoletes; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->obsoletes_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             FALSE,
                             &tmp_err);
@@ -1255,7 +1277,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->requires; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->requires_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1268,7 +1290,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->suggests; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->suggests_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1281,7 +1303,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->enhances; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->enhances_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1294,7 +1316,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->recommends; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->recommends_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1307,7 +1329,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->supplements; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->supplements_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1318,7 +1340,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     }
 
     for (iter = pkg->files; iter; iter = iter->next) {
-        db_file_write(stmts->db, stmts->files_handle, pkg->pkgKey,
+        db_file_write(stmts->db, stmts->files_handle, pkgKey,
                       (cr_PackageFile *) iter->data, &tmp_err);
         if (tmp_err) {
             g_propagate_error(err, tmp_err);
@@ -1356,6 +1378,7 @@ cr_db_prepare_filelists_statements(sqlite3 *db, GError **err)
     ret->db                = db;
     ret->package_id_handle = NULL;
     ret->filelists_handle  = NULL;
+    ret->store_pkgkey      = TRUE;
 
     ret->package_id_handle = db_package_ids_prepare(db, &tmp_err);
     if (tmp_err) {
@@ -1383,11 +1406,13 @@ cr_db_add_filelists_pkg(cr_DbFilelistsStatements stmts,
                         GError **err)
 {
     GError *tmp_err = NULL;
+    gint64 pkgKey;
 
     assert(!err || *err == NULL);
 
     // Add record into the package table
-    db_package_ids_write(stmts->db, stmts->package_id_handle, pkg, &tmp_err);
+    pkgKey = db_package_ids_write(stmts->db, stmts->package_id_handle, pkg,
+                                  stmts->store_pkgkey, &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1404,7 +1429,7 @@ cr_db_add_filelists_pkg(cr_DbFilelistsStatements stmts,
     hash = package_files_to_hash(pkg->files);
     g_hash_table_iter_init(&iter, hash);
     while (g_hash_table_iter_next (&iter, &key, &value)) {
-        cr_db_write_file(stmts->db, stmts->filelists_handle, pkg->pkgKey, key, value, &tmp_err);
+        cr_db_write_file(stmts->db, stmts->filelists_handle, pkgKey, key, value, &tmp_err);
         if (tmp_err) {
             g_propagate_error(err, tmp_err);
             break;
@@ -1443,6 +1468,7 @@ cr_db_prepare_other_statements(sqlite3 *db, GError **err)
     ret->db                = db;
     ret->package_id_handle = NULL;
     ret->changelog_handle  = NULL;
+    ret->store_pkgkey      = TRUE;
 
     ret->package_id_handle = db_package_ids_prepare(db, &tmp_err);
     if (tmp_err) {
@@ -1471,13 +1497,15 @@ cr_db_add_other_pkg(cr_DbOtherStatements stmts, cr_Package *pkg, GError **err)
     GSList *iter;
     cr_ChangelogEntry *entry;
     GError *tmp_err = NULL;
+    gint64 pkgKey;
 
     assert(!err || *err == NULL);
 
     sqlite3_stmt *handle = stmts->changelog_handle;
 
     // Add package record into the packages table
-    db_package_ids_write(stmts->db, stmts->package_id_handle, pkg, &tmp_err);
+    pkgKey = db_package_ids_write(stmts->db, stmts->package_id_handle, pkg,
+                                  stmts->store_pkgkey, &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1487,7 +1515,7 @@ cr_db_add_other_pkg(cr_DbOtherStatements stmts, cr_Package *pkg, GError **err)
     for (iter = pkg->changelogs; iter; iter = iter->next) {
         entry = (cr_ChangelogEntry *) iter->data;
 
-        sqlite3_bind_int  (handle, 1, pkg->pkgKey);
+        sqlite3_bind_int  (handle, 1, pkgKey);
         cr_sqlite3_bind_text (handle, 2, entry->author, -1, SQLITE_STATIC);
         sqlite3_bind_int  (handle, 3, entry->date);
         cr_sqlite3_bind_text (handle, 4, entry->changelog, -1, SQLITE_STATIC);
@@ -1640,6 +1668,399 @@ cr_db_open(const char *path, cr_DatabaseType db_type, GError **err)
 }
 
 
+GHashTable *
+cr_db_pkgids(cr_SqliteDb *sqlitedb, GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle;
+    GHashTable *pkgids;
+    const char *query = "SELECT pkgId, pkgKey FROM packages";
+
+    assert(sqlitedb);
+    assert(!err || *err == NULL);
+
+    rc = sqlite3_prepare_v2(sqlitedb->db, query, -1, &handle, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot prepare pkgIds selection: %s",
+                    sqlite3_errmsg(sqlitedb->db));
+        sqlite3_finalize(handle);
+        return NULL;
+    }
+
+    pkgids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                   (GDestroyNotify) g_array_unref);
+
+    while ((rc = sqlite3_step(handle)) == SQLITE_ROW) {
+        const char *pkgId = (const char *) sqlite3_column_text(handle, 0);
+        gint64 pkgKey = sqlite3_column_int64(handle, 1);
+        GArray *pkgkeys;
+
+        // The same package (pkgId) could be in the repo more times
+        if (!pkgId)
+            pkgId = "";
+        pkgkeys = g_hash_table_lookup(pkgids, pkgId);
+        if (!pkgkeys) {
+            pkgkeys = g_array_new(FALSE, FALSE, sizeof(gint64));
+            g_hash_table_insert(pkgids, g_strdup(pkgId), pkgkeys);
+        }
+        g_array_append_val(pkgkeys, pkgKey);
+    }
+
+    if (rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot select pkgIds: %s",
+                    sqlite3_errmsg(sqlitedb->db));
+        g_hash_table_destroy(pkgids);
+        pkgids = NULL;
+    }
+
+    sqlite3_finalize(handle);
+    return pkgids;
+}
+
+
+gboolean
+cr_db_pkg_unchanged(cr_SqliteDb *sqlitedb,
+                    gint64 pkgKey,
+                    cr_Package *pkg,
+                    GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle;
+    const char *query = "SELECT pkgKey FROM packages WHERE pkgKey = ? "
+                        "AND location_href IS ? AND location_base IS ? "
+                        "AND time_file = ? AND size_package = ?";
+
+    assert(sqlitedb);
+    assert(pkg);
+    assert(!err || *err == NULL);
+
+    // Only pkgIds are stored in filelists and other dbs
+    if (sqlitedb->type != CR_DB_PRIMARY)
+        return TRUE;
+
+    rc = sqlite3_prepare_v2(sqlitedb->db, query, -1, &handle, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot prepare package comparison: %s",
+                    sqlite3_errmsg(sqlitedb->db));
+        sqlite3_finalize(handle);
+        return FALSE;
+    }
+
+    // Bind the values the same way as db_package_write() does
+    sqlite3_bind_int64(handle, 1, pkgKey);
+    cr_sqlite3_bind_text(handle, 2, pkg->location_href, -1, SQLITE_STATIC);
+    cr_sqlite3_bind_text(handle, 3, force_null(pkg->location_base), -1, SQLITE_STATIC);
+    sqlite3_bind_int  (handle, 4, pkg->time_file);
+    sqlite3_bind_int64(handle, 5, pkg->size_package);
+
+    rc = sqlite3_step(handle);
+    sqlite3_finalize(handle);
+
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot compare package with db: %s",
+                    sqlite3_errmsg(sqlitedb->db));
+        return FALSE;
+    }
+
+    return rc == SQLITE_ROW;
+}
+
+
+int
+cr_db_remove_pkg(cr_SqliteDb *sqlitedb, gint64 pkgKey, GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle;
+    const char *query = "DELETE FROM packages WHERE pkgKey = ?";
+
+    assert(sqlitedb);
+    assert(!err || *err == NULL);
+
+    rc = sqlite3_prepare_v2(sqlitedb->db, query, -1, &handle, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot prepare package removal: %s",
+                    sqlite3_errmsg(sqlitedb->db));
+        sqlite3_finalize(handle);
+        return CRE_DB;
+    }
+
+    sqlite3_bind_int64(handle, 1, pkgKey);
+    rc = sqlite3_step(handle);
+    sqlite3_finalize(handle);
+
+    if (rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot remove package from db: %s",
+                    sqlite3_errmsg(sqlitedb->db));
+        return CRE_DB;
+    }
+
+    return CRE_OK;
+}
+
+
+/** Get value of an integer pragma (e.g. page_count) or -1 on error.
+ */
+static gint64
+db_pragma_int(sqlite3 *db, const char *query)
+{
+    gint64 value = -1;
+    sqlite3_stmt *handle;
+
+    if (sqlite3_prepare_v2(db, query, -1, &handle, NULL) == SQLITE_OK
+        && sqlite3_step(handle) == SQLITE_ROW)
+        value = sqlite3_column_int64(handle, 0);
+    sqlite3_finalize(handle);
+    return value;
+}
+
+
+int
+cr_db_vacuum(cr_SqliteDb *sqlitedb, double min_free_ratio, GError **err)
+{
+    int rc;
+    gint64 pages, free_pages;
+
+    assert(sqlitedb);
+    assert(!err || *err == NULL);
+
+    // Vacuum is not possible inside of a transaction
+    sqlite3_exec(sqlitedb->db, "COMMIT", NULL, NULL, NULL);
+
+    pages = db_pragma_int(sqlitedb->db, "PRAGMA page_count");
+    free_pages = db_pragma_int(sqlitedb->db, "PRAGMA freelist_count");
+
+    rc = SQLITE_OK;
+    if (pages > 0 && free_pages >= 0
+        && (double) free_pages >= min_free_ratio * (double) pages)
+    {
+        g_debug("%s: Vacuuming db (%"G_GINT64_FORMAT" of %"G_GINT64_FORMAT
+                " pages are free)", __func__, free_pages, pages);
+        rc = sqlite3_exec(sqlitedb->db, "VACUUM", NULL, NULL, NULL);
+    }
+
+    if (rc != SQLITE_OK)
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot vacuum db: %s", sqlite3_errmsg(sqlitedb->db));
+
+    sqlite3_exec(sqlitedb->db, "BEGIN", NULL, NULL, NULL);
+
+    return rc == SQLITE_OK ? CRE_OK : CRE_DB;
+}
+
+
+static void
+db_destroy_old_statements(cr_DbOldStatements stmts)
+{
+    if (!stmts)
+        return;
+
+    sqlite3_finalize(stmts->pkgkey_handle);
+    for (int i = 0; i < OLD_COPY_HANDLES && stmts->copy_handles[i]; i++)
+        sqlite3_finalize(stmts->copy_handles[i]);
+    g_free(stmts);
+}
+
+
+int
+cr_db_attach_old(cr_SqliteDb *sqlitedb, const char *path, GError **err)
+{
+    int rc, i;
+    sqlite3_stmt *handle;
+    cr_DbOldStatements stmts;
+    GPtrArray *queries = g_ptr_array_new_with_free_func(g_free);
+
+    assert(sqlitedb);
+    assert(path);
+    assert(!sqlitedb->old);
+    assert(!err || *err == NULL);
+
+    switch (sqlitedb->type) {
+        case CR_DB_PRIMARY: {
+            const char *deps[] = { "requires", "provides", "conflicts",
+                                   "obsoletes", "suggests", "enhances",
+                                   "recommends", "supplements", NULL };
+            g_ptr_array_add(queries, g_strdup(
+                "INSERT INTO main.files (name, type, pkgKey) "
+                "SELECT name, type, ?1 FROM old.files WHERE pkgKey = ?2"));
+            for (i = 0; deps[i]; i++) {
+                const char *pre = strcmp(deps[i], "requires") ? "" : ", pre";
+                g_ptr_array_add(queries, g_strdup_printf(
+                    "INSERT INTO main.%s "
+                    "(name, flags, epoch, version, release, pkgKey%s) "
+                    "SELECT name, flags, epoch, version, release, ?1%s "
+                    "FROM old.%s WHERE pkgKey = ?2",
+                    deps[i], pre, pre, deps[i]));
+            }
+            break;
+        }
+        case CR_DB_FILELISTS:
+            g_ptr_array_add(queries, g_strdup(
+                "INSERT INTO main.filelist "
+                "(pkgKey, dirname, filenames, filetypes) "
+                "SELECT ?1, dirname, filenames, filetypes "
+                "FROM old.filelist WHERE pkgKey = ?2"));
+            break;
+        case CR_DB_OTHER:
+            g_ptr_array_add(queries, g_strdup(
+                "INSERT INTO main.changelog (pkgKey, author, date, changelog) "
+                "SELECT ?1, author, date, changelog "
+                "FROM old.changelog WHERE pkgKey = ?2"));
+            break;
+        default:
+            g_critical("%s: Bad db type", __func__);
+            assert(0);
+            g_set_error(err, ERR_DOMAIN, CRE_ASSERT, "Bad db type");
+            g_ptr_array_free(queries, TRUE);
+            return CRE_ASSERT;
+    }
+
+    assert(queries->len <= OLD_COPY_HANDLES);
+
+    // ATTACH would silently create a new empty database
+    if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        g_set_error(err, ERR_DOMAIN, CRE_NOFILE,
+                    "Old db %s doesn't exist", path);
+        g_ptr_array_free(queries, TRUE);
+        return CRE_NOFILE;
+    }
+
+    // Databases cannot be attached inside of a transaction
+    sqlite3_exec(sqlitedb->db, "COMMIT", NULL, NULL, NULL);
+
+    rc = sqlite3_prepare_v2(sqlitedb->db, "ATTACH DATABASE ? AS old",
+                            -1, &handle, NULL);
+    if (rc == SQLITE_OK) {
+        cr_sqlite3_bind_text(handle, 1, path, -1, SQLITE_STATIC);
+        rc = sqlite3_step(handle);
+        if (rc == SQLITE_DONE)
+            rc = SQLITE_OK;
+    }
+    sqlite3_finalize(handle);
+
+    sqlite3_exec(sqlitedb->db, "BEGIN", NULL, NULL, NULL);
+
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot attach old db %s: %s",
+                    path, sqlite3_errmsg(sqlitedb->db));
+        g_ptr_array_free(queries, TRUE);
+        return CRE_DB;
+    }
+
+    stmts = g_new0(struct _DbOldStatements, 1);
+
+    rc = sqlite3_prepare_v2(sqlitedb->db,
+                            "SELECT pkgKey FROM old.packages WHERE pkgId = ?",
+                            -1, &stmts->pkgkey_handle, NULL);
+
+    for (i = 0; rc == SQLITE_OK && i < (int) queries->len; i++)
+        rc = sqlite3_prepare_v2(sqlitedb->db, queries->pdata[i], -1,
+                                &stmts->copy_handles[i], NULL);
+
+    g_ptr_array_free(queries, TRUE);
+
+    if (rc != SQLITE_OK) {
+        // E.g. the old db has an incompatible schema
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot prepare statements for old db %s: %s",
+                    path, sqlite3_errmsg(sqlitedb->db));
+        db_destroy_old_statements(stmts);
+        sqlite3_exec(sqlitedb->db, "COMMIT", NULL, NULL, NULL);
+        sqlite3_exec(sqlitedb->db, "DETACH DATABASE old", NULL, NULL, NULL);
+        sqlite3_exec(sqlitedb->db, "BEGIN", NULL, NULL, NULL);
+        return CRE_DB;
+    }
+
+    sqlitedb->old = stmts;
+    return CRE_OK;
+}
+
+
+int
+cr_db_add_pkg_from_old(cr_SqliteDb *sqlitedb, cr_Package *pkg, GError **err)
+{
+    int rc;
+    gint64 old_pkgKey, pkgKey;
+    cr_DbOldStatements stmts = sqlitedb->old;
+    GError *tmp_err = NULL;
+
+    assert(sqlitedb);
+    assert(!err || *err == NULL);
+
+    if (!stmts || !pkg || !pkg->pkgId)
+        return cr_db_add_pkg(sqlitedb, pkg, err);
+
+    // Find the package in the old db
+    cr_sqlite3_bind_text(stmts->pkgkey_handle, 1, pkg->pkgId, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmts->pkgkey_handle);
+    old_pkgKey = sqlite3_column_int64(stmts->pkgkey_handle, 0);
+    sqlite3_reset(stmts->pkgkey_handle);
+
+    if (rc != SQLITE_ROW)
+        // Not there, insert it row by row
+        return cr_db_add_pkg(sqlitedb, pkg, err);
+
+    // Add record into the packages table
+    switch (sqlitedb->type) {
+        case CR_DB_PRIMARY:
+            pkgKey = db_package_write(sqlitedb->db,
+                                      sqlitedb->statements.pri->pkg_handle,
+                                      pkg, &tmp_err);
+            break;
+        case CR_DB_FILELISTS:
+            pkgKey = db_package_ids_write(sqlitedb->db,
+                                  sqlitedb->statements.fil->package_id_handle,
+                                  pkg, sqlitedb->statements.fil->store_pkgkey,
+                                  &tmp_err);
+            break;
+        case CR_DB_OTHER:
+            pkgKey = db_package_ids_write(sqlitedb->db,
+                                  sqlitedb->statements.oth->package_id_handle,
+                                  pkg, sqlitedb->statements.oth->store_pkgkey,
+                                  &tmp_err);
+            break;
+        default:
+            g_critical("%s: Bad db type", __func__);
+            assert(0);
+            g_set_error(err, ERR_DOMAIN, CRE_ASSERT, "Bad db type");
+            return CRE_ASSERT;
+    }
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        return code;
+    }
+
+    // Copy the rest from the old db
+    for (int i = 0; i < OLD_COPY_HANDLES && stmts->copy_handles[i]; i++) {
+        sqlite3_stmt *handle = stmts->copy_handles[i];
+
+        sqlite3_bind_int64(handle, 1, pkgKey);
+        sqlite3_bind_int64(handle, 2, old_pkgKey);
+        rc = sqlite3_step(handle);
+        sqlite3_reset(handle);
+
+        if (rc != SQLITE_DONE) {
+            g_critical("%s: Error copying rows from old db: %s",
+                       __func__, sqlite3_errmsg(sqlitedb->db));
+            g_set_error(err, ERR_DOMAIN, CRE_DB,
+                        "Error copying rows from old db: %s",
+                        sqlite3_errmsg(sqlitedb->db));
+            return CRE_DB;
+        }
+    }
+
+    return CRE_OK;
+}
+
+
 int
 cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
 {
@@ -1676,6 +2097,8 @@ cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
         return code;
     }
 
+    db_destroy_old_statements(sqlitedb->old);
+
     sqlite3_exec (sqlitedb->db, "COMMIT", NULL, NULL, NULL);
     sqlite3_close(sqlitedb->db);
 
@@ -1685,6 +2108,24 @@ cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
 }
 
 
+void
+cr_db_set_store_pkgkey(cr_SqliteDb *sqlitedb, gboolean store)
+{
+    assert(sqlitedb);
+
+    switch (sqlitedb->type) {
+        case CR_DB_FILELISTS:
+            sqlitedb->statements.fil->store_pkgkey = store;
+            break;
+        case CR_DB_OTHER:
+            sqlitedb->statements.oth->store_pkgkey = store;
+            break;
+        default:
+            // The primary db always stores its pkgKey
+            break;
+    }
+}
+
 int
 cr_db_add_pkg(cr_SqliteDb *sqlitedb, cr_Package *pkg, GError **err)
 {
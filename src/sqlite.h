@@ -74,6 +74,8 @@ typedef struct _DbFilelistsStatements * cr_DbFilelistsStatements; /*!<
     Compiled filelists database statements */
 typedef struct _DbOtherStatements     * cr_DbOtherStatements; /*!<
     Compiled other database statements */
+typedef struct _DbOldStatements       * cr_DbOldStatements; /*!<
+    Compiled statements copying rows from an attached old database */
 
 /** Union of precompiled database statements
  */
@@ -92,6 +94,9 @@ typedef struct {
         Type of Sqlite database. */
     cr_Statements statements; /*!<
         Compiled SQL statements */
+    cr_DbOldStatements old; /*!<
+        Statements copying rows from the attached old database
+        (see cr_db_attach_old()) or NULL */
 } cr_SqliteDb;
 
 /** Macro over cr_db_open function. Open (create new) primary sqlite sqlite db.
@@ -153,6 +158,44 @@ int cr_db_add_pkg(cr_SqliteDb *sqlitedb,
                   cr_Package *pkg,
                   GError **err);
 
+/** Set whether packages added into a filelists or other database get
+ * the pkgKey of the database stored into their pkg->pkgKey (default).
+ * Switch it off when the same packages are added into multiple databases
+ * concurrently from different threads. The primary database always
+ * stores its pkgKey.
+ * @param sqlitedb              open db connection
+ * @param store                 store the pkgKey into the packages
+ */
+void cr_db_set_store_pkgkey(cr_SqliteDb *sqlitedb, gboolean store);
+
+/** Attach an old database of the same type (e.g. from the previous run
+ * of createrepo_c --update). Packages added by cr_db_add_pkg_from_old()
+ * then get their dependencies, files or changelogs copied from the old
+ * database by INSERT ... SELECT instead of inserting them row by row.
+ * On error (e.g. the old database doesn't exist or it is of another
+ * type) nothing is attached and cr_db_add_pkg_from_old() behaves
+ * as cr_db_add_pkg().
+ * @param sqlitedb              open db connection
+ * @param path                  path to the old (uncompressed) database
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_attach_old(cr_SqliteDb *sqlitedb, const char *path, GError **err);
+
+/** Add package into the database. If the package (its pkgId) is present
+ * in the old database attached by cr_db_attach_old(), its rows are
+ * copied from there, otherwise it is the same as cr_db_add_pkg().
+ * The package record itself is always written from the pkg, so
+ * the changed location_href and location_base are respected.
+ * @param sqlitedb              open db connection
+ * @param pkg                   package object
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_add_pkg_from_old(cr_SqliteDb *sqlitedb,
+                           cr_Package *pkg,
+                           GError **err);
+
 /** Insert record into the updateinfo table
  * @param sqlitedb              open db connection
  * @param checksum              compressed xml file checksum
@@ -163,6 +206,54 @@ int cr_db_dbinfo_update(cr_SqliteDb *sqlitedb,
                         const char *checksum,
                         GError **err);
 
+/** Get pkgIds of all packages in the database.
+ * Useful to update an existing database incrementally, the packages
+ * which are no longer in the repository can be removed
+ * by cr_db_remove_pkg().
+ * @param sqlitedb              open db connection
+ * @param err                   **GError
+ * @return                      GHashTable with pkgIds (keys) and GArrays
+ *                              of gint64 pkgKeys (values, the same pkgId
+ *                              can be stored more times) or NULL on error
+ */
+GHashTable *cr_db_pkgids(cr_SqliteDb *sqlitedb, GError **err);
+
+/** Check whether a package row of the database still matches the package
+ * with the same pkgId, i.e. whether its location_href, location_base,
+ * time_file and size_package are unchanged (e.g. the package was not
+ * moved). Rows of filelists and other databases contain only pkgIds,
+ * so they always match.
+ * @param sqlitedb              open db connection
+ * @param pkgKey                pkgKey of the row
+ * @param pkg                   package
+ * @param err                   **GError
+ * @return                      TRUE if the row matches the package,
+ *                              FALSE if it does not or on error
+ */
+gboolean cr_db_pkg_unchanged(cr_SqliteDb *sqlitedb,
+                             gint64 pkgKey,
+                             cr_Package *pkg,
+                             GError **err);
+
+/** Remove package from the database. All its records in the other tables
+ * (dependencies, files, changelogs) are removed by the triggers.
+ * @param sqlitedb              open db connection
+ * @param pkgKey                pkgKey of the package in the db
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_remove_pkg(cr_SqliteDb *sqlitedb, gint64 pkgKey, GError **err);
+
+/** Rebuild the database file if at least min_free_ratio of its pages
+ * are free (e.g. after removal of many packages). The running
+ * transaction is committed and a new one is started.
+ * @param sqlitedb              open db connection
+ * @param min_free_ratio        0.0 - always vacuum, 1.0 - never vacuum
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_vacuum(cr_SqliteDb *sqlitedb, double min_free_ratio, GError **err);
+
 /** Close db.
  *  - creates indexes on tables
  *  - commits transaction
@@ -43,6 +43,9 @@
 
 
 #define DEFAULT_CHECKSUM    CR_CHECKSUM_SHA256
+#define DEFAULT_WORKERS     3
+#define VACUUM_FREE_RATIO   0.25    // Vacuum updated DB if a quarter of
+                                    // its pages is free
 
 /**
  * Command line options
@@ -55,6 +58,7 @@ typedef struct {
     gboolean quiet;             /*!< quiet mode */
     gboolean verbose;           /*!< verbose mode */
     gboolean force;             /*!< overwrite existing DBs */
+    gboolean incremental;       /*!< update existing DBs */
     gboolean keep_old;          /*!< keep old DBs around */
     gboolean xz_compression;    /*!< use xz for DBs compression */
     gchar *compress_type;       /*!< which compression type to use */
@@ -63,6 +67,7 @@ typedef struct {
                                      sqlite has a trouble to gen DBs
                                      on NFS mounts.)*/
     gchar *chcksum_type;       /*!< type of checksum in repomd.xml */
+    gint workers;               /*!< number of DBs generated in parallel */
 
     /* Items filled by check_sqliterepo_arguments() */
 
@@ -81,11 +86,13 @@ sqliterepocmdoptions_new(void)
     options->quiet = FALSE;
     options->verbose = FALSE;
     options->force = FALSE;
+    options->incremental = FALSE;
     options->keep_old = FALSE;
     options->xz_compression = FALSE;
     options->compress_type = NULL;
     options->chcksum_type = NULL;
     options->local_sqlite = FALSE;
+    options->workers = DEFAULT_WORKERS;
     options->compression_type = CR_CW_BZ2_COMPRESSION;
     options->checksum_type = CR_CHECKSUM_UNKNOWN;
 
@@ -124,6 +131,10 @@ parse_sqliterepo_arguments(int *argc,
           "Run verbosely.", NULL },
         { "force", 'f', 0, G_OPTION_ARG_NONE, &(options->force),
           "Overwrite existing DBs.", NULL },
+        { "incremental", '\0', 0, G_OPTION_ARG_NONE, &(options->incremental),
+          "Update existing DBs. Only packages added to or removed from "
+          "the XML metadata since the DBs were generated are inserted "
+          "or deleted.", NULL },
         { "keep-old", '\0', 0, G_OPTION_ARG_NONE, &(options->keep_old),
           "Do not remove old DBs. Use only with combination with --force.", NULL },
         { "xz", '\0', 0, G_OPTION_ARG_NONE, &(options->xz_compression),
@@ -139,6 +150,9 @@ parse_sqliterepo_arguments(int *argc,
           "This option could lead to a higher memory consumption "
           "if TMPDIR is set to /tmp or not set at all, because then the /tmp is "
           "used and /tmp dir is often a ramdisk.", NULL },
+        { "workers", '\0', 0, G_OPTION_ARG_INT, &(options->workers),
+          "Number of DBs (primary, filelists, other) generated and compressed "
+          "in parallel (default: 3).", "NUM" },
         { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
     };
 
@@ -186,11 +200,29 @@ check_arguments(SqliterepoCmdOptions *options, GError **err)
     if (options->xz_compression)
         options->compression_type = CR_CW_XZ_COMPRESSION;
 
+    // --workers
+    if (options->workers < 1) {
+        g_warning("Wrong number of workers - Using %d workers.",
+                  DEFAULT_WORKERS);
+        options->workers = DEFAULT_WORKERS;
+    }
+
     return TRUE;
 }
 
 // Common
 
+/** Data shared by the callbacks of the XML parsers.
+ */
+typedef struct {
+    cr_SqliteDb *db;            /*!< DB to fill */
+    GHashTable *old_pkgids;     /*!< pkgIds (and GArrays of pkgKeys) of
+                                     packages from the old DB not found in
+                                     XML yet or NULL if the DB is generated
+                                     from scratch */
+    gint64 added;               /*!< number of packages added to the DB */
+} PkgCbData;
+
 static int
 warningcb(G_GNUC_UNUSED cr_XmlParserWarningType type,
           char *msg,
@@ -201,16 +233,103 @@ warningcb(G_GNUC_UNUSED cr_XmlParserWarningType type,
     return CR_CB_RET_OK;
 }
 
+/** Find a row of the old DB which matches the package and keep it,
+ * i.e. do not remove it from the DB at the end.
+ * @param cb_data       callback data
+ * @param pkgId         pkgId of the package
+ * @param pkg           parsed package to compare the row with or NULL
+ *                      to take any row with the pkgId
+ * @param err           **GError
+ * @return              TRUE if a matching row was found
+ */
+static gboolean
+keep_old_pkg(PkgCbData *cb_data,
+             const char *pkgId,
+             cr_Package *pkg,
+             GError **err)
+{
+    GArray *pkgkeys;
+
+    if (!cb_data->old_pkgids || !pkgId)
+        return FALSE;
+
+    pkgkeys = g_hash_table_lookup(cb_data->old_pkgids, pkgId);
+    if (!pkgkeys)
+        return FALSE;
+
+    for (guint i = 0; i < pkgkeys->len; i++) {
+        gint64 pkgKey = g_array_index(pkgkeys, gint64, i);
+
+        // A package moved in the repo has a stale primary row,
+        // it is removed at the end and the package is added again
+        if (pkg) {
+            GError *tmp_err = NULL;
+            gboolean unchanged = cr_db_pkg_unchanged(cb_data->db, pkgKey,
+                                                     pkg, &tmp_err);
+            if (tmp_err) {
+                g_propagate_error(err, tmp_err);
+                return FALSE;
+            }
+            if (!unchanged)
+                continue;
+        }
+
+        g_array_remove_index_fast(pkgkeys, i);
+        if (pkgkeys->len == 0)
+            g_hash_table_remove(cb_data->old_pkgids, pkgId);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static int
+newpkgcb(cr_Package **pkg,
+         const char *pkgId,
+         G_GNUC_UNUSED const char *name,
+         G_GNUC_UNUSED const char *arch,
+         void *cbdata,
+         G_GNUC_UNUSED GError **err)
+{
+    PkgCbData *cb_data = cbdata;
+
+    // Packages already present in the old DB are skipped (filelists
+    // and other only, pkgId is not known yet in case of primary)
+    if (keep_old_pkg(cb_data, pkgId, NULL, NULL)) {
+        *pkg = NULL;
+        return CR_CB_RET_OK;
+    }
+
+    *pkg = cr_package_new();
+    return CR_CB_RET_OK;
+}
+
 static int
 pkgcb(cr_Package *pkg,
               void *cbdata,
               GError **err)
 {
-    int rc;
-    rc = cr_db_add_pkg((cr_SqliteDb *) cbdata, pkg, err);
+    int rc = CRE_OK;
+    PkgCbData *cb_data = cbdata;
+    GError *tmp_err = NULL;
+
+    if (keep_old_pkg(cb_data, pkg->pkgId, pkg, &tmp_err)) {
+        // Package already present in the old DB
+        cr_package_free(pkg);
+        return CR_CB_RET_OK;
+    }
+
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        cr_package_free(pkg);
+        return CR_CB_RET_ERR;
+    }
+
+    rc = cr_db_add_pkg(cb_data->db, pkg, err);
     cr_package_free(pkg);
     if (rc != CRE_OK)
         return CR_CB_RET_ERR;
+    cb_data->added++;
     return CR_CB_RET_OK;
 }
 
@@ -218,15 +337,15 @@ pkgcb(cr_Package *pkg,
 
 static gboolean
 primary_to_sqlite(const gchar *pri_xml_path,
-                  cr_SqliteDb *pri_db,
+                  PkgCbData *cb_data,
                   GError **err)
 {
     int rc;
     rc = cr_xml_parse_primary(pri_xml_path,
-                              NULL,
-                              NULL,
+                              newpkgcb,
+                              (void *) cb_data,
                               pkgcb,
-                              (void *) pri_db,
+                              (void *) cb_data,
                               warningcb,
                               (void *) pri_xml_path,
                               TRUE,
@@ -240,15 +359,15 @@ primary_to_sqlite(const gchar *pri_xml_path,
 
 static gboolean
 filelists_to_sqlite(const gchar *fil_xml_path,
-                    cr_SqliteDb *fil_db,
+                    PkgCbData *cb_data,
                     GError **err)
 {
     int rc;
     rc = cr_xml_parse_filelists(fil_xml_path,
-                                NULL,
-                                NULL,
+                                newpkgcb,
+                                (void *) cb_data,
                                 pkgcb,
-                                (void *) fil_db,
+                                (void *) cb_data,
                                 warningcb,
                                 (void *) fil_xml_path,
                                 err);
@@ -261,15 +380,15 @@ filelists_to_sqlite(const gchar *fil_xml_path,
 
 static gboolean
 other_to_sqlite(const gchar *oth_xml_path,
-                cr_SqliteDb *oth_db,
+                PkgCbData *cb_data,
                 GError **err)
 {
     int rc;
     rc = cr_xml_parse_other(oth_xml_path,
-                            NULL,
-                            NULL,
+                            newpkgcb,
+                            (void *) cb_data,
                             pkgcb,
-                            (void *) oth_db,
+                            (void *) cb_data,
                             warningcb,
                             (void *) oth_xml_path,
                             err);
@@ -280,201 +399,189 @@ other_to_sqlite(const gchar *oth_xml_path,
 
 // Main
 
-static gboolean
-xml_to_sqlite(const gchar *pri_xml_path,
-              const gchar *fil_xml_path,
-              const gchar *oth_xml_path,
-              cr_SqliteDb *pri_db,
-              cr_SqliteDb *fil_db,
-              cr_SqliteDb *oth_db,
-              GError **err)
+/** Conversion of one XML file into a compressed sqlite database.
+ * The jobs of primary, filelists and other are independent of each other,
+ * so every one of them runs in a thread of the pool.
+ */
+typedef struct {
+    const gchar *name;              /*!< "primary", "filelists" or "other" */
+    cr_DatabaseType db_type;        /*!< type of the DB */
+    gboolean (*to_sqlite)(const gchar *, PkgCbData *, GError **);
+                                    /*!< XML to sqlite conversion */
+    const gchar *xml_path;          /*!< input XML file or NULL */
+    const gchar *xml_checksum;      /*!< checksum of the XML file for
+                                         the db_info table or NULL */
+    gchar *old_db_path;             /*!< compressed DB to update
+                                         (--incremental) or NULL */
+    const gchar *db_filename;       /*!< path to the uncompressed DB */
+    const gchar *tmp_out_repo;      /*!< where to put the compressed DB */
+    cr_CompressionType compression_type;
+    cr_ChecksumType checksum_type;
+
+    cr_RepomdRecord *rec;           /*!< record of the compressed DB */
+    gdouble sqlite_time;            /*!< seconds spent by XML to sqlite */
+    gdouble compress_time;          /*!< seconds spent by compression */
+    GError *err;                    /*!< error of the job or NULL */
+} SqliteJob;
+
+/** Decompress the old DB into the job->db_filename and get pkgIds of its
+ * packages. On failure the DB is generated from scratch.
+ */
+static GHashTable *
+prepare_old_db(SqliteJob *job)
 {
-    gboolean ret;
-
-    if (pri_xml_path && pri_db) {
-        ret = primary_to_sqlite(pri_xml_path,
-                                pri_db,
-                                err);
-        if (!ret)
-            return FALSE;
-        g_debug("Primary sqlite done");
+    GError *tmp_err = NULL;
+    cr_SqliteDb *db;
+    GHashTable *pkgids = NULL;
+    cr_CompressionType type;
+
+    type = cr_detect_compression(job->old_db_path, &tmp_err);
+    if (!tmp_err)
+        cr_decompress_file_with_stat(job->old_db_path, job->db_filename,
+                                     type, NULL, &tmp_err);
+    if (!tmp_err) {
+        db = cr_db_open(job->db_filename, job->db_type, &tmp_err);
+        pkgids = db ? cr_db_pkgids(db, &tmp_err) : NULL;
+        cr_db_close(db, NULL);
     }
 
-    if (fil_xml_path && fil_db) {
-        ret = filelists_to_sqlite(fil_xml_path,
-                                  fil_db,
-                                  err);
-        if (!ret)
-            return FALSE;
-        g_debug("Filelists sqlite done");
+    if (tmp_err) {
+        g_warning("Cannot use old %s DB %s, generating from scratch: %s",
+                  job->name, job->old_db_path, tmp_err->message);
+        g_clear_error(&tmp_err);
+        // Start with an empty DB
+        g_remove(job->db_filename);
+        if (pkgids)
+            g_hash_table_destroy(pkgids);
+        return NULL;
     }
 
-    if (oth_xml_path && oth_db) {
-        ret = other_to_sqlite(oth_xml_path,
-                              oth_db,
-                              err);
-        if (!ret)
-            return FALSE;
-        g_debug("Other sqlite done");
-    }
-
-    return TRUE;
+    return pkgids;
 }
 
-static gboolean
-sqlite_dbinfo_update(cr_Repomd *repomd,
-                     cr_SqliteDb *pri_db,
-                     cr_SqliteDb *fil_db,
-                     cr_SqliteDb *oth_db,
-                     GError **err)
+static void
+sqlite_job_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
 {
-    cr_RepomdRecord *rec = NULL;
+    SqliteJob *job = data;
+    GError *tmp_err = NULL;
+    GTimer *timer = g_timer_new();
+    _cleanup_free_ gchar *db_name = NULL;
+    _cleanup_free_ gchar *rec_type = NULL;
+    cr_ContentStat *stat = NULL;
+    PkgCbData cb_data = { NULL, NULL, 0 };
+    gint64 removed = 0;
+
+    // Old DB to update
+    if (job->old_db_path)
+        cb_data.old_pkgids = prepare_old_db(job);
+
+    // Open sqlite database
+    cb_data.db = cr_db_open(job->db_filename, job->db_type, &tmp_err);
+    if (tmp_err)
+        goto end;
 
-    // Parse repomd.xml
-    // Get files checksums and insert them into sqlite dbs
-    if (pri_db) {
-        rec = cr_repomd_get_record(repomd, "primary");
-        if (rec && rec->checksum)
-            if (cr_db_dbinfo_update(pri_db, rec->checksum, err) != CRE_OK)
-                return FALSE;
-    }
+    // XML to Sqlite
+    if (job->xml_path)
+        job->to_sqlite(job->xml_path, &cb_data, &tmp_err);
+
+    // Remove packages which are no longer in XML from the old DB
+    if (!tmp_err && cb_data.old_pkgids) {
+        GHashTableIter iter;
+        gpointer value;
+
+        g_hash_table_iter_init(&iter, cb_data.old_pkgids);
+        while (!tmp_err && g_hash_table_iter_next(&iter, NULL, &value)) {
+            GArray *pkgkeys = value;
+            for (guint i = 0; !tmp_err && i < pkgkeys->len; i++) {
+                cr_db_remove_pkg(cb_data.db,
+                                 g_array_index(pkgkeys, gint64, i),
+                                 &tmp_err);
+                removed++;
+            }
+        }
 
-    if (fil_db) {
-        rec = cr_repomd_get_record(repomd, "filelists");
-        if (rec && rec->checksum)
-            if (cr_db_dbinfo_update(fil_db, rec->checksum, err) != CRE_OK)
-                return FALSE;
-    }
+        if (!tmp_err && removed > 0)
+            cr_db_vacuum(cb_data.db, VACUUM_FREE_RATIO, &tmp_err);
 
-    if (oth_db) {
-        rec = cr_repomd_get_record(repomd, "other");
-        if (rec && rec->checksum)
-            if (cr_db_dbinfo_update(oth_db, rec->checksum, err) != CRE_OK)
-                return FALSE;
+        g_message("%s sqlite: %"G_GINT64_FORMAT" packages added, "
+                  "%"G_GINT64_FORMAT" removed", job->name,
+                  cb_data.added, removed);
     }
 
-    return TRUE;
+    // Put checksum of XML file into Sqlite
+    if (!tmp_err && job->xml_checksum)
+        cr_db_dbinfo_update(cb_data.db, job->xml_checksum, &tmp_err);
+
+    // Close db (indexes are created here)
+    cr_db_close(cb_data.db, tmp_err ? NULL : &tmp_err);
+    job->sqlite_time = g_timer_elapsed(timer, NULL);
+    if (tmp_err)
+        goto end;
+    g_debug("%s sqlite done", job->name);
+
+    // Compress DB file
+    g_timer_start(timer);
+    db_name = g_strconcat(job->tmp_out_repo, "/", job->name, ".sqlite",
+                          cr_compression_suffix(job->compression_type), NULL);
+    stat = cr_contentstat_new(job->checksum_type, NULL);
+    cr_compress_file_with_stat(job->db_filename, db_name,
+                               job->compression_type, stat,
+                               NULL, FALSE, &tmp_err);
+
+    // Remove uncompressed DB
+    cr_rm(job->db_filename, CR_RM_FORCE, NULL, NULL);
+    if (tmp_err)
+        goto end;
+
+    // Prepare repomd record from stats gathered during compression
+    rec_type = g_strconcat(job->name, "_db", NULL);
+    job->rec = cr_repomd_record_new(rec_type, db_name);
+    cr_repomd_record_load_contentstat(job->rec, stat);
+    cr_repomd_record_fill(job->rec, job->checksum_type, &tmp_err);
+    job->compress_time = g_timer_elapsed(timer, NULL);
+
+end:
+    if (tmp_err)
+        g_propagate_prefixed_error(&job->err, tmp_err, "%s: ", job->name);
+    if (cb_data.old_pkgids)
+        g_hash_table_destroy(cb_data.old_pkgids);
+    cr_contentstat_free(stat, NULL);
+    g_timer_destroy(timer);
 }
 
+/** Convert the XML files into compressed sqlite DBs in parallel
+ * and report how long every DB took.
+ */
 static gboolean
-compress_sqlite_dbs(const gchar *tmp_out_repo,
-                    const gchar *pri_db_filename,
-                    cr_RepomdRecord **in_pri_db_rec,
-                    const gchar *fil_db_filename,
-                    cr_RepomdRecord **in_fil_db_rec,
-                    const gchar *oth_db_filename,
-                    cr_RepomdRecord **in_oth_db_rec,
-                    cr_CompressionType compression_type,
-                    cr_ChecksumType checksum_type)
+xml_to_sqlite(SqliteJob *jobs, int jobs_count, int workers, GError **err)
 {
-    cr_CompressionTask *pri_db_task;
-    cr_CompressionTask *fil_db_task;
-    cr_CompressionTask *oth_db_task;
-    const char *sqlite_compression_suffix;
-    cr_RepomdRecord *pri_db_rec = NULL;
-    cr_RepomdRecord *fil_db_rec = NULL;
-    cr_RepomdRecord *oth_db_rec = NULL;
-
-    // Prepare thread pool for compression tasks
-    GThreadPool *compress_pool =  g_thread_pool_new(cr_compressing_thread,
-                                                    NULL, 3, FALSE, NULL);
-
-    // Prepare output filenames
-    sqlite_compression_suffix = cr_compression_suffix(compression_type);
-    gchar *pri_db_name = g_strconcat(tmp_out_repo, "/primary.sqlite",
-                                     sqlite_compression_suffix, NULL);
-    gchar *fil_db_name = g_strconcat(tmp_out_repo, "/filelists.sqlite",
-                                     sqlite_compression_suffix, NULL);
-    gchar *oth_db_name = g_strconcat(tmp_out_repo, "/other.sqlite",
-                                     sqlite_compression_suffix, NULL);
-
-    // Prepare compression tasks
-    pri_db_task = cr_compressiontask_new(pri_db_filename,
-                                         pri_db_name,
-                                         compression_type,
-                                         checksum_type,
-                                         NULL, FALSE, 1, NULL);
-    g_thread_pool_push(compress_pool, pri_db_task, NULL);
-
-    fil_db_task = cr_compressiontask_new(fil_db_filename,
-                                         fil_db_name,
-                                         compression_type,
-                                         checksum_type,
-                                         NULL, FALSE, 1, NULL);
-    g_thread_pool_push(compress_pool, fil_db_task, NULL);
-
-    oth_db_task = cr_compressiontask_new(oth_db_filename,
-                                         oth_db_name,
-                                         compression_type,
-                                         checksum_type,
-                                         NULL, FALSE, 1, NULL);
-    g_thread_pool_push(compress_pool, oth_db_task, NULL);
-
-    // Wait till all tasks are complete and free the thread pool
-    g_thread_pool_free(compress_pool, FALSE, TRUE);
-
-    // Remove uncompressed DBs
-    cr_rm(pri_db_filename, CR_RM_FORCE, NULL, NULL);
-    cr_rm(fil_db_filename, CR_RM_FORCE, NULL, NULL);
-    cr_rm(oth_db_filename, CR_RM_FORCE, NULL, NULL);
-
-    // Prepare repomd records
-    pri_db_rec = cr_repomd_record_new("primary_db", pri_db_name);
-    fil_db_rec = cr_repomd_record_new("filelists_db", fil_db_name);
-    oth_db_rec = cr_repomd_record_new("other_db", oth_db_name);
-
-    *in_pri_db_rec = pri_db_rec;
-    *in_fil_db_rec = fil_db_rec;
-    *in_oth_db_rec = oth_db_rec;
-
-    // Free paths to compressed files
-    g_free(pri_db_name);
-    g_free(fil_db_name);
-    g_free(oth_db_name);
-
-    // Fill repomd records from stats gathered during compression
-    cr_repomd_record_load_contentstat(pri_db_rec, pri_db_task->stat);
-    cr_repomd_record_load_contentstat(fil_db_rec, fil_db_task->stat);
-    cr_repomd_record_load_contentstat(oth_db_rec, oth_db_task->stat);
-
-    // Free the compression tasks
-    cr_compressiontask_free(pri_db_task, NULL);
-    cr_compressiontask_free(fil_db_task, NULL);
-    cr_compressiontask_free(oth_db_task, NULL);
-
-    // Prepare thread pool for repomd record filling tasks
-    GThreadPool *fill_pool = g_thread_pool_new(cr_repomd_record_fill_thread,
-                                               NULL, 3, FALSE, NULL);
-
-    // Prepare the tasks themselves
-    cr_RepomdRecordFillTask *pri_db_fill_task;
-    cr_RepomdRecordFillTask *fil_db_fill_task;
-    cr_RepomdRecordFillTask *oth_db_fill_task;
-
-    pri_db_fill_task = cr_repomdrecordfilltask_new(pri_db_rec,
-                                                   checksum_type,
-                                                   NULL);
-    g_thread_pool_push(fill_pool, pri_db_fill_task, NULL);
-
-    fil_db_fill_task = cr_repomdrecordfilltask_new(fil_db_rec,
-                                                   checksum_type,
-                                                   NULL);
-    g_thread_pool_push(fill_pool, fil_db_fill_task, NULL);
-
-    oth_db_fill_task = cr_repomdrecordfilltask_new(oth_db_rec,
-                                                   checksum_type,
-                                                   NULL);
-    g_thread_pool_push(fill_pool, oth_db_fill_task, NULL);
-
-    // Wait till the all tasks are finished and free the pool
-    g_thread_pool_free(fill_pool, FALSE, TRUE);
-
-    // Clear the tasks
-    cr_repomdrecordfilltask_free(pri_db_fill_task, NULL);
-    cr_repomdrecordfilltask_free(fil_db_fill_task, NULL);
-    cr_repomdrecordfilltask_free(oth_db_fill_task, NULL);
+    gboolean ret = TRUE;
+    GThreadPool *pool = g_thread_pool_new(sqlite_job_thread, NULL,
+                                          workers, FALSE, NULL);
+    for (int x = 0; x < jobs_count; x++)
+        g_thread_pool_push(pool, &jobs[x], NULL);
+
+    // Wait till all jobs are complete and free the thread pool
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    for (int x = 0; x < jobs_count; x++) {
+        if (jobs[x].err) {
+            // Report the first error only
+            if (ret)
+                g_propagate_error(err, jobs[x].err);
+            else
+                g_error_free(jobs[x].err);
+            jobs[x].err = NULL;
+            ret = FALSE;
+            continue;
+        }
+        g_message("%s sqlite: %.2f s (xml to sqlite %.2f s, "
+                  "compression %.2f s)", jobs[x].name,
+                  jobs[x].sqlite_time + jobs[x].compress_time,
+                  jobs[x].sqlite_time, jobs[x].compress_time);
+    }
 
-    return TRUE;
+    return ret;
 }
 
 static gboolean
@@ -705,8 +812,10 @@ static gboolean
 generate_sqlite_from_xml(const gchar *path,
                          cr_CompressionType compression_type,
                          cr_ChecksumType checksum_type,
+                         int workers,
                          gboolean local_sqlite,
                          gboolean force,
+                         gboolean incremental,
                          gboolean keep_old,
                          GError **err)
 {
@@ -792,10 +901,10 @@ generate_sqlite_from_xml(const gchar *path,
         dbs_already_exist = TRUE;
     }
 
-    if (dbs_already_exist && !force) {
+    if (dbs_already_exist && !force && !incremental) {
         g_set_error(err, CREATEREPO_C_ERROR, CRE_ERROR,
                     "Repository already has sqlitedb present "
-                    "in repomd.xml (You may use --force)");
+                    "in repomd.xml (You may use --force or --incremental)");
         return FALSE;
     }
 
@@ -821,13 +930,10 @@ generate_sqlite_from_xml(const gchar *path,
         }
     }
 
-    // Open sqlite databases
+    // Prepare paths of sqlite databases
     _cleanup_free_ gchar *pri_db_filename = NULL;
     _cleanup_free_ gchar *fil_db_filename = NULL;
     _cleanup_free_ gchar *oth_db_filename = NULL;
-    cr_SqliteDb *pri_db = NULL;
-    cr_SqliteDb *fil_db = NULL;
-    cr_SqliteDb *oth_db = NULL;
 
     _cleanup_file_close_ int pri_db_fd = -1;
     _cleanup_file_close_ int fil_db_fd = -1;
@@ -868,67 +974,58 @@ generate_sqlite_from_xml(const gchar *path,
         }
     }
 
-    pri_db = cr_db_open_primary(pri_db_filename, err);
-    if (!pri_db)
-        return FALSE;
-
-    fil_db = cr_db_open_filelists(fil_db_filename, err);
-    assert(fil_db);
-    if (!fil_db) {
-        cr_db_close(pri_db, NULL);
-        return FALSE;
-    }
-
-    oth_db = cr_db_open_other(oth_db_filename, err);
-    assert(oth_db);
-    if (!oth_db) {
-        cr_db_close(pri_db, NULL);
-        cr_db_close(fil_db, NULL);
-        return FALSE;
+    // XML to Sqlite, compress DB files and fill records
+    cr_RepomdRecord *pri_xml_rec = cr_repomd_get_record(repomd, "primary");
+    cr_RepomdRecord *fil_xml_rec = cr_repomd_get_record(repomd, "filelists");
+    cr_RepomdRecord *oth_xml_rec = cr_repomd_get_record(repomd, "other");
+    SqliteJob jobs[] = {
+        { .name = "primary", .db_type = CR_DB_PRIMARY,
+          .to_sqlite = primary_to_sqlite, .xml_path = pri_xml_path,
+          .xml_checksum = pri_xml_rec ? pri_xml_rec->checksum : NULL,
+          .db_filename = pri_db_filename },
+        { .name = "filelists", .db_type = CR_DB_FILELISTS,
+          .to_sqlite = filelists_to_sqlite, .xml_path = fil_xml_path,
+          .xml_checksum = fil_xml_rec ? fil_xml_rec->checksum : NULL,
+          .db_filename = fil_db_filename },
+        { .name = "other", .db_type = CR_DB_OTHER,
+          .to_sqlite = other_to_sqlite, .xml_path = oth_xml_path,
+          .xml_checksum = oth_xml_rec ? oth_xml_rec->checksum : NULL,
+          .db_filename = oth_db_filename },
+    };
+    const int jobs_count = G_N_ELEMENTS(jobs);
+
+    for (int x = 0; x < jobs_count; x++) {
+        jobs[x].tmp_out_repo     = tmp_out_repo;
+        jobs[x].compression_type = compression_type;
+        jobs[x].checksum_type    = checksum_type;
+
+        // Update the old DB instead of generating a new one
+        if (incremental) {
+            _cleanup_free_ gchar *rec_type = g_strconcat(jobs[x].name, "_db", NULL);
+            cr_RepomdRecord *old_rec = cr_repomd_get_record(repomd, rec_type);
+            if (old_rec && old_rec->location_href)
+                jobs[x].old_db_path = g_build_filename(in_dir,
+                                                       old_rec->location_href,
+                                                       NULL);
+        }
     }
 
-    // XML to Sqlite
-    ret = xml_to_sqlite(pri_xml_path,
-                        fil_xml_path,
-                        oth_xml_path,
-                        pri_db,
-                        fil_db,
-                        oth_db,
-                        err);
-    if (!ret)
-        return FALSE;
-
-    // Put checksums of XML files into Sqlite
-    ret = sqlite_dbinfo_update(repomd,
-                               pri_db,
-                               fil_db,
-                               oth_db,
-                               err);
-    if (!ret)
-        return FALSE;
+    ret = xml_to_sqlite(jobs, jobs_count, workers, err);
 
-    // Close dbs
-    cr_db_close(pri_db, NULL);
-    cr_db_close(fil_db, NULL);
-    cr_db_close(oth_db, NULL);
+    for (int x = 0; x < jobs_count; x++)
+        g_free(jobs[x].old_db_path);
 
     // Repomd records
-    cr_RepomdRecord *pri_db_rec = NULL;
-    cr_RepomdRecord *fil_db_rec = NULL;
-    cr_RepomdRecord *oth_db_rec = NULL;
+    cr_RepomdRecord *pri_db_rec = jobs[0].rec;
+    cr_RepomdRecord *fil_db_rec = jobs[1].rec;
+    cr_RepomdRecord *oth_db_rec = jobs[2].rec;
 
-    // Compress DB files and fill records
-    ret = compress_sqlite_dbs(tmp_out_repo,
-                              pri_db_filename,
-                              &pri_db_rec,
-                              fil_db_filename,
-                              &fil_db_rec,
-                              oth_db_filename,
-                              &oth_db_rec,
-                              compression_type,
-                              checksum_type);
-    if (!ret)
+    if (!ret) {
+        cr_repomd_record_free(pri_db_rec);
+        cr_repomd_record_free(fil_db_rec);
+        cr_repomd_record_free(oth_db_rec);
         return FALSE;
+    }
 
     // Prepare new repomd.xml
     ret = gen_new_repomd(tmp_out_repo,
@@ -948,7 +1045,7 @@ generate_sqlite_from_xml(const gchar *path,
         return FALSE;
 
     // Remove old DBs
-    if (dbs_already_exist && force && !keep_old) {
+    if (dbs_already_exist && (force || incremental) && !keep_old) {
         ret = remove_old_if_different(in_dir,
                                       cr_repomd_get_record(repomd, "primary_db"),
                                       pri_db_rec, err);
@@ -1021,8 +1118,10 @@ main(int argc, char **argv)
     ret = generate_sqlite_from_xml(argv[1],
                                    options->compression_type,
                                    options->checksum_type,
+                                   options->workers,
                                    options->local_sqlite,
                                    options->force,
+                                   options->incremental,
                                    options->keep_old,
                                    &tmp_err);
     if (!ret) {
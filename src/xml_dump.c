@@ -19,6 +19,7 @@
 
 #include <glib.h>
 #include <assert.h>
+#include <libxml/chvalid.h>
 #include <libxml/encoding.h>
 #include <libxml/xmlwriter.h>
 #include <libxml/parser.h>
@@ -27,6 +28,7 @@
 #include "misc.h"
 #include "xml_dump.h"
 #include "xml_dump_internal.h"
+#include "xml_parser_internal.h"
 
 
 static int _xml_dump_parameters[CR_XML_DUMP_OPTION_COUNT];
@@ -73,13 +75,8 @@ cr_xml_dump_cleanup()
 
 gboolean cr_hascontrollchars(const unsigned char *str)
 {
-    while (*str) {
-        if (*str < 32 && (*str != 9 && *str != 10 && *str != 13))
-            return TRUE;
-        ++str;
-    }
-
-    return FALSE;
+    size_t len = strlen((const char *) str);
+    return cr_xml_scan_ctrl((const char *) str, len) < len;
 }
 
 gchar *
@@ -231,6 +228,355 @@ cr_xml_dump_files(xmlNodePtr node, cr_Package *package, int primary, gboolean fi
     }
 }
 
+/** Initial size of the per-thread xml writer buffer */
+#define XML_WRITER_BUFFER_SIZE          8192
+/** Bigger buffers are not kept for the next package */
+#define XML_WRITER_BUFFER_KEEP_SIZE     (4*1024*1024)
+
+static void
+xml_writer_buffer_free(gpointer buf)
+{
+    g_string_free((GString *) buf, TRUE);
+}
+
+static GPrivate xml_writer_buffer = G_PRIVATE_INIT(xml_writer_buffer_free);
+
+void
+cr_xml_writer_init(cr_XmlWriter *w)
+{
+    GString *buf = g_private_get(&xml_writer_buffer);
+    if (!buf) {
+        buf = g_string_sized_new(XML_WRITER_BUFFER_SIZE);
+        g_private_set(&xml_writer_buffer, buf);
+    }
+    g_string_truncate(buf, 0);
+
+    w->buf    = buf;
+    w->pretty = cr_xml_dump_get_parameter(CR_XML_DUMP_DO_PRETTY_PRINT);
+    w->level  = 0;
+}
+
+char *
+cr_xml_writer_finish(cr_XmlWriter *w)
+{
+    char *result = g_strndup(w->buf->str, w->buf->len);
+
+    if (w->buf->allocated_len > XML_WRITER_BUFFER_KEEP_SIZE)
+        g_private_replace(&xml_writer_buffer,
+                          g_string_sized_new(XML_WRITER_BUFFER_SIZE));
+    w->buf = NULL;
+
+    return result;
+}
+
+/** Convert a non UTF-8 value as cr_xmlNewTextChild() and cr_xmlNewProp() do.
+ * @return          Malloced string
+ */
+static gchar *
+xml_writer_latin1(const char *value)
+{
+    gchar *converted = g_malloc(strlen(value)*2 + 1);
+    cr_latin1_to_utf8((const unsigned char *) value, (unsigned char *) converted);
+    return converted;
+}
+
+/** Length of the UTF-8 sequence at s, checked the same way as
+ * xmlCheckUTF8() does it.
+ * @return          Length of the sequence or 0 if it is invalid
+ */
+static inline gsize
+xml_utf8_seq_len(const unsigned char *s)
+{
+    if ((s[0] & 0xe0) == 0xc0)
+        return (s[1] & 0xc0) == 0x80 ? 2 : 0;
+    if ((s[0] & 0xf0) == 0xe0)
+        return ((s[1] & 0xc0) == 0x80 && (s[2] & 0xc0) == 0x80) ? 3 : 0;
+    if ((s[0] & 0xf8) == 0xf0)
+        return ((s[1] & 0xc0) == 0x80 && (s[2] & 0xc0) == 0x80
+                && (s[3] & 0xc0) == 0x80) ? 4 : 0;
+    return 0;
+}
+
+/** Append a character reference for the UTF-8 sequence at cur.
+ * Invalid sequences are referenced byte by byte (as libxml2 does).
+ * @return          Number of consumed bytes
+ */
+static gsize
+xml_append_char_ref(GString *buf, const unsigned char *cur)
+{
+    gunichar val = *cur;
+    gsize len = 1;
+
+    if (cur[0] >= 0xC0 && cur[0] < 0xE0) {
+        val = ((cur[0] & 0x1F) << 6) | (cur[1] & 0x3F);
+        len = 2;
+    } else if (cur[0] >= 0xE0 && cur[0] < 0xF0 && cur[2]) {
+        val = ((cur[0] & 0x0F) << 12) | ((cur[1] & 0x3F) << 6)
+              | (cur[2] & 0x3F);
+        len = 3;
+    } else if (cur[0] >= 0xF0 && cur[0] < 0xF8 && cur[2] && cur[3]) {
+        val = ((cur[0] & 0x07) << 18) | ((cur[1] & 0x3F) << 12)
+              | ((cur[2] & 0x3F) << 6) | (cur[3] & 0x3F);
+        len = 4;
+    }
+
+    if (len == 1 || !xmlIsCharQ(val)) {
+        val = *cur;
+        len = 1;
+    }
+
+    g_string_append_printf(buf, "&#x%X;", val);
+    return len;
+}
+
+/** Escape the text as element content.
+ * The kernel skips the runs of plain ASCII, the UTF-8 check (if requested)
+ * is done in the same pass.
+ * @param validate      Check the text is valid UTF-8
+ * @return              FALSE (and nothing appended) if the text is not UTF-8
+ */
+static gboolean
+xml_escape_text(GString *buf, const char *str, gboolean validate)
+{
+    const unsigned char *s = (const unsigned char *) str;
+    size_t len = strlen(str);
+    gsize orig_len = buf->len;
+    size_t pos = 0;
+
+    while (1) {
+        size_t run = cr_xml_scan_text((const char *) s + pos, len - pos);
+        g_string_append_len(buf, (const char *) s + pos, run);
+        pos += run;
+        if (pos >= len)
+            return TRUE;
+
+        const char *entity;
+        switch (s[pos]) {
+            case '<':   entity = "&lt;";    break;
+            case '>':   entity = "&gt;";    break;
+            case '&':   entity = "&amp;";   break;
+            case '\r':  entity = "&#13;";   break;
+            default: {
+                // Non ASCII chars are copied as they are
+                gsize seq = validate ? xml_utf8_seq_len(s + pos) : 1;
+                if (!seq) {
+                    g_string_truncate(buf, orig_len);
+                    return FALSE;
+                }
+                g_string_append_len(buf, (const char *) s + pos, seq);
+                pos += seq;
+                continue;
+            }
+        }
+        g_string_append(buf, entity);
+        pos++;
+    }
+}
+
+/** Escape the text as attribute value, non ASCII chars are written as
+ * character references.
+ * @param validate      Check the text is valid UTF-8
+ * @return              FALSE (and nothing appended) if the text is not UTF-8
+ */
+static gboolean
+xml_escape_attr(GString *buf, const char *str, gboolean validate)
+{
+    const unsigned char *s = (const unsigned char *) str;
+    size_t len = strlen(str);
+    gsize orig_len = buf->len;
+    size_t pos = 0;
+
+    while (1) {
+        size_t run = cr_xml_scan_attr((const char *) s + pos, len - pos);
+        g_string_append_len(buf, (const char *) s + pos, run);
+        pos += run;
+        if (pos >= len)
+            return TRUE;
+
+        const char *entity;
+        switch (s[pos]) {
+            case '\n':  entity = "&#10;";   break;
+            case '\r':  entity = "&#13;";   break;
+            case '\t':  entity = "&#9;";    break;
+            case '"':   entity = "&quot;";  break;
+            case '<':   entity = "&lt;";    break;
+            case '>':   entity = "&gt;";    break;
+            case '&':   entity = "&amp;";   break;
+            default: {
+                size_t end = pos + 1;
+                if (validate) {
+                    gsize seq = xml_utf8_seq_len(s + pos);
+                    if (!seq) {
+                        g_string_truncate(buf, orig_len);
+                        return FALSE;
+                    }
+                    end = pos + seq;
+                }
+                while (pos < end) {
+                    if (s[pos+1] == '\0') {
+                        // The last byte is copied as it is (libxml2 does so)
+                        g_string_append_c(buf, s[pos]);
+                        pos++;
+                    } else {
+                        pos += xml_append_char_ref(buf, s + pos);
+                    }
+                }
+                continue;
+            }
+        }
+        g_string_append(buf, entity);
+        pos++;
+    }
+}
+
+void
+cr_xml_escape_text(GString *buf, const char *str)
+{
+    xml_escape_text(buf, str, FALSE);
+}
+
+void
+cr_xml_escape_attr(GString *buf, const char *str)
+{
+    xml_escape_attr(buf, str, FALSE);
+}
+
+static inline void
+xml_writer_indent(cr_XmlWriter *w)
+{
+    if (w->pretty)
+        for (int i = 0; i < w->level; i++)
+            g_string_append_len(w->buf, "  ", 2);
+}
+
+static inline void
+xml_writer_eol(cr_XmlWriter *w)
+{
+    // The root element is always followed by a newline
+    if (w->pretty || w->level == 0)
+        g_string_append_c(w->buf, '\n');
+}
+
+void
+cr_xml_writer_start(cr_XmlWriter *w, const char *name)
+{
+    xml_writer_indent(w);
+    g_string_append_c(w->buf, '<');
+    g_string_append(w->buf, name);
+}
+
+void
+cr_xml_writer_attr_raw(cr_XmlWriter *w, const char *name, const char *value)
+{
+    g_string_append_c(w->buf, ' ');
+    g_string_append(w->buf, name);
+    g_string_append_len(w->buf, "=\"", 2);
+    if (value)
+        cr_xml_escape_attr(w->buf, value);
+    g_string_append_c(w->buf, '"');
+}
+
+void
+cr_xml_writer_attr(cr_XmlWriter *w, const char *name, const char *value)
+{
+    g_string_append_c(w->buf, ' ');
+    g_string_append(w->buf, name);
+    g_string_append_len(w->buf, "=\"", 2);
+    if (value && !xml_escape_attr(w->buf, value, TRUE)) {
+        // Not UTF-8, iso-8859-1 is assumed
+        gchar *converted = xml_writer_latin1(value);
+        xml_escape_attr(w->buf, converted, FALSE);
+        g_free(converted);
+    }
+    g_string_append_c(w->buf, '"');
+}
+
+void
+cr_xml_writer_attr_int(cr_XmlWriter *w, const char *name, gint64 value)
+{
+    g_string_append_printf(w->buf, " %s=\"%"G_GINT64_FORMAT"\"", name, value);
+}
+
+void
+cr_xml_writer_open(cr_XmlWriter *w)
+{
+    g_string_append_c(w->buf, '>');
+    if (w->pretty)
+        g_string_append_c(w->buf, '\n');
+    w->level++;
+}
+
+void
+cr_xml_writer_close(cr_XmlWriter *w, const char *name)
+{
+    w->level--;
+    xml_writer_indent(w);
+    g_string_append_len(w->buf, "</", 2);
+    g_string_append(w->buf, name);
+    g_string_append_c(w->buf, '>');
+    xml_writer_eol(w);
+}
+
+void
+cr_xml_writer_close_empty(cr_XmlWriter *w)
+{
+    g_string_append_len(w->buf, "/>", 2);
+    xml_writer_eol(w);
+}
+
+void
+cr_xml_writer_text(cr_XmlWriter *w, const char *name, const char *content)
+{
+    g_string_append_c(w->buf, '>');
+    if (content && !xml_escape_text(w->buf, content, TRUE)) {
+        // Not UTF-8, iso-8859-1 is assumed
+        gchar *converted = xml_writer_latin1(content);
+        xml_escape_text(w->buf, converted, FALSE);
+        g_free(converted);
+    }
+    g_string_append_len(w->buf, "</", 2);
+    g_string_append(w->buf, name);
+    g_string_append_c(w->buf, '>');
+    xml_writer_eol(w);
+}
+
+void
+cr_xml_writer_files(cr_XmlWriter *w, cr_Package *package, int primary, gboolean filelists_ext)
+{
+    if (!package->files)
+        return;
+
+    GString *fullname = g_string_sized_new(256);
+
+    for (GSList *element = package->files; element; element = element->next) {
+        cr_PackageFile *entry = (cr_PackageFile*) element->data;
+
+        // File without name or path is suspicious => Skip it
+        if (!(entry->path) || !(entry->name))
+            continue;
+
+        g_string_assign(fullname, entry->path);
+        g_string_append(fullname, entry->name);
+
+        // Skip a file if we want primary files and the file is not one
+        if (primary && !cr_is_primary(fullname->str))
+            continue;
+
+        cr_xml_writer_start(w, "file");
+
+        // Write type (skip type if type value is empty of "file")
+        if (entry->type && entry->type[0] != '\0' && strcmp(entry->type, "file"))
+            cr_xml_writer_attr(w, "type", entry->type);
+
+        if (filelists_ext && entry->digest && entry->digest[0] != '\0')
+            cr_xml_writer_attr(w, "hash", entry->digest);
+
+        cr_xml_writer_text(w, "file", fullname->str);
+    }
+
+    g_string_free(fullname, TRUE);
+}
+
 gboolean
 cr_GSList_of_cr_Dependency_contains_forbidden_control_chars(GSList *dep)
 {
@@ -464,6 +810,131 @@ cr_xml_dump_int(cr_Package *pkg, gboolean filelists_ext, GError **err)
     return result;
 }
 
+/** Append the attribute value escaped the way the libxml2 does it.
+ * Only plain ASCII values without whitespace control chars are supported.
+ * @return          FALSE if the value cannot be escaped here
+ */
+static gboolean
+raw_append_attr_value(GString *str, const char *value)
+{
+    for (const unsigned char *c = (const unsigned char *) value; *c; c++) {
+        switch (*c) {
+            case '<':   g_string_append(str, "&lt;");   break;
+            case '>':   g_string_append(str, "&gt;");   break;
+            case '&':   g_string_append(str, "&amp;");  break;
+            case '"':   g_string_append(str, "&quot;"); break;
+            default:
+                if (*c < 0x20 || *c >= 0x80)
+                    return FALSE;
+                g_string_append_c(str, *c);
+        }
+    }
+    return TRUE;
+}
+
+/** Replace the <location> element in the raw primary <package> element
+ * by one built from the current location_href and location_base.
+ * @return          New primary chunk or NULL if the raw element cannot
+ *                  be used
+ */
+static char *
+raw_primary_relocated(cr_Package *pkg)
+{
+    const char *raw = pkg->raw_primary;
+    const char *loc_start = strstr(raw, "<location ");
+    if (!loc_start)
+        return NULL;
+    const char *loc_end = strchr(loc_start, '>');
+    if (!loc_end || loc_end[-1] != '/')
+        return NULL;
+    loc_end++;
+
+    GString *str = g_string_sized_new(strlen(raw) + 128);
+    g_string_append_len(str, raw, loc_start - raw);
+    g_string_append(str, "<location");
+
+    gboolean ok = TRUE;
+    if (pkg->location_base && pkg->location_base[0] != '\0') {
+        gchar *location_base = cr_prepend_protocol(pkg->location_base);
+        g_string_append(str, " xml:base=\"");
+        ok = raw_append_attr_value(str, location_base);
+        g_string_append_c(str, '"');
+        g_free(location_base);
+    }
+
+    g_string_append(str, " href=\"");
+    if (ok)
+        ok = raw_append_attr_value(str, pkg->location_href ? pkg->location_href : "");
+    g_string_append(str, "\"/>");
+
+    if (!ok) {
+        g_string_free(str, TRUE);
+        return NULL;
+    }
+
+    g_string_append(str, loc_end);
+    g_string_append_c(str, '\n');
+    return g_string_free(str, FALSE);
+}
+
+struct cr_XmlStruct
+cr_xml_dump_raw(cr_Package *pkg, gboolean filelists_ext, GError **err)
+{
+    struct cr_XmlStruct result = { NULL, NULL, NULL, NULL };
+
+    assert(!err || *err == NULL);
+
+    if (!pkg)
+        return result;
+
+    if (pkg->raw_primary)
+        result.primary = raw_primary_relocated(pkg);
+    if (pkg->raw_filelists)
+        result.filelists = g_strconcat(pkg->raw_filelists, "\n", NULL);
+    if (filelists_ext && pkg->raw_filelists_ext)
+        result.filelists_ext = g_strconcat(pkg->raw_filelists_ext, "\n", NULL);
+    if (pkg->raw_other)
+        result.other = g_strconcat(pkg->raw_other, "\n", NULL);
+
+    if (result.primary && result.filelists && result.other
+        && (!filelists_ext || result.filelists_ext))
+        return result;
+
+    // Something has to be dumped, the files and changelogs may be
+    // kept only in the raw elements
+    if (cr_xml_parse_raw_content(pkg, err) != CRE_OK) {
+        g_clear_pointer(&result.primary, g_free);
+        g_clear_pointer(&result.filelists, g_free);
+        g_clear_pointer(&result.filelists_ext, g_free);
+        g_clear_pointer(&result.other, g_free);
+        return result;
+    }
+
+    struct cr_XmlStruct dumped = cr_xml_dump_int(pkg, filelists_ext, err);
+    if (!dumped.primary) {
+        g_free(result.primary);
+        g_free(result.filelists);
+        g_free(result.filelists_ext);
+        g_free(result.other);
+        return dumped;
+    }
+
+#define USE_RAW_OR_DUMPED(member) \
+    if (result.member) \
+        g_free(dumped.member); \
+    else \
+        result.member = dumped.member;
+
+    USE_RAW_OR_DUMPED(primary)
+    USE_RAW_OR_DUMPED(filelists)
+    USE_RAW_OR_DUMPED(filelists_ext)
+    USE_RAW_OR_DUMPED(other)
+
+#undef USE_RAW_OR_DUMPED
+
+    return result;
+}
+
 struct cr_XmlStruct
 cr_xml_dump(cr_Package *pkg, GError **err)
 {
@@ -77,12 +77,40 @@ cr_xml_dump_filelists_items(xmlNodePtr root, cr_Package *package, gboolean filel
 }
 
 
+/** Streaming counterpart of cr_xml_dump_filelists_items(),
+ * it has to produce exactly the same XML.
+ */
+static void
+cr_xml_write_filelists_package(cr_XmlWriter *w, cr_Package *package, gboolean filelists_ext)
+{
+    cr_xml_writer_start(w, "package");
+    cr_xml_writer_attr(w, "pkgid", package->pkgId);
+    cr_xml_writer_attr(w, "name", package->name);
+    cr_xml_writer_attr(w, "arch", package->arch);
+    cr_xml_writer_open(w);
+
+    cr_xml_writer_start(w, "version");
+    cr_xml_writer_attr(w, "epoch", package->epoch);
+    cr_xml_writer_attr(w, "ver", package->version);
+    cr_xml_writer_attr(w, "rel", package->release);
+    cr_xml_writer_close_empty(w);
+
+    if (filelists_ext) {
+        cr_xml_writer_start(w, "checksum");
+        cr_xml_writer_attr(w, "type", package->files_checksum_type);
+        cr_xml_writer_close_empty(w);
+    }
+
+    cr_xml_writer_files(w, package, 0, filelists_ext);
+
+    cr_xml_writer_close(w, "package");
+}
+
+
 char *
 cr_xml_dump_filelists_chunk(cr_Package *package, gboolean filelists_ext, GError **err)
 {
-    xmlNodePtr root;
-    char *result;
-    gboolean xml_dump_pretty = cr_xml_dump_get_parameter(CR_XML_DUMP_DO_PRETTY_PRINT);
+    cr_XmlWriter writer;
 
     assert(!err || *err == NULL);
 
@@ -95,30 +123,9 @@ cr_xml_dump_filelists_chunk(cr_Package *package, gboolean filelists_ext, GError
 
     // Dump IT!
 
-    xmlBufferPtr buf = xmlBufferCreate();
-    if (buf == NULL) {
-        g_critical("%s: Error creating the xml buffer", __func__);
-        g_set_error(err, ERR_DOMAIN, CRE_MEMORY,
-                    "Cannot create an xml buffer");
-        return NULL;
-    }
-
-    root = xmlNewNode(NULL, BAD_CAST "package");
-    cr_xml_dump_filelists_items(root, package, filelists_ext);
-    // xmlNodeDump seems to be a little bit faster than xmlDocDumpFormatMemory
-    xmlNodeDump(buf, NULL, root, 0, xml_dump_pretty);
-    assert(buf->content);
-    result = g_strndup((char *) buf->content, (buf->use+1));
-    result[buf->use]     = '\n';
-    result[buf->use+1]   = '\0';
-
-
-    // Cleanup
-
-    xmlBufferFree(buf);
-    xmlFreeNode(root);
-
-    return result;
+    cr_xml_writer_init(&writer);
+    cr_xml_write_filelists_package(&writer, package, filelists_ext);
+    return cr_xml_writer_finish(&writer);
 }
 
 
@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 #include "package_internal.h"
+#include "xml_dump.h"
 #include <libxml/tree.h>
 
 #define XML_DOC_VERSION "1.0"
@@ -39,6 +40,152 @@ extern "C" {
 #define DATESIZE_STR_MAX_LEN    SIZE_STR_MAX_LEN
 #endif
 
+/** Implementations of the byte scanning kernels (xml_dump_scan.c).
+ */
+typedef enum {
+    CR_XML_SCAN_AUTO,       /*!< The best one supported by the CPU */
+    CR_XML_SCAN_SCALAR,     /*!< Plain C, table driven */
+    CR_XML_SCAN_SSE42,      /*!< x86 SSE4.2 */
+    CR_XML_SCAN_AVX2,       /*!< x86 AVX2 */
+    CR_XML_SCAN_SENTINEL,
+} cr_XmlScanImpl;
+
+/** Is the implementation available in this build and on this CPU?
+ */
+gboolean cr_xml_scan_impl_supported(cr_XmlScanImpl impl);
+
+/** Human readable name of the implementation.
+ */
+const char *cr_xml_scan_impl_name(cr_XmlScanImpl impl);
+
+/** Select the implementation of the kernels (the best supported one is
+ * selected by default). Not thread safe, meant for tests and benchmarks.
+ * @return          FALSE if the implementation is not supported
+ */
+gboolean cr_xml_scan_set_impl(cr_XmlScanImpl impl);
+
+/** Currently used implementation of the kernels.
+ */
+cr_XmlScanImpl cr_xml_scan_get_impl(void);
+
+/** Length of the initial part of str without bytes which have to be
+ * escaped in element content (<, >, &, \r) and without non ASCII bytes.
+ * @return          Position of the first such byte or len
+ */
+size_t cr_xml_scan_text(const char *str, size_t len);
+
+/** Like cr_xml_scan_text(), but for attribute values (<, >, &, ", \t,
+ * \n, \r and non ASCII bytes).
+ */
+size_t cr_xml_scan_attr(const char *str, size_t len);
+
+/** Length of the initial part of str without forbidden control chars
+ * (ASCII values <32 except 9, 10 and 13).
+ */
+size_t cr_xml_scan_ctrl(const char *str, size_t len);
+
+/** Streaming XML writer.
+ * Serializes elements directly into a per-thread reusable buffer.
+ * The output is the same as xmlNodeDump() of an equivalent tree built by
+ * cr_xmlNewTextChild()/cr_xmlNewProp() (nodes without a document, UTF-8).
+ * Indentation follows the CR_XML_DUMP_DO_PRETTY_PRINT parameter.
+ */
+typedef struct {
+    GString *buf;       /*!< Output (per-thread buffer) */
+    gboolean pretty;    /*!< Indent the output */
+    int level;          /*!< Depth of the current element */
+} cr_XmlWriter;
+
+/** Prepare the writer, the per-thread buffer is emptied.
+ * Only one writer per thread can be in use at a time.
+ */
+void cr_xml_writer_init(cr_XmlWriter *w);
+
+/** Get a copy of the written XML terminated by a newline.
+ * @return          Malloced string
+ */
+char *cr_xml_writer_finish(cr_XmlWriter *w);
+
+/** Write the beginning of a start tag ("<name").
+ */
+void cr_xml_writer_start(cr_XmlWriter *w, const char *name);
+
+/** Write an attribute the way cr_xmlNewProp() would create it.
+ * NULL value is written as empty string, non UTF-8 value is converted
+ * from iso-8859-1.
+ */
+void cr_xml_writer_attr(cr_XmlWriter *w, const char *name, const char *value);
+
+/** Write an attribute the way xmlNewProp() would create it (the value is
+ * used as is).
+ */
+void cr_xml_writer_attr_raw(cr_XmlWriter *w, const char *name, const char *value);
+
+/** Write a numeric attribute.
+ */
+void cr_xml_writer_attr_int(cr_XmlWriter *w, const char *name, gint64 value);
+
+/** Finish the start tag of an element which will contain child elements.
+ */
+void cr_xml_writer_open(cr_XmlWriter *w);
+
+/** Write the end tag of an element opened by cr_xml_writer_open().
+ */
+void cr_xml_writer_close(cr_XmlWriter *w, const char *name);
+
+/** Finish the start tag of an element without content ("/>").
+ */
+void cr_xml_writer_close_empty(cr_XmlWriter *w);
+
+/** Finish the start tag, write the text content and the end tag.
+ * The content is handled as by cr_xmlNewTextChild().
+ */
+void cr_xml_writer_text(cr_XmlWriter *w, const char *name, const char *content);
+
+/** Write a whole element with text content and without attributes.
+ */
+static inline void
+cr_xml_writer_text_element(cr_XmlWriter *w, const char *name, const char *content)
+{
+    cr_xml_writer_start(w, name);
+    cr_xml_writer_text(w, name, content);
+}
+
+/** Append text escaped as element content (&lt; &gt; &amp; and &#13;).
+ */
+void cr_xml_escape_text(GString *buf, const char *str);
+
+/** Append text escaped as attribute value. Non ASCII characters are
+ * written as character references like libxml2 does for nodes without
+ * a document.
+ */
+void cr_xml_escape_attr(GString *buf, const char *str);
+
+/** Stream files of the package as file elements.
+ * @param w             xml writer
+ * @param package       cr_Package
+ * @param primary       process only primary files (see cr_is_primary() function
+ *                      in the misc module)
+ * @param filelists_ext includes the optional hash attribute for each file
+ */
+void cr_xml_writer_files(cr_XmlWriter *w, cr_Package *package, int primary, gboolean filelists_ext);
+
+/** Get XML chunks of a package loaded from the old metadata.
+ * The raw <package> elements kept by the loader (cr_Package raw_* members)
+ * are used verbatim, only the location element of the primary one is
+ * regenerated from the current location_href and location_base.
+ * Chunks without a usable raw element are dumped as by cr_xml_dump(),
+ * the files and changelogs kept only in the raw elements are parsed
+ * for them first.
+ * @param pkg           cr_Package
+ * @param filelists_ext Get the filelists-ext chunk too
+ * @param err           GError **
+ * @return              cr_XmlStruct
+ */
+struct cr_XmlStruct cr_xml_dump_raw(cr_Package *pkg,
+                                    gboolean filelists_ext,
+                                    GError **err);
+
 /** Dump files from the package and append them to the node as childrens.
  * @param node          parent xml node
  * @param package       cr_Package
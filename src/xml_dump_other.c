@@ -112,12 +112,43 @@ cr_xml_dump_other_items(xmlNodePtr root, cr_Package *package)
 }
 
 
+/** Streaming counterpart of cr_xml_dump_other_items(),
+ * it has to produce exactly the same XML.
+ */
+static void
+cr_xml_write_other_package(cr_XmlWriter *w, cr_Package *package)
+{
+    cr_xml_writer_start(w, "package");
+    cr_xml_writer_attr(w, "pkgid", package->pkgId);
+    cr_xml_writer_attr(w, "name", package->name);
+    cr_xml_writer_attr(w, "arch", package->arch);
+    cr_xml_writer_open(w);
+
+    cr_xml_writer_start(w, "version");
+    cr_xml_writer_attr_raw(w, "epoch", package->epoch);
+    cr_xml_writer_attr_raw(w, "ver", package->version);
+    cr_xml_writer_attr_raw(w, "rel", package->release);
+    cr_xml_writer_close_empty(w);
+
+    for (GSList *element = package->changelogs; element; element=element->next) {
+        cr_ChangelogEntry *entry = (cr_ChangelogEntry*) element->data;
+
+        assert(entry);
+
+        cr_xml_writer_start(w, "changelog");
+        cr_xml_writer_attr(w, "author", entry->author);
+        cr_xml_writer_attr_int(w, "date", entry->date);
+        cr_xml_writer_text(w, "changelog", entry->changelog);
+    }
+
+    cr_xml_writer_close(w, "package");
+}
+
+
 char *
 cr_xml_dump_other(cr_Package *package, GError **err)
 {
-    xmlNodePtr root;
-    char *result;
-    gboolean xml_dump_pretty = cr_xml_dump_get_parameter(CR_XML_DUMP_DO_PRETTY_PRINT);
+    cr_XmlWriter writer;
 
     assert(!err || *err == NULL);
 
@@ -130,28 +161,7 @@ cr_xml_dump_other(cr_Package *package, GError **err)
 
     // Dump IT!
 
-    xmlBufferPtr buf = xmlBufferCreate();
-    if (buf == NULL) {
-        g_critical("%s: Error creating the xml buffer", __func__);
-        g_set_error(err, ERR_DOMAIN, CRE_MEMORY,
-                    "Cannot create an xml buffer");
-        return NULL;
-    }
-
-    root = xmlNewNode(NULL, BAD_CAST "package");
-    cr_xml_dump_other_items(root, package);
-    // xmlNodeDump seems to be a little bit faster than xmlDocDumpFormatMemory
-    xmlNodeDump(buf, NULL, root, 0, xml_dump_pretty);
-    assert(buf->content);
-    result = g_strndup((char *) buf->content, (buf->use+1));
-    result[buf->use]     = '\n';
-    result[buf->use+1]   = '\0';
-
-
-    // Cleanup
-
-    xmlBufferFree(buf);
-    xmlFreeNode(root);
-
-    return result;
+    cr_xml_writer_init(&writer);
+    cr_xml_write_other_package(&writer, package);
+    return cr_xml_writer_finish(&writer);
 }
@@ -377,12 +377,151 @@ cr_xml_dump_primary_base_items(xmlNodePtr root, cr_Package *package)
 
 
 
+static void
+cr_xml_write_primary_pco(cr_XmlWriter *w, cr_Package *package, PcoType pcotype)
+{
+    const char *elem_name;
+    GSList *list = NULL;
+    gboolean opened = FALSE;
+
+    if (pcotype >= PCO_TYPE_SENTINEL)
+        return;
+
+    elem_name = pco_info[pcotype].elemname;
+    list = *((GSList **) ((size_t) package + pco_info[pcotype].listoffset));
+
+    if (!list)
+        return;
+
+    for (GSList *element = list; element; element=element->next) {
+        cr_Dependency *entry = (cr_Dependency*) element->data;
+
+        assert(entry);
+
+        if (!entry->name || entry->name[0] == '\0')
+            continue;
+
+        if (!opened) {
+            cr_xml_writer_start(w, elem_name);
+            cr_xml_writer_open(w);
+            opened = TRUE;
+        }
+
+        cr_xml_writer_start(w, "rpm:entry");
+        cr_xml_writer_attr(w, "name", entry->name);
+
+        if (entry->flags && entry->flags[0] != '\0') {
+            cr_xml_writer_attr(w, "flags", entry->flags);
+
+            if (entry->epoch && entry->epoch[0] != '\0')
+                cr_xml_writer_attr(w, "epoch", entry->epoch);
+
+            if (entry->version && entry->version[0] != '\0')
+                cr_xml_writer_attr(w, "ver", entry->version);
+
+            if (entry->release && entry->release[0] != '\0')
+                cr_xml_writer_attr(w, "rel", entry->release);
+        }
+
+        if (pcotype == PCO_TYPE_REQUIRES && entry->pre)
+            cr_xml_writer_attr_raw(w, "pre", "1");
+
+        cr_xml_writer_close_empty(w);
+    }
+
+    if (opened) {
+        cr_xml_writer_close(w, elem_name);
+    } else {
+        // Only entries without name, the element stays empty
+        cr_xml_writer_start(w, elem_name);
+        cr_xml_writer_close_empty(w);
+    }
+}
+
+
+/** Streaming counterpart of cr_xml_dump_primary_base_items(),
+ * it has to produce exactly the same XML.
+ */
+static void
+cr_xml_write_primary_package(cr_XmlWriter *w, cr_Package *package)
+{
+    cr_xml_writer_start(w, "package");
+    cr_xml_writer_attr_raw(w, "type", "rpm");
+    cr_xml_writer_open(w);
+
+    cr_xml_writer_text_element(w, "name", package->name);
+    cr_xml_writer_text_element(w, "arch", package->arch);
+
+    cr_xml_writer_start(w, "version");
+    cr_xml_writer_attr(w, "epoch", package->epoch);
+    cr_xml_writer_attr(w, "ver", package->version);
+    cr_xml_writer_attr(w, "rel", package->release);
+    cr_xml_writer_close_empty(w);
+
+    cr_xml_writer_start(w, "checksum");
+    cr_xml_writer_attr(w, "type", package->checksum_type);
+    cr_xml_writer_attr_raw(w, "pkgid", "YES");
+    cr_xml_writer_text(w, "checksum", package->pkgId);
+
+    cr_xml_writer_text_element(w, "summary", package->summary);
+    cr_xml_writer_text_element(w, "description", package->description);
+    cr_xml_writer_text_element(w, "packager", package->rpm_packager);
+    cr_xml_writer_text_element(w, "url", package->url);
+
+    cr_xml_writer_start(w, "time");
+    cr_xml_writer_attr_int(w, "file", package->time_file);
+    cr_xml_writer_attr_int(w, "build", package->time_build);
+    cr_xml_writer_close_empty(w);
+
+    cr_xml_writer_start(w, "size");
+    cr_xml_writer_attr_int(w, "package", package->size_package);
+    cr_xml_writer_attr_int(w, "installed", package->size_installed);
+    cr_xml_writer_attr_int(w, "archive", package->size_archive);
+    cr_xml_writer_close_empty(w);
+
+    cr_xml_writer_start(w, "location");
+    if (package->location_base && package->location_base[0] != '\0') {
+        gchar *location_base_with_protocol = NULL;
+        location_base_with_protocol = cr_prepend_protocol(package->location_base);
+        cr_xml_writer_attr(w, "xml:base", location_base_with_protocol);
+        g_free(location_base_with_protocol);
+    }
+    cr_xml_writer_attr(w, "href", package->location_href);
+    cr_xml_writer_close_empty(w);
+
+    cr_xml_writer_start(w, "format");
+    cr_xml_writer_open(w);
+
+    cr_xml_writer_text_element(w, "rpm:license", package->rpm_license);
+    cr_xml_writer_text_element(w, "rpm:vendor", package->rpm_vendor);
+    cr_xml_writer_text_element(w, "rpm:group", package->rpm_group);
+    cr_xml_writer_text_element(w, "rpm:buildhost", package->rpm_buildhost);
+    cr_xml_writer_text_element(w, "rpm:sourcerpm", package->rpm_sourcerpm);
+
+    cr_xml_writer_start(w, "rpm:header-range");
+    cr_xml_writer_attr_int(w, "start", package->rpm_header_start);
+    cr_xml_writer_attr_int(w, "end", package->rpm_header_end);
+    cr_xml_writer_close_empty(w);
+
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_PROVIDES);
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_REQUIRES);
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_CONFLICTS);
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_OBSOLETES);
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_SUGGESTS);
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_ENHANCES);
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_RECOMMENDS);
+    cr_xml_write_primary_pco(w, package, PCO_TYPE_SUPPLEMENTS);
+    cr_xml_writer_files(w, package, 1, FALSE);
+
+    cr_xml_writer_close(w, "format");
+    cr_xml_writer_close(w, "package");
+}
+
+
 char *
 cr_xml_dump_primary(cr_Package *package, GError **err)
 {
-    xmlNodePtr root;
-    char *result;
-    gboolean xml_dump_pretty = cr_xml_dump_get_parameter(CR_XML_DUMP_DO_PRETTY_PRINT);
+    cr_XmlWriter writer;
 
     assert(!err || *err == NULL);
 
@@ -394,29 +533,7 @@ cr_xml_dump_primary(cr_Package *package, GError **err)
 
     // Dump IT!
 
-    xmlBufferPtr buf = xmlBufferCreate();
-    if (buf == NULL) {
-        g_critical("%s: Error creating the xml buffer", __func__);
-        g_set_error(err, ERR_DOMAIN, CRE_MEMORY,
-                    "Cannot create an xml buffer");
-        return NULL;
-    }
-
-    root = xmlNewNode(NULL, BAD_CAST "package");
-    cr_xml_dump_primary_base_items(root, package);
-    // xmlNodeDump seems to be a little bit faster than xmlDocDumpFormatMemory
-    xmlNodeDump(buf, NULL, root, 0, xml_dump_pretty);
-    assert(buf->content);
-    result = g_strndup((char *) buf->content, (buf->use+1));
-    result[buf->use]     = '\n';
-    result[buf->use+1]   = '\0';
-
-
-    // Cleanup
-
-    xmlBufferFree(buf);
-    xmlFreeNode(root);
-
-    return result;
-
+    cr_xml_writer_init(&writer);
+    cr_xml_write_primary_package(&writer, package);
+    return cr_xml_writer_finish(&writer);
 }
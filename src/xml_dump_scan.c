@@ -0,0 +1,307 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "xml_dump_internal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WITH_X86_KERNELS    1
+#include <immintrin.h>
+#endif
+
+/*
+ * Byte scanning kernels of the XML dump.
+ * Every kernel returns the length of the initial part of the string
+ * which contains no byte of the searched class (len if there is none).
+ */
+
+// Byte classes
+#define CLASS_TEXT      0x01    // Escaped in element content or non ASCII
+#define CLASS_ATTR      0x02    // Escaped in attribute value or non ASCII
+#define CLASS_CTRL      0x04    // Forbidden control char
+
+typedef size_t (*ScanFunc)(const unsigned char *str, size_t len);
+
+typedef struct {
+    ScanFunc text;
+    ScanFunc attr;
+    ScanFunc ctrl;
+} ScanKernels;
+
+static guint8 byte_class[256];
+
+
+// Scalar kernels
+
+static void
+init_byte_class(void)
+{
+    for (int c = 0; c < 256; c++) {
+        guint8 cls = 0;
+
+        if (c >= 0x80 || c == '<' || c == '>' || c == '&' || c == '\r')
+            cls |= CLASS_TEXT | CLASS_ATTR;
+        if (c == '"' || c == '\t' || c == '\n')
+            cls |= CLASS_ATTR;
+        if (c < 0x20 && c != '\t' && c != '\n' && c != '\r')
+            cls |= CLASS_CTRL;
+
+        byte_class[c] = cls;
+    }
+}
+
+static inline size_t
+scalar_scan(const unsigned char *str, size_t len, guint8 cls)
+{
+    size_t i = 0;
+    while (i < len && !(byte_class[str[i]] & cls))
+        i++;
+    return i;
+}
+
+static size_t scalar_scan_text(const unsigned char *s, size_t l) { return scalar_scan(s, l, CLASS_TEXT); }
+static size_t scalar_scan_attr(const unsigned char *s, size_t l) { return scalar_scan(s, l, CLASS_ATTR); }
+static size_t scalar_scan_ctrl(const unsigned char *s, size_t l) { return scalar_scan(s, l, CLASS_CTRL); }
+
+static const ScanKernels scalar_kernels = {
+    scalar_scan_text,
+    scalar_scan_attr,
+    scalar_scan_ctrl,
+};
+
+
+#ifdef WITH_X86_KERNELS
+
+// SSE4.2 kernels - PCMPESTRI with byte ranges, 16 bytes per step
+
+#define SSE42_MODE  (_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT)
+
+// Inclusive ranges of the byte classes (padded to 16 bytes)
+static const unsigned char sse42_text_ranges[16] = {
+    '\r', '\r', '&', '&', '<', '<', '>', '>', 0x80, 0xff };
+static const unsigned char sse42_attr_ranges[16] = {
+    '\t', '\n', '\r', '\r', '"', '"', '&', '&', '<', '<', '>', '>', 0x80, 0xff };
+static const unsigned char sse42_ctrl_ranges[16] = {
+    0x01, 0x08, 0x0b, 0x0c, 0x0e, 0x1f };
+
+#define SSE42_SCAN_FUNC(kind, nranges, cls) \
+__attribute__((target("sse4.2"))) \
+static size_t \
+sse42_scan_##kind(const unsigned char *str, size_t len) \
+{ \
+    const __m128i ranges = _mm_loadu_si128((const __m128i *) sse42_##kind##_ranges); \
+    size_t i = 0; \
+    for (; i + 16 <= len; i += 16) { \
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i)); \
+        int idx = _mm_cmpestri(ranges, nranges, v, 16, SSE42_MODE); \
+        if (idx < 16) \
+            return i + idx; \
+    } \
+    return i + scalar_scan(str + i, len - i, cls); \
+}
+
+SSE42_SCAN_FUNC(text, 10, CLASS_TEXT)
+SSE42_SCAN_FUNC(attr, 14, CLASS_ATTR)
+SSE42_SCAN_FUNC(ctrl, 6, CLASS_CTRL)
+
+static const ScanKernels sse42_kernels = {
+    sse42_scan_text,
+    sse42_scan_attr,
+    sse42_scan_ctrl,
+};
+
+
+// AVX2 kernels - byte compares and movemask, 32 bytes per step
+
+#define AVX2_EQ(v, c)   _mm256_cmpeq_epi8((v), _mm256_set1_epi8(c))
+
+__attribute__((target("avx2")))
+static inline __m256i
+avx2_text_mask(__m256i v)
+{
+    __m256i m = _mm256_or_si256(_mm256_or_si256(AVX2_EQ(v, '<'), AVX2_EQ(v, '>')),
+                                _mm256_or_si256(AVX2_EQ(v, '&'), AVX2_EQ(v, '\r')));
+    // The high bit of non ASCII bytes is enough for the movemask
+    return _mm256_or_si256(m, v);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+avx2_attr_mask(__m256i v)
+{
+    __m256i m = _mm256_or_si256(_mm256_or_si256(AVX2_EQ(v, '"'), AVX2_EQ(v, '\t')),
+                                AVX2_EQ(v, '\n'));
+    return _mm256_or_si256(m, avx2_text_mask(v));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+avx2_ctrl_mask(__m256i v)
+{
+    // v <= 0x1f and not one of the allowed whitespaces
+    __m256i low = _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(0x1f)),
+                                    _mm256_set1_epi8(0x1f));
+    __m256i ws = _mm256_or_si256(_mm256_or_si256(AVX2_EQ(v, '\t'), AVX2_EQ(v, '\n')),
+                                 AVX2_EQ(v, '\r'));
+    return _mm256_andnot_si256(ws, low);
+}
+
+#define AVX2_SCAN_FUNC(kind, cls) \
+__attribute__((target("avx2"))) \
+static size_t \
+avx2_scan_##kind(const unsigned char *str, size_t len) \
+{ \
+    size_t i = 0; \
+    for (; i + 32 <= len; i += 32) { \
+        __m256i v = _mm256_loadu_si256((const __m256i *) (str + i)); \
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(avx2_##kind##_mask(v)); \
+        if (mask) \
+            return i + __builtin_ctz(mask); \
+    } \
+    return i + scalar_scan(str + i, len - i, cls); \
+}
+
+AVX2_SCAN_FUNC(text, CLASS_TEXT)
+AVX2_SCAN_FUNC(attr, CLASS_ATTR)
+AVX2_SCAN_FUNC(ctrl, CLASS_CTRL)
+
+static const ScanKernels avx2_kernels = {
+    avx2_scan_text,
+    avx2_scan_attr,
+    avx2_scan_ctrl,
+};
+
+#endif // WITH_X86_KERNELS
+
+
+// Dispatch
+
+static const ScanKernels *kernels = &scalar_kernels;
+static cr_XmlScanImpl kernels_impl = CR_XML_SCAN_SCALAR;
+
+gboolean
+cr_xml_scan_impl_supported(cr_XmlScanImpl impl)
+{
+    switch (impl) {
+        case CR_XML_SCAN_AUTO:
+        case CR_XML_SCAN_SCALAR:
+            return TRUE;
+#ifdef WITH_X86_KERNELS
+        case CR_XML_SCAN_SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        case CR_XML_SCAN_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return FALSE;
+    }
+}
+
+const char *
+cr_xml_scan_impl_name(cr_XmlScanImpl impl)
+{
+    switch (impl) {
+        case CR_XML_SCAN_AUTO:      return "auto";
+        case CR_XML_SCAN_SCALAR:    return "scalar";
+        case CR_XML_SCAN_SSE42:     return "sse4.2";
+        case CR_XML_SCAN_AVX2:      return "avx2";
+        default:                    return "unknown";
+    }
+}
+
+static void
+select_kernels(cr_XmlScanImpl impl)
+{
+    switch (impl) {
+#ifdef WITH_X86_KERNELS
+        case CR_XML_SCAN_SSE42: kernels = &sse42_kernels;   break;
+        case CR_XML_SCAN_AVX2:  kernels = &avx2_kernels;    break;
+#endif
+        default:                kernels = &scalar_kernels;  break;
+    }
+    kernels_impl = impl;
+}
+
+static cr_XmlScanImpl
+best_impl(void)
+{
+    if (cr_xml_scan_impl_supported(CR_XML_SCAN_AVX2))
+        return CR_XML_SCAN_AVX2;
+    if (cr_xml_scan_impl_supported(CR_XML_SCAN_SSE42))
+        return CR_XML_SCAN_SSE42;
+    return CR_XML_SCAN_SCALAR;
+}
+
+static void
+scan_init(void)
+{
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        init_byte_class();
+        select_kernels(best_impl());
+        g_debug("%s: Using %s kernels", __func__,
+                cr_xml_scan_impl_name(kernels_impl));
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+gboolean
+cr_xml_scan_set_impl(cr_XmlScanImpl impl)
+{
+    scan_init();
+
+    if (impl == CR_XML_SCAN_AUTO)
+        impl = best_impl();
+
+    if (!cr_xml_scan_impl_supported(impl))
+        return FALSE;
+
+    select_kernels(impl);
+    return TRUE;
+}
+
+cr_XmlScanImpl
+cr_xml_scan_get_impl(void)
+{
+    scan_init();
+    return kernels_impl;
+}
+
+size_t
+cr_xml_scan_text(const char *str, size_t len)
+{
+    scan_init();
+    return kernels->text((const unsigned char *) str, len);
+}
+
+size_t
+cr_xml_scan_attr(const char *str, size_t len)
+{
+    scan_init();
+    return kernels->attr((const unsigned char *) str, len);
+}
+
+size_t
+cr_xml_scan_ctrl(const char *str, size_t len)
+{
+    scan_init();
+    return kernels->ctrl((const unsigned char *) str, len);
+}
@@ -20,6 +20,7 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <assert.h>
+#include <string.h>
 #include <rpm/rpmstring.h>
 #include "xml_file.h"
 #include <errno.h>
@@ -47,6 +48,9 @@
 #define XML_UPDATEINFO_HEADER    XML_HEADER"<updates>\n"
 
 #define XML_MAX_HEADER_SIZE      300
+#define XML_HEADER_ALTERNATIVES  2  /*!< Lower package counts for which
+                                         the stats of the file are computed
+                                         along with the header member */
 #define XML_RECOMPRESS_BUFFER_SIZE   8192
 
 #define XML_PRIMARY_FOOTER       "</metadata>"
@@ -56,6 +60,29 @@
 #define XML_PRESTODELTA_FOOTER   "</prestodelta>"
 #define XML_UPDATEINFO_FOOTER    "</updates>"
 
+/** cr_XmlFile with the state private to the library. Every cr_XmlFile
+ * is allocated by cr_xmlfile_sopen() as the first member of this
+ * structure, so the public cr_XmlFile keeps its size.
+ */
+typedef struct {
+    cr_XmlFile  file;           /*!< Public part */
+    gchar       *filename;      /*!< Name of the file */
+    long        header_pkgs;    /*!< Number of packages in the header if it
+                                     was written as a header member (see
+                                     cr_write_header_member()), -1 otherwise */
+    int         header_len;     /*!< Capacity of the header member (length
+                                     of the header with header_pkgs) */
+    GPtrArray   *header_alts;   /*!< Stats of the file with header_pkgs-1,
+                                     header_pkgs-2, ... packages in the header
+                                     member (filled by cr_close()) or NULL */
+} XmlFilePriv;
+
+static inline XmlFilePriv *
+xmlfile_priv(cr_XmlFile *f)
+{
+    return (XmlFilePriv *) f;
+}
+
 cr_XmlFile *
 cr_xmlfile_sopen(const char *filename,
                  cr_XmlFileType type,
@@ -87,34 +114,69 @@ cr_xmlfile_sopen(const char *filename,
         return NULL;
     }
 
-    f = g_new0(cr_XmlFile, 1);
+    f = (cr_XmlFile *) g_new0(XmlFilePriv, 1);
     f->f      = cr_f;
     f->type   = type;
     f->header = 0;
     f->footer = 0;
     f->pkgs   = 0;
+    xmlfile_priv(f)->filename    = g_strdup(filename);
+    xmlfile_priv(f)->header_pkgs = -1;
+    xmlfile_priv(f)->header_len  = 0;
 
     return f;
 }
 
+static const char *
+xml_header_format(cr_XmlFileType type)
+{
+    switch (type) {
+    case CR_XMLFILE_PRIMARY:        return XML_PRIMARY_HEADER;
+    case CR_XMLFILE_FILELISTS:      return XML_FILELISTS_HEADER;
+    case CR_XMLFILE_FILELISTS_EXT:  return XML_FILELISTS_EXT_HEADER;
+    case CR_XMLFILE_OTHER:          return XML_OTHER_HEADER;
+    case CR_XMLFILE_PRESTODELTA:    return XML_PRESTODELTA_HEADER;
+    case CR_XMLFILE_UPDATEINFO:     return XML_UPDATEINFO_HEADER;
+    default:                        return NULL;
+    }
+}
+
+static gboolean
+xml_header_has_count(cr_XmlFileType type)
+{
+    return type == CR_XMLFILE_PRIMARY
+           || type == CR_XMLFILE_FILELISTS
+           || type == CR_XMLFILE_FILELISTS_EXT
+           || type == CR_XMLFILE_OTHER;
+}
+
 int
 cr_xmlfile_set_num_of_pkgs(cr_XmlFile *f, long num, GError **err)
 {
+    XmlFilePriv *priv = xmlfile_priv(f);
+
     assert(f);
     assert(!err || *err == NULL);
 
-    if (f->header != 0) {
-        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
-                    "Header was already written");
-        return CRE_BADARG;
-    }
-
     if (num < 0) {
         g_set_error(err, ERR_DOMAIN, CRE_BADARG,
                     "The number must be a positive integer number");
         return CRE_BADARG;
     }
 
+    if (f->header != 0) {
+        // A count in a header member is fixed in place when the file
+        // is closed, as long as it doesn't need more digits
+        if (priv->header_pkgs < 0
+            || g_snprintf(NULL, 0, "%d", (int) num)
+               > g_snprintf(NULL, 0, "%d", (int) priv->header_pkgs))
+        {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Header was already written");
+            return CRE_BADARG;
+        }
+    }
+
     f->pkgs = num;
     return CRE_OK;
 }
@@ -122,6 +184,7 @@ cr_xmlfile_set_num_of_pkgs(cr_XmlFile *f, long num, GError **err)
 int
 cr_xmlfile_write_xml_header(cr_XmlFile *f, GError **err)
 {
+    XmlFilePriv *priv = xmlfile_priv(f);
     const char *xml_header;
     GError *tmp_err = NULL;
 
@@ -129,33 +192,51 @@ cr_xmlfile_write_xml_header(cr_XmlFile *f, GError **err)
     assert(!err || *err == NULL);
     assert(f->header == 0);
 
-    switch (f->type) {
-    case CR_XMLFILE_PRIMARY:
-        xml_header = XML_PRIMARY_HEADER;
-        break;
-    case CR_XMLFILE_FILELISTS:
-        xml_header = XML_FILELISTS_HEADER;
-        break;
-    case CR_XMLFILE_FILELISTS_EXT:
-        xml_header = XML_FILELISTS_EXT_HEADER;
-        break;
-    case CR_XMLFILE_OTHER:
-        xml_header = XML_OTHER_HEADER;
-        break;
-    case CR_XMLFILE_PRESTODELTA:
-        xml_header = XML_PRESTODELTA_HEADER;
-        break;
-    case CR_XMLFILE_UPDATEINFO:
-        xml_header = XML_UPDATEINFO_HEADER;
-        break;
-    default:
+    xml_header = xml_header_format(f->type);
+    if (!xml_header) {
         g_critical("%s: Bad file type", __func__);
         assert(0);
         g_set_error(err, ERR_DOMAIN, CRE_ASSERT, "Bad file type");
         return CRE_ASSERT;
     }
 
-    if (cr_printf(&tmp_err, f->f, xml_header, f->pkgs) == CR_CW_ERR) {
+    if (xml_header_has_count(f->type) && cr_header_member_supported(f->f->type)) {
+        // Header as a standalone member, the package count in it
+        // can be corrected in place by cr_xmlfile_close(). The stats for
+        // the few lower counts (packages which failed to load) are
+        // computed in advance, so the file doesn't have to be read again.
+        cr_HeaderMemberAlt alts[XML_HEADER_ALTERNATIVES];
+        unsigned int n_alts = 0;
+        gchar *header = g_strdup_printf(xml_header, (int) f->pkgs);
+        int len = strlen(header);
+
+        if (f->f->stat && f->f->stat->checksum_type != CR_CHECKSUM_UNKNOWN) {
+            priv->header_alts = g_ptr_array_new();
+            for (long pkgs = f->pkgs - 1;
+                 pkgs >= 0 && n_alts < XML_HEADER_ALTERNATIVES;
+                 pkgs--, n_alts++)
+            {
+                alts[n_alts].buffer = g_strdup_printf(xml_header, (int) pkgs);
+                alts[n_alts].len = strlen(alts[n_alts].buffer);
+                alts[n_alts].stat = cr_contentstat_new(
+                                        f->f->stat->checksum_type, NULL);
+                g_ptr_array_add(priv->header_alts, alts[n_alts].stat);
+            }
+        }
+
+        cr_write_header_member(f->f, header, len, alts, n_alts, &tmp_err);
+        g_free(header);
+        for (unsigned int x = 0; x < n_alts; x++)
+            g_free((gpointer) alts[x].buffer);
+        if (tmp_err) {
+            int code = tmp_err->code;
+            g_propagate_prefixed_error(err, tmp_err, "Cannot write XML header: ");
+            return code;
+        }
+
+        priv->header_pkgs = f->pkgs;
+        priv->header_len = len;
+    } else if (cr_printf(&tmp_err, f->f, xml_header, f->pkgs) == CR_CW_ERR) {
         int code = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err, "Cannot write XML header: ");
         return code;
@@ -298,9 +379,127 @@ cr_xmlfile_add_chunk(cr_XmlFile *f, const char* chunk, GError **err)
     return CRE_OK;
 }
 
+static int
+restat_file(const char *filename,
+            cr_CompressionType comtype,
+            cr_ContentStat *stat,
+            GError **err)
+{
+    GError *tmp_err = NULL;
+    gchar buf[XML_RECOMPRESS_BUFFER_SIZE];
+    int len_read;
+
+    cr_ContentStat *new_stat = cr_contentstat_new(stat->checksum_type, NULL);
+    CR_FILE *cr_f = cr_sopen(filename, CR_CW_MODE_READ, comtype,
+                             new_stat, &tmp_err);
+    if (!cr_f) {
+        g_propagate_error(err, tmp_err);
+        cr_contentstat_free(new_stat, NULL);
+        return CRE_IO;
+    }
+
+    do {
+        len_read = cr_read(cr_f, buf, XML_RECOMPRESS_BUFFER_SIZE, &tmp_err);
+    } while (len_read > 0);
+
+    if (!tmp_err)
+        cr_close(cr_f, &tmp_err);
+    else
+        cr_close(cr_f, NULL);
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        cr_contentstat_free(new_stat, NULL);
+        return code;
+    }
+
+    stat->size = new_stat->size;
+    g_free(stat->checksum);
+    stat->checksum = new_stat->checksum;
+    new_stat->checksum = NULL;
+    cr_contentstat_free(new_stat, NULL);
+
+    // The size of the compressed file is the same, its checksum isn't
+    gint64 compressed_size;
+    if (cr_contentstat_get_compressed(stat, &compressed_size)) {
+        gchar *checksum = cr_checksum_file(filename, stat->checksum_type,
+                                           &tmp_err);
+        if (!checksum) {
+            int code = tmp_err->code;
+            g_propagate_error(err, tmp_err);
+            return code;
+        }
+
+        cr_contentstat_set_compressed(stat, compressed_size, checksum);
+        g_free(checksum);
+    }
+
+    return CRE_OK;
+}
+
+/** Replace the header member of a closed file by a header with
+ * the current package count. Only the header member is rewritten,
+ * the rest of the file is kept as is. The stats of the file come from
+ * the alternatives computed while the file was written; if the count
+ * dropped below them, the file has to be read again (no recompression).
+ */
+static int
+fix_header_member(cr_XmlFile *f,
+                  cr_CompressionType comtype,
+                  cr_ContentStat *stat,
+                  GError **err)
+{
+    XmlFilePriv *priv = xmlfile_priv(f);
+    int ret;
+    gchar *header = g_strdup_printf(xml_header_format(f->type), (int) f->pkgs);
+    int len = strlen(header);
+
+    assert(len <= priv->header_len);
+
+    g_debug("%s: Fixing package count %ld -> %ld in %s", __func__,
+            priv->header_pkgs, f->pkgs, priv->filename);
+
+    ret = cr_rewrite_header_member(priv->filename, comtype, header, len,
+                                   priv->header_len, err);
+    g_free(header);
+    if (ret != CRE_OK)
+        return ret;
+
+    if (stat && stat->checksum_type != CR_CHECKSUM_UNKNOWN) {
+        long alt = priv->header_pkgs - f->pkgs - 1;
+        cr_ContentStat *alt_stat = NULL;
+
+        if (priv->header_alts && alt >= 0
+            && alt < (long) priv->header_alts->len)
+            alt_stat = g_ptr_array_index(priv->header_alts, alt);
+
+        if (alt_stat && alt_stat->checksum) {
+            gint64 compressed_size;
+            const char *compressed_checksum =
+                cr_contentstat_get_compressed(alt_stat, &compressed_size);
+
+            stat->size = alt_stat->size;
+            g_free(stat->checksum);
+            stat->checksum = alt_stat->checksum;
+            alt_stat->checksum = NULL;
+            cr_contentstat_set_compressed(stat, compressed_size,
+                                          compressed_checksum);
+        } else {
+            g_debug("%s: No precomputed stats for %ld packages, "
+                    "reading %s again", __func__, f->pkgs, priv->filename);
+            ret = restat_file(priv->filename, comtype, stat, err);
+        }
+    }
+
+    priv->header_pkgs = f->pkgs;
+    return ret;
+}
+
 int
 cr_xmlfile_close(cr_XmlFile *f, GError **err)
 {
+    XmlFilePriv *priv = xmlfile_priv(f);
     GError *tmp_err = NULL;
 
     assert(!err || *err == NULL);
@@ -326,6 +525,9 @@ cr_xmlfile_close(cr_XmlFile *f, GError **err)
         }
     }
 
+    cr_ContentStat *stat = f->f->stat;
+    cr_CompressionType comtype = f->f->type;
+
     cr_close(f->f, &tmp_err);
     if (tmp_err) {
         int code = tmp_err->code;
@@ -334,6 +536,24 @@ cr_xmlfile_close(cr_XmlFile *f, GError **err)
         return code;
     }
 
+    if (priv->header_pkgs >= 0 && f->pkgs != priv->header_pkgs)
+        fix_header_member(f, comtype, stat, &tmp_err);
+
+    if (priv->header_alts) {
+        for (guint x = 0; x < priv->header_alts->len; x++)
+            cr_contentstat_free(g_ptr_array_index(priv->header_alts, x), NULL);
+        g_ptr_array_free(priv->header_alts, TRUE);
+        priv->header_alts = NULL;
+    }
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err,
+                "Cannot fix package count in %s: ", priv->filename);
+        return code;
+    }
+
+    g_free(priv->filename);
     g_free(f);
 
     return CRE_OK;
@@ -205,6 +205,11 @@ cr_XmlFile *cr_xmlfile_sopen(const char *filename,
 /** Set total number of packages that will be in the file.
  * This number must be set before any write operation
  * (cr_xml_add_pkg, cr_xml_file_add_chunk, ..).
+ * Exception: If the header was written as a header member (primary,
+ * filelists, filelists-ext and other files with compression types
+ * supported by cr_header_member_supported()), the number may be changed
+ * later too as long as it doesn't have more digits than the number
+ * in the header. The header is then fixed in place by cr_xmlfile_close().
  * @param f             An opened cr_XmlFile
  * @param num           Total number of packages in the file.
  * @param err           **GError
@@ -235,6 +240,9 @@ int cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err);
 int cr_xmlfile_add_chunk(cr_XmlFile *f, const char *chunk, GError **err);
 
 /** Close an opened cr_XmlFile.
+ * If the number of packages was changed after the header was written
+ * as a header member, the header is rewritten in place and the content
+ * stat of the file is updated.
  * @param f             An opened cr_XmlFile
  * @param err           **GError
  * @return              cr_Error code
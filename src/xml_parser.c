@@ -28,6 +28,9 @@
 
 #define ERR_DOMAIN      CREATEREPO_C_ERROR
 
+#define RAW_PACKAGE_START       "<package"
+#define RAW_PACKAGE_END         "</package>"
+
 
 cr_ParserData *
 cr_xml_parser_data(unsigned int numstates)
@@ -50,12 +53,112 @@ cr_xml_parser_data_free(cr_ParserData *pd)
     if (pd->parser) {
         xmlFreeParserCtxt(pd->parser);
     }
+    cr_raw_xml_capture_free(pd->raw);
     g_free(pd->content);
     g_free(pd->swtab);
     g_free(pd->sbtab);
     g_free(pd);
 }
 
+cr_RawXmlCapture *
+cr_raw_xml_capture_new(void)
+{
+    cr_RawXmlCapture *raw = g_new0(cr_RawXmlCapture, 1);
+    raw->buf = g_string_sized_new(XML_BUFFER_SIZE * 2);
+    raw->captured = g_queue_new();
+    return raw;
+}
+
+void
+cr_raw_xml_capture_free(cr_RawXmlCapture *raw)
+{
+    if (!raw)
+        return;
+    g_string_free(raw->buf, TRUE);
+    g_queue_free_full(raw->captured, g_free);
+    g_free(raw);
+}
+
+/** Find start of a package element (not e.g. <packager>) in the buf.
+ * @return      Offset of the element or -1 if not found
+ */
+static gssize
+raw_find_package_start(GString *buf, gsize from)
+{
+    const gsize tag_len = strlen(RAW_PACKAGE_START);
+
+    while (from < buf->len) {
+        char *tag = g_strstr_len(buf->str + from, buf->len - from,
+                                 RAW_PACKAGE_START);
+        if (!tag)
+            return -1;
+
+        gsize offset = tag - buf->str;
+        if (offset + tag_len >= buf->len)
+            return -1;  // Don't know what follows yet
+
+        char next = buf->str[offset + tag_len];
+        if (next == ' ' || next == '>' || next == '\t'
+            || next == '\n' || next == '\r')
+            return offset;
+
+        from = offset + tag_len;
+    }
+
+    return -1;
+}
+
+void
+cr_raw_xml_capture_feed(cr_RawXmlCapture *raw, const char *data, int len)
+{
+    const gsize start_len = strlen(RAW_PACKAGE_START);
+    const gsize end_len = strlen(RAW_PACKAGE_END);
+
+    // Package elements contain no comments nor CDATA sections and every
+    // '<' in the text is escaped, so a plain search for the tags is enough
+    g_string_append_len(raw->buf, data, len);
+
+    while (TRUE) {
+        if (!raw->in_package) {
+            gssize start = raw_find_package_start(raw->buf, raw->scan_from);
+            if (start < 0) {
+                // Keep only what could be a beginning of the start tag
+                gsize keep = MIN(raw->buf->len, start_len);
+                g_string_erase(raw->buf, 0, raw->buf->len - keep);
+                raw->scan_from = 0;
+                return;
+            }
+            g_string_erase(raw->buf, 0, start);
+            raw->in_package = TRUE;
+            raw->scan_from = start_len;
+        }
+
+        char *end = g_strstr_len(raw->buf->str + raw->scan_from,
+                                 raw->buf->len - raw->scan_from,
+                                 RAW_PACKAGE_END);
+        if (!end) {
+            if (raw->buf->len > end_len)
+                raw->scan_from = MAX(raw->scan_from,
+                                     raw->buf->len - end_len);
+            return;
+        }
+
+        gsize elem_len = end - raw->buf->str + end_len;
+        g_queue_push_tail(raw->captured, g_strndup(raw->buf->str, elem_len));
+        g_string_erase(raw->buf, 0, elem_len);
+        raw->in_package = FALSE;
+        raw->scan_from = 0;
+    }
+}
+
+gchar *
+cr_xml_parser_take_raw(cr_ParserData *pd)
+{
+    if (!pd->raw)
+        return NULL;
+    return g_queue_pop_head(pd->raw->captured);
+}
+
 void
 cr_char_handler(void *pdata, const xmlChar *s, int len)
 {
@@ -199,6 +302,9 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
             break;
         }
 
+        if (pd->raw)
+            cr_raw_xml_capture_feed(pd->raw, buf, len);
+
         if (xmlParseChunk(parser, buf, len, len == 0)) {
             ret = CRE_XMLPARSER;
             const xmlError *xml_err = xmlCtxtGetLastError(parser);
@@ -240,6 +346,73 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
     return ret;
 }
 
+int
+cr_xml_parser_generic_raw(xmlParserCtxtPtr parser,
+                          cr_ParserData *pd,
+                          const char *path,
+                          GError **err)
+{
+    if (!pd->raw)
+        pd->raw = cr_raw_xml_capture_new();
+    return cr_xml_parser_generic(parser, pd, path, err);
+}
+
+int
+cr_xml_parser_generic_raw_only(xmlParserCtxtPtr parser,
+                               cr_ParserData *pd,
+                               const char *path,
+                               GError **err)
+{
+    if (!pd->raw)
+        pd->raw = cr_raw_xml_capture_new();
+    pd->raw->skip_content = TRUE;
+    return cr_xml_parser_generic(parser, pd, path, err);
+}
+
+/** New package callback which parses into the package passed as cbdata.
+ */
+static int
+raw_content_newpkgcb(cr_Package **pkg,
+                     G_GNUC_UNUSED const char *pkgId,
+                     G_GNUC_UNUSED const char *name,
+                     G_GNUC_UNUSED const char *arch,
+                     void *cbdata,
+                     G_GNUC_UNUSED GError **err)
+{
+    *pkg = cbdata;
+    return CRE_OK;
+}
+
+int
+cr_xml_parse_raw_content(cr_Package *pkg, GError **err)
+{
+    int ret = CRE_OK;
+    const char *raw_filelists = pkg->raw_filelists_ext ? pkg->raw_filelists_ext
+                                                       : pkg->raw_filelists;
+
+    assert(!err || *err == NULL);
+
+    if (raw_filelists && !(pkg->loadingflags & CR_PACKAGE_LOADED_FIL)) {
+        ret = cr_xml_parse_filelists_snippet(raw_filelists,
+                                             raw_content_newpkgcb, pkg,
+                                             NULL, NULL, NULL, NULL, err);
+        if (ret != CRE_OK)
+            return ret;
+        pkg->loadingflags |= CR_PACKAGE_LOADED_FIL;
+    }
+
+    if (pkg->raw_other && !(pkg->loadingflags & CR_PACKAGE_LOADED_OTH)) {
+        ret = cr_xml_parse_other_snippet(pkg->raw_other,
+                                         raw_content_newpkgcb, pkg,
+                                         NULL, NULL, NULL, NULL, err);
+        if (ret != CRE_OK)
+            return ret;
+        pkg->loadingflags |= CR_PACKAGE_LOADED_OTH;
+    }
+
+    return ret;
+}
+
 int
 cr_xml_parser_generic_from_string(xmlParserCtxtPtr parser,
                                   cr_ParserData *pd,
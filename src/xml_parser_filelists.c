@@ -113,8 +113,12 @@ cr_start_handler(void *pdata, const xmlChar *element, const xmlChar **attr)
         break;
 
     case STATE_FILELISTS:
+        pd->main_tag_found = TRUE;
+        break;
+
     case STATE_FILELISTS_EXT:
         pd->main_tag_found = TRUE;
+        pd->filelists_ext = TRUE;
         break;
 
     case STATE_PACKAGE: {
@@ -254,9 +258,21 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
     case STATE_CHECKSUM:
         break;
 
-    case STATE_PACKAGE:
-        if (!pd->pkg)
+    case STATE_PACKAGE: {
+        gchar *raw = cr_xml_parser_take_raw(pd);
+
+        if (!pd->pkg) {
+            g_free(raw);
             return;
+        }
+
+        if (raw && pd->filelists_ext) {
+            g_free(pd->pkg->raw_filelists_ext);
+            pd->pkg->raw_filelists_ext = raw;
+        } else if (raw) {
+            g_free(pd->pkg->raw_filelists);
+            pd->pkg->raw_filelists = raw;
+        }
 
         // Reverse list of files
         pd->pkg->files = g_slist_reverse(pd->pkg->files);
@@ -277,10 +293,16 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
 
         pd->pkg = NULL;
         break;
+    }
 
     case STATE_FILE: {
         assert(pd->pkg);
 
+        if (cr_xml_parser_skip_content(pd)) {
+            g_clear_pointer(&pd->last_digest, g_free);
+            break;
+        }
+
         if (!pd->content)
             break;
 
@@ -367,7 +389,7 @@ cr_xml_parse_filelists_internal(const char *target,
                                 void *pkgcb_data,
                                 cr_XmlParserWarningCb warningcb,
                                 void *warningcb_data,
-                                int (*parser_func)(xmlParserCtxtPtr, cr_ParserData *, const char *, GError**),
+                                cr_XmlParserFunc parser_func,
                                 GError **err)
 {
     int ret = CRE_OK;
@@ -62,6 +62,19 @@ typedef struct {
     int             docontent;  /*!< Read text content of element? */
 } cr_StatesSwitch;
 
+/** Capture of raw package elements (<package>...</package>) exactly as
+ * they are written in the parsed file.
+ */
+typedef struct {
+    GString     *buf;           /*!< Data not yet captured */
+    gsize       scan_from;      /*!< Where to continue the search in buf */
+    gboolean    in_package;     /*!< Does buf start with a <package>? */
+    GQueue      *captured;      /*!< Complete elements (gchar *) which
+                                     weren't taken by the parser yet */
+    gboolean    skip_content;   /*!< Don't parse files and changelogs,
+                                     they are kept only in the raw elements */
+} cr_RawXmlCapture;
+
 /** Parser data
  */
 typedef struct _cr_ParserData {
@@ -131,6 +144,14 @@ typedef struct _cr_ParserData {
         Type of file in a currently parsed element */
     char *last_digest; /*!<
         Disgest of the current parsed element */
+    gboolean filelists_ext; /*!<
+        The parsed file is a filelists-ext.xml */
+
+    /* Raw xml related stuff */
+
+    cr_RawXmlCapture *raw; /*!<
+        If not NULL, the raw package elements are stored into the packages
+        (see cr_xml_parser_generic_raw()) */
 
     /* Other related stuff */
 
@@ -214,6 +235,31 @@ int cr_newpkgcb(cr_Package **pkg,
                 void *cbdata,
                 GError **err);
 
+/** Create a new capture of raw package elements.
+ */
+cr_RawXmlCapture *cr_raw_xml_capture_new(void);
+
+/** Free the capture of raw package elements.
+ */
+void cr_raw_xml_capture_free(cr_RawXmlCapture *raw);
+
+/** Feed the capture with the same data which are going to be passed
+ * to the xmlParseChunk().
+ */
+void cr_raw_xml_capture_feed(cr_RawXmlCapture *raw,
+                             const char *data,
+                             int len);
+
+/** Should the files and changelogs be skipped by the parser?
+ */
+#define cr_xml_parser_skip_content(pd) ((pd)->raw && (pd)->raw->skip_content)
+
+/** Take the raw element of the package which was just parsed.
+ * Must be called by the end handler of every package element.
+ * @return      Raw <package> element or NULL if raw capture is not used
+ */
+gchar *cr_xml_parser_take_raw(cr_ParserData *pd);
+
 /** Generic parser.
  */
 int
@@ -221,6 +267,34 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
                       cr_ParserData *pd,
                       const char *path,
                       GError **err);
+/** Generic parser which also keeps the raw package elements
+ * in the packages (cr_Package raw_* members).
+ */
+int
+cr_xml_parser_generic_raw(xmlParserCtxtPtr parser,
+                          cr_ParserData *pd,
+                          const char *path,
+                          GError **err);
+/** Generic parser which keeps the raw package elements like
+ * the cr_xml_parser_generic_raw(), but doesn't parse the files and
+ * changelogs. The packages don't get the CR_PACKAGE_LOADED_FIL and
+ * CR_PACKAGE_LOADED_OTH flags then, cr_xml_parse_raw_content() parses
+ * the files and changelogs from the raw elements when they are needed.
+ */
+int
+cr_xml_parser_generic_raw_only(xmlParserCtxtPtr parser,
+                               cr_ParserData *pd,
+                               const char *path,
+                               GError **err);
+/** Parse files and changelogs of a package loaded by
+ * the cr_xml_parser_generic_raw_only() from its raw elements.
+ * Content which is already loaded is left untouched.
+ * @param pkg       package, the strings are stored in its chunk
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int
+cr_xml_parse_raw_content(cr_Package *pkg, GError **err);
 int
 cr_xml_parser_generic_from_string(xmlParserCtxtPtr parser,
                                   cr_ParserData *pd,
@@ -252,6 +326,54 @@ other_parser_data_new(cr_XmlParserNewPkgCb newpkgcb,
                       cr_XmlParserWarningCb warningcb,
                       void *warningcb_data);
 
+typedef int (*cr_XmlParserFunc)(xmlParserCtxtPtr,
+                                cr_ParserData *,
+                                const char *,
+                                GError **);
+
+int
+cr_xml_parse_primary_internal(const char *target,
+                              cr_XmlParserNewPkgCb newpkgcb,
+                              void *newpkgcb_data,
+                              cr_XmlParserPkgCb pkgcb,
+                              void *pkgcb_data,
+                              cr_XmlParserWarningCb warningcb,
+                              void *warningcb_data,
+                              int do_files,
+                              cr_XmlParserFunc parser_func,
+                              GError **err);
+
+int
+cr_xml_parse_filelists_internal(const char *target,
+                                cr_XmlParserNewPkgCb newpkgcb,
+                                void *newpkgcb_data,
+                                cr_XmlParserPkgCb pkgcb,
+                                void *pkgcb_data,
+                                cr_XmlParserWarningCb warningcb,
+                                void *warningcb_data,
+                                cr_XmlParserFunc parser_func,
+                                GError **err);
+
+int
+cr_xml_parse_other_internal(const char *target,
+                            cr_XmlParserNewPkgCb newpkgcb,
+                            void *newpkgcb_data,
+                            cr_XmlParserPkgCb pkgcb,
+                            void *pkgcb_data,
+                            cr_XmlParserWarningCb warningcb,
+                            void *warningcb_data,
+                            cr_XmlParserFunc parser_func,
+                            GError **err);
+
+/** Keep the raw package elements in the packages returned by
+ * the iterator (cr_Package raw_* members).
+ * Must be called before the first cr_PkgIterator_parse_next().
+ * @param iter      iterator
+ * @param only      Keep the files and changelogs only in the raw elements
+ *                  (see cr_xml_parse_raw_content())?
+ */
+void cr_PkgIterator_keep_raw_xml(cr_PkgIterator *iter, gboolean only);
+
 /** Replace &#38; by real ampersand char from values in attr.
  * @param attr                   List of attributes
  * @param allocation_needed      Output bool whether returned attr has to be freed.
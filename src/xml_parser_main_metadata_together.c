@@ -300,6 +300,8 @@ parse_next_section(CR_FILE *target_file, const char *path, cr_ParserData *pd, GE
         return FALSE;
     }
     int done = parsed_len == 0;
+    if (pd->raw)
+        cr_raw_xml_capture_feed(pd->raw, buf, parsed_len);
     if (xmlParseChunk(pd->parser, buf, parsed_len, done)) {
         const xmlError *xml_err = xmlCtxtGetLastError(pd->parser);
         g_critical("%s: parsing error '%s': %s", __func__, path,
@@ -409,6 +411,22 @@ cr_PkgIterator_new(const char *primary_path,
     return new_iter;
 }
 
+void
+cr_PkgIterator_keep_raw_xml(cr_PkgIterator *iter, gboolean only)
+{
+    cr_ParserData *pds[] = { iter->primary_pd,
+                             iter->filelists_pd,
+                             iter->other_pd };
+
+    for (size_t x = 0; x < G_N_ELEMENTS(pds); x++) {
+        if (pds[x] && !pds[x]->raw)
+            pds[x]->raw = cr_raw_xml_capture_new();
+        // Files and changelogs are kept in the raw elements only
+        if (pds[x] && pds[x] != iter->primary_pd)
+            pds[x]->raw->skip_content = only;
+    }
+}
+
 cr_Package *
 cr_PkgIterator_parse_next(cr_PkgIterator *iter, GError **err) {
     cr_CbData *cbdata = (cr_CbData*) iter->cbdata;
@@ -439,7 +457,16 @@ cr_PkgIterator_parse_next(cr_PkgIterator *iter, GError **err) {
         }
     }
 
-    return g_queue_pop_head(cbdata->finished_pkgs_queue);
+    cr_Package *pkg = g_queue_pop_head(cbdata->finished_pkgs_queue);
+
+    // The flags marked the parsed parts, the skipped files and changelogs
+    // aren't loaded though (see cr_xml_parse_raw_content())
+    if (pkg && cr_xml_parser_skip_content((cr_ParserData *) iter->filelists_pd))
+        pkg->loadingflags &= ~CR_PACKAGE_LOADED_FIL;
+    if (pkg && cr_xml_parser_skip_content((cr_ParserData *) iter->other_pd))
+        pkg->loadingflags &= ~CR_PACKAGE_LOADED_OTH;
+
+    return pkg;
 }
 
 gboolean cr_PkgIterator_is_finished(cr_PkgIterator *iter) {
@@ -184,6 +184,9 @@ cr_start_handler(void *pdata, const xmlChar *element, const xmlChar **attr)
         assert(pd->pkg);
         assert(!pd->changelog);
 
+        if (cr_xml_parser_skip_content(pd))
+            break;
+
         cr_ChangelogEntry *changelog = cr_changelog_entry_new();
 
         val = cr_find_attr("author", attr);
@@ -242,9 +245,18 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
     case STATE_VERSION:
         break;
 
-    case STATE_PACKAGE:
-        if (!pd->pkg)
+    case STATE_PACKAGE: {
+        gchar *raw = cr_xml_parser_take_raw(pd);
+
+        if (!pd->pkg) {
+            g_free(raw);
             return;
+        }
+
+        if (raw) {
+            g_free(pd->pkg->raw_other);
+            pd->pkg->raw_other = raw;
+        }
 
         // Reverse list of changelogs
         pd->pkg->changelogs = g_slist_reverse(pd->pkg->changelogs);
@@ -265,9 +277,14 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
 
         pd->pkg = NULL;
         break;
+    }
 
     case STATE_CHANGELOG: {
         assert(pd->pkg);
+
+        if (cr_xml_parser_skip_content(pd))
+            break;
+
         assert(pd->changelog);
 
         if (!pd->content)
@@ -333,7 +350,7 @@ cr_xml_parse_other_internal(const char *target,
                             void *pkgcb_data,
                             cr_XmlParserWarningCb warningcb,
                             void *warningcb_data,
-                            int (*parser_func)(xmlParserCtxtPtr, cr_ParserData *, const char *, GError**),
+                            cr_XmlParserFunc parser_func,
                             GError **err)
 {
     int ret = CRE_OK;
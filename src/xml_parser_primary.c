@@ -479,9 +479,18 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
     case STATE_METADATA:
         break;
 
-    case STATE_PACKAGE:
-        if (!pd->pkg)
+    case STATE_PACKAGE: {
+        gchar *raw = cr_xml_parser_take_raw(pd);
+
+        if (!pd->pkg) {
+            g_free(raw);
             return;
+        }
+
+        if (raw) {
+            g_free(pd->pkg->raw_primary);
+            pd->pkg->raw_primary = raw;
+        }
 
         if (!pd->pkg->pkgId) {
             // Package without a pkgid attr is error
@@ -517,6 +526,7 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
 
         pd->pkg = NULL;
         break;
+    }
 
     case STATE_NAME:
         assert(pd->pkg);
@@ -717,7 +727,7 @@ cr_xml_parse_primary_internal(const char *target,
                               cr_XmlParserWarningCb warningcb,
                               void *warningcb_data,
                               int do_files,
-                              int (*parser_func)(xmlParserCtxtPtr, cr_ParserData *, const char *, GError**),
+                              cr_XmlParserFunc parser_func,
                               GError **err)
 {
     int ret = CRE_OK;
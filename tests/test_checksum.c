@@ -24,6 +24,8 @@
 #include <unistd.h>
 #include "fixtures.h"
 #include "createrepo/checksum.h"
+#include "createrepo/checksum_cache.h"
+#include "createrepo/misc.h"
 
 static void
 test_cr_checksum_file(void)
@@ -35,7 +37,7 @@ test_cr_checksum_file(void)
     checksum = cr_checksum_file(TEST_EMPTY_FILE, CR_CHECKSUM_MD5, NULL);
     g_assert_cmpstr(checksum, ==, "d41d8cd98f00b204e9800998ecf8427e");
     g_free(checksum);
-    checksum = cr_checksum_file(TEST_EMPTY_FILE, CR_CHECKSUM_SHA1, NULL);
+    checksum = cr_checksum_file(TEST_EMPTY_FILE, CR_CHECKSUM_SHA384, NULL);
     g_assert_cmpstr(checksum, ==, "da39a3ee5e6b4b0d3255bfef95601890afd80709");
     g_free(checksum);
 #endif
@@ -75,7 +77,7 @@ test_cr_checksum_file(void)
     checksum = cr_checksum_file(TEST_BINARY_FILE, CR_CHECKSUM_MD5, NULL);
     g_assert_cmpstr(checksum, ==, "4f8b033d7a402927a20c9328fc0e0f46");
     g_free(checksum);
-    checksum = cr_checksum_file(TEST_BINARY_FILE, CR_CHECKSUM_SHA1, NULL);
+    checksum = cr_checksum_file(TEST_BINARY_FILE, CR_CHECKSUM_SHA384, NULL);
     g_assert_cmpstr(checksum, ==, "3539fb660a41846352ac4fa9076d168a3c77070b");
     g_free(checksum);
 #endif
@@ -139,6 +141,105 @@ test_cr_checksum_name_str(void)
     g_assert_cmpstr(checksum_name, ==, NULL);
 }
 
+static void
+test_cr_checksum_cache(void)
+{
+    cr_ChecksumCache *cache;
+    struct stat st1, st2;
+    char *checksum;
+    GError *tmp_err = NULL;
+    gchar *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+    gchar *path = g_build_filename(tmp_dir, CR_CHECKSUM_CACHE_FILENAME, NULL);
+
+    g_assert(!stat(TEST_EMPTY_FILE, &st1));
+    g_assert(!stat(TEST_TEXT_FILE, &st2));
+
+    // Empty cache
+    cache = cr_checksum_cache_open(path, 0, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+    checksum = cr_checksum_cache_lookup(cache, &st1, CR_CHECKSUM_SHA256, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(!checksum);
+    cr_checksum_cache_store(cache, &st1, CR_CHECKSUM_SHA256, "hdrid1", "aaa");
+    g_assert(cr_checksum_cache_close(cache, &tmp_err));
+    g_assert(!tmp_err);
+
+    // Persistent entry, checked hdrid and checksum type
+    cache = cr_checksum_cache_open(path, 1, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+    checksum = cr_checksum_cache_lookup(cache, &st1, CR_CHECKSUM_SHA256, "hdrid1", &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksum, ==, "aaa");
+    g_free(checksum);
+    checksum = cr_checksum_cache_lookup(cache, &st1, CR_CHECKSUM_SHA256, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksum, ==, "aaa");
+    g_free(checksum);
+    checksum = cr_checksum_cache_lookup(cache, &st1, CR_CHECKSUM_SHA256, "hdrid2", &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(!checksum);
+    checksum = cr_checksum_cache_lookup(cache, &st1, CR_CHECKSUM_SHA512, "hdrid1", &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(!checksum);
+    checksum = cr_checksum_cache_lookup(cache, &st2, CR_CHECKSUM_SHA256, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(!checksum);
+    cr_checksum_cache_store(cache, &st2, CR_CHECKSUM_SHA256, NULL, "bbb");
+    // Limit is 1 entry - one of them is evicted
+    g_assert(cr_checksum_cache_close(cache, &tmp_err));
+    g_assert(!tmp_err);
+
+    cache = cr_checksum_cache_open(path, 0, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+    char *checksum1 = cr_checksum_cache_lookup(cache, &st1, CR_CHECKSUM_SHA256, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    char *checksum2 = cr_checksum_cache_lookup(cache, &st2, CR_CHECKSUM_SHA256, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert((checksum1 == NULL) != (checksum2 == NULL));
+    g_free(checksum1);
+    g_free(checksum2);
+    g_assert(cr_checksum_cache_close(cache, &tmp_err));
+    g_assert(!tmp_err);
+
+    // More entries than fit into a single batch, written while
+    // the cache is still used
+    cache = cr_checksum_cache_open(path, 0, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+    for (int x = 0; x < 3000; x++) {
+        gchar *value = g_strdup_printf("%d", x);
+        st2.st_ino = x + 1;
+        cr_checksum_cache_store(cache, &st2, CR_CHECKSUM_SHA384, NULL, value);
+        g_free(value);
+    }
+    st2.st_ino = 1;
+    checksum = cr_checksum_cache_lookup(cache, &st2, CR_CHECKSUM_SHA384, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksum, ==, "0");
+    g_free(checksum);
+    g_assert(cr_checksum_cache_close(cache, &tmp_err));
+    g_assert(!tmp_err);
+
+    cache = cr_checksum_cache_open(path, 0, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+    st2.st_ino = 3000;
+    checksum = cr_checksum_cache_lookup(cache, &st2, CR_CHECKSUM_SHA384, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksum, ==, "2999");
+    g_free(checksum);
+    g_assert(cr_checksum_cache_close(cache, &tmp_err));
+    g_assert(!tmp_err);
+
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(path);
+    g_free(tmp_dir);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -148,6 +249,8 @@ main(int argc, char *argv[])
             test_cr_checksum_file);
     g_test_add_func("/checksum/test_cr_checksum_name_str",
             test_cr_checksum_name_str);
+    g_test_add_func("/checksum/test_cr_checksum_cache",
+            test_cr_checksum_cache);
 
     return g_test_run();
 }
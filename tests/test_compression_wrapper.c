@@ -26,6 +26,7 @@
 #include "createrepo/error.h"
 #include "createrepo/misc.h"
 #include "createrepo/compression_wrapper.h"
+#include "createrepo/compression_wrapper_internal.h"
 
 #define TMP_FILE_PATTERN                        "test_XXXXXX"
 
@@ -858,6 +859,307 @@ test_contentstating_multiwrite(Outputtest *outputtest,
     g_assert(!tmp_err);
 }
 
+static void
+test_contentstating_threaded(Outputtest *outputtest,
+                             G_GNUC_UNUSED gconstpointer test_data)
+{
+    CR_FILE *f;
+    int ret;
+    cr_ContentStat *stat;
+    GError *tmp_err = NULL;
+    char buf[64];
+
+    const char *content = "sdlkjowykjnhsadyhfsoaf\nasoiuyseahlndsf\n";
+    const int content_len = 39;
+    const char *content_sha256 = "c9d112f052ab86270bfb484817a513d6ce188133ddc0"
+                                 "7c0fc1ac32018b6da6c7";
+    cr_CompressionType types[] = { CR_CW_XZ_COMPRESSION,
+                                   CR_CW_ZSTD_COMPRESSION,
+                                   CR_CW_GZ_COMPRESSION,
+                                   CR_CW_BZ2_COMPRESSION };
+
+    cr_set_compression_threads(4);
+    g_assert_cmpint(cr_get_compression_threads(), ==, 4);
+
+    for (size_t x = 0; x < sizeof(types)/sizeof(types[0]); x++) {
+        stat = cr_contentstat_new(CR_CHECKSUM_SHA256, &tmp_err);
+        g_assert(stat);
+        g_assert(!tmp_err);
+
+        f = cr_sopen(outputtest->tmp_filename,
+                     CR_CW_MODE_WRITE,
+                     types[x],
+                     stat,
+                     &tmp_err);
+        g_assert(f);
+        g_assert(!tmp_err);
+
+        ret = cr_write(f, content, 10, &tmp_err);
+        g_assert_cmpint(ret, ==, 10);
+        g_assert(!tmp_err);
+
+        ret = cr_write(f, content+10, 29, &tmp_err);
+        g_assert_cmpint(ret, ==, 29);
+        g_assert(!tmp_err);
+
+        cr_close(f, &tmp_err);
+        g_assert(!tmp_err);
+
+        g_assert_cmpint(stat->size, ==, content_len);
+        g_assert_cmpstr(stat->checksum, ==, content_sha256);
+        cr_contentstat_free(stat, &tmp_err);
+        g_assert(!tmp_err);
+
+        // Output of the threaded encoder is readable as usual
+        f = cr_open(outputtest->tmp_filename,
+                    CR_CW_MODE_READ,
+                    CR_CW_AUTO_DETECT_COMPRESSION,
+                    &tmp_err);
+        g_assert(f);
+        g_assert(!tmp_err);
+
+        ret = cr_read(f, buf, sizeof(buf), &tmp_err);
+        g_assert_cmpint(ret, ==, content_len);
+        g_assert(!tmp_err);
+        g_assert(!strncmp(buf, content, content_len));
+
+        cr_close(f, &tmp_err);
+        g_assert(!tmp_err);
+    }
+
+    cr_set_compression_threads(1);
+    g_assert_cmpint(cr_get_compression_threads(), ==, 0);
+}
+
+static void
+test_contentstating_compressed(Outputtest *outputtest,
+                               G_GNUC_UNUSED gconstpointer test_data)
+{
+    CR_FILE *f;
+    int ret;
+    cr_ContentStat *stat;
+    GError *tmp_err = NULL;
+    GStatBuf st;
+
+    const char *content = "sdlkjowykjnhsadyhfsoaf\nasoiuyseahlndsf\n";
+    const int content_len = 39;
+    cr_CompressionType types[] = { CR_CW_NO_COMPRESSION,
+                                   CR_CW_GZ_COMPRESSION,
+                                   CR_CW_BZ2_COMPRESSION,
+                                   CR_CW_XZ_COMPRESSION,
+                                   CR_CW_ZSTD_COMPRESSION };
+    int threads[] = { 0, 4 };
+
+    for (size_t t = 0; t < sizeof(threads)/sizeof(threads[0]); t++) {
+        cr_set_compression_threads(threads[t]);
+
+        for (size_t x = 0; x < sizeof(types)/sizeof(types[0]); x++) {
+            stat = cr_contentstat_new(CR_CHECKSUM_SHA256, &tmp_err);
+            g_assert(stat);
+            g_assert(!tmp_err);
+
+            f = cr_sopen(outputtest->tmp_filename,
+                         CR_CW_MODE_WRITE,
+                         types[x],
+                         stat,
+                         &tmp_err);
+            g_assert(f);
+            g_assert(!tmp_err);
+
+            ret = cr_write(f, content, content_len, &tmp_err);
+            g_assert_cmpint(ret, ==, content_len);
+            g_assert(!tmp_err);
+
+            cr_close(f, &tmp_err);
+            g_assert(!tmp_err);
+
+            // Stats of the compressed file match the file on the disk
+            gchar *checksum = cr_checksum_file(outputtest->tmp_filename,
+                                               CR_CHECKSUM_SHA256,
+                                               &tmp_err);
+            g_assert(checksum);
+            g_assert(!tmp_err);
+            gint64 compressed_size;
+            g_assert_cmpstr(cr_contentstat_get_compressed(stat,
+                                                          &compressed_size),
+                            ==, checksum);
+            g_assert_cmpint(g_stat(outputtest->tmp_filename, &st), ==, 0);
+            g_assert_cmpint(compressed_size, ==, st.st_size);
+            g_free(checksum);
+
+            cr_contentstat_free(stat, &tmp_err);
+            g_assert(!tmp_err);
+        }
+    }
+
+    cr_set_compression_threads(0);
+
+    // A cr_ContentStat allocated by the caller gets only the open stats
+    cr_ContentStat caller_stat = { .checksum_type = CR_CHECKSUM_SHA256 };
+    f = cr_sopen(outputtest->tmp_filename,
+                 CR_CW_MODE_WRITE,
+                 CR_CW_GZ_COMPRESSION,
+                 &caller_stat,
+                 &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+    ret = cr_write(f, content, content_len, &tmp_err);
+    g_assert_cmpint(ret, ==, content_len);
+    cr_close(f, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpint(caller_stat.size, ==, content_len);
+    g_assert(caller_stat.checksum);
+    g_assert(!cr_contentstat_get_compressed(&caller_stat, NULL));
+    g_free(caller_stat.checksum);
+}
+
+static void
+test_parallel_multiblock(Outputtest *outputtest,
+                         G_GNUC_UNUSED gconstpointer test_data)
+{
+    CR_FILE *f;
+    int ret;
+    GError *tmp_err = NULL;
+    // More than one block for both gz (1MiB) and bz2 (500kB) writers
+    const gsize content_len = 3*1024*1024 + 123;
+    gchar *content = g_malloc(content_len);
+    gchar *readed = g_malloc(content_len + 1);
+    cr_CompressionType types[] = { CR_CW_GZ_COMPRESSION,
+                                   CR_CW_BZ2_COMPRESSION };
+
+    for (gsize x = 0; x < content_len; x++)
+        content[x] = 'a' + (x * 7 + x / 1000) % 26;
+
+    cr_set_compression_threads(3);
+
+    for (size_t x = 0; x < sizeof(types)/sizeof(types[0]); x++) {
+        f = cr_open(outputtest->tmp_filename,
+                    CR_CW_MODE_WRITE,
+                    types[x],
+                    &tmp_err);
+        g_assert(f);
+        g_assert(!tmp_err);
+        g_assert(cr_file_priv(f)->parallel);
+
+        // Writes crossing the block boundaries
+        for (gsize off = 0; off < content_len; off += 100000) {
+            unsigned int len = MIN(100000, content_len - off);
+            ret = cr_write(f, content + off, len, &tmp_err);
+            g_assert_cmpint(ret, ==, len);
+            g_assert(!tmp_err);
+        }
+
+        cr_close(f, &tmp_err);
+        g_assert(!tmp_err);
+
+        // Read back the multi-member/multi-stream file
+        f = cr_open(outputtest->tmp_filename,
+                    CR_CW_MODE_READ,
+                    CR_CW_AUTO_DETECT_COMPRESSION,
+                    &tmp_err);
+        g_assert(f);
+        g_assert(!tmp_err);
+
+        gsize total = 0;
+        do {
+            ret = cr_read(f, readed + total, content_len + 1 - total, &tmp_err);
+            g_assert(!tmp_err);
+            g_assert_cmpint(ret, >=, 0);
+            total += ret;
+        } while (ret > 0 && total <= content_len);
+
+        g_assert_cmpint(total, ==, content_len);
+        g_assert(!memcmp(readed, content, content_len));
+
+        cr_close(f, &tmp_err);
+        g_assert(!tmp_err);
+    }
+
+    cr_set_compression_threads(0);
+    g_free(content);
+    g_free(readed);
+}
+
+static void
+test_read_ahead(Outputtest *outputtest,
+                G_GNUC_UNUSED gconstpointer test_data)
+{
+    CR_FILE *f;
+    int ret;
+    GError *tmp_err = NULL;
+    // More than a few read-ahead buffers
+    const gsize content_len = 5*1024*1024 + 321;
+    gchar *content = g_malloc(content_len);
+    gchar *readed = g_malloc(content_len + 1);
+    cr_CompressionType types[] = { CR_CW_GZ_COMPRESSION,
+                                   CR_CW_BZ2_COMPRESSION,
+                                   CR_CW_XZ_COMPRESSION,
+                                   CR_CW_ZSTD_COMPRESSION };
+
+    for (gsize x = 0; x < content_len; x++)
+        content[x] = 'a' + (x * 7 + x / 1000) % 26;
+
+    for (size_t x = 0; x < sizeof(types)/sizeof(types[0]); x++) {
+        f = cr_open(outputtest->tmp_filename,
+                    CR_CW_MODE_WRITE,
+                    types[x],
+                    &tmp_err);
+        g_assert(f);
+        g_assert(!tmp_err);
+        ret = cr_write(f, content, content_len, &tmp_err);
+        g_assert_cmpint(ret, ==, content_len);
+        g_assert(!tmp_err);
+        cr_close(f, &tmp_err);
+        g_assert(!tmp_err);
+
+        cr_set_decompression_threads(4);
+        f = cr_open(outputtest->tmp_filename,
+                    CR_CW_MODE_READ,
+                    CR_CW_AUTO_DETECT_COMPRESSION,
+                    &tmp_err);
+        cr_set_decompression_threads(0);
+        g_assert(f);
+        g_assert(!tmp_err);
+        g_assert(cr_file_priv(f)->read_ahead);
+
+        // Reads of an odd size crossing the read-ahead buffer boundaries
+        gsize total = 0;
+        do {
+            unsigned int len = MIN(77777, content_len + 1 - total);
+            ret = cr_read(f, readed + total, len, &tmp_err);
+            g_assert(!tmp_err);
+            g_assert_cmpint(ret, >=, 0);
+            total += ret;
+        } while (ret > 0 && total <= content_len);
+
+        g_assert_cmpint(total, ==, content_len);
+        g_assert(!memcmp(readed, content, content_len));
+
+        cr_close(f, &tmp_err);
+        g_assert(!tmp_err);
+    }
+
+    // Closing before the whole file was read, a single read-ahead thread
+    cr_set_decompression_threads(1);
+    f = cr_open(outputtest->tmp_filename,
+                CR_CW_MODE_READ,
+                CR_CW_AUTO_DETECT_COMPRESSION,
+                &tmp_err);
+    cr_set_decompression_threads(0);
+    g_assert(f);
+    g_assert(!tmp_err);
+    g_assert(cr_file_priv(f)->read_ahead);
+    ret = cr_read(f, readed, 100, &tmp_err);
+    g_assert_cmpint(ret, ==, 100);
+    g_assert(!tmp_err);
+    g_assert(!memcmp(readed, content, 100));
+    cr_close(f, &tmp_err);
+    g_assert(!tmp_err);
+
+    g_free(content);
+    g_free(readed);
+}
+
 static void
 test_cr_get_zchunk_with_index(void)
 {
@@ -927,6 +1229,18 @@ main(int argc, char *argv[])
     g_test_add("/compression_wrapper/test_contentstating_multiwrite",
             Outputtest, NULL, outputtest_setup,
             test_contentstating_multiwrite, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_contentstating_threaded",
+            Outputtest, NULL, outputtest_setup,
+            test_contentstating_threaded, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_contentstating_compressed",
+            Outputtest, NULL, outputtest_setup,
+            test_contentstating_compressed, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_parallel_multiblock",
+            Outputtest, NULL, outputtest_setup,
+            test_parallel_multiblock, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_read_ahead",
+            Outputtest, NULL, outputtest_setup,
+            test_read_ahead, outputtest_teardown);
     g_test_add_func("/compression_wrapper/test_cr_get_zchunk_with_index",
             test_cr_get_zchunk_with_index);
 
@@ -167,6 +167,49 @@ static void test_cr_metadata_locate_and_load_xml_detailed(void)
 }
 
 
+static void test_helper_check_files_and_changelogs(int use_single_chunk)
+{
+    int ret;
+    cr_Package *pkg;
+    cr_PackageFile *file;
+    cr_ChangelogEntry *changelog;
+    cr_Metadata *metadata;
+
+    metadata = cr_metadata_new(CR_HT_KEY_NAME, use_single_chunk, NULL);
+    g_assert(metadata);
+    ret = cr_metadata_locate_and_load_xml(metadata, TEST_REPO_01, NULL);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    pkg = (cr_Package *) g_hash_table_lookup(cr_metadata_hashtable(metadata),
+                                             "super_kernel");
+    g_assert(pkg);
+    g_assert(pkg->loadingflags & CR_PACKAGE_LOADED_FIL);
+    g_assert(pkg->loadingflags & CR_PACKAGE_LOADED_OTH);
+
+    g_assert_cmpint(g_slist_length(pkg->files), ==, 2);
+    file = pkg->files->data;
+    g_assert_cmpstr(file->path, ==, "/usr/bin/");
+    g_assert_cmpstr(file->name, ==, "super_kernel");
+    file = pkg->files->next->data;
+    g_assert_cmpstr(file->path, ==, "/usr/share/man/");
+    g_assert_cmpstr(file->name, ==, "super_kernel.8.gz");
+
+    g_assert_cmpint(g_slist_length(pkg->changelogs), ==, 2);
+    changelog = pkg->changelogs->next->data;
+    g_assert_cmpstr(changelog->author, ==, "Tomas Mlcoch <tmlcoch@redhat.com> - 6.0.1-2");
+    g_assert_cmpint(changelog->date, ==, 1334664001);
+    g_assert_cmpstr(changelog->changelog, ==, "- Second release");
+
+    cr_metadata_free(metadata);
+}
+
+
+static void test_cr_metadata_locate_and_load_xml_files_and_changelogs(void)
+{
+    test_helper_check_files_and_changelogs(0);
+    test_helper_check_files_and_changelogs(1);
+}
+
+
 #ifdef WITH_LIBMODULEMD
 static void test_cr_metadata_locate_and_load_modulemd(void)
 {
@@ -200,6 +243,7 @@ int main(int argc, char *argv[])
     g_test_add_func("/load_metadata/test_cr_metadata_new", test_cr_metadata_new);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml", test_cr_metadata_locate_and_load_xml);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml_detailed", test_cr_metadata_locate_and_load_xml_detailed);
+    g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml_files_and_changelogs", test_cr_metadata_locate_and_load_xml_files_and_changelogs);
 
 #ifdef WITH_LIBMODULEMD
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_modulemd", test_cr_metadata_locate_and_load_modulemd);
@@ -19,12 +19,14 @@
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include "fixtures.h"
 #include "createrepo/checksum.h"
 #include "createrepo/misc.h"
+#include "createrepo/package_internal.h"
 #include "createrepo/error.h"
 
 #define PACKAGE_01              TEST_PACKAGES_PATH"super_kernel-6.0.1-2.x86_64.rpm"
@@ -357,6 +359,98 @@ test_cr_get_header_byte_range(void)
 }
 
 
+static void
+test_cr_get_header_byte_range_fd(void)
+{
+    struct cr_HeaderRangeStruct hdr_range;
+    cr_ChecksumCtx *ctx;
+    GError *tmp_err = NULL;
+    int fd;
+
+    // Header range only
+    fd = open(PACKAGE_01, O_RDONLY);
+    g_assert_cmpint(fd, >=, 0);
+    hdr_range = cr_get_header_byte_range_fd(fd, PACKAGE_01, NULL, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpuint(hdr_range.start, ==, PACKAGE_01_HEADER_START);
+    g_assert_cmpuint(hdr_range.end, ==, PACKAGE_01_HEADER_END);
+    close(fd);
+
+    // Header range together with the checksum of the whole file
+    fd = open(PACKAGE_02, O_RDONLY);
+    g_assert_cmpint(fd, >=, 0);
+    ctx = cr_checksum_new(CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(ctx);
+    hdr_range = cr_get_header_byte_range_fd(fd, PACKAGE_02, ctx, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpuint(hdr_range.start, ==, PACKAGE_02_HEADER_START);
+    g_assert_cmpuint(hdr_range.end, ==, PACKAGE_02_HEADER_END);
+    close(fd);
+
+    char *checksum = cr_checksum_final(ctx, &tmp_err);
+    char *expected = cr_checksum_file(PACKAGE_02, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksum, ==, expected);
+    g_free(checksum);
+    g_free(expected);
+
+    // Not a package
+    fd = open(TEST_EMPTY_FILE, O_RDONLY);
+    g_assert_cmpint(fd, >=, 0);
+    hdr_range = cr_get_header_byte_range_fd(fd, TEST_EMPTY_FILE, NULL, &tmp_err);
+    g_assert(tmp_err);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+    g_assert_cmpuint(hdr_range.start, ==, 0);
+    g_assert_cmpuint(hdr_range.end, ==, 0);
+    close(fd);
+
+    // Signature header sizes out of limits
+    gchar *bogus_path = NULL;
+    unsigned char bogus[512];
+    memset(bogus, 0xff, sizeof(bogus));
+    fd = g_file_open_tmp("test_XXXXXX", &bogus_path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(write(fd, bogus, sizeof(bogus)), ==, sizeof(bogus));
+    g_assert_cmpint(lseek(fd, 0, SEEK_SET), ==, 0);
+    hdr_range = cr_get_header_byte_range_fd(fd, bogus_path, NULL, &tmp_err);
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_ERROR);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+    g_assert_cmpuint(hdr_range.start, ==, 0);
+    g_assert_cmpuint(hdr_range.end, ==, 0);
+    close(fd);
+    remove(bogus_path);
+    g_free(bogus_path);
+}
+
+
+static void
+test_cr_location_href_cmp(void)
+{
+    // Order of the tasks (sorted by filename, then by the directory path)
+    const char *hrefs[] = {
+        "a-b/w.rpm",
+        "x.rpm",
+        "a/x.rpm",
+        "a-b/x.rpm",
+        "a/b/x.rpm",
+        "a/b-c/x.rpm",
+        "b/x.rpm",
+    };
+    const size_t n = sizeof(hrefs) / sizeof(hrefs[0]);
+
+    for (size_t x = 0; x < n; x++) {
+        g_assert_cmpint(cr_location_href_cmp(hrefs[x], hrefs[x]), ==, 0);
+        for (size_t y = x + 1; y < n; y++) {
+            g_assert_cmpint(cr_location_href_cmp(hrefs[x], hrefs[y]), <, 0);
+            g_assert_cmpint(cr_location_href_cmp(hrefs[y], hrefs[x]), >, 0);
+        }
+    }
+}
+
+
 static void
 test_cr_get_filename(void)
 {
@@ -1255,6 +1349,51 @@ test_cr_cmp_evr(void)
 }
 
 
+static int
+cmp_evr_keys(const char *e1, const char *v1, const char *r1,
+             const char *e2, const char *v2, const char *r2)
+{
+    cr_EvrKey *key1 = cr_evr_key_new(e1, v1, r1);
+    cr_EvrKey *key2 = cr_evr_key_new(e2, v2, r2);
+    int res = cr_evr_key_cmp(key1, key2);
+    cr_evr_key_free(key1);
+    cr_evr_key_free(key2);
+    return res;
+}
+
+
+static void
+test_cr_evr_key_cmp(void)
+{
+    // The same cases as for cr_cmp_evr()
+    g_assert_cmpint(cmp_evr_keys(NULL, "2", "1", "0", "2", "1"), ==, 0);
+    g_assert_cmpint(cmp_evr_keys(NULL, "2", "2", "0", "2", "1"), ==, 1);
+    g_assert_cmpint(cmp_evr_keys("0", "2", "2", "1", "2", "1"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "22", "2", "0", "2", "2"), ==, 1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "13", "2", "0", "2", "2"), ==, 1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "55", "2", NULL, "55", "2"), ==, 0);
+    g_assert_cmpint(cmp_evr_keys(NULL, "0", "2a", "0", "0", "2b"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "0", "2", "0", NULL, "3"), ==, 1);
+
+    // Segments
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.010", "1", NULL, "1.10", "1"), ==, 0);
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.0", "1", NULL, "1_0", "1"), ==, 0);
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.a", "1", NULL, "1.1", "1"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "2.1", "1", NULL, "2.1.3", "1"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "6.3.2azb", "1", NULL, "6.3.2abc", "1"), ==, 1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.ab", "1", NULL, "1.abc", "1"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "12345678901234567890", "1",
+                                 NULL, "9999999999999999999", "1"), ==, 1);
+
+    // Tilde and caret
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.0~rc1", "1", NULL, "1.0", "1"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.0~rc1", "1", NULL, "1.0~rc2", "1"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.0^git1", "1", NULL, "1.0", "1"), ==, 1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.0^git1", "1", NULL, "1.0.1", "1"), ==, -1);
+    g_assert_cmpint(cmp_evr_keys(NULL, "1.0^", "1", NULL, "1.0~", "1"), ==, 1);
+}
+
+
 static void
 test_cr_cut_dirs(void)
 {
@@ -1320,6 +1459,10 @@ main(int argc, char *argv[])
             test_cr_is_primary);
     g_test_add_func("/misc/test_cr_get_header_byte_range",
             test_cr_get_header_byte_range);
+    g_test_add_func("/misc/test_cr_get_header_byte_range_fd",
+            test_cr_get_header_byte_range_fd);
+    g_test_add_func("/misc/test_cr_location_href_cmp",
+            test_cr_location_href_cmp);
     g_test_add_func("/misc/test_cr_get_filename",
             test_cr_get_filename);
     g_test_add("/misc/copyfiletest_test_empty_file",
@@ -1377,6 +1520,8 @@ main(int argc, char *argv[])
             test_cr_str_to_nevra);
     g_test_add_func("/misc/test_cr_cmp_evr",
             test_cr_cmp_evr);
+    g_test_add_func("/misc/test_cr_evr_key_cmp",
+            test_cr_evr_key_cmp);
     g_test_add_func("/misc/test_cr_cut_dirs",
             test_cr_cut_dirs);
 
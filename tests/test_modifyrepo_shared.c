@@ -20,8 +20,11 @@
 
 #include <glib/gstdio.h>
 #include "fixtures.h"
+#include "createrepo/error.h"
 #include "createrepo/misc.h"
 #include "createrepo/modifyrepo_shared.h"
+#include "createrepo/updateinfo.h"
+#include "createrepo/xml_parser.h"
 
 static void 
 copy_repo_TEST_REPO_00(const gchar *target_path, const gchar *tmp){
@@ -129,6 +132,151 @@ test_cr_write_file_with_gz_file(void)
     g_free(out);
 }
 
+static void
+test_cr_modifyrepo_merge_updateinfo(void)
+{
+    GError *tmp_err = NULL;
+    char *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+    gchar *out = g_build_filename(tmp_dir, "updateinfo.xml", NULL);
+
+    gboolean ret = cr_modifyrepo_merge_updateinfo(TEST_UPDATEINFO_03,
+                                                  TEST_UPDATEINFO_01,
+                                                  out, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(ret);
+
+    // New advisory is appended after the untouched ones
+    cr_UpdateInfo *ui = cr_updateinfo_new();
+    int rc = cr_xml_parse_updateinfo(out, ui, NULL, NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(rc, ==, CRE_OK);
+    g_assert_cmpint(g_slist_length(ui->updates), ==, 7);
+    cr_UpdateRecord *update = g_slist_nth_data(ui->updates, 1);
+    g_assert_cmpstr(update->id, ==, "RHEA-2012:0056");
+    update = g_slist_last(ui->updates)->data;
+    g_assert_cmpstr(update->id, ==, "foobarupdate_1");
+    cr_updateinfo_free(ui);
+
+    // Advisories with the same ids are replaced in place
+    ret = cr_modifyrepo_merge_updateinfo(TEST_UPDATEINFO_03,
+                                         TEST_UPDATEINFO_03,
+                                         out, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(ret);
+
+    gchar *expected = NULL, *merged = NULL;
+    g_assert(g_file_get_contents(TEST_UPDATEINFO_03, &expected, NULL, NULL));
+    g_assert(g_file_get_contents(out, &merged, NULL, NULL));
+    g_assert_cmpstr(merged, ==, expected);
+
+    g_free(expected);
+    g_free(merged);
+    g_assert(cr_remove_dir(tmp_dir, NULL) == CRE_OK);
+    g_free(out);
+    g_free(tmp_dir);
+}
+
+static cr_UpdateInfo *
+merge_updateinfo_strings(const gchar *tmp_dir,
+                         const gchar *old_xml,
+                         const gchar *new_xml)
+{
+    GError *tmp_err = NULL;
+    gchar *old_path = g_build_filename(tmp_dir, "old.xml", NULL);
+    gchar *new_path = g_build_filename(tmp_dir, "new.xml", NULL);
+    gchar *out = g_build_filename(tmp_dir, "updateinfo.xml", NULL);
+
+    g_assert(g_file_set_contents(old_path, old_xml, -1, NULL));
+    g_assert(g_file_set_contents(new_path, new_xml, -1, NULL));
+
+    gboolean ret = cr_modifyrepo_merge_updateinfo(old_path, new_path,
+                                                  out, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(ret);
+
+    cr_UpdateInfo *ui = cr_updateinfo_new();
+    int rc = cr_xml_parse_updateinfo(out, ui, NULL, NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(rc, ==, CRE_OK);
+
+    g_free(old_path);
+    g_free(new_path);
+    g_free(out);
+    return ui;
+}
+
+static void
+test_cr_modifyrepo_merge_updateinfo_escaped_id(void)
+{
+    char *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+
+    // The same ids written with entities, character references and CDATA
+    cr_UpdateInfo *ui = merge_updateinfo_strings(tmp_dir,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<updates>\n"
+        "  <update><id>FOO&amp;1</id><title>old 1</title></update>\n"
+        "  <update><id> <![CDATA[FOO<2>]]> </id><title>old 2</title></update>\n"
+        "  <update><id>FOO&#x2D;&#51;</id><title>old 3</title></update>\n"
+        "</updates>\n",
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<updates>\n"
+        "  <update><id><![CDATA[FOO&1]]></id><title>new 1</title></update>\n"
+        "  <update><id>FOO&lt;2&gt;</id><title>new 2</title></update>\n"
+        "  <update><id>FOO-3</id><title>new 3</title></update>\n"
+        "</updates>\n");
+
+    g_assert_cmpint(g_slist_length(ui->updates), ==, 3);
+    cr_UpdateRecord *update = g_slist_nth_data(ui->updates, 0);
+    g_assert_cmpstr(update->id, ==, "FOO&1");
+    g_assert_cmpstr(update->title, ==, "new 1");
+    update = g_slist_nth_data(ui->updates, 1);
+    g_assert_cmpstr(update->id, ==, "FOO<2>");
+    g_assert_cmpstr(update->title, ==, "new 2");
+    update = g_slist_nth_data(ui->updates, 2);
+    g_assert_cmpstr(update->id, ==, "FOO-3");
+    g_assert_cmpstr(update->title, ==, "new 3");
+    cr_updateinfo_free(ui);
+
+    g_assert(cr_remove_dir(tmp_dir, NULL) == CRE_OK);
+    g_free(tmp_dir);
+}
+
+static void
+test_cr_modifyrepo_merge_updateinfo_old_duplicates(void)
+{
+    char *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+
+    // Replaced advisory is present twice in the old file
+    g_test_expect_message("C_CREATEREPOLIB", G_LOG_LEVEL_WARNING,
+                          "Advisory \"FOO-1\" is present in * more than once*");
+    cr_UpdateInfo *ui = merge_updateinfo_strings(tmp_dir,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<updates>\n"
+        "  <update><id>FOO-1</id><title>old 1</title></update>\n"
+        "  <update><id>FOO-2</id><title>old 2</title></update>\n"
+        "  <update><id>FOO-1</id><title>old 1 again</title></update>\n"
+        "</updates>\n",
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<updates>\n"
+        "  <update><id>FOO-1</id><title>new 1</title></update>\n"
+        "</updates>\n");
+    g_test_assert_expected_messages();
+
+    g_assert_cmpint(g_slist_length(ui->updates), ==, 2);
+    cr_UpdateRecord *update = g_slist_nth_data(ui->updates, 0);
+    g_assert_cmpstr(update->id, ==, "FOO-1");
+    g_assert_cmpstr(update->title, ==, "new 1");
+    update = g_slist_nth_data(ui->updates, 1);
+    g_assert_cmpstr(update->id, ==, "FOO-2");
+    cr_updateinfo_free(ui);
+
+    g_assert(cr_remove_dir(tmp_dir, NULL) == CRE_OK);
+    g_free(tmp_dir);
+}
+
 int main(int argc, char *argv[])
 {
     g_test_init(&argc, &argv, NULL);
@@ -139,5 +287,9 @@ int main(int argc, char *argv[])
     g_test_add_func("/modifyrepo_shared/test_cr_write_file", test_cr_write_file);
     g_test_add_func("/modifyrepo_shared/test_cr_write_file_with_gz_file", test_cr_write_file_with_gz_file);
 
+    g_test_add_func("/modifyrepo_shared/test_cr_modifyrepo_merge_updateinfo", test_cr_modifyrepo_merge_updateinfo);
+    g_test_add_func("/modifyrepo_shared/test_cr_modifyrepo_merge_updateinfo_escaped_id", test_cr_modifyrepo_merge_updateinfo_escaped_id);
+    g_test_add_func("/modifyrepo_shared/test_cr_modifyrepo_merge_updateinfo_old_duplicates", test_cr_modifyrepo_merge_updateinfo_old_duplicates);
+
     return g_test_run();
 }
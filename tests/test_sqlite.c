@@ -21,9 +21,11 @@
 #include <glib/gstdio.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sqlite3.h>
 #include "fixtures.h"
+#include "createrepo/error.h"
 #include "createrepo/misc.h"
 #include "createrepo/package.h"
 #include "createrepo/sqlite.h"
@@ -244,6 +246,565 @@ test_all(TestData *testdata,
 
 
 
+static void
+test_cr_db_remove_pkg(TestData *testdata,
+                      G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *path;
+    cr_SqliteDb *db;
+    cr_Package *pkg, *pkg2;
+    GHashTable *pkgids;
+    GArray *pkgkeys;
+
+    // Create new db with two packages, one of them twice
+
+    path = g_strconcat(testdata->tmp_dir, "/", TMP_OTHER_NAME, NULL);
+    db = cr_db_open_other(path, &err);
+    g_assert(db);
+    g_assert(!err);
+
+    pkg = get_package();
+    pkg2 = get_empty_package();
+    pkg2->pkgId = "654321";
+
+    cr_db_add_pkg(db, pkg, &err);
+    g_assert(!err);
+    cr_db_add_pkg(db, pkg2, &err);
+    g_assert(!err);
+    cr_db_add_pkg(db, pkg, &err);
+    g_assert(!err);
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+
+    // Reopen the existing db and remove both rows of one package
+
+    db = cr_db_open_other(path, &err);
+    g_assert(db);
+    g_assert(!err);
+
+    pkgids = cr_db_pkgids(db, &err);
+    g_assert(pkgids);
+    g_assert(!err);
+    g_assert_cmpint(g_hash_table_size(pkgids), ==, 2);
+
+    pkgkeys = g_hash_table_lookup(pkgids, pkg->pkgId);
+    g_assert(pkgkeys);
+    g_assert_cmpint(pkgkeys->len, ==, 2);
+    for (guint i = 0; i < pkgkeys->len; i++) {
+        cr_db_remove_pkg(db, g_array_index(pkgkeys, gint64, i), &err);
+        g_assert(!err);
+    }
+    g_hash_table_destroy(pkgids);
+
+    cr_db_vacuum(db, 0.0, &err);
+    g_assert(!err);
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+
+    // Only the other package should remain
+
+    db = cr_db_open_other(path, &err);
+    g_assert(db);
+    g_assert(!err);
+
+    pkgids = cr_db_pkgids(db, &err);
+    g_assert(pkgids);
+    g_assert_cmpint(g_hash_table_size(pkgids), ==, 1);
+    g_assert(g_hash_table_contains(pkgids, pkg2->pkgId));
+    g_hash_table_destroy(pkgids);
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+
+    // Cleanup
+
+    cr_package_free(pkg);
+    cr_package_free(pkg2);
+    g_free(path);
+}
+
+
+static gint64
+db_count(cr_SqliteDb *db, const char *query, const char *pkgId)
+{
+    sqlite3_stmt *stmt = NULL;
+    gint64 count = -1;
+
+    g_assert_cmpint(sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL),
+                    ==, SQLITE_OK);
+    if (pkgId)
+        sqlite3_bind_text(stmt, 1, pkgId, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+
+/** Primary rows (without pkgKeys) of a db sorted, one row per line.
+ */
+static gchar *
+db_primary_rows(cr_SqliteDb *db)
+{
+    sqlite3_stmt *stmt = NULL;
+    GString *rows = g_string_new(NULL);
+
+    g_assert_cmpint(sqlite3_prepare_v2(db->db,
+            "SELECT pkgId, name, location_href, location_base, time_file, "
+            "size_package FROM packages ORDER BY pkgId, location_href",
+            -1, &stmt, NULL), ==, SQLITE_OK);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        for (int i = 0; i < 6; i++) {
+            const char *val = (const char *) sqlite3_column_text(stmt, i);
+            g_string_append_printf(rows, "%s|", val ? val : "NULL");
+        }
+        g_string_append_c(rows, '\n');
+    }
+    sqlite3_finalize(stmt);
+    return g_string_free(rows, FALSE);
+}
+
+
+/** Update the db the same way as sqliterepo_c --incremental does:
+ * keep unchanged rows, add the new packages and remove the rest.
+ */
+static void
+db_update_incremental(cr_SqliteDb *db, cr_Package **pkgs, int count)
+{
+    GError *err = NULL;
+    GHashTable *pkgids;
+    GHashTableIter iter;
+    gpointer value;
+
+    pkgids = cr_db_pkgids(db, &err);
+    g_assert(pkgids);
+    g_assert(!err);
+
+    for (int x = 0; x < count; x++) {
+        GArray *pkgkeys = g_hash_table_lookup(pkgids, pkgs[x]->pkgId);
+        gboolean found = FALSE;
+
+        for (guint i = 0; !found && pkgkeys && i < pkgkeys->len; i++) {
+            found = cr_db_pkg_unchanged(db, g_array_index(pkgkeys, gint64, i),
+                                        pkgs[x], &err);
+            g_assert(!err);
+            if (found)
+                g_array_remove_index_fast(pkgkeys, i);
+        }
+
+        if (!found) {
+            cr_db_add_pkg(db, pkgs[x], &err);
+            g_assert(!err);
+        }
+    }
+
+    g_hash_table_iter_init(&iter, pkgids);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        GArray *pkgkeys = value;
+        for (guint i = 0; i < pkgkeys->len; i++) {
+            cr_db_remove_pkg(db, g_array_index(pkgkeys, gint64, i), &err);
+            g_assert(!err);
+        }
+    }
+
+    g_hash_table_destroy(pkgids);
+}
+
+
+static void
+test_cr_db_update_moved_pkg(TestData *testdata,
+                            G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *path, *fresh_path;
+    gchar *rows, *fresh_rows;
+    cr_SqliteDb *db, *fresh_db;
+    cr_Package *old_pkgs[3], *new_pkgs[3];
+
+    for (int x = 0; x < 3; x++) {
+        old_pkgs[x] = get_package();
+        new_pkgs[x] = get_package();
+    }
+
+    // Old repo: foo.rpm, bar.rpm and baz.rpm
+    old_pkgs[1]->pkgId = new_pkgs[1]->pkgId = "654321";
+    old_pkgs[1]->location_href = new_pkgs[1]->location_href = "bar.rpm";
+    old_pkgs[2]->pkgId = "999999";
+    old_pkgs[2]->location_href = "baz.rpm";
+
+    // New repo: foo.rpm moved, bar.rpm unchanged, baz.rpm replaced
+    // by a second copy of bar.rpm
+    new_pkgs[0]->location_href = "sub/foo.rpm";
+    new_pkgs[0]->location_base = NULL;
+    new_pkgs[0]->time_file = 654321;
+    new_pkgs[2]->pkgId = "654321";
+    new_pkgs[2]->location_href = "sub/bar.rpm";
+
+    path = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME, NULL);
+    db = cr_db_open_primary(path, &err);
+    g_assert(!err);
+    for (int x = 0; x < 3; x++) {
+        cr_db_add_pkg(db, old_pkgs[x], &err);
+        g_assert(!err);
+    }
+    cr_db_close(db, &err);
+    g_assert(!err);
+
+    db = cr_db_open_primary(path, &err);
+    g_assert(!err);
+    db_update_incremental(db, new_pkgs, 3);
+
+    fresh_path = g_strconcat(testdata->tmp_dir, "/fresh_", TMP_PRIMARY_NAME,
+                             NULL);
+    fresh_db = cr_db_open_primary(fresh_path, &err);
+    g_assert(!err);
+    for (int x = 0; x < 3; x++) {
+        cr_db_add_pkg(fresh_db, new_pkgs[x], &err);
+        g_assert(!err);
+    }
+
+    // The updated db must be the same as the freshly generated one
+    rows = db_primary_rows(db);
+    fresh_rows = db_primary_rows(fresh_db);
+    g_assert_cmpstr(rows, ==, fresh_rows);
+    g_assert(strstr(rows, "|sub/foo.rpm|NULL|654321|"));
+    g_assert(!strstr(rows, "baz.rpm"));
+
+    // Orphaned dependency rows of the old packages are removed as well
+    g_assert_cmpint(db_count(db, "SELECT COUNT(*) FROM requires", NULL), ==,
+                    db_count(fresh_db, "SELECT COUNT(*) FROM requires", NULL));
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+    cr_db_close(fresh_db, &err);
+    g_assert(!err);
+
+    g_free(rows);
+    g_free(fresh_rows);
+    g_free(path);
+    g_free(fresh_path);
+    for (int x = 0; x < 3; x++) {
+        cr_package_free(old_pkgs[x]);
+        cr_package_free(new_pkgs[x]);
+    }
+}
+
+
+static cr_SqliteDb *
+open_db(TestData *testdata, const char *name, cr_DatabaseType type)
+{
+    GError *err = NULL;
+    gchar *path = g_strconcat(testdata->tmp_dir, "/", name, NULL);
+    cr_SqliteDb *db = cr_db_open(path, type, &err);
+    g_assert(db);
+    g_assert(!err);
+    g_free(path);
+    return db;
+}
+
+
+static void
+test_cr_db_add_pkg_from_old(TestData *testdata,
+                            G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    const char *names[3] = { "old_" TMP_PRIMARY_NAME,
+                             "old_" TMP_FILELISTS_NAME,
+                             "old_" TMP_OTHER_NAME };
+    cr_DatabaseType types[3] = { CR_DB_PRIMARY, CR_DB_FILELISTS,
+                                 CR_DB_OTHER };
+    cr_SqliteDb *dbs[3];
+    cr_Package *extra, *pkg, *new_pkg;
+    cr_ChangelogEntry *entry;
+
+    // Old dbs, the extra package shifts the old pkgKeys
+    extra = get_package();
+    extra->pkgId = "extra";
+    pkg = get_package();
+    entry = cr_changelog_entry_new();
+    entry->author = "Foo Bar <foo@bar.org>";
+    entry->date = 123456;
+    entry->changelog = "- Old changelog entry";
+    pkg->changelogs = g_slist_prepend(NULL, entry);
+
+    for (int x = 0; x < 3; x++) {
+        dbs[x] = open_db(testdata, names[x], types[x]);
+        cr_db_add_pkg(dbs[x], extra, &err);
+        g_assert(!err);
+        cr_db_add_pkg(dbs[x], pkg, &err);
+        g_assert(!err);
+        cr_db_close(dbs[x], &err);
+        g_assert(!err);
+    }
+
+    // New dbs with the same package at a new location but without any
+    // dependencies, files and changelogs, these come from the old dbs
+    g_slist_free_full(pkg->requires, g_free);
+    pkg->requires = NULL;
+    g_slist_free_full(pkg->files, g_free);
+    pkg->files = NULL;
+    g_slist_free_full(pkg->changelogs, g_free);
+    pkg->changelogs = NULL;
+    pkg->location_href = "sub/foo.rpm";
+    pkg->pkgKey = 0;
+    new_pkg = get_package();
+    new_pkg->pkgId = "new";
+
+    for (int x = 0; x < 3; x++) {
+        gchar *old_path = g_strconcat(testdata->tmp_dir, "/", names[x], NULL);
+        dbs[x] = open_db(testdata, names[x] + 4, types[x]);
+        cr_db_attach_old(dbs[x], old_path, &err);
+        g_assert(!err);
+        g_assert(dbs[x]->old);
+        g_free(old_path);
+
+        cr_db_add_pkg_from_old(dbs[x], pkg, &err);
+        g_assert(!err);
+        cr_db_add_pkg_from_old(dbs[x], new_pkg, &err);
+        g_assert(!err);
+    }
+
+    // New pkgKey mapping, the old pkgKey was 2
+    g_assert_cmpint(pkg->pkgKey, ==, 1);
+    g_assert_cmpint(db_count(dbs[0], "SELECT pkgKey FROM packages "
+                                     "WHERE pkgId = ?", pkg->pkgId), ==, 1);
+    g_assert_cmpint(db_count(dbs[1], "SELECT pkgKey FROM packages "
+                                     "WHERE pkgId = ?", pkg->pkgId), ==, 1);
+    g_assert_cmpint(db_count(dbs[2], "SELECT pkgKey FROM packages "
+                                     "WHERE pkgId = ?", pkg->pkgId), ==, 1);
+
+    // Package record is written from the pkg
+    g_assert_cmpint(db_count(dbs[0], "SELECT COUNT(*) FROM packages "
+                                     "WHERE location_href = 'sub/foo.rpm' "
+                                     "AND pkgId = ?", pkg->pkgId), ==, 1);
+
+    // Rows copied from the old dbs
+    g_assert_cmpint(db_count(dbs[0],
+            "SELECT COUNT(*) FROM requires JOIN packages "
+            "USING (pkgKey) WHERE pkgId = ?", pkg->pkgId), ==, 2);
+    g_assert_cmpint(db_count(dbs[0],
+            "SELECT COUNT(*) FROM requires JOIN packages USING (pkgKey) "
+            "WHERE requires.name = 'foobar_pre_dep' AND pre = 'TRUE' "
+            "AND pkgId = ?", pkg->pkgId), ==, 1);
+    g_assert_cmpint(db_count(dbs[0],
+            "SELECT COUNT(*) FROM files JOIN packages "
+            "USING (pkgKey) WHERE pkgId = ?", pkg->pkgId), ==, 1);
+    g_assert_cmpint(db_count(dbs[1],
+            "SELECT COUNT(*) FROM filelist JOIN packages "
+            "USING (pkgKey) WHERE pkgId = ?", pkg->pkgId), ==, 2);
+    g_assert_cmpint(db_count(dbs[2],
+            "SELECT COUNT(*) FROM changelog JOIN packages USING (pkgKey) "
+            "WHERE changelog = '- Old changelog entry' AND pkgId = ?",
+            pkg->pkgId), ==, 1);
+
+    // Package not present in the old dbs is inserted row by row
+    g_assert_cmpint(new_pkg->pkgKey, ==, 2);
+    g_assert_cmpint(db_count(dbs[0],
+            "SELECT COUNT(*) FROM requires JOIN packages "
+            "USING (pkgKey) WHERE pkgId = ?", "new"), ==, 2);
+    g_assert_cmpint(db_count(dbs[1],
+            "SELECT COUNT(*) FROM filelist JOIN packages "
+            "USING (pkgKey) WHERE pkgId = ?", "new"), ==, 2);
+    g_assert_cmpint(db_count(dbs[2], "SELECT COUNT(*) FROM changelog", NULL),
+                    ==, 1);
+
+    for (int x = 0; x < 3; x++) {
+        cr_db_close(dbs[x], &err);
+        g_assert(!err);
+    }
+
+    cr_package_free(extra);
+    cr_package_free(pkg);
+    cr_package_free(new_pkg);
+}
+
+
+static void
+test_cr_db_attach_old_bad(TestData *testdata,
+                          G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *path;
+    cr_SqliteDb *db, *other_db;
+    cr_Package *pkg;
+
+    // Old db of another type
+    other_db = open_db(testdata, "old_" TMP_OTHER_NAME, CR_DB_OTHER);
+    pkg = get_package();
+    cr_db_add_pkg(other_db, pkg, &err);
+    g_assert(!err);
+    cr_db_close(other_db, &err);
+    g_assert(!err);
+
+    db = open_db(testdata, TMP_PRIMARY_NAME, CR_DB_PRIMARY);
+
+    // Missing old db is not created by the attempt
+    path = g_strconcat(testdata->tmp_dir, "/missing.sqlite", NULL);
+    g_assert_cmpint(cr_db_attach_old(db, path, &err), ==, CRE_NOFILE);
+    g_assert_error(err, CREATEREPO_C_ERROR, CRE_NOFILE);
+    g_clear_error(&err);
+    g_assert(!db->old);
+    g_assert(!g_file_test(path, G_FILE_TEST_EXISTS));
+    g_free(path);
+
+    path = g_strconcat(testdata->tmp_dir, "/old_", TMP_OTHER_NAME, NULL);
+    g_assert_cmpint(cr_db_attach_old(db, path, &err), ==, CRE_DB);
+    g_assert_error(err, CREATEREPO_C_ERROR, CRE_DB);
+    g_clear_error(&err);
+    g_assert(!db->old);
+
+    // Nothing is attached, the package is inserted row by row
+    cr_db_add_pkg_from_old(db, pkg, &err);
+    g_assert(!err);
+    g_assert_cmpint(db_count(db,
+            "SELECT COUNT(*) FROM requires JOIN packages "
+            "USING (pkgKey) WHERE pkgId = ?", pkg->pkgId), ==, 2);
+
+    // The failed attempt left no old db attached
+    other_db = open_db(testdata, "old_" TMP_PRIMARY_NAME, CR_DB_PRIMARY);
+    cr_db_close(other_db, &err);
+    g_assert(!err);
+    g_free(path);
+    path = g_strconcat(testdata->tmp_dir, "/old_", TMP_PRIMARY_NAME, NULL);
+    cr_db_attach_old(db, path, &err);
+    g_assert(!err);
+    g_assert(db->old);
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+
+    cr_package_free(pkg);
+    g_free(path);
+}
+
+
+#define WRITER_PKGS     50
+
+typedef struct {
+    cr_SqliteDb *db;
+    cr_Package **pkgs;
+} WriterData;
+
+
+static gpointer
+db_writer_thread(gpointer data)
+{
+    WriterData *writer = data;
+    GError *err = NULL;
+
+    for (int x = 0; x < WRITER_PKGS; x++) {
+        cr_db_add_pkg(writer->db, writer->pkgs[x], &err);
+        g_assert(!err);
+    }
+
+    return NULL;
+}
+
+
+static void
+test_cr_db_add_pkg_writer_threads(TestData *testdata,
+                                  G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    cr_SqliteDb *dbs[3];
+    GThread *threads[3];
+    WriterData writers[3];
+    cr_Package *pkgs[WRITER_PKGS];
+    cr_Package *extra;
+    gchar *path;
+
+    path = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME, NULL);
+    dbs[0] = cr_db_open_primary(path, &err);
+    g_assert(!err);
+    g_free(path);
+    path = g_strconcat(testdata->tmp_dir, "/", TMP_FILELISTS_NAME, NULL);
+    dbs[1] = cr_db_open_filelists(path, &err);
+    g_assert(!err);
+    g_free(path);
+    path = g_strconcat(testdata->tmp_dir, "/", TMP_OTHER_NAME, NULL);
+    dbs[2] = cr_db_open_other(path, &err);
+    g_assert(!err);
+    g_free(path);
+
+    // By default the filelists and other dbs store their pkgKey as well,
+    // the extra package also shifts their pkgKeys against the primary
+    extra = get_package();
+    extra->pkgId = "extra";
+    cr_db_add_pkg(dbs[1], extra, &err);
+    g_assert(!err);
+    g_assert_cmpint(extra->pkgKey, ==,
+                    db_count(dbs[1], "SELECT pkgKey FROM packages "
+                                     "WHERE pkgId = ?", "extra"));
+    extra->pkgKey = 0;
+    cr_db_add_pkg(dbs[2], extra, &err);
+    g_assert(!err);
+    g_assert_cmpint(extra->pkgKey, ==, 1);
+
+    for (int x = 0; x < WRITER_PKGS; x++) {
+        cr_ChangelogEntry *entry = cr_changelog_entry_new();
+        gchar pkgId[32];
+        g_snprintf(pkgId, sizeof(pkgId), "pkgid%d", x);
+        pkgs[x] = get_package();
+        pkgs[x]->pkgId = g_string_chunk_insert(pkgs[x]->chunk, pkgId);
+        entry->author = "Foo Bar <foo@bar.org>";
+        entry->date = 123456 + x;
+        entry->changelog = "- Changelog entry";
+        pkgs[x]->changelogs = g_slist_prepend(NULL, entry);
+    }
+
+    // Every db gets the same packages from its own thread, as from
+    // the sqlite writers of createrepo_c
+    cr_db_set_store_pkgkey(dbs[1], FALSE);
+    cr_db_set_store_pkgkey(dbs[2], FALSE);
+    for (int x = 0; x < 3; x++) {
+        writers[x].db = dbs[x];
+        writers[x].pkgs = pkgs;
+        threads[x] = g_thread_new(NULL, db_writer_thread, &writers[x]);
+    }
+    for (int x = 0; x < 3; x++)
+        g_thread_join(threads[x]);
+
+    for (int x = 0; x < WRITER_PKGS; x++) {
+        const char *pkgId = pkgs[x]->pkgId;
+
+        // pkgKey of the primary db
+        g_assert_cmpint(pkgs[x]->pkgKey, ==,
+                        db_count(dbs[0], "SELECT pkgKey FROM packages "
+                                         "WHERE pkgId = ?", pkgId));
+        g_assert_cmpint(db_count(dbs[0],
+                "SELECT COUNT(*) FROM requires JOIN packages "
+                "USING (pkgKey) WHERE pkgId = ?", pkgId), ==, 2);
+        g_assert_cmpint(db_count(dbs[0],
+                "SELECT COUNT(*) FROM files JOIN packages "
+                "USING (pkgKey) WHERE pkgId = ?", pkgId), ==, 1);
+        g_assert_cmpint(db_count(dbs[1],
+                "SELECT COUNT(*) FROM filelist JOIN packages "
+                "USING (pkgKey) WHERE pkgId = ?", pkgId), ==, 2);
+        g_assert_cmpint(db_count(dbs[2],
+                "SELECT COUNT(*) FROM changelog JOIN packages "
+                "USING (pkgKey) WHERE pkgId = ?", pkgId), ==, 1);
+    }
+
+    g_assert_cmpint(db_count(dbs[0], "SELECT COUNT(*) FROM packages", NULL),
+                    ==, WRITER_PKGS);
+    g_assert_cmpint(db_count(dbs[1], "SELECT COUNT(*) FROM packages", NULL),
+                    ==, WRITER_PKGS + 1);
+    g_assert_cmpint(db_count(dbs[2], "SELECT COUNT(*) FROM changelog", NULL),
+                    ==, WRITER_PKGS);
+
+    for (int x = 0; x < 3; x++) {
+        cr_db_close(dbs[x], &err);
+        g_assert(!err);
+    }
+    for (int x = 0; x < WRITER_PKGS; x++)
+        cr_package_free(pkgs[x]);
+    cr_package_free(extra);
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -253,6 +814,11 @@ main(int argc, char *argv[])
     g_test_add("/sqlite/test_cr_db_add_primary_pkg", TestData, NULL, testdata_setup, test_cr_db_add_primary_pkg, testdata_teardown);
     g_test_add("/sqlite/test_cr_db_dbinfo_update", TestData, NULL, testdata_setup, test_cr_db_dbinfo_update, testdata_teardown);
     g_test_add("/sqlite/test_all", TestData, NULL, testdata_setup, test_all, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_remove_pkg", TestData, NULL, testdata_setup, test_cr_db_remove_pkg, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_update_moved_pkg", TestData, NULL, testdata_setup, test_cr_db_update_moved_pkg, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_add_pkg_from_old", TestData, NULL, testdata_setup, test_cr_db_add_pkg_from_old, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_attach_old_bad", TestData, NULL, testdata_setup, test_cr_db_attach_old_bad, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_add_pkg_writer_threads", TestData, NULL, testdata_setup, test_cr_db_add_pkg_writer_threads, testdata_teardown);
 
     return g_test_run();
 }
@@ -2,11 +2,13 @@
 #include <glib.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "fixtures.h"
 #include "createrepo/error.h"
 #include "createrepo/package_internal.h"
 #include "createrepo/misc.h"
 #include "createrepo/xml_dump.h"
+#include "createrepo/xml_dump_internal.h"
 
 // Tests
 
@@ -100,6 +102,91 @@ test_cr_GSList_of_cr_Dependency_contains_forbidden_control_chars_02(void)
     cr_package_free(p);
 }
 
+static void
+test_cr_xml_scan_00(void)
+{
+    // Every kernel has to stop at the same byte as the scalar one
+    const char specials[] = "<>&\"\t\n\r\x01\x1f\x7f\x80\xc3\xff";
+    char str[80];
+
+    for (size_t len = 0; len < sizeof(str) - 1; len++) {
+        for (size_t pos = 0; pos <= len; pos++) {
+            for (size_t s = 0; s < sizeof(specials) - 1; s++) {
+                memset(str, 'a', len);
+                str[len] = '\0';
+                if (pos < len)
+                    str[pos] = specials[s];
+
+                cr_xml_scan_set_impl(CR_XML_SCAN_SCALAR);
+                size_t text = cr_xml_scan_text(str, len);
+                size_t attr = cr_xml_scan_attr(str, len);
+                size_t ctrl = cr_xml_scan_ctrl(str, len);
+
+                for (int impl = CR_XML_SCAN_SSE42; impl < CR_XML_SCAN_SENTINEL; impl++) {
+                    if (!cr_xml_scan_set_impl(impl))
+                        continue;
+                    g_assert_cmpuint(cr_xml_scan_text(str, len), ==, text);
+                    g_assert_cmpuint(cr_xml_scan_attr(str, len), ==, attr);
+                    g_assert_cmpuint(cr_xml_scan_ctrl(str, len), ==, ctrl);
+                }
+            }
+        }
+    }
+
+    g_assert_cmpuint(cr_xml_scan_text("ab<c", 4), ==, 2);
+    g_assert_cmpuint(cr_xml_scan_text("ab\"\tc", 5), ==, 5);
+    g_assert_cmpuint(cr_xml_scan_attr("ab\"\tc", 5), ==, 2);
+    g_assert_cmpuint(cr_xml_scan_ctrl("a\t\n\rb\x02", 6), ==, 5);
+
+    cr_xml_scan_set_impl(CR_XML_SCAN_AUTO);
+}
+
+static void
+test_cr_hascontrollchars_00(void)
+{
+    for (int impl = CR_XML_SCAN_SCALAR; impl < CR_XML_SCAN_SENTINEL; impl++) {
+        if (!cr_xml_scan_set_impl(impl))
+            continue;
+        g_assert(!cr_hascontrollchars((unsigned char *) ""));
+        g_assert(!cr_hascontrollchars((unsigned char *) "a long line of text with\ttabs\r\nand newlines"));
+        g_assert(cr_hascontrollchars((unsigned char *) "a long line of text with a bell\a somewhere"));
+        g_assert(cr_hascontrollchars((unsigned char *) "\x1b"));
+    }
+    cr_xml_scan_set_impl(CR_XML_SCAN_AUTO);
+}
+
+static void
+test_cr_xml_scan_perf(void)
+{
+    // Microbenchmark of the kernels, run by: test_xml_dump -m perf
+    const gsize len = 16 * 1024 * 1024;
+    gchar *str = g_malloc(len + 1);
+
+    for (gsize i = 0; i < len; i++)
+        str[i] = 'a' + i % 26;
+    str[len] = '\0';
+
+    for (int impl = CR_XML_SCAN_SCALAR; impl < CR_XML_SCAN_SENTINEL; impl++) {
+        if (!cr_xml_scan_set_impl(impl))
+            continue;
+
+        GTimer *timer = g_timer_new();
+        for (int i = 0; i < 10; i++) {
+            g_assert_cmpuint(cr_xml_scan_attr(str, len), ==, len);
+            g_assert_cmpuint(cr_xml_scan_ctrl(str, len), ==, len);
+        }
+        gdouble elapsed = g_timer_elapsed(timer, NULL);
+        g_timer_destroy(timer);
+
+        g_test_minimized_result(elapsed, "%s kernels: %.0f MB/s",
+                                cr_xml_scan_impl_name(impl),
+                                20.0 * len / elapsed / (1024 * 1024));
+    }
+
+    cr_xml_scan_set_impl(CR_XML_SCAN_AUTO);
+    g_free(str);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -124,5 +211,12 @@ main(int argc, char *argv[])
                     test_cr_GSList_of_cr_Dependency_contains_forbidden_control_chars_01);
     g_test_add_func("/xml_dump/test_cr_GSList_of_cr_Dependency_contains_forbidden_control_chars_02",
                     test_cr_GSList_of_cr_Dependency_contains_forbidden_control_chars_02);
+    g_test_add_func("/xml_dump/test_cr_xml_scan_00",
+                    test_cr_xml_scan_00);
+    g_test_add_func("/xml_dump/test_cr_hascontrollchars_00",
+                    test_cr_hascontrollchars_00);
+    if (g_test_perf())
+        g_test_add_func("/xml_dump/test_cr_xml_scan_perf",
+                        test_cr_xml_scan_perf);
     return g_test_run();
 }
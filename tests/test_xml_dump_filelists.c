@@ -0,0 +1,128 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/xml_dump_filelists.c"
+
+static cr_Package *
+get_package_with_files()
+{
+    cr_Package *pkg = get_package();
+    cr_PackageFile *file;
+
+    pkg->files_checksum_type = "sha256";
+
+    file = cr_package_file_new();
+    file->type = "";
+    file->path = "/usr/share/doc/\"foo\"&<bar>/";
+    file->name = "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80";
+    file->digest = "0123456789abcdef";
+    pkg->files = g_slist_append(pkg->files, file);
+
+    file = cr_package_file_new();
+    file->type = "ghost";
+    file->path = "/var/lib/foo\r\n/";
+    file->name = "tab\tbed\x7f";
+    file->digest = "";
+    pkg->files = g_slist_append(pkg->files, file);
+
+    file = cr_package_file_new();
+    file->type = "dir<\"&\">";
+    file->path = "/opt/";
+    file->name = "latin1 caf\xe9";
+    file->digest = "a\tb\n\"c\"";
+    pkg->files = g_slist_append(pkg->files, file);
+
+    file = cr_package_file_new();
+    file->type = "file";
+    file->path = "/etc/";
+    file->name = "J\xc3\xb6rg's > file";
+    file->digest = "caf\xc3\xa9";
+    pkg->files = g_slist_append(pkg->files, file);
+
+    return pkg;
+}
+
+/** Dump the package through the libxml2 tree as the dumper used to do */
+static char *
+dump_filelists_by_tree(cr_Package *pkg, gboolean filelists_ext)
+{
+    xmlNodePtr node = xmlNewNode(NULL, BAD_CAST "package");
+    xmlBufferPtr buf = xmlBufferCreate();
+
+    cr_xml_dump_filelists_items(node, pkg, filelists_ext);
+    xmlNodeDump(buf, NULL, node, 0,
+                cr_xml_dump_get_parameter(CR_XML_DUMP_DO_PRETTY_PRINT));
+    char *result = g_strconcat((char *) buf->content, "\n", NULL);
+
+    xmlBufferFree(buf);
+    xmlFreeNode(node);
+    return result;
+}
+
+static void
+cmp_filelists_with_tree_dump(cr_Package *pkg)
+{
+    for (int pretty = 0; pretty < 2; pretty++) {
+        GError *tmp_err = NULL;
+        cr_xml_dump_set_parameter(CR_XML_DUMP_DO_PRETTY_PRINT, pretty);
+
+        char *expected = dump_filelists_by_tree(pkg, FALSE);
+        char *dumped = cr_xml_dump_filelists(pkg, &tmp_err);
+        g_assert(!tmp_err);
+        g_assert_cmpstr(dumped, ==, expected);
+        g_free(expected);
+        g_free(dumped);
+
+        expected = dump_filelists_by_tree(pkg, TRUE);
+        dumped = cr_xml_dump_filelists_ext(pkg, &tmp_err);
+        g_assert(!tmp_err);
+        g_assert_cmpstr(dumped, ==, expected);
+        g_free(expected);
+        g_free(dumped);
+    }
+    cr_xml_dump_set_parameter(CR_XML_DUMP_DO_PRETTY_PRINT, TRUE);
+}
+
+// Tests
+
+static void
+test_cr_xml_dump_filelists_00(void)
+{
+    cr_Package *pkg = get_package();
+    cmp_filelists_with_tree_dump(pkg);
+    cr_package_free(pkg);
+
+    pkg = get_empty_package();
+    cmp_filelists_with_tree_dump(pkg);
+    cr_package_free(pkg);
+}
+
+static void
+test_cr_xml_dump_filelists_01(void)
+{
+    cr_Package *pkg = get_package_with_files();
+
+    pkg->pkgId = "12<34>&\"56\"";
+    pkg->name = "caf\xc3\xa9\t\r\nfoo";
+    pkg->arch = "latin1 caf\xe9";
+    pkg->version = "1.2\x7f";
+    pkg->release = "2 \xf0\x9f\x98\x80";
+
+    cmp_filelists_with_tree_dump(pkg);
+    cr_package_free(pkg);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/xml_dump_filelists/test_cr_xml_dump_filelists_00",
+                    test_cr_xml_dump_filelists_00);
+    g_test_add_func("/xml_dump_filelists/test_cr_xml_dump_filelists_01",
+                    test_cr_xml_dump_filelists_01);
+    return g_test_run();
+}
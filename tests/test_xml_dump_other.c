@@ -0,0 +1,108 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/xml_dump_other.c"
+
+static void
+add_changelog(cr_Package *pkg, char *author, gint64 date, char *text)
+{
+    cr_ChangelogEntry *entry = cr_changelog_entry_new();
+    entry->author = author;
+    entry->date = date;
+    entry->changelog = text;
+    pkg->changelogs = g_slist_append(pkg->changelogs, entry);
+}
+
+/** Dump the package through the libxml2 tree as the dumper used to do */
+static char *
+dump_other_by_tree(cr_Package *pkg)
+{
+    xmlNodePtr node = xmlNewNode(NULL, BAD_CAST "package");
+    xmlBufferPtr buf = xmlBufferCreate();
+
+    cr_xml_dump_other_items(node, pkg);
+    xmlNodeDump(buf, NULL, node, 0,
+                cr_xml_dump_get_parameter(CR_XML_DUMP_DO_PRETTY_PRINT));
+    char *result = g_strconcat((char *) buf->content, "\n", NULL);
+
+    xmlBufferFree(buf);
+    xmlFreeNode(node);
+    return result;
+}
+
+static void
+cmp_other_with_tree_dump(cr_Package *pkg)
+{
+    for (int pretty = 0; pretty < 2; pretty++) {
+        GError *tmp_err = NULL;
+        cr_xml_dump_set_parameter(CR_XML_DUMP_DO_PRETTY_PRINT, pretty);
+
+        char *expected = dump_other_by_tree(pkg);
+        char *dumped = cr_xml_dump_other(pkg, &tmp_err);
+        g_assert(!tmp_err);
+        g_assert_cmpstr(dumped, ==, expected);
+
+        g_free(expected);
+        g_free(dumped);
+    }
+    cr_xml_dump_set_parameter(CR_XML_DUMP_DO_PRETTY_PRINT, TRUE);
+}
+
+// Tests
+
+static void
+test_cr_xml_dump_other_00(void)
+{
+    cr_Package *pkg = get_package();
+    cmp_other_with_tree_dump(pkg);
+
+    add_changelog(pkg, "Foo Bar <foo@bar.org> - 1.2.3-2", 1234567890,
+                  "- Initial package");
+    cmp_other_with_tree_dump(pkg);
+    cr_package_free(pkg);
+
+    pkg = get_empty_package();
+    cmp_other_with_tree_dump(pkg);
+
+    add_changelog(pkg, NULL, 0, NULL);
+    cmp_other_with_tree_dump(pkg);
+    cr_package_free(pkg);
+}
+
+static void
+test_cr_xml_dump_other_01(void)
+{
+    cr_Package *pkg = get_package();
+
+    pkg->pkgId = "12<34>&\"56\"";
+    pkg->name = "caf\xc3\xa9\t\r\nfoo";
+    pkg->arch = "latin1 caf\xe9";
+    pkg->epoch = "1<2>&\"3\"";
+    pkg->version = "1.2\t\x7f";
+    pkg->release = "2 \xf0\x9f\x98\x80\r\n";
+
+    add_changelog(pkg, "J\xc3\xb6rg <jorg@example.com> - 1.2-3", -1,
+                  "- a < b && c > d\r\n\ttabbed \"quoted\" 'single'");
+    add_changelog(pkg, "latin1 Andr\xe9 <andre@example.com>", G_MAXINT64,
+                  "- latin1 caf\xe9\n- \xe2\x82\xac \xf0\x9f\x98\x80\x7f");
+    add_changelog(pkg, "\t\"quoted\"\r\n", 1,
+                  "]]> <![CDATA[ &amp; &#10;");
+
+    cmp_other_with_tree_dump(pkg);
+    cr_package_free(pkg);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/xml_dump_other/test_cr_xml_dump_other_00",
+                    test_cr_xml_dump_other_00);
+    g_test_add_func("/xml_dump_other/test_cr_xml_dump_other_01",
+                    test_cr_xml_dump_other_01);
+    return g_test_run();
+}
@@ -391,6 +391,79 @@ test_cr_xml_dump_primary_base_items_02(void)
     cr_package_free(pkg);
 }
 
+/** Dump the package through the libxml2 tree as the dumper used to do */
+static char *
+dump_primary_by_tree(cr_Package *pkg)
+{
+    xmlNodePtr node = xmlNewNode(NULL, BAD_CAST "package");
+    xmlBufferPtr buf = xmlBufferCreate();
+
+    cr_xml_dump_primary_base_items(node, pkg);
+    xmlNodeDump(buf, NULL, node, 0,
+                cr_xml_dump_get_parameter(CR_XML_DUMP_DO_PRETTY_PRINT));
+    char *result = g_strconcat((char *) buf->content, "\n", NULL);
+
+    xmlBufferFree(buf);
+    xmlFreeNode(node);
+    return result;
+}
+
+static void
+cmp_primary_with_tree_dump(cr_Package *pkg)
+{
+    for (int pretty = 0; pretty < 2; pretty++) {
+        GError *tmp_err = NULL;
+        cr_xml_dump_set_parameter(CR_XML_DUMP_DO_PRETTY_PRINT, pretty);
+
+        char *expected = dump_primary_by_tree(pkg);
+        char *dumped = cr_xml_dump_primary(pkg, &tmp_err);
+        g_assert(!tmp_err);
+        g_assert_cmpstr(dumped, ==, expected);
+
+        g_free(expected);
+        g_free(dumped);
+    }
+    cr_xml_dump_set_parameter(CR_XML_DUMP_DO_PRETTY_PRINT, TRUE);
+}
+
+static void
+test_cr_xml_dump_primary_00(void)
+{
+    cr_Package *pkg = get_package();
+    cmp_primary_with_tree_dump(pkg);
+    cr_package_free(pkg);
+
+    pkg = get_empty_package();
+    cmp_primary_with_tree_dump(pkg);
+    cr_package_free(pkg);
+}
+
+static void
+test_cr_xml_dump_primary_01(void)
+{
+    cr_Package *pkg = get_package();
+    cr_Dependency *dep;
+
+    pkg->summary = "a < b && c > d\r\n\ttabbed";
+    pkg->description = "latin1 caf\xe9 \"quoted\"";
+    pkg->rpm_packager = "J\xc3\xb6rg <jorg@example.com>";
+    pkg->location_href = "dir/\"foo\"&<bar>\t.rpm";
+    pkg->location_base = "http://example.com/\xe2\x82\xac/";
+
+    dep = cr_dependency_new();
+    dep->name = "caf\xc3\xa9(x86-64) \xf0\x9f\x98\x80";
+    dep->flags = "GE";
+    dep->version = "1\n2";
+    pkg->provides = g_slist_prepend(pkg->provides, dep);
+
+    dep = cr_dependency_new();
+    dep->name = "";
+    pkg->obsoletes = g_slist_prepend(pkg->obsoletes, dep);
+
+    cmp_primary_with_tree_dump(pkg);
+    cr_package_free(pkg);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -403,6 +476,10 @@ main(int argc, char *argv[])
     g_test_add_func("/xml_dump_primary/test_cr_xml_dump_primary_base_items_02",
                     test_cr_xml_dump_primary_base_items_01);
 
+    g_test_add_func("/xml_dump_primary/test_cr_xml_dump_primary_00",
+                    test_cr_xml_dump_primary_00);
+    g_test_add_func("/xml_dump_primary/test_cr_xml_dump_primary_01",
+                    test_cr_xml_dump_primary_01);
     g_test_add_func("/xml_dump_primary/test_cr_xml_dump_primary_dump_pco_00",
                     test_cr_xml_dump_primary_dump_pco_00);
     g_test_add_func("/xml_dump_primary/test_cr_xml_dump_primary_dump_pco_01",
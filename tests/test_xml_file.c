@@ -23,8 +23,10 @@
 #include <glib/gstdio.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "fixtures.h"
+#include "createrepo/error.h"
 #include "createrepo/misc.h"
 #include "createrepo/xml_file.h"
 #include "createrepo/compression_wrapper.h"
@@ -139,6 +141,102 @@ test_rewrite_header_pacakge_count(TestFixtures *fixtures,
     g_free(path);
 }
 
+/** Write a file with a header for 100 packages, fix the count and check
+ * the content and the stats of the file.
+ */
+static void
+check_fix_header_member(const char *tmpdir,
+                        cr_CompressionType type,
+                        long count)
+{
+    gchar contents[2048];
+    int ret;
+    GError *err = NULL;
+
+    gchar *name = g_strdup_printf("primary%ld.xml%s", count,
+                                  cr_compression_suffix(type));
+    gchar *path = g_build_filename(tmpdir, name, NULL);
+    g_free(name);
+
+    cr_ContentStat *stat = cr_contentstat_new(CR_CHECKSUM_SHA256, &err);
+    cr_XmlFile *f = cr_xmlfile_sopen_primary(path, type, stat, &err);
+    g_assert(f);
+    g_assert(!err);
+
+    ret = cr_xmlfile_set_num_of_pkgs(f, 100, &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    ret = cr_xmlfile_add_chunk(f, "<package/>\n", &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+
+    // The header was written - more digits are not possible
+    ret = cr_xmlfile_set_num_of_pkgs(f, 1000, &err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_clear_error(&err);
+
+    ret = cr_xmlfile_set_num_of_pkgs(f, count, &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    cr_xmlfile_close(f, &err);
+    g_assert(!err);
+
+    CR_FILE *crf = cr_open(path,
+                           CR_CW_MODE_READ,
+                           CR_CW_AUTO_DETECT_COMPRESSION,
+                           NULL);
+    g_assert(crf);
+    ret = cr_read(crf, &contents, 2047, NULL);
+    g_assert(ret != CR_CW_ERR);
+    contents[ret] = '\0';
+    cr_close(crf, NULL);
+
+    // The padding is in the container, not in the XML
+    gchar *expected = g_strdup_printf(
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<metadata xmlns=\"http://linux.duke.edu/metadata/common\" "
+            "xmlns:rpm=\"http://linux.duke.edu/metadata/rpm\" "
+            "packages=\"%ld\">\n<package/>\n</metadata>", count);
+    g_assert_cmpstr(contents, ==, expected);
+    g_free(expected);
+
+    // Stats describe the fixed content
+    gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+                                                    contents, -1);
+    g_assert_cmpint(stat->size, ==, strlen(contents));
+    g_assert_cmpstr(stat->checksum, ==, checksum);
+    g_free(checksum);
+
+    // And the rewritten file itself
+    GStatBuf st;
+    gint64 compressed_size;
+    const char *compressed_checksum =
+                cr_contentstat_get_compressed(stat, &compressed_size);
+    g_assert_cmpint(g_stat(path, &st), ==, 0);
+    g_assert_cmpint(compressed_size, ==, st.st_size);
+    checksum = cr_checksum_file(path, CR_CHECKSUM_SHA256, NULL);
+    g_assert_cmpstr(compressed_checksum, ==, checksum);
+
+    g_free(checksum);
+    cr_contentstat_free(stat, NULL);
+    g_free(path);
+}
+
+static void
+test_fix_header_member(TestFixtures *fixtures,
+                       G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_CompressionType types[] = { CR_CW_GZ_COMPRESSION,
+                                   CR_CW_ZSTD_COMPRESSION };
+    // The stats for 99 and 98 packages are precomputed,
+    // for the others the file is read again
+    long counts[] = { 99, 98, 10, 1 };
+
+    g_assert(g_file_test(fixtures->tmpdir, G_FILE_TEST_IS_DIR));
+    g_assert(!cr_header_member_supported(CR_CW_NO_COMPRESSION));
+
+    for (size_t i = 0; i < G_N_ELEMENTS(types); i++)
+        for (size_t j = 0; j < G_N_ELEMENTS(counts); j++)
+            check_fix_header_member(fixtures->tmpdir, types[i], counts[j]);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -147,6 +245,8 @@ main(int argc, char *argv[])
     g_test_add("/xml_file/test_no_packages", TestFixtures, NULL, fixtures_setup, test_no_packages, fixtures_teardown);
     g_test_add("/xml_file/test_write_modified_header", TestFixtures, NULL,
             fixtures_setup, test_rewrite_header_pacakge_count, fixtures_teardown);
+    g_test_add("/xml_file/test_fix_header_member", TestFixtures, NULL,
+            fixtures_setup, test_fix_header_member, fixtures_teardown);
 
     return g_test_run();
 }
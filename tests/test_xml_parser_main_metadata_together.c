@@ -21,9 +21,11 @@
 #include <glib.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "fixtures.h"
 #include "createrepo/error.h"
 #include "createrepo/package.h"
+#include "createrepo/package_internal.h"
 #include "createrepo/misc.h"
 #include "createrepo/xml_parser.h"
 #include "createrepo/xml_parser_internal.h"
@@ -120,6 +122,96 @@ test_cr_xml_package_iterator_00(void)
     g_assert_cmpint(parsed, ==, 2);
 }
 
+static void
+test_cr_xml_package_iterator_00_keep_raw_xml(void)
+{
+    int parsed = 0;
+    GError *tmp_err = NULL;
+    cr_Package *package = NULL;
+
+    cr_PkgIterator *pkg_iterator = cr_PkgIterator_new(
+        TEST_REPO_02_PRIMARY, TEST_REPO_02_FILELISTS, TEST_REPO_02_OTHER, NULL, NULL, NULL, NULL, &tmp_err);
+    cr_PkgIterator_keep_raw_xml(pkg_iterator, FALSE);
+
+    while ((package = cr_PkgIterator_parse_next(pkg_iterator, &tmp_err))) {
+        parsed++;
+        g_assert(g_str_has_prefix(package->raw_primary, "<package type=\"rpm\">"));
+        g_assert(g_str_has_suffix(package->raw_primary, "</package>"));
+        g_assert(strstr(package->raw_primary, package->pkgId));
+        g_assert(g_str_has_prefix(package->raw_filelists, "<package pkgid=\""));
+        g_assert(g_str_has_suffix(package->raw_filelists, "</package>"));
+        g_assert(!package->raw_filelists_ext);
+        g_assert(g_str_has_prefix(package->raw_other, "<package pkgid=\""));
+        g_assert(g_str_has_suffix(package->raw_other, "</package>"));
+        cr_package_free(package);
+    }
+
+    g_assert(cr_PkgIterator_is_finished(pkg_iterator));
+    cr_PkgIterator_free(pkg_iterator, &tmp_err);
+
+    g_assert(tmp_err == NULL);
+    g_assert_cmpint(parsed, ==, 2);
+}
+
+static void
+test_cr_xml_package_iterator_00_keep_raw_xml_only(void)
+{
+    int parsed = 0;
+    GError *tmp_err = NULL;
+    cr_Package *package = NULL;
+
+    cr_PkgIterator *pkg_iterator = cr_PkgIterator_new(
+        TEST_REPO_02_PRIMARY, TEST_REPO_02_FILELISTS, TEST_REPO_02_OTHER, NULL, NULL, NULL, NULL, &tmp_err);
+    cr_PkgIterator *full_iterator = cr_PkgIterator_new(
+        TEST_REPO_02_PRIMARY, TEST_REPO_02_FILELISTS, TEST_REPO_02_OTHER, NULL, NULL, NULL, NULL, &tmp_err);
+    cr_PkgIterator_keep_raw_xml(pkg_iterator, TRUE);
+
+    while ((package = cr_PkgIterator_parse_next(pkg_iterator, &tmp_err))) {
+        cr_Package *full = cr_PkgIterator_parse_next(full_iterator, &tmp_err);
+        parsed++;
+        g_assert(full);
+        g_assert_cmpstr(package->pkgId, ==, full->pkgId);
+
+        // Files and changelogs are only in the raw elements
+        g_assert(package->raw_filelists);
+        g_assert(package->raw_other);
+        g_assert(!package->files);
+        g_assert(!package->changelogs);
+        g_assert(!(package->loadingflags & CR_PACKAGE_LOADED_FIL));
+        g_assert(!(package->loadingflags & CR_PACKAGE_LOADED_OTH));
+
+        // Until they are needed
+        g_assert_cmpint(cr_xml_parse_raw_content(package, &tmp_err), ==, CRE_OK);
+        g_assert(tmp_err == NULL);
+        g_assert(package->loadingflags & CR_PACKAGE_LOADED_FIL);
+        g_assert(package->loadingflags & CR_PACKAGE_LOADED_OTH);
+        g_assert_cmpint(g_slist_length(package->files), ==,
+                        g_slist_length(full->files));
+        g_assert_cmpint(g_slist_length(package->changelogs), ==,
+                        g_slist_length(full->changelogs));
+        g_assert(package->files);
+        g_assert(package->changelogs);
+        cr_PackageFile *file = package->files->data;
+        cr_PackageFile *full_file = full->files->data;
+        g_assert_cmpstr(file->path, ==, full_file->path);
+        g_assert_cmpstr(file->name, ==, full_file->name);
+        cr_ChangelogEntry *changelog = package->changelogs->data;
+        cr_ChangelogEntry *full_changelog = full->changelogs->data;
+        g_assert_cmpstr(changelog->author, ==, full_changelog->author);
+        g_assert_cmpstr(changelog->changelog, ==, full_changelog->changelog);
+
+        cr_package_free(full);
+        cr_package_free(package);
+    }
+
+    g_assert(cr_PkgIterator_is_finished(pkg_iterator));
+    cr_PkgIterator_free(pkg_iterator, &tmp_err);
+    cr_PkgIterator_free(full_iterator, &tmp_err);
+
+    g_assert(tmp_err == NULL);
+    g_assert_cmpint(parsed, ==, 2);
+}
+
 static void
 test_cr_xml_package_iterator_00_no_filelists(void)
 {
@@ -364,6 +456,10 @@ main(int argc, char *argv[])
     g_test_add_func("/xml_parser_main_metadata/test_cr_xml_package_iterator_00",
                     test_cr_xml_package_iterator_00);
 
+    g_test_add_func("/xml_parser_main_metadata/test_cr_xml_package_iterator_00_keep_raw_xml",
+                    test_cr_xml_package_iterator_00_keep_raw_xml);
+    g_test_add_func("/xml_parser_main_metadata/test_cr_xml_package_iterator_00_keep_raw_xml_only",
+                    test_cr_xml_package_iterator_00_keep_raw_xml_only);
     g_test_add_func("/xml_parser_main_metadata/test_cr_xml_package_iterator_00_no_filelists",
                     test_cr_xml_package_iterator_00_no_filelists);
 